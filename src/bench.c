@@ -0,0 +1,196 @@
+#include "pigeon_context_pool.h"
+#include "pigeon_hash.h"
+#include "pigeon_log.h"
+#include "pigeon_memory.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Parses every message of a log from 1 up to N threads at once and reports
+// throughput per thread count. Each thread takes a contiguous slice of the
+// messages and folds what it parsed into a checksum; the totals must agree
+// across runs, which catches any state shared between concurrent parses.
+
+typedef struct {
+    const char * data;
+    const pigeon_log_index_t * index;
+    size_t first;
+    size_t last;
+    unsigned rounds;
+
+    uint64_t checksum;
+    size_t failures;
+} bench_worker_t;
+
+static void * bench_worker(void * arg)
+{
+    bench_worker_t * worker = arg;
+    uint64_t checksum = 0;
+    size_t failures = 0;
+
+    for (unsigned round = 0; round < worker->rounds; ++round)
+    {
+        for (size_t i = worker->first; i < worker->last; ++i)
+        {
+            pigeon_parse_context_t * ctx = pigeon_parse_context_acquire();
+            if (!ctx)
+            {
+                ++failures;
+                continue;
+            }
+
+            pigeon_parsed_message_t message;
+            if (pigeon_parse_message(ctx, worker->data + worker->index->starts[i], worker->index->sizes[i], &message))
+            {
+                checksum += pigeon_hash_str(message.sequence_number, message.author.hash);
+                pigeon_field_t * field = pigeon_list_head(&message.fields);
+                for (; field != NULL; field = pigeon_list_next(field))
+                    checksum += pigeon_hash_str(field->field_type, field->field_name);
+
+                pigeon_free_parsed_message(&message);
+            }
+            else
+            {
+                checksum += pigeon_hash_str(0, pigeon_get_error_messages(ctx));
+                ++failures;
+            }
+
+            pigeon_parse_context_release(ctx);
+        }
+    }
+
+    worker->checksum = checksum;
+    worker->failures = failures;
+    return NULL;
+}
+
+static double bench_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static bool bench_run(const char * data, const pigeon_log_index_t * index, unsigned threads, unsigned rounds, uint64_t * checksum, size_t * failures, double * seconds)
+{
+    bench_worker_t workers[threads];
+    pthread_t handles[threads];
+
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        workers[t].data = data;
+        workers[t].index = index;
+        workers[t].first = index->count * t / threads;
+        workers[t].last = index->count * (t + 1) / threads;
+        workers[t].rounds = rounds;
+    }
+
+    double start = bench_now();
+    unsigned started = 0;
+    for (; started < threads; ++started)
+        if (pthread_create(&handles[started], NULL, bench_worker, &workers[started]) != 0)
+            break;
+
+    for (unsigned t = 0; t < started; ++t)
+        pthread_join(handles[t], NULL);
+
+    *seconds = bench_now() - start;
+    if (started != threads)
+        return false;
+
+    *checksum = 0;
+    *failures = 0;
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        *checksum += workers[t].checksum;
+        *failures += workers[t].failures;
+    }
+
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 2)
+    {
+        fputs("Usage: parser_bench LOG [MAX_THREADS] [ROUNDS]\n", stderr);
+        return 1;
+    }
+
+    unsigned max_threads = argc > 2 ? (unsigned)atoi(argv[2]) : 8;
+    unsigned rounds = argc > 3 ? (unsigned)atoi(argv[3]) : 5;
+    if (max_threads == 0 || max_threads > 1024 || rounds == 0)
+    {
+        fputs("Error: invalid thread or round count\n", stderr);
+        return 1;
+    }
+
+    FILE * file = fopen(argv[1], "rb");
+    if (!file)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    rewind(file);
+
+    char * data = pigeon_malloc(file_size > 0 ? file_size : 1);
+    size_t size = data ? fread(data, 1, file_size, file) : 0;
+    fclose(file);
+
+    pigeon_log_index_t index;
+    pigeon_log_index_init(&index);
+    if (!data || !pigeon_log_index_scan(&index, data, size, 0) || index.count == 0)
+    {
+        fputs("Error: no messages found\n", stderr);
+        return 1;
+    }
+
+    printf("%zu messages, %zu bytes, %u rounds\n", index.count, size, rounds);
+    printf("%8s %14s %10s %8s\n", "threads", "msgs/s", "MB/s", "speedup");
+
+    int rc = 0;
+    double base_rate = 0;
+    uint64_t base_checksum = 0;
+    for (unsigned threads = 1; threads <= max_threads; threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2)
+    {
+        uint64_t checksum;
+        size_t failures;
+        double seconds;
+        if (!bench_run(data, &index, threads, rounds, &checksum, &failures, &seconds))
+        {
+            fprintf(stderr, "Error: could not start %u threads\n", threads);
+            rc = 1;
+            break;
+        }
+
+        double rate = (double)index.count * rounds / seconds;
+        if (threads == 1)
+        {
+            base_rate = rate;
+            base_checksum = checksum;
+        }
+        else if (checksum != base_checksum)
+        {
+            fprintf(stderr, "Error: checksum mismatch with %u threads\n", threads);
+            rc = 1;
+        }
+
+        printf("%8u %14.0f %10.1f %7.2fx", threads, rate, (double)size * rounds / seconds / 1e6, rate / base_rate);
+        if (failures)
+            printf("  (%zu parse failures)", failures);
+        putchar('\n');
+
+        if (threads == max_threads)
+            break;
+    }
+
+    pigeon_log_index_free(&index);
+    pigeon_free(data);
+    return rc;
+}
@@ -0,0 +1,608 @@
+#include "pigeon_context_pool.h"
+#include "pigeon_emit.h"
+#include "pigeon_log.h"
+#include "pigeon_memory.h"
+#include "pigeon_query.h"
+#include "pigeon_string.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// pigeon_cat: parses whole logs and writes one NDJSON object or TSV row per
+// message. Files are handed out to worker threads one at a time, so message
+// order is preserved within a file; with more than one thread, records from
+// different files interleave, but a record is never split.
+
+#define CAT_READ_BUFFER (1 << 20)
+#define CAT_OUTPUT_BUFFER (1 << 20)
+
+typedef enum {
+    CAT_FORMAT_NDJSON,
+    CAT_FORMAT_TSV
+} cat_format_t;
+
+typedef enum {
+    CAT_COLUMN_FILE,
+    CAT_COLUMN_OFFSET,
+    CAT_COLUMN_AUTHOR,
+    CAT_COLUMN_SEQUENCE,
+    CAT_COLUMN_KIND,
+    CAT_COLUMN_PREVIOUS,
+    CAT_COLUMN_TIMESTAMP,
+    CAT_COLUMN_SIGNATURE,
+    CAT_COLUMN_FIELD
+} cat_column_type_t;
+
+typedef struct {
+    cat_column_type_t type;
+    const char * name;
+} cat_column_t;
+
+typedef struct {
+    cat_format_t format;
+    cat_column_t * columns;
+    size_t column_count;
+    pigeon_query_t * query;
+
+    char ** paths;
+    size_t path_count;
+    atomic_size_t next_path;
+
+    pthread_mutex_t output_lock;
+} cat_shared_t;
+
+typedef struct {
+    cat_shared_t * shared;
+    pthread_t thread;
+    pigeon_emitter_t emitter;
+
+    uint64_t bytes;
+    uint64_t messages;
+    uint64_t written;
+    uint64_t errors;
+} cat_worker_t;
+
+static const struct {
+    const char * name;
+    cat_column_type_t type;
+} column_names[] = {
+    { "file", CAT_COLUMN_FILE },
+    { "offset", CAT_COLUMN_OFFSET },
+    { "author", CAT_COLUMN_AUTHOR },
+    { "sequence", CAT_COLUMN_SEQUENCE },
+    { "kind", CAT_COLUMN_KIND },
+    { "previous", CAT_COLUMN_PREVIOUS },
+    { "timestamp", CAT_COLUMN_TIMESTAMP },
+    { "signature", CAT_COLUMN_SIGNATURE }
+};
+
+static void cat_usage(FILE * out)
+{
+    fputs("Usage: pigeon_cat [OPTIONS] [FILE|DIR]...\n"
+        "Parses pigeon logs and writes one record per message to stdout.\n"
+        "Directories are searched recursively; with no paths, stdin is read.\n"
+        "\n"
+        "  -f FORMAT   ndjson (default) or tsv\n"
+        "  -c COLUMNS  comma-separated TSV columns: file, offset, author, sequence,\n"
+        "              kind, previous, timestamp, signature, or a data field name\n"
+        "              (default author,sequence,kind,timestamp)\n"
+        "  -w QUERY    only write messages whose header matches QUERY\n"
+        "  -j THREADS  number of files processed at once (default 1)\n"
+        "  -q          do not print the summary to stderr\n", out);
+}
+
+static bool cat_parse_columns(cat_shared_t * restrict shared, char * restrict spec)
+{
+    size_t count = 1;
+    for (const char * pos = spec; *pos; ++pos)
+        count += *pos == ',';
+
+    shared->columns = pigeon_malloc(count * sizeof(cat_column_t));
+    if (!shared->columns)
+        return false;
+
+    for (char * name = strtok(spec, ","); name != NULL; name = strtok(NULL, ","))
+    {
+        cat_column_t * column = &shared->columns[shared->column_count++];
+        column->type = CAT_COLUMN_FIELD;
+        column->name = name;
+        for (size_t i = 0; i < sizeof(column_names) / sizeof(column_names[0]); ++i)
+            if (strcmp(name, column_names[i].name) == 0)
+                column->type = column_names[i].type;
+    }
+
+    return shared->column_count > 0;
+}
+
+static int cat_compare_paths(const void * lhs, const void * rhs)
+{
+    return strcmp(*(char * const *)lhs, *(char * const *)rhs);
+}
+
+static bool cat_add_path(cat_shared_t * restrict shared, size_t * restrict capacity, char * path)
+{
+    if (shared->path_count == *capacity)
+    {
+        size_t new_capacity = *capacity ? *capacity * 2 : 64;
+        char ** paths = pigeon_realloc(shared->paths, new_capacity * sizeof(char *));
+        if (!paths)
+        {
+            pigeon_free(path);
+            return false;
+        }
+
+        shared->paths = paths;
+        *capacity = new_capacity;
+    }
+
+    shared->paths[shared->path_count++] = path;
+    return true;
+}
+
+// Adds path, or every regular file below it in name order if it is a
+// directory. Hidden entries are skipped.
+static bool cat_collect(cat_shared_t * restrict shared, size_t * restrict capacity, const char * restrict path)
+{
+    struct stat info;
+    if (strcmp(path, "-") != 0 && stat(path, &info) == 0 && S_ISDIR(info.st_mode))
+    {
+        DIR * dir = opendir(path);
+        if (!dir)
+        {
+            fprintf(stderr, "pigeon_cat: %s: %s\n", path, strerror(errno));
+            return false;
+        }
+
+        size_t first = shared->path_count;
+        bool success = true;
+        struct dirent * entry;
+        while (success && (entry = readdir(dir)) != NULL)
+        {
+            if (entry->d_name[0] == '.')
+                continue;
+
+            size_t length = strlen(path) + strlen(entry->d_name) + 2;
+            char * child = pigeon_malloc(length);
+            if (!child)
+            {
+                success = false;
+                break;
+            }
+
+            snprintf(child, length, "%s/%s", path, entry->d_name);
+            if (stat(child, &info) == 0 && S_ISDIR(info.st_mode))
+            {
+                success = cat_collect(shared, capacity, child);
+                pigeon_free(child);
+            }
+            else
+                success = cat_add_path(shared, capacity, child);
+        }
+
+        closedir(dir);
+        qsort(shared->paths + first, shared->path_count - first, sizeof(char *), cat_compare_paths);
+        return success;
+    }
+
+    char * copy = pigeon_strdup_range(path, strlen(path));
+    return copy != NULL && cat_add_path(shared, capacity, copy);
+}
+
+static void cat_emit_encoded(pigeon_emitter_t * restrict emitter, char sigil, const pigeon_encoded_value_t * restrict value, bool quoted)
+{
+    if (!value->hash)
+    {
+        if (quoted)
+            pigeon_emit_raw(emitter, "null", 4);
+        return;
+    }
+
+    // Hashes only hold base64 characters, so they never need escaping
+    if (quoted)
+        pigeon_emit_char(emitter, '"');
+    pigeon_emit_char(emitter, sigil);
+    pigeon_emit_str(emitter, pigeon_encoding_name(value->encoding_type));
+    pigeon_emit_char(emitter, ':');
+    pigeon_emit_str(emitter, value->hash);
+    if (quoted)
+        pigeon_emit_char(emitter, '"');
+}
+
+// Empty names and values are stored as NULL and written as empty strings.
+static inline void cat_emit_json_cstr(pigeon_emitter_t * restrict emitter, const char * restrict str)
+{
+    pigeon_emit_json_string(emitter, str ? str : "", str ? strlen(str) : 0);
+}
+
+static inline void cat_emit_tsv_cstr(pigeon_emitter_t * restrict emitter, const char * restrict str)
+{
+    if (str)
+        pigeon_emit_tsv_string(emitter, str, strlen(str));
+}
+
+static char cat_field_sigil(pigeon_field_type_t type)
+{
+    switch (type)
+    {
+        case PIGEON_FIELD_IDENTITY: return '@';
+        case PIGEON_FIELD_BLOB: return '&';
+        default: return '%';
+    }
+}
+
+static void cat_emit_json_field(pigeon_emitter_t * restrict emitter, const pigeon_field_t * restrict field)
+{
+    switch (field->field_type)
+    {
+        case PIGEON_FIELD_STRING:
+            cat_emit_json_cstr(emitter, field->field_value.string);
+            break;
+
+        case PIGEON_FIELD_INT64:
+            pigeon_emit_int64(emitter, field->field_value.int64_);
+            break;
+
+        case PIGEON_FIELD_IDENTITY:
+        case PIGEON_FIELD_SIGNATURE:
+        case PIGEON_FIELD_BLOB:
+            cat_emit_encoded(emitter, cat_field_sigil(field->field_type), &field->field_value.encoded, true);
+            break;
+
+        default:
+            pigeon_emit_raw(emitter, "null", 4);
+            break;
+    }
+}
+
+static void cat_emit_ndjson(pigeon_emitter_t * restrict emitter, const char * restrict path, uint64_t offset, pigeon_parsed_message_t * restrict message)
+{
+    pigeon_emit_raw(emitter, "{\"file\":", 8);
+    pigeon_emit_json_string(emitter, path, strlen(path));
+    pigeon_emit_raw(emitter, ",\"offset\":", 10);
+    pigeon_emit_int64(emitter, (int64_t)offset);
+    pigeon_emit_raw(emitter, ",\"author\":", 10);
+    cat_emit_encoded(emitter, '@', &message->author, true);
+    pigeon_emit_raw(emitter, ",\"sequence\":", 12);
+    pigeon_emit_int64(emitter, message->sequence_number);
+    pigeon_emit_raw(emitter, ",\"kind\":", 8);
+    cat_emit_json_cstr(emitter, message->kind);
+    pigeon_emit_raw(emitter, ",\"previous\":", 12);
+    cat_emit_encoded(emitter, '%', &message->previous, true);
+    pigeon_emit_raw(emitter, ",\"timestamp\":", 13);
+    pigeon_emit_int64(emitter, message->timestamp);
+
+    pigeon_emit_raw(emitter, ",\"fields\":{", 11);
+    pigeon_field_t * field = pigeon_list_head(&message->fields);
+    for (bool first = true; field != NULL; field = pigeon_list_next(field), first = false)
+    {
+        if (!first)
+            pigeon_emit_char(emitter, ',');
+        cat_emit_json_cstr(emitter, field->field_name);
+        pigeon_emit_char(emitter, ':');
+        cat_emit_json_field(emitter, field);
+    }
+
+    pigeon_emit_raw(emitter, "},\"signature\":", 14);
+    cat_emit_encoded(emitter, '%', &message->signature, true);
+    pigeon_emit_char(emitter, '}');
+}
+
+static void cat_emit_tsv(pigeon_emitter_t * restrict emitter, const cat_shared_t * restrict shared, const char * restrict path, uint64_t offset, pigeon_parsed_message_t * restrict message)
+{
+    for (size_t i = 0; i < shared->column_count; ++i)
+    {
+        if (i > 0)
+            pigeon_emit_char(emitter, '\t');
+
+        const cat_column_t * column = &shared->columns[i];
+        switch (column->type)
+        {
+            case CAT_COLUMN_FILE: pigeon_emit_tsv_string(emitter, path, strlen(path)); break;
+            case CAT_COLUMN_OFFSET: pigeon_emit_int64(emitter, (int64_t)offset); break;
+            case CAT_COLUMN_AUTHOR: cat_emit_encoded(emitter, '@', &message->author, false); break;
+            case CAT_COLUMN_SEQUENCE: pigeon_emit_int64(emitter, message->sequence_number); break;
+            case CAT_COLUMN_PREVIOUS: cat_emit_encoded(emitter, '%', &message->previous, false); break;
+            case CAT_COLUMN_TIMESTAMP: pigeon_emit_int64(emitter, message->timestamp); break;
+            case CAT_COLUMN_SIGNATURE: cat_emit_encoded(emitter, '%', &message->signature, false); break;
+
+            case CAT_COLUMN_KIND: cat_emit_tsv_cstr(emitter, message->kind); break;
+
+            case CAT_COLUMN_FIELD:
+            {
+                // First field with that name; missing fields leave the column empty
+                pigeon_field_t * field = pigeon_list_head(&message->fields);
+                while (field != NULL && strcmp(field->field_name ? field->field_name : "", column->name) != 0)
+                    field = pigeon_list_next(field);
+                if (!field)
+                    break;
+
+                if (field->field_type == PIGEON_FIELD_STRING)
+                    cat_emit_tsv_cstr(emitter, field->field_value.string);
+                else if (field->field_type == PIGEON_FIELD_INT64)
+                    pigeon_emit_int64(emitter, field->field_value.int64_);
+                else if (field->field_type != PIGEON_FIELD_EMPTY)
+                    cat_emit_encoded(emitter, cat_field_sigil(field->field_type), &field->field_value.encoded, false);
+                break;
+            }
+        }
+    }
+}
+
+static void cat_report_error(const char * restrict path, uint64_t offset, const char * restrict error)
+{
+    fprintf(stderr, "pigeon_cat: %s, message at offset %llu: %s%s", path, (unsigned long long)offset, error,
+        *error && error[strlen(error) - 1] == '\n' ? "" : "\n");
+}
+
+static void cat_file(cat_worker_t * restrict worker, pigeon_parse_context_t * restrict ctx, const char * restrict path)
+{
+    const cat_shared_t * shared = worker->shared;
+    bool is_stdin = strcmp(path, "-") == 0;
+    int fd = is_stdin ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "pigeon_cat: %s: %s\n", path, strerror(errno));
+        ++worker->errors;
+        return;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    pigeon_log_reader_t reader;
+    if (!pigeon_log_reader_init(&reader, fd, CAT_READ_BUFFER))
+    {
+        fprintf(stderr, "pigeon_cat: %s: out of memory\n", path);
+        ++worker->errors;
+        if (!is_stdin)
+            close(fd);
+        return;
+    }
+
+    const char * msg_data;
+    size_t msg_size;
+    uint64_t msg_offset;
+    pigeon_log_status_t status;
+    while ((status = pigeon_log_reader_next(&reader, &msg_data, &msg_size, &msg_offset)) == PIGEON_LOG_MESSAGE)
+    {
+        ++worker->messages;
+
+        pigeon_parsed_message_t message;
+        bool matched = true;
+        bool parsed = shared->query
+            ? pigeon_query_parse_message(shared->query, ctx, msg_data, (pigeon_message_size_t)msg_size, &message, &matched)
+            : pigeon_parse_message(ctx, msg_data, (pigeon_message_size_t)msg_size, &message);
+
+        if (!parsed)
+        {
+            cat_report_error(path, msg_offset, pigeon_get_error_messages(ctx));
+            ++worker->errors;
+        }
+        else if (matched)
+        {
+            if (shared->format == CAT_FORMAT_NDJSON)
+                cat_emit_ndjson(&worker->emitter, path, msg_offset, &message);
+            else
+                cat_emit_tsv(&worker->emitter, shared, path, msg_offset, &message);
+
+            pigeon_emitter_end_record(&worker->emitter);
+            ++worker->written;
+        }
+
+        pigeon_free_parsed_message(&message);
+    }
+
+    if (status == PIGEON_LOG_ERROR)
+    {
+        fprintf(stderr, "pigeon_cat: %s: read error\n", path);
+        ++worker->errors;
+    }
+    else if (pigeon_log_reader_pending(&reader) > 0)
+    {
+        cat_report_error(path, reader.offset, "incomplete message at end of file");
+        ++worker->errors;
+    }
+
+    worker->bytes += reader.offset + pigeon_log_reader_pending(&reader);
+
+    pigeon_log_reader_free(&reader);
+    if (!is_stdin)
+        close(fd);
+}
+
+static void * cat_worker(void * arg)
+{
+    cat_worker_t * worker = arg;
+    cat_shared_t * shared = worker->shared;
+
+    pigeon_parse_context_t * ctx = pigeon_parse_context_acquire();
+    if (!ctx)
+    {
+        ++worker->errors;
+        return NULL;
+    }
+
+    for (;;)
+    {
+        size_t index = atomic_fetch_add(&shared->next_path, 1);
+        if (index >= shared->path_count || worker->emitter.failed)
+            break;
+
+        cat_file(worker, ctx, shared->paths[index]);
+    }
+
+    pigeon_parse_context_release(ctx);
+    return NULL;
+}
+
+static double cat_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char ** argv)
+{
+    cat_shared_t shared;
+    memset(&shared, 0, sizeof(shared));
+    atomic_init(&shared.next_path, 0);
+
+    char default_columns[] = "author,sequence,kind,timestamp";
+    char * columns = default_columns;
+    const char * where = NULL;
+    unsigned threads = 1;
+    bool quiet = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:c:w:j:qh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'f':
+                if (strcmp(optarg, "ndjson") == 0)
+                    shared.format = CAT_FORMAT_NDJSON;
+                else if (strcmp(optarg, "tsv") == 0)
+                    shared.format = CAT_FORMAT_TSV;
+                else
+                {
+                    fprintf(stderr, "pigeon_cat: unknown format '%s'\n", optarg);
+                    return 2;
+                }
+                break;
+
+            case 'c': columns = optarg; break;
+            case 'w': where = optarg; break;
+            case 'q': quiet = true; break;
+
+            case 'j':
+                threads = (unsigned)atoi(optarg);
+                if (threads == 0 || threads > 1024)
+                {
+                    fprintf(stderr, "pigeon_cat: invalid thread count '%s'\n", optarg);
+                    return 2;
+                }
+                break;
+
+            case 'h':
+                cat_usage(stdout);
+                return 0;
+
+            default:
+                cat_usage(stderr);
+                return 2;
+        }
+    }
+
+    if (shared.format == CAT_FORMAT_TSV && !cat_parse_columns(&shared, columns))
+    {
+        fputs("pigeon_cat: no TSV columns given\n", stderr);
+        return 2;
+    }
+
+    pigeon_query_t query;
+    if (where)
+    {
+        if (!pigeon_query_compile(&query, where))
+        {
+            fprintf(stderr, "pigeon_cat: invalid query: %s\n", query.error_messages);
+            pigeon_query_free(&query);
+            return 2;
+        }
+
+        shared.query = &query;
+    }
+
+    int rc = 0;
+    size_t path_capacity = 0;
+    if (optind == argc)
+        rc |= !cat_collect(&shared, &path_capacity, "-");
+    for (int i = optind; i < argc; ++i)
+        rc |= !cat_collect(&shared, &path_capacity, argv[i]);
+
+    if (threads > shared.path_count)
+        threads = shared.path_count > 0 ? shared.path_count : 1;
+
+    pthread_mutex_init(&shared.output_lock, NULL);
+    cat_worker_t * workers = pigeon_malloc(threads * sizeof(cat_worker_t));
+    if (!workers)
+    {
+        fputs("pigeon_cat: out of memory\n", stderr);
+        return 1;
+    }
+
+    double start = cat_now();
+    unsigned started = 0;
+    for (; started < threads; ++started)
+    {
+        cat_worker_t * worker = &workers[started];
+        memset(worker, 0, sizeof(*worker));
+        worker->shared = &shared;
+        if (!pigeon_emitter_init(&worker->emitter, STDOUT_FILENO, CAT_OUTPUT_BUFFER, threads > 1 ? &shared.output_lock : NULL))
+            break;
+
+        // The first worker runs on the main thread
+        if (started > 0 && pthread_create(&worker->thread, NULL, cat_worker, worker) != 0)
+        {
+            pigeon_emitter_free(&worker->emitter);
+            break;
+        }
+    }
+
+    if (started == 0)
+    {
+        fputs("pigeon_cat: out of memory\n", stderr);
+        return 1;
+    }
+
+    cat_worker(&workers[0]);
+
+    uint64_t bytes = 0, messages = 0, written = 0, errors = 0;
+    bool output_failed = false;
+    for (unsigned i = 0; i < started; ++i)
+    {
+        if (i > 0)
+            pthread_join(workers[i].thread, NULL);
+
+        output_failed |= !pigeon_emitter_free(&workers[i].emitter);
+        bytes += workers[i].bytes;
+        messages += workers[i].messages;
+        written += workers[i].written;
+        errors += workers[i].errors;
+    }
+
+    double seconds = cat_now() - start;
+    if (output_failed)
+    {
+        fprintf(stderr, "pigeon_cat: error writing output: %s\n", strerror(errno));
+        rc = 1;
+    }
+
+    if (!quiet)
+    {
+        fprintf(stderr, "pigeon_cat: %zu files, %llu messages, %llu written, %llu errors, %.1f MB in %.3f s (%.1f MB/s, %.0f msgs/s)\n",
+            shared.path_count, (unsigned long long)messages, (unsigned long long)written, (unsigned long long)errors,
+            bytes / 1e6, seconds, seconds > 0 ? bytes / 1e6 / seconds : 0.0, seconds > 0 ? messages / seconds : 0.0);
+    }
+
+    for (size_t i = 0; i < shared.path_count; ++i)
+        pigeon_free(shared.paths[i]);
+    pigeon_free(shared.paths);
+    pigeon_free(shared.columns);
+    pigeon_free(workers);
+    if (shared.query)
+        pigeon_query_free(&query);
+    pthread_mutex_destroy(&shared.output_lock);
+
+    return rc != 0 || errors != 0 ? 1 : 0;
+}
@@ -0,0 +1,353 @@
+#include "pigeon_aio.h"
+#include "pigeon_context_pool.h"
+#include "pigeon_log.h"
+#include "pigeon_memory.h"
+#include "pigeon_string.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// pigeon_ingest: reads and parses every message of a set of feed files, the
+// way a cold-start reindex does, and reports the throughput. Files are read
+// through pigeon_aio so that I/O overlaps parsing; -b sync reads them one at
+// a time instead, for comparison.
+
+typedef struct {
+    char ** paths;
+    size_t count;
+    size_t capacity;
+} ingest_paths_t;
+
+typedef struct {
+    pigeon_parse_context_t * ctx;
+    pigeon_log_index_t index;
+
+    uint64_t files;
+    uint64_t bytes;
+    uint64_t messages;
+    uint64_t errors;
+    bool quiet;
+} ingest_state_t;
+
+static void ingest_usage(FILE * out)
+{
+    fputs("Usage: pigeon_ingest [OPTIONS] FILE|DIR...\n"
+        "Reads and parses every message of the given logs and reports throughput.\n"
+        "Directories are searched recursively.\n"
+        "\n"
+        "  -b BACKEND  auto (default), io_uring, threads, or sync for one blocking\n"
+        "              read at a time\n"
+        "  -d DEPTH    files read at once (default 64)\n"
+        "  -s KB       size of each pooled read buffer (default 256)\n"
+        "  -c          drop the files from the page cache first, for a cold start\n"
+        "  -q          do not report parse errors\n", out);
+}
+
+static int ingest_compare_paths(const void * a, const void * b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static bool ingest_add_path(ingest_paths_t * restrict paths, char * restrict path)
+{
+    if (paths->count == paths->capacity)
+    {
+        size_t capacity = paths->capacity ? paths->capacity * 2 : 64;
+        char ** grown = pigeon_realloc(paths->paths, capacity * sizeof(char *));
+        if (!grown)
+        {
+            pigeon_free(path);
+            return false;
+        }
+
+        paths->paths = grown;
+        paths->capacity = capacity;
+    }
+
+    paths->paths[paths->count++] = path;
+    return true;
+}
+
+static bool ingest_collect(ingest_paths_t * restrict paths, const char * restrict path)
+{
+    struct stat info;
+    if (stat(path, &info) != 0 || !S_ISDIR(info.st_mode))
+    {
+        char * copy = pigeon_strdup_range(path, strlen(path));
+        return copy != NULL && ingest_add_path(paths, copy);
+    }
+
+    DIR * dir = opendir(path);
+    if (!dir)
+    {
+        fprintf(stderr, "pigeon_ingest: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    size_t first = paths->count;
+    bool success = true;
+    struct dirent * entry;
+    while (success && (entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        size_t length = strlen(path) + strlen(entry->d_name) + 2;
+        char * child = pigeon_malloc(length);
+        if (!child)
+        {
+            success = false;
+            break;
+        }
+
+        snprintf(child, length, "%s/%s", path, entry->d_name);
+        success = ingest_collect(paths, child);
+        pigeon_free(child);
+    }
+
+    closedir(dir);
+    qsort(paths->paths + first, paths->count - first, sizeof(char *), ingest_compare_paths);
+    return success;
+}
+
+static void ingest_evict(const ingest_paths_t * restrict paths)
+{
+#ifdef POSIX_FADV_DONTNEED
+    for (size_t i = 0; i < paths->count; ++i)
+    {
+        int fd = open(paths->paths[i], O_RDONLY);
+        if (fd < 0)
+            continue;
+
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#else
+    (void)paths;
+#endif
+}
+
+static bool ingest_file(void * user_data, const pigeon_aio_file_t * file)
+{
+    ingest_state_t * state = user_data;
+    ++state->files;
+    if (file->error)
+    {
+        fprintf(stderr, "pigeon_ingest: %s: %s\n", file->path, strerror(file->error));
+        ++state->errors;
+        return true;
+    }
+
+    state->bytes += file->size;
+    pigeon_log_index_reset(&state->index);
+    if (!pigeon_log_index_scan(&state->index, file->data, file->size, 0))
+    {
+        fprintf(stderr, "pigeon_ingest: %s: out of memory\n", file->path);
+        ++state->errors;
+        return true;
+    }
+
+    for (size_t i = 0; i < state->index.count; ++i)
+    {
+        pigeon_parsed_message_t message;
+        if (pigeon_parse_message(state->ctx, file->data + state->index.starts[i], (pigeon_message_size_t)state->index.sizes[i], &message))
+            ++state->messages;
+        else
+        {
+            if (!state->quiet)
+                fprintf(stderr, "pigeon_ingest: %s:%llu: %s", file->path, (unsigned long long)state->index.starts[i], pigeon_get_error_messages(state->ctx));
+            ++state->errors;
+        }
+
+        pigeon_free_parsed_message(&message);
+    }
+
+    return true;
+}
+
+// The blocking baseline: read a whole file, parse it, move on.
+static void ingest_sync(const ingest_paths_t * restrict paths, ingest_state_t * restrict state)
+{
+    size_t capacity = 0;
+    char * buffer = NULL;
+    for (size_t i = 0; i < paths->count; ++i)
+    {
+        pigeon_aio_file_t file = { paths->paths[i], i, NULL, 0, 0 };
+        int fd = open(file.path, O_RDONLY | O_CLOEXEC);
+        struct stat info;
+        size_t limit = 0;
+        if (fd < 0 || fstat(fd, &info) != 0)
+            file.error = errno;
+        else
+        {
+            limit = (size_t)info.st_size + 1;
+            if (limit > capacity)
+            {
+                capacity = limit;
+                pigeon_free(buffer);
+                buffer = pigeon_malloc(capacity);
+                if (!buffer)
+                    capacity = 0;
+            }
+
+            // The spare byte only fills if the file grew after fstat
+            ssize_t bytes = 0;
+            while (buffer && file.size < limit)
+            {
+                bytes = read(fd, buffer + file.size, limit - file.size);
+                if (bytes < 0 && errno == EINTR)
+                    continue;
+                if (bytes <= 0)
+                    break;
+                file.size += (size_t)bytes;
+            }
+
+            file.data = buffer;
+            file.error = !buffer ? ENOMEM : bytes < 0 ? errno : 0;
+        }
+
+        if (fd >= 0)
+            close(fd);
+
+        if (!file.error && file.size == limit)
+        {
+            fprintf(stderr, "pigeon_ingest: %s: file grew while being read\n", file.path);
+            ++state->files;
+            ++state->errors;
+            continue;
+        }
+
+        ingest_file(state, &file);
+    }
+
+    pigeon_free(buffer);
+}
+
+static double ingest_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char ** argv)
+{
+    pigeon_aio_options_t options = { PIGEON_AIO_AUTO, 0, 0 };
+    bool sync_reads = false;
+    bool cold = false;
+    bool quiet = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:d:s:cqh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'b':
+                if (strcmp(optarg, "auto") == 0)
+                    options.backend = PIGEON_AIO_AUTO;
+                else if (strcmp(optarg, "io_uring") == 0)
+                    options.backend = PIGEON_AIO_URING;
+                else if (strcmp(optarg, "threads") == 0)
+                    options.backend = PIGEON_AIO_THREADS;
+                else if (strcmp(optarg, "sync") == 0)
+                    sync_reads = true;
+                else
+                {
+                    fprintf(stderr, "pigeon_ingest: unknown backend '%s'\n", optarg);
+                    return 2;
+                }
+                break;
+
+            case 'd':
+                options.depth = (unsigned)atoi(optarg);
+                if (options.depth == 0 || options.depth > 4096)
+                {
+                    fprintf(stderr, "pigeon_ingest: invalid depth '%s'\n", optarg);
+                    return 2;
+                }
+                break;
+
+            case 's':
+                options.buffer_size = (size_t)strtoull(optarg, NULL, 10) * 1024;
+                if (options.buffer_size == 0)
+                {
+                    fprintf(stderr, "pigeon_ingest: invalid buffer size '%s'\n", optarg);
+                    return 2;
+                }
+                break;
+
+            case 'c': cold = true; break;
+            case 'q': quiet = true; break;
+
+            case 'h':
+                ingest_usage(stdout);
+                return 0;
+
+            default:
+                ingest_usage(stderr);
+                return 2;
+        }
+    }
+
+    if (optind == argc)
+    {
+        ingest_usage(stderr);
+        return 2;
+    }
+
+    ingest_paths_t paths = { NULL, 0, 0 };
+    int rc = 0;
+    for (int i = optind; i < argc; ++i)
+        rc |= !ingest_collect(&paths, argv[i]);
+
+    if (cold)
+        ingest_evict(&paths);
+
+    ingest_state_t state;
+    memset(&state, 0, sizeof(state));
+    state.quiet = quiet;
+    state.ctx = pigeon_parse_context_acquire();
+    pigeon_log_index_init(&state.index);
+    if (!state.ctx)
+    {
+        fputs("pigeon_ingest: out of memory\n", stderr);
+        return 1;
+    }
+
+    double start = ingest_now();
+    const char * backend = "sync";
+    if (sync_reads)
+        ingest_sync(&paths, &state);
+    else
+    {
+        pigeon_aio_result_t result;
+        if (!pigeon_aio_read_files((const char * const *)paths.paths, paths.count, &options, ingest_file, &state, &result))
+        {
+            fprintf(stderr, "pigeon_ingest: %s\n", result.error_messages);
+            rc = 1;
+        }
+
+        backend = result.backend == PIGEON_AIO_URING && result.registered ? "io_uring, registered buffers" : pigeon_aio_backend_name(result.backend);
+    }
+    double seconds = ingest_now() - start;
+
+    fprintf(stderr, "pigeon_ingest: %s: %llu files, %llu messages, %llu errors, %.1f MB in %.3f s (%.1f MB/s, %.0f msgs/s)\n",
+        backend, (unsigned long long)state.files, (unsigned long long)state.messages, (unsigned long long)state.errors,
+        state.bytes / 1e6, seconds, seconds > 0 ? state.bytes / 1e6 / seconds : 0.0, seconds > 0 ? state.messages / seconds : 0.0);
+
+    for (size_t i = 0; i < paths.count; ++i)
+        pigeon_free(paths.paths[i]);
+    pigeon_free(paths.paths);
+    pigeon_log_index_free(&state.index);
+    pigeon_parse_context_release(state.ctx);
+    return rc || state.errors ? 1 : 0;
+}
@@ -1,11 +1,10 @@
+#include "pigeon_memory.h"
 #include "pigeon_parser.h"
 
 #include <stdio.h>
 
-static const char* format_encoded_value(const pigeon_encoded_value_t * restrict value)
+static const char* format_encoded_value(const pigeon_encoded_value_t * restrict value, char * restrict buffer, size_t buffer_size)
 {
-    static char buffer[256];
-
     const char * type = "(unknown)";
     switch (value->encoding_type)
     {
@@ -13,7 +12,7 @@ static const char* format_encoded_value(const pigeon_encoded_value_t * restrict
         case PIGEON_ENCODING_TYPE_SHA256: type = "SHA256"; break;
     }
 
-    snprintf(buffer, sizeof(buffer), "%s (%s)", value->hash, type);
+    snprintf(buffer, buffer_size, "%s (%s)", value->hash, type);
     return buffer;
 }
 
@@ -21,12 +20,35 @@ int main(void)
 {
     int rc = 0;
     
-    char buffer[10240];
+    char value_buffer[256];
+
+    // Read all of stdin, however large the message is
+    size_t input_size = 0;
+    size_t capacity = 64 * 1024;
+    char * buffer = pigeon_malloc(capacity);
+    for (;;)
+    {
+        if (!buffer)
+        {
+            fputs("Error: out of memory!\n", stderr);
+            return 1;
+        }
+
+        input_size += fread(buffer + input_size, 1, capacity - input_size, stdin);
+        if (input_size < capacity)
+            break;
+
+        capacity *= 2;
+        char * grown = pigeon_realloc(buffer, capacity);
+        if (!grown)
+            pigeon_free(buffer);
+        buffer = grown;
+    }
 
-    size_t input_size = fread(buffer, 1, sizeof(buffer), stdin);
     if (input_size == 0)
     {
         fputs("Error: no input!\n", stderr);
+        pigeon_free(buffer);
         return 1;
     }
 
@@ -42,14 +64,15 @@ int main(void)
         else
             puts("Parsing failed\n");
 
+        pigeon_free(buffer);
         return 1;        
     }
 
     puts("==== HEADER ====");
-    printf("author: %s\n", format_encoded_value(&message.author));
+    printf("author: %s\n", format_encoded_value(&message.author, value_buffer, sizeof(value_buffer)));
     printf("sequence: %u\n", message.sequence_number);
     printf("kind: %s\n", message.kind);
-    printf("previous: %s\n", format_encoded_value(&message.previous));
+    printf("previous: %s\n", format_encoded_value(&message.previous, value_buffer, sizeof(value_buffer)));
     printf("timestamp: %ld\n", message.timestamp);
 
     puts("\n==== DATA FIELDS ====");
@@ -62,7 +85,7 @@ int main(void)
             case PIGEON_FIELD_IDENTITY:
             case PIGEON_FIELD_BLOB:
             case PIGEON_FIELD_SIGNATURE:
-                printf("%s\n", format_encoded_value(&field->field_value.encoded));
+                printf("%s\n", format_encoded_value(&field->field_value.encoded, value_buffer, sizeof(value_buffer)));
                 break;
 
             case PIGEON_FIELD_INT64:
@@ -73,6 +96,10 @@ int main(void)
                 printf("[%s]\n", field->field_value.string);
                 break;
 
+            case PIGEON_FIELD_STREAMED:
+                printf("(%ld bytes, streamed)\n", field->field_value.int64_);
+                break;
+
             default:
                 puts("(error)\n");
                 break;
@@ -80,10 +107,11 @@ int main(void)
     }
 
     puts("\n==== FOOTER ====");
-    printf("signature: %s\n", format_encoded_value(&message.signature));
+    printf("signature: %s\n", format_encoded_value(&message.signature, value_buffer, sizeof(value_buffer)));
     
     fflush(stdout);
 
     pigeon_free_parsed_message(&message);
+    pigeon_free(buffer);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,735 @@
+#include "pigeon_aio.h"
+#include "pigeon_memory.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(PIGEON_HAVE_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// Opening and reading through the ring needs the 5.6 opcodes, which came
+// with the probe interface.
+#if defined(IO_URING_OP_SUPPORTED) && defined(__NR_io_uring_setup)
+#define PIGEON_AIO_URING_ENABLED
+#endif
+#endif
+
+typedef struct {
+    size_t file;
+    int fd;
+    char * buffer;    // the slot's pool buffer, or a heap buffer once grown
+    size_t capacity;
+    size_t size;
+    size_t requested; // length of the read in flight
+    int error;
+    bool opening;     // io_uring: the open is in flight
+} pigeon_aio_slot_t;
+
+typedef struct {
+    const char * const * paths;
+    size_t count;
+    pigeon_aio_callback_t callback;
+    void * user_data;
+    pigeon_aio_result_t * result;
+
+    char * pool;
+    size_t buffer_size;
+    pigeon_aio_slot_t * slots;
+    unsigned depth;
+    bool stopped;
+    bool busy;      // io_uring: reads may still land in the buffers
+} pigeon_aio_run_t;
+
+static void pigeon_aio_error(pigeon_aio_result_t * restrict result, const char * format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(result->error_messages, sizeof(result->error_messages), format, ap);
+    va_end(ap);
+}
+
+static inline char * pigeon_aio_pool_buffer(const pigeon_aio_run_t * restrict run, unsigned index)
+{
+    return run->pool + (size_t)index * run->buffer_size;
+}
+
+static void pigeon_aio_slot_reset(pigeon_aio_run_t * restrict run, unsigned index, size_t file)
+{
+    pigeon_aio_slot_t * slot = &run->slots[index];
+    slot->file = file;
+    slot->fd = -1;
+    slot->buffer = pigeon_aio_pool_buffer(run, index);
+    slot->capacity = run->buffer_size;
+    slot->size = 0;
+    slot->requested = 0;
+    slot->error = 0;
+    slot->opening = false;
+}
+
+// Called once a read filled the buffer: the file may go on, so move it to a
+// heap buffer sized from fstat, with a spare byte so that a full read never
+// means end of file.
+static bool pigeon_aio_grow(pigeon_aio_run_t * restrict run, unsigned index)
+{
+    pigeon_aio_slot_t * slot = &run->slots[index];
+    bool pooled = slot->buffer == pigeon_aio_pool_buffer(run, index);
+
+    size_t capacity = slot->capacity * 2;
+    struct stat info;
+    if (fstat(slot->fd, &info) == 0 && (uint64_t)info.st_size >= capacity)
+        capacity = (size_t)info.st_size + 1;
+
+    char * buffer = pooled ? pigeon_malloc(capacity) : pigeon_realloc(slot->buffer, capacity);
+    if (!buffer)
+    {
+        slot->error = ENOMEM;
+        return false;
+    }
+
+    if (pooled)
+        memcpy(buffer, slot->buffer, slot->size);
+
+    slot->buffer = buffer;
+    slot->capacity = capacity;
+    return true;
+}
+
+// Hands a finished file to the callback and releases what it held.
+static void pigeon_aio_deliver(pigeon_aio_run_t * restrict run, unsigned index)
+{
+    pigeon_aio_slot_t * slot = &run->slots[index];
+    if (slot->fd >= 0)
+        close(slot->fd);
+    slot->fd = -1;
+
+    // Once stopped, files still in flight are drained without a callback
+    if (!run->stopped)
+    {
+        pigeon_aio_result_t * result = run->result;
+        ++result->files;
+        if (slot->error)
+            ++result->errors;
+        else
+            result->bytes += slot->size;
+
+        pigeon_aio_file_t file = { run->paths[slot->file], slot->file, slot->buffer, slot->error ? 0 : slot->size, slot->error };
+        if (!run->callback(run->user_data, &file))
+            run->stopped = true;
+    }
+
+    if (slot->buffer != pigeon_aio_pool_buffer(run, index))
+        pigeon_free(slot->buffer);
+    slot->buffer = pigeon_aio_pool_buffer(run, index);
+}
+
+// Thread pool backend: each worker claims a free slot and the next file,
+// reads it with blocking calls and queues the slot for the calling thread.
+
+typedef struct {
+    pigeon_aio_run_t * run;
+    pthread_mutex_t lock;
+    pthread_cond_t slot_freed;
+    pthread_cond_t file_done;
+
+    unsigned * free_slots;
+    unsigned free_count;
+    unsigned * done_slots; // FIFO ring of depth entries
+    unsigned done_head;
+    unsigned done_count;
+
+    size_t next_file;
+    size_t claimed;
+    bool stop;
+} pigeon_aio_pool_t;
+
+static void pigeon_aio_read_blocking(pigeon_aio_run_t * restrict run, unsigned index)
+{
+    pigeon_aio_slot_t * slot = &run->slots[index];
+    slot->fd = open(run->paths[slot->file], O_RDONLY | O_CLOEXEC);
+    if (slot->fd < 0)
+    {
+        slot->error = errno;
+        return;
+    }
+
+    for (;;)
+    {
+        if (slot->size == slot->capacity && !pigeon_aio_grow(run, index))
+            break;
+
+        ssize_t bytes = pread(slot->fd, slot->buffer + slot->size, slot->capacity - slot->size, (off_t)slot->size);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+
+        if (bytes < 0)
+        {
+            slot->error = errno;
+            break;
+        }
+
+        slot->size += (size_t)bytes;
+        if (slot->size < slot->capacity)
+            break; // short read: end of file
+    }
+
+    close(slot->fd);
+    slot->fd = -1;
+}
+
+static void * pigeon_aio_worker(void * arg)
+{
+    pigeon_aio_pool_t * pool = arg;
+    pigeon_aio_run_t * run = pool->run;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        while (!pool->stop && pool->next_file < run->count && pool->free_count == 0)
+            pthread_cond_wait(&pool->slot_freed, &pool->lock);
+
+        if (pool->stop || pool->next_file >= run->count)
+            break;
+
+        unsigned index = pool->free_slots[--pool->free_count];
+        pigeon_aio_slot_reset(run, index, pool->next_file++);
+        ++pool->claimed;
+        pthread_mutex_unlock(&pool->lock);
+
+        pigeon_aio_read_blocking(run, index);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->done_slots[(pool->done_head + pool->done_count++) % run->depth] = index;
+        pthread_cond_signal(&pool->file_done);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static bool pigeon_aio_run_threads(pigeon_aio_run_t * restrict run)
+{
+    pigeon_aio_pool_t pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.run = run;
+
+    pthread_t * threads = pigeon_malloc(run->depth * sizeof(pthread_t));
+    pool.free_slots = pigeon_malloc(run->depth * sizeof(unsigned));
+    pool.done_slots = pigeon_malloc(run->depth * sizeof(unsigned));
+    if (!threads || !pool.free_slots || !pool.done_slots)
+    {
+        pigeon_aio_error(run->result, "out of memory");
+        pigeon_free(threads);
+        pigeon_free(pool.free_slots);
+        pigeon_free(pool.done_slots);
+        return false;
+    }
+
+    for (unsigned i = 0; i < run->depth; ++i)
+        pool.free_slots[pool.free_count++] = run->depth - 1 - i;
+
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.slot_freed, NULL);
+    pthread_cond_init(&pool.file_done, NULL);
+
+    // One thread per slot: every read in flight is a blocked thread
+    unsigned started = 0;
+    for (; started < run->depth; ++started)
+        if (pthread_create(&threads[started], NULL, pigeon_aio_worker, &pool) != 0)
+            break;
+
+    bool success = started > 0 || run->count == 0;
+    if (!success)
+        pigeon_aio_error(run->result, "cannot start reader threads");
+
+    size_t delivered = 0;
+    pthread_mutex_lock(&pool.lock);
+    while (success)
+    {
+        // After a stop, no file is claimed any more, so only those already
+        // claimed remain to be drained.
+        while (pool.done_count == 0 && delivered < (pool.stop ? pool.claimed : run->count))
+            pthread_cond_wait(&pool.file_done, &pool.lock);
+
+        if (pool.done_count == 0)
+            break;
+
+        unsigned index = pool.done_slots[pool.done_head];
+        pool.done_head = (pool.done_head + 1) % run->depth;
+        --pool.done_count;
+        pthread_mutex_unlock(&pool.lock);
+
+        pigeon_aio_deliver(run, index);
+        ++delivered;
+
+        pthread_mutex_lock(&pool.lock);
+        pool.free_slots[pool.free_count++] = index;
+        if (run->stopped && !pool.stop)
+        {
+            pool.stop = true;
+            pthread_cond_broadcast(&pool.slot_freed);
+        }
+        else
+            pthread_cond_signal(&pool.slot_freed);
+    }
+
+    pool.stop = true;
+    pthread_cond_broadcast(&pool.slot_freed);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (unsigned i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+
+    pthread_cond_destroy(&pool.file_done);
+    pthread_cond_destroy(&pool.slot_freed);
+    pthread_mutex_destroy(&pool.lock);
+    pigeon_free(pool.done_slots);
+    pigeon_free(pool.free_slots);
+    pigeon_free(threads);
+    return success;
+}
+
+#if defined(PIGEON_AIO_URING_ENABLED)
+
+// io_uring backend, driven through the raw system calls so that liburing is
+// not needed. Every slot has at most one request queued or in flight, and
+// the rings are sized for depth slots, so they can never overflow.
+
+typedef struct {
+    int fd;
+    unsigned entries;
+
+    unsigned * sq_head;
+    unsigned * sq_tail;
+    unsigned sq_mask;
+    unsigned * sq_array;
+    struct io_uring_sqe * sqes;
+
+    unsigned * cq_head;
+    unsigned * cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe * cqes;
+
+    void * sq_ring;
+    size_t sq_ring_size;
+    void * cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned to_submit;
+    unsigned in_flight; // submitted and not yet completed
+} pigeon_uring_t;
+
+static void pigeon_uring_free(pigeon_uring_t * restrict ring)
+{
+    if (ring->sqes)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring)
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0)
+        close(ring->fd);
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+static bool pigeon_uring_init(pigeon_uring_t * restrict ring, unsigned entries)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0)
+        return false;
+
+    ring->entries = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap)
+    {
+        if (ring->cq_ring_size > ring->sq_ring_size)
+            ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    void * sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED)
+    {
+        pigeon_uring_free(ring);
+        return false;
+    }
+    ring->sq_ring = sq_ring;
+
+    void * cq_ring = sq_ring;
+    if (!single_mmap)
+    {
+        cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED)
+        {
+            pigeon_uring_free(ring);
+            return false;
+        }
+    }
+    ring->cq_ring = cq_ring;
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void * sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        pigeon_uring_free(ring);
+        return false;
+    }
+    ring->sqes = sqes;
+
+    char * sq = sq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+
+    char * cq = cq_ring;
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return true;
+}
+
+static bool pigeon_uring_supports(const pigeon_uring_t * restrict ring)
+{
+    static const unsigned required[] = { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_READ_FIXED };
+
+    size_t size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe * probe = pigeon_malloc(size);
+    if (!probe)
+        return false;
+
+    memset(probe, 0, size);
+    bool supported = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) >= 0;
+    for (size_t i = 0; supported && i < sizeof(required) / sizeof(required[0]); ++i)
+        supported = required[i] <= probe->last_op && (probe->ops[required[i]].flags & IO_URING_OP_SUPPORTED);
+
+    pigeon_free(probe);
+    return supported;
+}
+
+// Pinning the pool lets the kernel skip mapping the pages on every read.
+// It can fail under a low RLIMIT_MEMLOCK; plain reads are used then.
+static bool pigeon_uring_register_pool(const pigeon_uring_t * restrict ring, const pigeon_aio_run_t * restrict run)
+{
+    struct iovec * buffers = pigeon_malloc(run->depth * sizeof(struct iovec));
+    if (!buffers)
+        return false;
+
+    for (unsigned i = 0; i < run->depth; ++i)
+    {
+        buffers[i].iov_base = pigeon_aio_pool_buffer(run, i);
+        buffers[i].iov_len = run->buffer_size;
+    }
+
+    bool registered = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, buffers, run->depth) >= 0;
+    pigeon_free(buffers);
+    return registered;
+}
+
+// The entry is only published by pigeon_uring_push, once it is filled in.
+static struct io_uring_sqe * pigeon_uring_sqe(pigeon_uring_t * restrict ring)
+{
+    unsigned tail = *ring->sq_tail;
+    unsigned head = atomic_load_explicit((_Atomic unsigned *)ring->sq_head, memory_order_acquire);
+    if (tail - head >= ring->entries)
+        return NULL;
+
+    struct io_uring_sqe * sqe = &ring->sqes[tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static void pigeon_uring_push(pigeon_uring_t * restrict ring)
+{
+    unsigned tail = *ring->sq_tail;
+    ring->sq_array[tail & ring->sq_mask] = tail & ring->sq_mask;
+    atomic_store_explicit((_Atomic unsigned *)ring->sq_tail, tail + 1, memory_order_release);
+    ++ring->to_submit;
+}
+
+static bool pigeon_aio_uring_open(pigeon_aio_run_t * restrict run, pigeon_uring_t * restrict ring, unsigned index, size_t file)
+{
+    pigeon_aio_slot_reset(run, index, file);
+
+    struct io_uring_sqe * sqe = pigeon_uring_sqe(ring);
+    if (!sqe)
+    {
+        run->slots[index].error = EAGAIN;
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t)(uintptr_t)run->paths[file];
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    sqe->user_data = index;
+    pigeon_uring_push(ring);
+
+    run->slots[index].opening = true;
+    return true;
+}
+
+static bool pigeon_aio_uring_read(pigeon_aio_run_t * restrict run, pigeon_uring_t * restrict ring, unsigned index, bool registered)
+{
+    pigeon_aio_slot_t * slot = &run->slots[index];
+    if (slot->size == slot->capacity && !pigeon_aio_grow(run, index))
+        return false;
+
+    struct io_uring_sqe * sqe = pigeon_uring_sqe(ring);
+    if (!sqe)
+    {
+        slot->error = EAGAIN;
+        return false;
+    }
+
+    size_t length = slot->capacity - slot->size;
+    if (length > (1u << 30))
+        length = 1u << 30;
+
+    bool fixed = registered && slot->buffer == pigeon_aio_pool_buffer(run, index);
+    sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = slot->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(slot->buffer + slot->size);
+    sqe->len = (unsigned)length;
+    sqe->off = slot->size;
+    if (fixed)
+        sqe->buf_index = (uint16_t)index;
+    sqe->user_data = index;
+    pigeon_uring_push(ring);
+
+    slot->requested = length;
+    return true;
+}
+
+// Returns true while the slot still has a request in flight.
+static bool pigeon_aio_uring_complete(pigeon_aio_run_t * restrict run, pigeon_uring_t * restrict ring, unsigned index, int res, bool registered)
+{
+    pigeon_aio_slot_t * slot = &run->slots[index];
+    if (slot->opening)
+    {
+        slot->opening = false;
+        if (res < 0)
+        {
+            slot->error = -res;
+            return false;
+        }
+
+        slot->fd = res;
+        return pigeon_aio_uring_read(run, ring, index, registered);
+    }
+
+    if (res == -EINTR || res == -EAGAIN)
+        return pigeon_aio_uring_read(run, ring, index, registered);
+
+    if (res < 0)
+    {
+        slot->error = -res;
+        return false;
+    }
+
+    slot->size += (size_t)res;
+    if ((size_t)res < slot->requested)
+        return false; // short read: end of file
+
+    return pigeon_aio_uring_read(run, ring, index, registered);
+}
+
+// Starts the next file in a free slot, delivering files that fail to start
+// straight away. Returns false when there is nothing left to start.
+static bool pigeon_aio_uring_start(pigeon_aio_run_t * restrict run, pigeon_uring_t * restrict ring, unsigned index, size_t * restrict next_file)
+{
+    while (!run->stopped && *next_file < run->count)
+    {
+        if (pigeon_aio_uring_open(run, ring, index, (*next_file)++))
+            return true;
+
+        pigeon_aio_deliver(run, index);
+    }
+
+    return false;
+}
+
+// Waits for every request the kernel has accepted, without queueing more,
+// so that no read can land in a buffer after it is freed. Files opened in
+// the meantime are left in their slots to be closed. Returns false if the
+// ring cannot be waited on any more.
+static bool pigeon_aio_uring_drain(pigeon_aio_run_t * restrict run, pigeon_uring_t * restrict ring)
+{
+    for (;;)
+    {
+        unsigned head = *ring->cq_head;
+        unsigned tail = atomic_load_explicit((_Atomic unsigned *)ring->cq_tail, memory_order_acquire);
+        for (; head != tail; ++head)
+        {
+            const struct io_uring_cqe * cqe = &ring->cqes[head & ring->cq_mask];
+            pigeon_aio_slot_t * slot = &run->slots[(unsigned)cqe->user_data];
+            if (slot->opening && cqe->res >= 0)
+                slot->fd = cqe->res;
+            slot->opening = false;
+            --ring->in_flight;
+        }
+
+        atomic_store_explicit((_Atomic unsigned *)ring->cq_head, head, memory_order_release);
+        if (ring->in_flight == 0)
+            return true;
+
+        if (syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+            return false;
+    }
+}
+
+static bool pigeon_aio_run_uring(pigeon_aio_run_t * restrict run, pigeon_uring_t * restrict ring, bool registered)
+{
+    size_t next_file = 0;
+    unsigned active = 0;
+    for (unsigned i = 0; i < run->depth; ++i)
+        active += pigeon_aio_uring_start(run, ring, i, &next_file);
+
+    while (active > 0)
+    {
+        int submitted = (int)syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            // Closing the ring does not wait for reads in flight, so they
+            // are drained first; if even that fails, the buffers are kept.
+            pigeon_aio_error(run->result, "io_uring_enter failed: %s", strerror(errno));
+            run->stopped = true;
+            run->busy = !pigeon_aio_uring_drain(run, ring);
+            return false;
+        }
+        ring->to_submit -= (unsigned)submitted;
+        ring->in_flight += (unsigned)submitted;
+
+        unsigned head = *ring->cq_head;
+        unsigned tail = atomic_load_explicit((_Atomic unsigned *)ring->cq_tail, memory_order_acquire);
+        for (; head != tail; ++head)
+        {
+            const struct io_uring_cqe * cqe = &ring->cqes[head & ring->cq_mask];
+            unsigned index = (unsigned)cqe->user_data;
+            --ring->in_flight;
+            if (pigeon_aio_uring_complete(run, ring, index, cqe->res, registered))
+                continue;
+
+            pigeon_aio_deliver(run, index);
+            if (!pigeon_aio_uring_start(run, ring, index, &next_file))
+                --active;
+        }
+
+        atomic_store_explicit((_Atomic unsigned *)ring->cq_head, head, memory_order_release);
+    }
+
+    return true;
+}
+
+#endif
+
+bool pigeon_aio_read_files(const char * const * paths, size_t count, const pigeon_aio_options_t * options, pigeon_aio_callback_t callback, void * user_data, pigeon_aio_result_t * result)
+{
+    memset(result, 0, sizeof(*result));
+
+    pigeon_aio_backend_t backend = options ? options->backend : PIGEON_AIO_AUTO;
+    unsigned depth = options && options->depth ? options->depth : PIGEON_AIO_DEFAULT_DEPTH;
+    size_t buffer_size = options && options->buffer_size ? options->buffer_size : PIGEON_AIO_DEFAULT_BUFFER;
+    if (depth > count)
+        depth = count > 0 ? (unsigned)count : 1;
+
+    if (depth > 4096 || buffer_size > SIZE_MAX / depth)
+    {
+        pigeon_aio_error(result, "invalid depth %u or buffer size %zu", depth, buffer_size);
+        return false;
+    }
+
+    pigeon_aio_run_t run;
+    memset(&run, 0, sizeof(run));
+    run.paths = paths;
+    run.count = count;
+    run.callback = callback;
+    run.user_data = user_data;
+    run.result = result;
+    run.depth = depth;
+    run.buffer_size = buffer_size;
+    run.pool = pigeon_malloc(depth * buffer_size);
+    run.slots = pigeon_malloc(depth * sizeof(pigeon_aio_slot_t));
+    if (!run.pool || !run.slots)
+    {
+        pigeon_aio_error(result, "out of memory");
+        pigeon_free(run.pool);
+        pigeon_free(run.slots);
+        return false;
+    }
+
+    for (unsigned i = 0; i < depth; ++i)
+        pigeon_aio_slot_reset(&run, i, 0);
+
+    bool success = false;
+    bool done = false;
+
+#if defined(PIGEON_AIO_URING_ENABLED)
+    if (backend != PIGEON_AIO_THREADS)
+    {
+        pigeon_uring_t ring;
+        if (pigeon_uring_init(&ring, depth) && pigeon_uring_supports(&ring))
+        {
+            result->backend = PIGEON_AIO_URING;
+            result->registered = pigeon_uring_register_pool(&ring, &run);
+            success = pigeon_aio_run_uring(&run, &ring, result->registered);
+            done = true;
+        }
+
+        pigeon_uring_free(&ring);
+    }
+#endif
+
+    if (!done && backend == PIGEON_AIO_URING)
+        pigeon_aio_error(result, "io_uring is not available");
+    else if (!done)
+    {
+        result->backend = PIGEON_AIO_THREADS;
+        success = pigeon_aio_run_threads(&run);
+    }
+
+    // Any fds left open by an aborted io_uring run. Buffers the kernel may
+    // still write to are leaked rather than freed.
+    for (unsigned i = 0; i < depth; ++i)
+    {
+        if (run.slots[i].fd >= 0)
+            close(run.slots[i].fd);
+        if (!run.busy && run.slots[i].buffer != pigeon_aio_pool_buffer(&run, i))
+            pigeon_free(run.slots[i].buffer);
+    }
+
+    if (!run.busy)
+        pigeon_free(run.pool);
+    pigeon_free(run.slots);
+
+    if (success && run.stopped)
+    {
+        pigeon_aio_error(result, "stopped by callback");
+        success = false;
+    }
+
+    return success;
+}
@@ -0,0 +1,74 @@
+#ifndef PIGEON_AIO_H
+#define PIGEON_AIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Reads many whole files with the reads overlapped, handing each file to a
+// callback on the calling thread as soon as it has landed, so parsing one
+// file overlaps the I/O of the next ones.
+//
+// Reads go through io_uring when the kernel supports it: files are opened
+// and read by the kernel, into a pool of buffers registered with the ring
+// when the memlock limit allows. Otherwise, or when asked to, a pool of
+// threads does blocking open/pread calls into the same buffer pool.
+//
+// A file larger than a pool buffer gets a buffer of its own. A short read
+// is taken as the end of the file, which holds for regular files.
+
+#define PIGEON_AIO_DEFAULT_DEPTH 64
+#define PIGEON_AIO_DEFAULT_BUFFER (256 * 1024)
+
+typedef enum {
+    PIGEON_AIO_AUTO,    // io_uring if available, threads otherwise
+    PIGEON_AIO_URING,
+    PIGEON_AIO_THREADS
+} pigeon_aio_backend_t;
+
+typedef struct {
+    pigeon_aio_backend_t backend;
+    unsigned depth;     // files in flight; 0 for PIGEON_AIO_DEFAULT_DEPTH
+    size_t buffer_size; // size of each pool buffer; 0 for PIGEON_AIO_DEFAULT_BUFFER
+} pigeon_aio_options_t;
+
+typedef struct {
+    const char * path;
+    size_t index;     // position of path in the list given
+    const char * data; // valid for the duration of the callback only
+    size_t size;
+    int error;        // errno value if the file could not be read
+} pigeon_aio_file_t;
+
+// Returning false stops the run once the reads in flight have drained.
+typedef bool (*pigeon_aio_callback_t)(void * user_data, const pigeon_aio_file_t * file);
+
+typedef struct {
+    pigeon_aio_backend_t backend; // the backend that was used
+    bool registered;              // io_uring reads used registered buffers
+    uint64_t files;               // files handed to the callback
+    uint64_t bytes;
+    uint64_t errors;              // files that could not be read
+
+    char error_messages[256];
+} pigeon_aio_result_t;
+
+static inline const char * pigeon_aio_backend_name(pigeon_aio_backend_t backend)
+{
+    switch (backend)
+    {
+        case PIGEON_AIO_AUTO: return "auto";
+        case PIGEON_AIO_URING: return "io_uring";
+        case PIGEON_AIO_THREADS: return "threads";
+    }
+
+    return "unknown";
+}
+
+// Calls callback once per path, in completion order; unreadable files are
+// reported with error set. Returns false if the run could not be set up
+// (or PIGEON_AIO_URING was asked for and is unavailable) or was stopped by
+// the callback.
+bool pigeon_aio_read_files(const char * const * paths, size_t count, const pigeon_aio_options_t * options, pigeon_aio_callback_t callback, void * user_data, pigeon_aio_result_t * result);
+
+#endif
@@ -0,0 +1,660 @@
+#include "pigeon_archive.h"
+#include "pigeon_lz.h"
+#include "pigeon_memory.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef PIGEON_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+static const char archive_magic[8] = { 'P', 'G', 'N', 'A', 'R', 'C', '0', '1' };
+static const char archive_index_magic[8] = { 'P', 'G', 'N', 'A', 'I', 'D', 'X', '1' };
+
+#define PIGEON_ARCHIVE_INDEX_ENTRY_SIZE 48
+#define PIGEON_ARCHIVE_FOOTER_SIZE 24
+
+static void pigeon_archive_error(char * restrict buffer, const char * format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(buffer, 256, format, ap);
+    va_end(ap);
+}
+
+static inline void pigeon_put_u32(char * restrict dst, uint32_t value)
+{
+    for (unsigned i = 0; i < 4; ++i)
+        dst[i] = (char)(value >> (i * 8));
+}
+
+static inline void pigeon_put_u64(char * restrict dst, uint64_t value)
+{
+    for (unsigned i = 0; i < 8; ++i)
+        dst[i] = (char)(value >> (i * 8));
+}
+
+static inline uint32_t pigeon_get_u32(const char * restrict src)
+{
+    uint32_t value = 0;
+    for (unsigned i = 0; i < 4; ++i)
+        value |= (uint32_t)(unsigned char)src[i] << (i * 8);
+    return value;
+}
+
+static inline uint64_t pigeon_get_u64(const char * restrict src)
+{
+    uint64_t value = 0;
+    for (unsigned i = 0; i < 8; ++i)
+        value |= (uint64_t)(unsigned char)src[i] << (i * 8);
+    return value;
+}
+
+static bool pigeon_archive_write(pigeon_archive_writer_t * restrict writer, const void * data, size_t size)
+{
+    if (fwrite(data, 1, size, writer->file) != size)
+    {
+        pigeon_archive_error(writer->error_messages, "write failed: %s", strerror(errno));
+        return false;
+    }
+
+    writer->file_offset += size;
+    return true;
+}
+
+bool pigeon_archive_writer_open(pigeon_archive_writer_t * restrict writer, const char * restrict path, size_t target_block_size)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->target_block_size = target_block_size != 0 ? target_block_size : PIGEON_ARCHIVE_DEFAULT_BLOCK_SIZE;
+#ifdef PIGEON_HAVE_ZLIB
+    writer->codec = PIGEON_ARCHIVE_CODEC_ZLIB;
+#else
+    writer->codec = PIGEON_ARCHIVE_CODEC_LZ;
+#endif
+
+    writer->file = fopen(path, "wb");
+    if (!writer->file)
+    {
+        pigeon_archive_error(writer->error_messages, "unable to create '%s': %s", path, strerror(errno));
+        return false;
+    }
+
+    return pigeon_archive_write(writer, archive_magic, sizeof(archive_magic));
+}
+
+static bool pigeon_archive_flush_block(pigeon_archive_writer_t * restrict writer)
+{
+    if (writer->block_message_count == 0)
+        return true;
+
+    if (writer->block_count == writer->block_capacity)
+    {
+        size_t new_capacity = writer->block_capacity != 0 ? writer->block_capacity * 2 : 64;
+        pigeon_archive_block_t * blocks = pigeon_realloc(writer->blocks, new_capacity * sizeof(*blocks));
+        if (!blocks)
+        {
+            pigeon_archive_error(writer->error_messages, "memory allocation failed");
+            return false;
+        }
+
+        writer->blocks = blocks;
+        writer->block_capacity = new_capacity;
+    }
+
+    pigeon_archive_block_t * block = &writer->blocks[writer->block_count];
+    block->file_offset = writer->file_offset;
+    block->first_ordinal = writer->message_count - writer->block_message_count;
+    block->log_offset = writer->log_offset - writer->block_log_size;
+    block->log_size = writer->block_log_size;
+    block->raw_size = (uint32_t)writer->block_size;
+    block->message_count = writer->block_message_count;
+
+    size_t compressed_size = 0;
+    switch (writer->codec)
+    {
+        case PIGEON_ARCHIVE_CODEC_LZ:
+            compressed_size = pigeon_lz_compress_bound(writer->block_size);
+            break;
+
+#ifdef PIGEON_HAVE_ZLIB
+        case PIGEON_ARCHIVE_CODEC_ZLIB:
+            compressed_size = compressBound(writer->block_size);
+            break;
+#endif
+
+        default:
+            break;
+    }
+
+    char * compressed = pigeon_malloc(compressed_size != 0 ? compressed_size : 1);
+    if (!compressed)
+    {
+        pigeon_archive_error(writer->error_messages, "memory allocation failed");
+        return false;
+    }
+
+    block->codec = writer->codec;
+    switch (writer->codec)
+    {
+        case PIGEON_ARCHIVE_CODEC_LZ:
+            compressed_size = pigeon_lz_compress(writer->block_data, writer->block_size, compressed, compressed_size);
+            if (compressed_size == 0)
+                compressed_size = writer->block_size;
+            break;
+
+#ifdef PIGEON_HAVE_ZLIB
+        case PIGEON_ARCHIVE_CODEC_ZLIB:
+        {
+            uLongf zlib_size = compressed_size;
+            compressed_size = Z_OK == compress2((Bytef *)compressed, &zlib_size, (const Bytef *)writer->block_data, writer->block_size, Z_DEFAULT_COMPRESSION)
+                ? zlib_size : writer->block_size;
+            break;
+        }
+#endif
+
+        default:
+            compressed_size = writer->block_size;
+            break;
+    }
+
+    bool success;
+    if (compressed_size >= writer->block_size)
+    {
+        block->codec = PIGEON_ARCHIVE_CODEC_STORED;
+        block->compressed_size = (uint32_t)writer->block_size;
+        success = pigeon_archive_write(writer, writer->block_data, writer->block_size);
+    }
+    else
+    {
+        block->compressed_size = (uint32_t)compressed_size;
+        success = pigeon_archive_write(writer, compressed, compressed_size);
+    }
+
+    pigeon_free(compressed);
+    if (!success)
+        return false;
+
+    ++writer->block_count;
+    writer->block_size = 0;
+    writer->block_message_count = 0;
+    writer->block_log_size = 0;
+    return true;
+}
+
+bool pigeon_archive_writer_append(pigeon_archive_writer_t * restrict writer, const char * restrict msg_data, size_t msg_size, uint64_t log_offset)
+{
+    if (msg_size > UINT32_MAX - 4)
+    {
+        pigeon_archive_error(writer->error_messages, "message of %zu bytes is too large to archive", msg_size);
+        return false;
+    }
+
+    if (log_offset < writer->log_offset)
+    {
+        pigeon_archive_error(writer->error_messages, "message at log offset %llu overlaps the previous one", (unsigned long long)log_offset);
+        return false;
+    }
+
+    size_t required = writer->block_size + 4 + msg_size;
+    if (required > writer->block_capacity_bytes)
+    {
+        size_t new_capacity = writer->block_capacity_bytes != 0 ? writer->block_capacity_bytes : writer->target_block_size;
+        while (new_capacity < required)
+            new_capacity *= 2;
+
+        char * block_data = pigeon_realloc(writer->block_data, new_capacity);
+        if (!block_data)
+        {
+            pigeon_archive_error(writer->error_messages, "memory allocation failed");
+            return false;
+        }
+
+        writer->block_data = block_data;
+        writer->block_capacity_bytes = new_capacity;
+    }
+
+    pigeon_put_u32(writer->block_data + writer->block_size, (uint32_t)msg_size);
+    memcpy(writer->block_data + writer->block_size + 4, msg_data, msg_size);
+    writer->block_size += 4 + msg_size;
+    ++writer->block_message_count;
+    ++writer->message_count;
+
+    // Separators before the message count towards its block, so that the
+    // blocks cover the log without gaps
+    writer->block_log_size += log_offset + msg_size - writer->log_offset;
+    writer->log_offset = log_offset + msg_size;
+
+    if (writer->block_size >= writer->target_block_size)
+        return pigeon_archive_flush_block(writer);
+
+    return true;
+}
+
+bool pigeon_archive_writer_close(pigeon_archive_writer_t * restrict writer)
+{
+    bool success = writer->file != NULL && pigeon_archive_flush_block(writer);
+
+    uint64_t index_offset = writer->file_offset;
+    for (size_t i = 0; success && i < writer->block_count; ++i)
+    {
+        const pigeon_archive_block_t * block = &writer->blocks[i];
+        char entry[PIGEON_ARCHIVE_INDEX_ENTRY_SIZE];
+        pigeon_put_u64(entry, block->file_offset);
+        pigeon_put_u64(entry + 8, block->first_ordinal);
+        pigeon_put_u64(entry + 16, block->log_offset);
+        pigeon_put_u64(entry + 24, block->log_size);
+        pigeon_put_u32(entry + 32, block->compressed_size);
+        pigeon_put_u32(entry + 36, block->raw_size);
+        pigeon_put_u32(entry + 40, block->message_count);
+        pigeon_put_u32(entry + 44, block->codec);
+        success = pigeon_archive_write(writer, entry, sizeof(entry));
+    }
+
+    if (success)
+    {
+        char footer[PIGEON_ARCHIVE_FOOTER_SIZE];
+        pigeon_put_u64(footer, index_offset);
+        pigeon_put_u64(footer + 8, writer->block_count);
+        memcpy(footer + 16, archive_index_magic, sizeof(archive_index_magic));
+        success = pigeon_archive_write(writer, footer, sizeof(footer));
+    }
+
+    if (writer->file && fclose(writer->file) != 0 && success)
+    {
+        pigeon_archive_error(writer->error_messages, "close failed: %s", strerror(errno));
+        success = false;
+    }
+
+    writer->file = NULL;
+    pigeon_free(writer->blocks);
+    writer->blocks = NULL;
+    pigeon_free(writer->block_data);
+    writer->block_data = NULL;
+    return success;
+}
+
+static bool pigeon_archive_pread(int fd, void * buffer, size_t size, uint64_t offset)
+{
+    char * pos = buffer;
+    while (size > 0)
+    {
+        ssize_t count = pread(fd, pos, size, (off_t)offset);
+        if (count < 0 && errno == EINTR)
+            continue;
+        else if (count <= 0)
+            return false;
+
+        pos += count;
+        size -= count;
+        offset += count;
+    }
+
+    return true;
+}
+
+bool pigeon_archive_reader_open(pigeon_archive_reader_t * restrict reader, const char * restrict path)
+{
+    memset(reader, 0, sizeof(*reader));
+
+    reader->fd = open(path, O_RDONLY);
+    if (reader->fd < 0)
+    {
+        pigeon_archive_error(reader->error_messages, "unable to open '%s': %s", path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    char header[sizeof(archive_magic)];
+    char footer[PIGEON_ARCHIVE_FOOTER_SIZE];
+    if (fstat(reader->fd, &st) != 0
+        || (uint64_t)st.st_size < sizeof(archive_magic) + PIGEON_ARCHIVE_FOOTER_SIZE
+        || !pigeon_archive_pread(reader->fd, header, sizeof(header), 0)
+        || !pigeon_archive_pread(reader->fd, footer, sizeof(footer), st.st_size - PIGEON_ARCHIVE_FOOTER_SIZE)
+        || 0 != memcmp(header, archive_magic, sizeof(archive_magic))
+        || 0 != memcmp(footer + 16, archive_index_magic, sizeof(archive_index_magic)))
+    {
+        pigeon_archive_error(reader->error_messages, "'%s' is not a pigeon archive", path);
+        goto error;
+    }
+
+    // Bound block_count by the file size before multiplying, so a crafted
+    // footer can't wrap the size checks below
+    uint64_t file_size = (uint64_t)st.st_size;
+    uint64_t index_offset = pigeon_get_u64(footer);
+    uint64_t block_count = pigeon_get_u64(footer + 8);
+    if (index_offset < sizeof(archive_magic)
+        || block_count > (file_size - sizeof(archive_magic) - PIGEON_ARCHIVE_FOOTER_SIZE) / PIGEON_ARCHIVE_INDEX_ENTRY_SIZE
+        || index_offset != file_size - PIGEON_ARCHIVE_FOOTER_SIZE - block_count * PIGEON_ARCHIVE_INDEX_ENTRY_SIZE)
+    {
+        pigeon_archive_error(reader->error_messages, "corrupt block index in '%s'", path);
+        goto error;
+    }
+
+    size_t index_size = block_count * PIGEON_ARCHIVE_INDEX_ENTRY_SIZE;
+    char * index = pigeon_malloc(index_size != 0 ? index_size : 1);
+    reader->blocks = pigeon_malloc((block_count != 0 ? block_count : 1) * sizeof(pigeon_archive_block_t));
+    if (!index || !reader->blocks)
+    {
+        pigeon_free(index);
+        pigeon_archive_error(reader->error_messages, "memory allocation failed");
+        goto error;
+    }
+
+    if (!pigeon_archive_pread(reader->fd, index, index_size, index_offset))
+    {
+        pigeon_free(index);
+        pigeon_archive_error(reader->error_messages, "unable to read block index of '%s'", path);
+        goto error;
+    }
+
+    for (size_t i = 0; i < block_count; ++i)
+    {
+        const char * entry = index + i * PIGEON_ARCHIVE_INDEX_ENTRY_SIZE;
+        pigeon_archive_block_t * block = &reader->blocks[i];
+        block->file_offset = pigeon_get_u64(entry);
+        block->first_ordinal = pigeon_get_u64(entry + 8);
+        block->log_offset = pigeon_get_u64(entry + 16);
+        block->log_size = pigeon_get_u64(entry + 24);
+        block->compressed_size = pigeon_get_u32(entry + 32);
+        block->raw_size = pigeon_get_u32(entry + 36);
+        block->message_count = pigeon_get_u32(entry + 40);
+        block->codec = pigeon_get_u32(entry + 44);
+
+        // Every payload must lie between the header and the index
+        if (block->file_offset < sizeof(archive_magic)
+            || block->file_offset > index_offset
+            || block->compressed_size > index_offset - block->file_offset)
+        {
+            pigeon_free(index);
+            pigeon_archive_error(reader->error_messages, "corrupt block index in '%s'", path);
+            goto error;
+        }
+    }
+
+    pigeon_free(index);
+    reader->block_count = block_count;
+    if (block_count > 0)
+    {
+        const pigeon_archive_block_t * last = &reader->blocks[block_count - 1];
+        reader->message_count = last->first_ordinal + last->message_count;
+        reader->log_size = last->log_offset + last->log_size;
+    }
+
+    return true;
+
+error:
+    pigeon_archive_reader_close(reader);
+    return false;
+}
+
+void pigeon_archive_reader_close(pigeon_archive_reader_t * restrict reader)
+{
+    if (reader->fd >= 0)
+        close(reader->fd);
+
+    reader->fd = -1;
+    pigeon_free(reader->blocks);
+    reader->blocks = NULL;
+    reader->block_count = 0;
+}
+
+bool pigeon_archive_find_by_ordinal(const pigeon_archive_reader_t * restrict reader, uint64_t ordinal, size_t * restrict block_index)
+{
+    size_t low = 0;
+    size_t high = reader->block_count;
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        const pigeon_archive_block_t * block = &reader->blocks[mid];
+        if (ordinal < block->first_ordinal)
+            high = mid;
+        else if (ordinal >= block->first_ordinal + block->message_count)
+            low = mid + 1;
+        else
+        {
+            *block_index = mid;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool pigeon_archive_find_by_offset(const pigeon_archive_reader_t * restrict reader, uint64_t log_offset, size_t * restrict block_index)
+{
+    size_t low = 0;
+    size_t high = reader->block_count;
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        const pigeon_archive_block_t * block = &reader->blocks[mid];
+        if (log_offset < block->log_offset)
+            high = mid;
+        else if (log_offset >= block->log_offset + block->log_size)
+            low = mid + 1;
+        else
+        {
+            *block_index = mid;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool pigeon_archive_decode_block(const pigeon_archive_reader_t * restrict reader, size_t block_index, char ** restrict raw_data, size_t * restrict raw_size, char * restrict error_messages)
+{
+    if (block_index >= reader->block_count)
+    {
+        pigeon_archive_error(error_messages, "block %zu out of range", block_index);
+        return false;
+    }
+
+    const pigeon_archive_block_t * block = &reader->blocks[block_index];
+    char * compressed = pigeon_malloc(block->compressed_size != 0 ? block->compressed_size : 1);
+    char * raw = pigeon_malloc(block->raw_size != 0 ? block->raw_size : 1);
+    if (!compressed || !raw)
+    {
+        pigeon_archive_error(error_messages, "memory allocation failed");
+        goto error;
+    }
+
+    if (!pigeon_archive_pread(reader->fd, compressed, block->compressed_size, block->file_offset))
+    {
+        pigeon_archive_error(error_messages, "unable to read block %zu", block_index);
+        goto error;
+    }
+
+    bool decoded = false;
+    switch (block->codec)
+    {
+        case PIGEON_ARCHIVE_CODEC_STORED:
+            decoded = block->compressed_size == block->raw_size;
+            if (decoded)
+                memcpy(raw, compressed, block->raw_size);
+            break;
+
+        case PIGEON_ARCHIVE_CODEC_LZ:
+            decoded = pigeon_lz_decompress(compressed, block->compressed_size, raw, block->raw_size);
+            break;
+
+        case PIGEON_ARCHIVE_CODEC_ZLIB:
+#ifdef PIGEON_HAVE_ZLIB
+        {
+            uLongf dest_size = block->raw_size;
+            decoded = Z_OK == uncompress((Bytef *)raw, &dest_size, (const Bytef *)compressed, block->compressed_size)
+                && dest_size == block->raw_size;
+            break;
+        }
+#else
+            pigeon_archive_error(error_messages, "block %zu is zlib compressed but zlib support is not built in", block_index);
+            goto error;
+#endif
+
+        default:
+            break;
+    }
+
+    if (!decoded)
+    {
+        pigeon_archive_error(error_messages, "block %zu is corrupt", block_index);
+        goto error;
+    }
+
+    pigeon_free(compressed);
+    *raw_data = raw;
+    *raw_size = block->raw_size;
+    return true;
+
+error:
+    pigeon_free(compressed);
+    pigeon_free(raw);
+    return false;
+}
+
+bool pigeon_archive_read_block(pigeon_archive_reader_t * restrict reader, size_t block_index, char ** restrict raw_data, size_t * restrict raw_size)
+{
+    return pigeon_archive_decode_block(reader, block_index, raw_data, raw_size, reader->error_messages);
+}
+
+typedef struct {
+    pigeon_archive_reader_t * reader;
+    size_t end_block;
+    atomic_size_t next_block;
+    atomic_bool stop;
+    bool failed;
+    pthread_mutex_t error_lock;
+
+    pigeon_archive_message_callback_t callback;
+    void * user_data;
+} pigeon_archive_replay_t;
+
+static void pigeon_archive_replay_fail(pigeon_archive_replay_t * restrict replay, const char * restrict error_messages)
+{
+    pthread_mutex_lock(&replay->error_lock);
+    if (!replay->failed)
+    {
+        replay->failed = true;
+        memcpy(replay->reader->error_messages, error_messages, sizeof(replay->reader->error_messages));
+    }
+    pthread_mutex_unlock(&replay->error_lock);
+    atomic_store(&replay->stop, true);
+}
+
+static bool pigeon_archive_replay_block(pigeon_archive_replay_t * restrict replay, size_t block_index, const char * raw, size_t raw_size, char * restrict error_messages)
+{
+    uint64_t ordinal = replay->reader->blocks[block_index].first_ordinal;
+    pigeon_parse_context_t ctx;
+
+    for (size_t pos = 0; pos < raw_size; ++ordinal)
+    {
+        if (raw_size - pos < 4 || pigeon_get_u32(raw + pos) > raw_size - pos - 4)
+        {
+            pigeon_archive_error(error_messages, "block %zu has a truncated message", block_index);
+            return false;
+        }
+
+        uint32_t msg_size = pigeon_get_u32(raw + pos);
+        const char * msg_data = raw + pos + 4;
+        pos += 4 + msg_size;
+
+        // A failed parse can leave part of the message allocated as well
+        pigeon_parsed_message_t message;
+        bool parse_success = pigeon_parse_message(&ctx, msg_data, msg_size, &message);
+        bool keep_going = replay->callback(replay->user_data, ordinal, msg_data, msg_size, parse_success, &ctx, &message);
+        pigeon_free_parsed_message(&message);
+
+        if (!keep_going)
+        {
+            atomic_store(&replay->stop, true);
+            break;
+        }
+    }
+
+    return true;
+}
+
+static void * pigeon_archive_replay_worker(void * arg)
+{
+    pigeon_archive_replay_t * replay = arg;
+    char error_messages[256];
+
+    while (!atomic_load(&replay->stop))
+    {
+        size_t block_index = atomic_fetch_add(&replay->next_block, 1);
+        if (block_index >= replay->end_block)
+            break;
+
+        char * raw;
+        size_t raw_size;
+        if (!pigeon_archive_decode_block(replay->reader, block_index, &raw, &raw_size, error_messages))
+        {
+            pigeon_archive_replay_fail(replay, error_messages);
+            break;
+        }
+
+        bool success = pigeon_archive_replay_block(replay, block_index, raw, raw_size, error_messages);
+        pigeon_free(raw);
+        if (!success)
+        {
+            pigeon_archive_replay_fail(replay, error_messages);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+bool pigeon_archive_replay(pigeon_archive_reader_t * restrict reader, size_t first_block, size_t block_count, unsigned thread_count, pigeon_archive_message_callback_t callback, void * user_data)
+{
+    if (first_block > reader->block_count || block_count > reader->block_count - first_block)
+    {
+        pigeon_archive_error(reader->error_messages, "block range out of bounds");
+        return false;
+    }
+
+    pigeon_archive_replay_t replay;
+    replay.reader = reader;
+    replay.end_block = first_block + block_count;
+    atomic_init(&replay.next_block, first_block);
+    atomic_init(&replay.stop, false);
+    replay.failed = false;
+    pthread_mutex_init(&replay.error_lock, NULL);
+    replay.callback = callback;
+    replay.user_data = user_data;
+
+    if (thread_count == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cpus > 0 ? (unsigned)cpus : 1;
+    }
+
+    if (thread_count > block_count)
+        thread_count = block_count != 0 ? block_count : 1;
+
+    pthread_t * threads = thread_count > 1 ? pigeon_malloc((thread_count - 1) * sizeof(pthread_t)) : NULL;
+    unsigned started = 0;
+    if (threads)
+    {
+        for (; started < thread_count - 1; ++started)
+            if (0 != pthread_create(&threads[started], NULL, pigeon_archive_replay_worker, &replay))
+                break;
+    }
+
+    // The calling thread takes part in the replay as well.
+    pigeon_archive_replay_worker(&replay);
+
+    for (unsigned i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+
+    pigeon_free(threads);
+    pthread_mutex_destroy(&replay.error_lock);
+    return !replay.failed;
+}
@@ -0,0 +1,104 @@
+#ifndef PIGEON_ARCHIVE_H
+#define PIGEON_ARCHIVE_H
+
+#include "pigeon_parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// A seekable archive of pigeon messages. Messages are grouped into blocks
+// that are compressed independently (zlib when available at build time,
+// otherwise the in-tree LZ codec), followed by a block index so readers can
+// seek by message ordinal or by byte offset into the original log text.
+
+#define PIGEON_ARCHIVE_DEFAULT_BLOCK_SIZE (256 * 1024)
+
+typedef enum {
+    PIGEON_ARCHIVE_CODEC_STORED,
+    PIGEON_ARCHIVE_CODEC_LZ,
+    PIGEON_ARCHIVE_CODEC_ZLIB
+} pigeon_archive_codec_t;
+
+typedef struct {
+    uint64_t file_offset;    // position of the compressed payload in the archive
+    uint64_t first_ordinal;  // ordinal of the first message in the block
+    uint64_t log_offset;     // start of the range of the original log covered by the block
+    uint64_t log_size;       // bytes of log text covered by the block
+    uint32_t compressed_size;
+    uint32_t raw_size;
+    uint32_t message_count;
+    uint32_t codec;
+} pigeon_archive_block_t;
+
+typedef struct {
+    FILE * file;
+    uint64_t file_offset;
+
+    pigeon_archive_block_t * blocks;
+    size_t block_count;
+    size_t block_capacity;
+
+    char * block_data;
+    size_t block_size;
+    size_t block_capacity_bytes;
+    size_t target_block_size;
+    uint32_t block_message_count;
+
+    uint64_t message_count;
+    uint64_t log_offset;
+    uint64_t block_log_size;
+
+    // Codec for new blocks; zlib when built in, otherwise LZ. May be changed
+    // after open. Blocks that don't shrink are always stored.
+    pigeon_archive_codec_t codec;
+
+    char error_messages[256];
+} pigeon_archive_writer_t;
+
+typedef struct {
+    int fd;
+
+    pigeon_archive_block_t * blocks;
+    size_t block_count;
+    uint64_t message_count;
+    uint64_t log_size;
+
+    char error_messages[256];
+} pigeon_archive_reader_t;
+
+bool pigeon_archive_writer_open(pigeon_archive_writer_t * restrict writer, const char * restrict path, size_t target_block_size);
+
+// Appends one complete message (header through signature line) found at
+// log_offset in the original log. Offsets must increase; the bytes between
+// messages are counted in the log range of the block that follows them.
+bool pigeon_archive_writer_append(pigeon_archive_writer_t * restrict writer, const char * restrict msg_data, size_t msg_size, uint64_t log_offset);
+
+// Flushes the pending block, writes the index and closes the file.
+bool pigeon_archive_writer_close(pigeon_archive_writer_t * restrict writer);
+
+bool pigeon_archive_reader_open(pigeon_archive_reader_t * restrict reader, const char * restrict path);
+
+void pigeon_archive_reader_close(pigeon_archive_reader_t * restrict reader);
+
+bool pigeon_archive_find_by_ordinal(const pigeon_archive_reader_t * restrict reader, uint64_t ordinal, size_t * restrict block_index);
+
+bool pigeon_archive_find_by_offset(const pigeon_archive_reader_t * restrict reader, uint64_t log_offset, size_t * restrict block_index);
+
+// Decompresses one block into a heap buffer owned by the caller. The buffer
+// holds the block's messages, each prefixed by its size as a little-endian
+// uint32.
+bool pigeon_archive_read_block(pigeon_archive_reader_t * restrict reader, size_t block_index, char ** restrict raw_data, size_t * restrict raw_size);
+
+// Called once per message during replay. msg_data points into the decoded
+// block and is only valid for the duration of the call. When parse_success
+// is false, ctx holds the parse error and message must not be used.
+// The callback is invoked concurrently from the replay threads.
+typedef bool (*pigeon_archive_message_callback_t)(void * user_data, uint64_t ordinal, const char * msg_data, size_t msg_size, bool parse_success, const pigeon_parse_context_t * ctx, pigeon_parsed_message_t * message);
+
+// Decodes and parses blocks [first_block, first_block + block_count) on
+// thread_count threads (0 picks the number of online CPUs). Replay stops
+// early if the callback returns false.
+bool pigeon_archive_replay(pigeon_archive_reader_t * restrict reader, size_t first_block, size_t block_count, unsigned thread_count, pigeon_archive_message_callback_t callback, void * user_data);
+
+#endif
@@ -0,0 +1,480 @@
+#include "pigeon_blob.h"
+#include "pigeon_memory.h"
+#include "pigeon_string.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PIGEON_BLOB_HEX_SIZE (PIGEON_SHA256_DIGEST_SIZE * 2 + 1)
+
+struct pigeon_blob_mapping_t {
+    char key[PIGEON_BLOB_HEX_SIZE];
+    void * data;
+    size_t size;
+    unsigned pins;
+
+    pigeon_blob_mapping_t * prev; // LRU links, only while unpinned
+    pigeon_blob_mapping_t * next;
+};
+
+static char empty_blob[1];
+
+// Must not be called with the lock held
+static void pigeon_blob_error(pigeon_blob_store_t * restrict store, const char * format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    pthread_mutex_lock(&store->lock);
+    vsnprintf(store->error_messages, sizeof(store->error_messages), format, ap);
+    pthread_mutex_unlock(&store->lock);
+    va_end(ap);
+}
+
+void pigeon_blob_store_error(pigeon_blob_store_t * restrict store, char * restrict buffer, size_t size)
+{
+    pthread_mutex_lock(&store->lock);
+    snprintf(buffer, size, "%s", store->error_messages);
+    pthread_mutex_unlock(&store->lock);
+}
+
+static bool pigeon_blob_mkdir(const char * restrict path)
+{
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+// Depth 1 gives ROOT/ab, 2 gives ROOT/ab/cd and 3 the blob file itself.
+static char * pigeon_blob_path(const pigeon_blob_store_t * restrict store, const char * restrict key, unsigned depth)
+{
+    size_t size = strlen(store->root) + 8 + PIGEON_BLOB_HEX_SIZE;
+    char * path = pigeon_malloc(size);
+    if (!path)
+        return NULL;
+
+    if (depth == 1)
+        snprintf(path, size, "%s/%.2s", store->root, key);
+    else if (depth == 2)
+        snprintf(path, size, "%s/%.2s/%.2s", store->root, key, key + 2);
+    else
+        snprintf(path, size, "%s/%.2s/%.2s/%s", store->root, key, key + 2, key);
+
+    return path;
+}
+
+bool pigeon_blob_store_open(pigeon_blob_store_t * restrict store, const char * restrict root, size_t cache_limit)
+{
+    memset(store, 0, sizeof(*store));
+    pthread_mutex_init(&store->lock, NULL);
+    store->cache_limit = cache_limit ? cache_limit : PIGEON_BLOB_DEFAULT_CACHE_SIZE;
+
+    size_t root_length = strlen(root);
+    while (root_length > 1 && root[root_length - 1] == '/')
+        --root_length;
+
+    store->root = pigeon_strdup_range(root, root_length);
+    char * temp_dir = store->root ? pigeon_malloc(root_length + 5) : NULL;
+    if (!temp_dir || !pigeon_map_init(&store->mappings, 64))
+    {
+        pigeon_free(temp_dir);
+        pigeon_blob_error(store, "memory allocation failed");
+        return false;
+    }
+
+    snprintf(temp_dir, root_length + 5, "%s/tmp", store->root);
+    bool success = pigeon_blob_mkdir(store->root) && pigeon_blob_mkdir(temp_dir);
+    if (!success)
+        pigeon_blob_error(store, "cannot create '%s': %s", temp_dir, strerror(errno));
+
+    pigeon_free(temp_dir);
+    return success;
+}
+
+static void pigeon_blob_unmap(pigeon_blob_mapping_t * restrict mapping)
+{
+    if (mapping->size > 0)
+        munmap(mapping->data, mapping->size);
+    pigeon_free(mapping);
+}
+
+static void pigeon_blob_free_mapping(void * mapping)
+{
+    pigeon_blob_unmap(mapping);
+}
+
+void pigeon_blob_store_close(pigeon_blob_store_t * restrict store)
+{
+    if (store->mappings.entries)
+        pigeon_map_free(&store->mappings, pigeon_blob_free_mapping);
+
+    pigeon_free(store->root);
+    store->root = NULL;
+    store->lru_head = store->lru_tail = NULL;
+    store->cache_size = 0;
+    pthread_mutex_destroy(&store->lock);
+}
+
+bool pigeon_blob_writer_open(pigeon_blob_store_t * restrict store, pigeon_blob_writer_t * restrict writer, const unsigned char * restrict expected)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->store = store;
+    writer->fd = -1;
+    pigeon_sha256_init(&writer->sha);
+
+    if (expected)
+    {
+        writer->has_expected = true;
+        memcpy(writer->expected, expected, PIGEON_SHA256_DIGEST_SIZE);
+    }
+
+    pthread_mutex_lock(&store->lock);
+    unsigned counter = store->temp_counter++;
+    pthread_mutex_unlock(&store->lock);
+
+    size_t size = strlen(store->root) + 64;
+    writer->temp_path = pigeon_malloc(size);
+    if (!writer->temp_path)
+    {
+        pigeon_blob_error(store, "memory allocation failed");
+        return false;
+    }
+
+    snprintf(writer->temp_path, size, "%s/tmp/%ld-%u.tmp", store->root, (long)getpid(), counter);
+    writer->fd = open(writer->temp_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (writer->fd < 0)
+    {
+        pigeon_blob_error(store, "cannot create '%s': %s", writer->temp_path, strerror(errno));
+        pigeon_free(writer->temp_path);
+        writer->temp_path = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+bool pigeon_blob_writer_write(pigeon_blob_writer_t * restrict writer, const void * restrict data, size_t size)
+{
+    pigeon_sha256_update(&writer->sha, data, size);
+    writer->size += size;
+
+    const char * pos = data;
+    while (size > 0)
+    {
+        ssize_t written = write(writer->fd, pos, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        else if (written <= 0)
+        {
+            pigeon_blob_error(writer->store, "write to '%s' failed: %s", writer->temp_path, strerror(errno));
+            return false;
+        }
+
+        pos += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+void pigeon_blob_writer_abort(pigeon_blob_writer_t * restrict writer)
+{
+    if (writer->fd >= 0)
+        close(writer->fd);
+    if (writer->temp_path)
+        unlink(writer->temp_path);
+
+    pigeon_free(writer->temp_path);
+    writer->temp_path = NULL;
+    writer->fd = -1;
+}
+
+bool pigeon_blob_writer_close(pigeon_blob_writer_t * restrict writer, unsigned char * restrict digest)
+{
+    pigeon_blob_store_t * store = writer->store;
+
+    unsigned char actual[PIGEON_SHA256_DIGEST_SIZE];
+    pigeon_sha256_final(&writer->sha, actual);
+
+    char key[PIGEON_BLOB_HEX_SIZE];
+    pigeon_sha256_format_hex(actual, key);
+
+    if (writer->has_expected && memcmp(actual, writer->expected, sizeof(actual)) != 0)
+    {
+        pigeon_blob_error(store, "blob content hashes to %s, not the expected digest", key);
+        pigeon_blob_writer_abort(writer);
+        return false;
+    }
+
+    // The data must be durable before the name makes it visible
+    if (fsync(writer->fd) != 0)
+    {
+        pigeon_blob_error(store, "sync of '%s' failed: %s", writer->temp_path, strerror(errno));
+        pigeon_blob_writer_abort(writer);
+        return false;
+    }
+
+    char * shard = pigeon_blob_path(store, key, 1);
+    char * subshard = pigeon_blob_path(store, key, 2);
+    char * path = pigeon_blob_path(store, key, 3);
+    bool success = shard && subshard && path;
+    if (!success)
+        pigeon_blob_error(store, "memory allocation failed");
+    else if (!pigeon_blob_mkdir(shard) || !pigeon_blob_mkdir(subshard))
+    {
+        pigeon_blob_error(store, "cannot create '%s': %s", subshard, strerror(errno));
+        success = false;
+    }
+    else if (rename(writer->temp_path, path) != 0)
+    {
+        pigeon_blob_error(store, "cannot rename '%s' to '%s': %s", writer->temp_path, path, strerror(errno));
+        success = false;
+    }
+    else
+    {
+        pigeon_free(writer->temp_path);
+        writer->temp_path = NULL;
+    }
+
+    pigeon_free(shard);
+    pigeon_free(subshard);
+    pigeon_free(path);
+    pigeon_blob_writer_abort(writer);
+
+    if (success && digest)
+        memcpy(digest, actual, sizeof(actual));
+    return success;
+}
+
+bool pigeon_blob_store_put(pigeon_blob_store_t * restrict store, const void * restrict data, size_t size, unsigned char * restrict digest)
+{
+    pigeon_blob_writer_t writer;
+    if (!pigeon_blob_writer_open(store, &writer, NULL))
+        return false;
+
+    if (!pigeon_blob_writer_write(&writer, data, size))
+    {
+        pigeon_blob_writer_abort(&writer);
+        return false;
+    }
+
+    return pigeon_blob_writer_close(&writer, digest);
+}
+
+bool pigeon_blob_store_contains(pigeon_blob_store_t * restrict store, const unsigned char digest[PIGEON_SHA256_DIGEST_SIZE])
+{
+    char key[PIGEON_BLOB_HEX_SIZE];
+    pigeon_sha256_format_hex(digest, key);
+
+    pthread_mutex_lock(&store->lock);
+    bool cached = pigeon_map_find(&store->mappings, key) != NULL;
+    pthread_mutex_unlock(&store->lock);
+    if (cached)
+        return true;
+
+    char * path = pigeon_blob_path(store, key, 3);
+    bool found = path && access(path, F_OK) == 0;
+    pigeon_free(path);
+    return found;
+}
+
+static void pigeon_blob_lru_unlink(pigeon_blob_store_t * restrict store, pigeon_blob_mapping_t * restrict mapping)
+{
+    if (mapping->prev)
+        mapping->prev->next = mapping->next;
+    else
+        store->lru_head = mapping->next;
+
+    if (mapping->next)
+        mapping->next->prev = mapping->prev;
+    else
+        store->lru_tail = mapping->prev;
+
+    mapping->prev = mapping->next = NULL;
+}
+
+// Called with the lock held
+static void pigeon_blob_evict(pigeon_blob_store_t * restrict store)
+{
+    while (store->cache_size > store->cache_limit && store->lru_tail)
+    {
+        pigeon_blob_mapping_t * victim = store->lru_tail;
+        pigeon_blob_lru_unlink(store, victim);
+        pigeon_map_remove(&store->mappings, victim->key, NULL);
+        store->cache_size -= victim->size;
+        pigeon_blob_unmap(victim);
+    }
+}
+
+static pigeon_blob_mapping_t * pigeon_blob_map_file(pigeon_blob_store_t * restrict store, const char * restrict key)
+{
+    char * path = pigeon_blob_path(store, key, 3);
+    if (!path)
+    {
+        pigeon_blob_error(store, "memory allocation failed");
+        return NULL;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        pigeon_blob_error(store, "cannot open blob %s: %s", key, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        pigeon_free(path);
+        return NULL;
+    }
+
+    pigeon_free(path);
+
+    pigeon_blob_mapping_t * mapping = pigeon_malloc(sizeof(pigeon_blob_mapping_t));
+    if (!mapping)
+    {
+        pigeon_blob_error(store, "memory allocation failed");
+        close(fd);
+        return NULL;
+    }
+
+    memset(mapping, 0, sizeof(*mapping));
+    memcpy(mapping->key, key, sizeof(mapping->key));
+    mapping->size = (size_t)info.st_size;
+    mapping->data = empty_blob;
+    if (mapping->size > 0)
+    {
+        mapping->data = mmap(NULL, mapping->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping->data == MAP_FAILED)
+        {
+            pigeon_blob_error(store, "cannot map blob %s: %s", key, strerror(errno));
+            pigeon_free(mapping);
+            mapping = NULL;
+        }
+    }
+
+    close(fd);
+    return mapping;
+}
+
+bool pigeon_blob_store_get(pigeon_blob_store_t * restrict store, const unsigned char digest[PIGEON_SHA256_DIGEST_SIZE], pigeon_blob_t * restrict blob)
+{
+    char key[PIGEON_BLOB_HEX_SIZE];
+    pigeon_sha256_format_hex(digest, key);
+    memset(blob, 0, sizeof(*blob));
+
+    pthread_mutex_lock(&store->lock);
+    void ** slot = pigeon_map_find(&store->mappings, key);
+    pigeon_blob_mapping_t * mapping = slot ? *slot : NULL;
+    if (mapping && mapping->pins++ == 0)
+        pigeon_blob_lru_unlink(store, mapping);
+    pthread_mutex_unlock(&store->lock);
+
+    if (!mapping)
+    {
+        // Map outside the lock so a slow open does not stall other readers
+        pigeon_blob_mapping_t * mapped = pigeon_blob_map_file(store, key);
+        if (!mapped)
+            return false;
+
+        pthread_mutex_lock(&store->lock);
+        bool inserted;
+        slot = pigeon_map_insert(&store->mappings, key, &inserted);
+        if (!slot)
+        {
+            pthread_mutex_unlock(&store->lock);
+            pigeon_blob_unmap(mapped);
+            pigeon_blob_error(store, "memory allocation failed");
+            return false;
+        }
+
+        if (inserted)
+        {
+            *slot = mapping = mapped;
+            store->cache_size += mapping->size;
+            mapping->pins = 1;
+        }
+        else
+        {
+            // Another thread mapped it first
+            mapping = *slot;
+            if (mapping->pins++ == 0)
+                pigeon_blob_lru_unlink(store, mapping);
+        }
+
+        pigeon_blob_evict(store);
+        pthread_mutex_unlock(&store->lock);
+
+        if (mapping != mapped)
+            pigeon_blob_unmap(mapped);
+    }
+
+    blob->data = mapping->data;
+    blob->size = mapping->size;
+    blob->mapping = mapping;
+    return true;
+}
+
+void pigeon_blob_release(pigeon_blob_store_t * restrict store, pigeon_blob_t * restrict blob)
+{
+    pigeon_blob_mapping_t * mapping = blob->mapping;
+    if (!mapping)
+        return;
+
+    pthread_mutex_lock(&store->lock);
+    if (--mapping->pins == 0)
+    {
+        mapping->next = store->lru_head;
+        if (store->lru_head)
+            store->lru_head->prev = mapping;
+        else
+            store->lru_tail = mapping;
+        store->lru_head = mapping;
+
+        pigeon_blob_evict(store);
+    }
+    pthread_mutex_unlock(&store->lock);
+
+    memset(blob, 0, sizeof(*blob));
+}
+
+void * pigeon_blob_store_read(pigeon_blob_store_t * restrict store, const unsigned char digest[PIGEON_SHA256_DIGEST_SIZE], size_t * restrict size)
+{
+    pigeon_blob_t blob;
+    if (!pigeon_blob_store_get(store, digest, &blob))
+        return NULL;
+
+    void * copy = pigeon_malloc(blob.size > 0 ? blob.size : 1);
+    if (copy)
+    {
+        memcpy(copy, blob.data, blob.size);
+        *size = blob.size;
+    }
+    else
+        pigeon_blob_error(store, "memory allocation failed");
+
+    pigeon_blob_release(store, &blob);
+    return copy;
+}
+
+bool pigeon_blob_field_digest(const pigeon_field_t * restrict field, unsigned char digest[PIGEON_SHA256_DIGEST_SIZE])
+{
+    return field->field_type == PIGEON_FIELD_BLOB
+        && field->field_value.encoded.encoding_type == PIGEON_ENCODING_TYPE_SHA256
+        && field->field_value.encoded.hash != NULL
+        && pigeon_sha256_decode(field->field_value.encoded.hash, digest);
+}
+
+bool pigeon_blob_resolve_field(pigeon_blob_store_t * restrict store, const pigeon_field_t * restrict field, pigeon_blob_t * restrict blob)
+{
+    unsigned char digest[PIGEON_SHA256_DIGEST_SIZE];
+    if (!pigeon_blob_field_digest(field, digest))
+    {
+        memset(blob, 0, sizeof(*blob));
+        pigeon_blob_error(store, "field '%s' is not a sha256 blob reference", field->field_name ? field->field_name : "");
+        return false;
+    }
+
+    return pigeon_blob_store_get(store, digest, blob);
+}
@@ -0,0 +1,102 @@
+#ifndef PIGEON_BLOB_H
+#define PIGEON_BLOB_H
+
+#include "pigeon_map.h"
+#include "pigeon_parser.h"
+#include "pigeon_sha256.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Content-addressed store for the blobs that '&sha256:...' fields refer to.
+// A blob lives at ROOT/ab/cd/abcd... (its hex digest, sharded by the first
+// two bytes); writes go through ROOT/tmp and are renamed into place only
+// after their SHA-256 has been verified.
+//
+// Reads map blob files read-only and hand out pinned views. Unpinned
+// mappings stay cached, least recently used first out, until the mapped
+// total exceeds the cache limit. The store is safe to share between threads;
+// error_messages is then shared too and is best read with
+// pigeon_blob_store_error.
+
+#define PIGEON_BLOB_DEFAULT_CACHE_SIZE (256 * 1024 * 1024)
+
+typedef struct pigeon_blob_mapping_t pigeon_blob_mapping_t;
+
+typedef struct {
+    char * root;
+    size_t cache_limit;
+    size_t cache_size;     // bytes mapped, pinned or not
+
+    pigeon_map_t mappings; // hex digest -> pigeon_blob_mapping_t
+    pigeon_blob_mapping_t * lru_head; // most recently used unpinned mapping
+    pigeon_blob_mapping_t * lru_tail;
+    unsigned temp_counter;
+
+    pthread_mutex_t lock;
+    char error_messages[256];
+} pigeon_blob_store_t;
+
+// A pinned, read-only view of a blob; valid until pigeon_blob_release.
+typedef struct {
+    const void * data;
+    size_t size;
+    pigeon_blob_mapping_t * mapping;
+} pigeon_blob_t;
+
+typedef struct {
+    pigeon_blob_store_t * store;
+    int fd;
+    char * temp_path;
+    pigeon_sha256_t sha;
+    uint64_t size;
+
+    bool has_expected;
+    unsigned char expected[PIGEON_SHA256_DIGEST_SIZE];
+} pigeon_blob_writer_t;
+
+// Creates root and its tmp directory if needed. cache_limit of 0 uses
+// PIGEON_BLOB_DEFAULT_CACHE_SIZE.
+bool pigeon_blob_store_open(pigeon_blob_store_t * restrict store, const char * restrict root, size_t cache_limit);
+
+// All views must have been released.
+void pigeon_blob_store_close(pigeon_blob_store_t * restrict store);
+
+// Copies the last error reported by any thread into buffer.
+void pigeon_blob_store_error(pigeon_blob_store_t * restrict store, char * restrict buffer, size_t size);
+
+// expected may be NULL; otherwise the blob is rejected on close unless its
+// content hashes to it.
+bool pigeon_blob_writer_open(pigeon_blob_store_t * restrict store, pigeon_blob_writer_t * restrict writer, const unsigned char * restrict expected);
+
+bool pigeon_blob_writer_write(pigeon_blob_writer_t * restrict writer, const void * restrict data, size_t size);
+
+// Verifies and publishes the blob, storing its digest if digest is not NULL.
+// The writer is released whether or not this succeeds.
+bool pigeon_blob_writer_close(pigeon_blob_writer_t * restrict writer, unsigned char * restrict digest);
+
+void pigeon_blob_writer_abort(pigeon_blob_writer_t * restrict writer);
+
+bool pigeon_blob_store_put(pigeon_blob_store_t * restrict store, const void * restrict data, size_t size, unsigned char * restrict digest);
+
+bool pigeon_blob_store_contains(pigeon_blob_store_t * restrict store, const unsigned char digest[PIGEON_SHA256_DIGEST_SIZE]);
+
+// Returns false if the blob is missing or cannot be mapped.
+bool pigeon_blob_store_get(pigeon_blob_store_t * restrict store, const unsigned char digest[PIGEON_SHA256_DIGEST_SIZE], pigeon_blob_t * restrict blob);
+
+void pigeon_blob_release(pigeon_blob_store_t * restrict store, pigeon_blob_t * restrict blob);
+
+// Copies a blob to the heap, for callers that need to keep or modify it.
+// The result is freed with pigeon_free; a size 0 blob still returns a buffer.
+void * pigeon_blob_store_read(pigeon_blob_store_t * restrict store, const unsigned char digest[PIGEON_SHA256_DIGEST_SIZE], size_t * restrict size);
+
+// Decodes the digest of a '&sha256:...' field. Returns false for any other
+// field type or encoding.
+bool pigeon_blob_field_digest(const pigeon_field_t * restrict field, unsigned char digest[PIGEON_SHA256_DIGEST_SIZE]);
+
+// Maps the blob a field refers to; nothing is loaded until this is called.
+bool pigeon_blob_resolve_field(pigeon_blob_store_t * restrict store, const pigeon_field_t * restrict field, pigeon_blob_t * restrict blob);
+
+#endif
@@ -0,0 +1,451 @@
+#include "pigeon_chain.h"
+#include "pigeon_hash.h"
+#include "pigeon_log.h"
+#include "pigeon_map.h"
+#include "pigeon_memory.h"
+#include "pigeon_parser.h"
+#include "pigeon_seen_filter.h"
+#include "pigeon_sha256.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PIGEON_CHAIN_READ_BUFFER (1 << 20)
+#define PIGEON_CHAIN_BATCH_BYTES (256 * 1024)
+#define PIGEON_CHAIN_BATCH_ENTRIES 2048
+#define PIGEON_CHAIN_BATCHES 4 // per worker
+
+typedef struct {
+    int32_t sequence;
+    int64_t timestamp;
+    unsigned char digest[PIGEON_SHA256_DIGEST_SIZE];
+} pigeon_chain_feed_t;
+
+typedef struct {
+    uint64_t offset;
+    uint32_t start;
+    uint32_t size;
+    uint32_t path;
+} pigeon_chain_entry_t;
+
+typedef struct {
+    char * data;
+    size_t size;
+    size_t capacity;
+
+    pigeon_chain_entry_t entries[PIGEON_CHAIN_BATCH_ENTRIES];
+    size_t count;
+} pigeon_chain_batch_t;
+
+typedef struct pigeon_chain_shared_t pigeon_chain_shared_t;
+
+typedef struct {
+    pigeon_chain_shared_t * shared;
+    pthread_t thread;
+
+    pigeon_parse_context_t ctx;
+    pigeon_map_t feeds; // pigeon_encoded_value_key of the author -> feed
+    pigeon_string_t author_key;
+    uint64_t issues;
+
+    // Batches cycle between the free stack, filled by nobody, and the
+    // full ring, which the reader fills and this worker drains.
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pigeon_chain_batch_t batches[PIGEON_CHAIN_BATCHES];
+    pigeon_chain_batch_t * free_batches[PIGEON_CHAIN_BATCHES];
+    size_t free_count;
+    pigeon_chain_batch_t * full_batches[PIGEON_CHAIN_BATCHES];
+    size_t full_first;
+    size_t full_count;
+    bool done;
+} pigeon_chain_worker_t;
+
+struct pigeon_chain_shared_t {
+    const pigeon_chain_options_t * options;
+    const char * const * paths;
+    pthread_mutex_t report_lock;
+};
+
+static void pigeon_chain_error(pigeon_chain_result_t * restrict result, const char * format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(result->error_messages, sizeof(result->error_messages), format, ap);
+    va_end(ap);
+}
+
+static void pigeon_chain_report(pigeon_chain_shared_t * restrict shared, uint64_t * restrict issues, uint32_t path, uint64_t offset, pigeon_chain_issue_t issue, const char * format, ...)
+{
+    ++*issues;
+    if (!shared->options->report)
+        return;
+
+    char details[256];
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(details, sizeof(details), format, ap);
+    va_end(ap);
+
+    pthread_mutex_lock(&shared->report_lock);
+    shared->options->report(shared->options->user_data, shared->paths[path], offset, issue, details);
+    pthread_mutex_unlock(&shared->report_lock);
+}
+
+static bool pigeon_chain_skip_field(void * user_data, const pigeon_parsed_message_t * header, const pigeon_field_t * field)
+{
+    (void)user_data;
+    (void)header;
+    (void)field;
+    return true;
+}
+
+static bool pigeon_chain_check(pigeon_chain_worker_t * restrict worker, uint32_t path, uint64_t offset, const char * restrict data, size_t size)
+{
+    const pigeon_chain_options_t * options = worker->shared->options;
+
+    // Only the header is needed; data fields are checked but not kept
+    pigeon_parsed_message_t message;
+    if (!pigeon_visit_message(&worker->ctx, data, (pigeon_message_size_t)size, &message, pigeon_chain_skip_field, NULL))
+    {
+        const char * error = pigeon_get_error_messages(&worker->ctx);
+        pigeon_chain_report(worker->shared, &worker->issues, path, offset, PIGEON_CHAIN_PARSE_ERROR, "%.*s", (int)strcspn(error, "\n"), error);
+        pigeon_free_parsed_message(&message);
+        return true;
+    }
+
+    const char * author = pigeon_encoded_value_key(&message.author, &worker->author_key);
+    bool inserted;
+    void ** slot = author ? pigeon_map_insert(&worker->feeds, author, &inserted) : NULL;
+    if (!slot)
+    {
+        pigeon_free_parsed_message(&message);
+        return false;
+    }
+
+    pigeon_chain_feed_t * feed = *slot;
+    if (inserted)
+    {
+        feed = *slot = pigeon_malloc(sizeof(pigeon_chain_feed_t));
+        if (!feed)
+        {
+            pigeon_free_parsed_message(&message);
+            return false;
+        }
+    }
+
+    int32_t sequence = message.sequence_number;
+    bool link = !inserted && sequence == feed->sequence + 1;
+    if (inserted && sequence != 1 && !options->allow_partial)
+        pigeon_chain_report(worker->shared, &worker->issues, path, offset, PIGEON_CHAIN_FEED_START, "@%s starts at sequence %d", author, sequence);
+    else if (!inserted && sequence <= feed->sequence)
+    {
+        pigeon_chain_report(worker->shared, &worker->issues, path, offset, PIGEON_CHAIN_SEQUENCE_REPEAT, "@%s sequence %d after %d", author, sequence, feed->sequence);
+        pigeon_free_parsed_message(&message);
+        return true;
+    }
+    else if (!inserted && !link)
+        pigeon_chain_report(worker->shared, &worker->issues, path, offset, PIGEON_CHAIN_SEQUENCE_GAP, "@%s sequence %d after %d", author, sequence, feed->sequence);
+
+    // The first message of a feed has no previous digest to check
+    unsigned char previous[PIGEON_SHA256_DIGEST_SIZE];
+    bool has_previous = sequence > 1 && message.previous.encoding_type == PIGEON_ENCODING_TYPE_SHA256
+        && message.previous.hash && pigeon_sha256_decode(message.previous.hash, previous);
+    if (sequence > 1 && !has_previous)
+        pigeon_chain_report(worker->shared, &worker->issues, path, offset, PIGEON_CHAIN_PREVIOUS_INVALID, "@%s sequence %d", author, sequence);
+    else if (link && has_previous && memcmp(previous, feed->digest, sizeof(previous)) != 0)
+        pigeon_chain_report(worker->shared, &worker->issues, path, offset, PIGEON_CHAIN_PREVIOUS_MISMATCH, "@%s sequence %d does not follow sequence %d", author, sequence, feed->sequence);
+
+    if (link && message.timestamp < feed->timestamp)
+        pigeon_chain_report(worker->shared, &worker->issues, path, offset, PIGEON_CHAIN_TIMESTAMP_REGRESSION, "@%s sequence %d at %lld, before %lld", author, sequence, (long long)message.timestamp, (long long)feed->timestamp);
+
+    feed->sequence = sequence;
+    feed->timestamp = message.timestamp;
+    pigeon_sha256(data, size, feed->digest);
+
+    pigeon_free_parsed_message(&message);
+    return true;
+}
+
+static pigeon_chain_batch_t * pigeon_chain_take_full(pigeon_chain_worker_t * restrict worker)
+{
+    pthread_mutex_lock(&worker->lock);
+    while (worker->full_count == 0 && !worker->done)
+        pthread_cond_wait(&worker->changed, &worker->lock);
+
+    pigeon_chain_batch_t * batch = NULL;
+    if (worker->full_count > 0)
+    {
+        batch = worker->full_batches[worker->full_first];
+        worker->full_first = (worker->full_first + 1) % PIGEON_CHAIN_BATCHES;
+        --worker->full_count;
+    }
+
+    pthread_mutex_unlock(&worker->lock);
+    return batch;
+}
+
+static void pigeon_chain_give_free(pigeon_chain_worker_t * restrict worker, pigeon_chain_batch_t * restrict batch)
+{
+    batch->size = 0;
+    batch->count = 0;
+
+    pthread_mutex_lock(&worker->lock);
+    worker->free_batches[worker->free_count++] = batch;
+    pthread_cond_broadcast(&worker->changed);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+static void * pigeon_chain_worker(void * arg)
+{
+    pigeon_chain_worker_t * worker = arg;
+    bool healthy = true;
+
+    pigeon_chain_batch_t * batch;
+    while ((batch = pigeon_chain_take_full(worker)) != NULL)
+    {
+        for (size_t i = 0; healthy && i < batch->count; ++i)
+        {
+            const pigeon_chain_entry_t * entry = &batch->entries[i];
+            healthy = pigeon_chain_check(worker, entry->path, entry->offset, batch->data + entry->start, entry->size);
+        }
+
+        pigeon_chain_give_free(worker, batch);
+    }
+
+    return healthy ? worker : NULL;
+}
+
+static pigeon_chain_batch_t * pigeon_chain_take_free(pigeon_chain_worker_t * restrict worker)
+{
+    pthread_mutex_lock(&worker->lock);
+    while (worker->free_count == 0)
+        pthread_cond_wait(&worker->changed, &worker->lock);
+
+    pigeon_chain_batch_t * batch = worker->free_batches[--worker->free_count];
+    pthread_mutex_unlock(&worker->lock);
+    return batch;
+}
+
+static void pigeon_chain_give_full(pigeon_chain_worker_t * restrict worker, pigeon_chain_batch_t * restrict batch)
+{
+    pthread_mutex_lock(&worker->lock);
+    worker->full_batches[(worker->full_first + worker->full_count) % PIGEON_CHAIN_BATCHES] = batch;
+    ++worker->full_count;
+    pthread_cond_broadcast(&worker->changed);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+static void pigeon_chain_finish(pigeon_chain_worker_t * restrict worker)
+{
+    pthread_mutex_lock(&worker->lock);
+    worker->done = true;
+    pthread_cond_broadcast(&worker->changed);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+// Picks a worker from the author read off the message text, without
+// parsing. The hash is the one of the feed map key, so every message of a
+// feed reaches the same worker however its author line is spaced.
+static size_t pigeon_chain_route(const char * restrict data, size_t size, size_t worker_count)
+{
+    uint64_t hash;
+    if (!pigeon_message_author_key(data, size, &hash))
+        return 0; // the parser rejects it on any worker
+
+    return (size_t)(pigeon_hash_mix(hash) % worker_count);
+}
+
+static bool pigeon_chain_batch_append(pigeon_chain_batch_t * restrict batch, uint32_t path, uint64_t offset, const char * restrict data, size_t size)
+{
+    if (batch->capacity - batch->size < size)
+    {
+        char * grown = pigeon_realloc(batch->data, batch->size + size);
+        if (!grown)
+            return false;
+
+        batch->data = grown;
+        batch->capacity = batch->size + size;
+    }
+
+    pigeon_chain_entry_t * entry = &batch->entries[batch->count++];
+    entry->offset = offset;
+    entry->start = (uint32_t)batch->size;
+    entry->size = (uint32_t)size;
+    entry->path = path;
+
+    memcpy(batch->data + batch->size, data, size);
+    batch->size += size;
+    return true;
+}
+
+static bool pigeon_chain_worker_init(pigeon_chain_worker_t * restrict worker, pigeon_chain_shared_t * shared)
+{
+    memset(worker, 0, sizeof(*worker));
+    worker->shared = shared;
+    pthread_mutex_init(&worker->lock, NULL);
+    pthread_cond_init(&worker->changed, NULL);
+
+    for (size_t i = 0; i < PIGEON_CHAIN_BATCHES; ++i)
+    {
+        pigeon_chain_batch_t * batch = &worker->batches[i];
+        batch->capacity = PIGEON_CHAIN_BATCH_BYTES;
+        batch->data = pigeon_malloc(batch->capacity);
+        if (!batch->data)
+            return false;
+
+        worker->free_batches[worker->free_count++] = batch;
+    }
+
+    return pigeon_map_init(&worker->feeds, 64);
+}
+
+static void pigeon_chain_worker_free(pigeon_chain_worker_t * restrict worker)
+{
+    for (size_t i = 0; i < PIGEON_CHAIN_BATCHES; ++i)
+        pigeon_free(worker->batches[i].data);
+
+    if (worker->feeds.entries)
+        pigeon_map_free(&worker->feeds, pigeon_free);
+    pigeon_string_free(&worker->author_key);
+    pthread_cond_destroy(&worker->changed);
+    pthread_mutex_destroy(&worker->lock);
+}
+
+bool pigeon_chain_validate(const char * const * paths, size_t path_count, const pigeon_chain_options_t * restrict options, pigeon_chain_result_t * restrict result)
+{
+    memset(result, 0, sizeof(*result));
+
+    pigeon_chain_shared_t shared;
+    shared.options = options;
+    shared.paths = paths;
+    pthread_mutex_init(&shared.report_lock, NULL);
+
+    size_t worker_count = options->threads > 1 ? options->threads : 1;
+    bool threaded = worker_count > 1;
+    pigeon_chain_worker_t * workers = pigeon_malloc(worker_count * sizeof(pigeon_chain_worker_t));
+    if (!workers)
+    {
+        pigeon_chain_error(result, "memory allocation failed");
+        pthread_mutex_destroy(&shared.report_lock);
+        return false;
+    }
+
+    bool success = true;
+    size_t initialized = 0;
+    for (; success && initialized < worker_count; ++initialized)
+        success = pigeon_chain_worker_init(&workers[initialized], &shared);
+
+    // Only threads that were created are joined
+    size_t started = 0;
+    while (success && threaded && started < worker_count)
+    {
+        success = pthread_create(&workers[started].thread, NULL, pigeon_chain_worker, &workers[started]) == 0;
+        if (success)
+            ++started;
+    }
+
+    if (!success)
+        pigeon_chain_error(result, "could not start %zu workers", worker_count);
+
+    // Batches being filled, one per worker
+    pigeon_chain_batch_t * filling[worker_count];
+    memset(filling, 0, sizeof(filling));
+
+    pigeon_log_reader_t reader;
+    memset(&reader, 0, sizeof(reader));
+    for (size_t p = 0; success && p < path_count; ++p)
+    {
+        bool is_stdin = strcmp(paths[p], "-") == 0;
+        int fd = is_stdin ? STDIN_FILENO : open(paths[p], O_RDONLY);
+        if (fd < 0)
+        {
+            pigeon_chain_error(result, "%s: %s", paths[p], strerror(errno));
+            success = false;
+            break;
+        }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+        if (!pigeon_log_reader_init(&reader, fd, PIGEON_CHAIN_READ_BUFFER))
+        {
+            pigeon_chain_error(result, "memory allocation failed");
+            success = false;
+        }
+
+        const char * msg_data;
+        size_t msg_size;
+        uint64_t msg_offset;
+        pigeon_log_status_t status = PIGEON_LOG_END;
+        while (success && (status = pigeon_log_reader_next(&reader, &msg_data, &msg_size, &msg_offset)) == PIGEON_LOG_MESSAGE)
+        {
+            ++result->messages;
+            if (!threaded)
+            {
+                success = pigeon_chain_check(&workers[0], (uint32_t)p, msg_offset, msg_data, msg_size);
+                continue;
+            }
+
+            size_t target = pigeon_chain_route(msg_data, msg_size, worker_count);
+            pigeon_chain_batch_t * batch = filling[target];
+            if (batch && (batch->count == PIGEON_CHAIN_BATCH_ENTRIES || (batch->count > 0 && batch->capacity - batch->size < msg_size)))
+            {
+                pigeon_chain_give_full(&workers[target], batch);
+                batch = NULL;
+            }
+
+            if (!batch)
+                batch = filling[target] = pigeon_chain_take_free(&workers[target]);
+
+            success = pigeon_chain_batch_append(batch, (uint32_t)p, msg_offset, msg_data, msg_size);
+        }
+
+        if (!success && result->error_messages[0] == '\0')
+            pigeon_chain_error(result, "memory allocation failed");
+        else if (status == PIGEON_LOG_ERROR)
+        {
+            pigeon_chain_error(result, "%s: read error", paths[p]);
+            success = false;
+        }
+        else if (reader.buffer && pigeon_log_reader_pending(&reader) > 0)
+            pigeon_chain_report(&shared, &result->issues, (uint32_t)p, reader.offset, PIGEON_CHAIN_INCOMPLETE, "%zu bytes", pigeon_log_reader_pending(&reader));
+
+        result->bytes += reader.offset + (reader.buffer ? pigeon_log_reader_pending(&reader) : 0);
+        pigeon_log_reader_free(&reader);
+        if (!is_stdin)
+            close(fd);
+    }
+
+    for (size_t w = 0; w < started; ++w)
+    {
+        if (filling[w] && filling[w]->count > 0)
+            pigeon_chain_give_full(&workers[w], filling[w]);
+        pigeon_chain_finish(&workers[w]);
+
+        void * status;
+        pthread_join(workers[w].thread, &status);
+        if (!status && success)
+        {
+            pigeon_chain_error(result, "memory allocation failed");
+            success = false;
+        }
+    }
+
+    for (size_t w = 0; w < initialized; ++w)
+    {
+        result->authors += workers[w].feeds.count;
+        result->issues += workers[w].issues;
+        pigeon_chain_worker_free(&workers[w]);
+    }
+
+    pigeon_free(workers);
+    pthread_mutex_destroy(&shared.report_lock);
+    return success;
+}
@@ -0,0 +1,70 @@
+#ifndef PIGEON_CHAIN_H
+#define PIGEON_CHAIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Feed integrity checks over whole logs. For every author, sequence numbers
+// must count up by one, each message's previous header must be the SHA-256
+// of the author's prior message (its exact bytes in the log, signature line
+// included) and timestamps must not go backwards.
+//
+// Messages are routed to worker threads by author, so each feed is checked
+// in log order by a single thread; only the last message's sequence,
+// timestamp and digest are kept per author.
+
+typedef enum {
+    PIGEON_CHAIN_PARSE_ERROR,
+    PIGEON_CHAIN_FEED_START,           // first message of a feed is not sequence 1
+    PIGEON_CHAIN_SEQUENCE_GAP,
+    PIGEON_CHAIN_SEQUENCE_REPEAT,      // sequence at or below one already seen
+    PIGEON_CHAIN_PREVIOUS_INVALID,     // not a sha256 digest in hex or base64
+    PIGEON_CHAIN_PREVIOUS_MISMATCH,
+    PIGEON_CHAIN_TIMESTAMP_REGRESSION,
+    PIGEON_CHAIN_INCOMPLETE            // truncated message at the end of a file
+} pigeon_chain_issue_t;
+
+static inline const char * pigeon_chain_issue_name(pigeon_chain_issue_t issue)
+{
+    switch (issue)
+    {
+        case PIGEON_CHAIN_PARSE_ERROR: return "parse-error";
+        case PIGEON_CHAIN_FEED_START: return "feed-start";
+        case PIGEON_CHAIN_SEQUENCE_GAP: return "sequence-gap";
+        case PIGEON_CHAIN_SEQUENCE_REPEAT: return "sequence-repeat";
+        case PIGEON_CHAIN_PREVIOUS_INVALID: return "previous-invalid";
+        case PIGEON_CHAIN_PREVIOUS_MISMATCH: return "previous-mismatch";
+        case PIGEON_CHAIN_TIMESTAMP_REGRESSION: return "timestamp-regression";
+        case PIGEON_CHAIN_INCOMPLETE: return "incomplete";
+    }
+
+    return "unknown";
+}
+
+// Called once per issue; calls are serialized but may come from any worker.
+typedef void (*pigeon_chain_report_t)(void * user_data, const char * path, uint64_t offset, pigeon_chain_issue_t issue, const char * details);
+
+typedef struct {
+    unsigned threads;      // 0 or 1 checks on the calling thread
+    bool allow_partial;    // feeds may start past sequence 1, as in a trimmed snapshot
+    pigeon_chain_report_t report;
+    void * user_data;
+} pigeon_chain_options_t;
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t messages;
+    uint64_t authors;
+    uint64_t issues;
+
+    char error_messages[256];
+} pigeon_chain_result_t;
+
+// Reads the paths in order as one stream ("-" is stdin), so a feed may
+// continue from one file into the next. Returns false on an I/O or memory
+// error, described in result->error_messages; integrity problems are only
+// reported and counted.
+bool pigeon_chain_validate(const char * const * paths, size_t path_count, const pigeon_chain_options_t * restrict options, pigeon_chain_result_t * restrict result);
+
+#endif
@@ -0,0 +1,707 @@
+#include "pigeon_columnar.h"
+#include "pigeon_memory.h"
+#include "pigeon_string.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Column file layout, in native byte order:
+//
+//     0   magic "PGNCOL01"
+//     8   uint32 column type
+//     12  uint32 rows per block
+//     16  uint64 row count
+//     24  uint64 block count
+//     32  uint64 offset of the block statistics
+//     64  values, followed by the statistics (int64 min/max per block)
+
+static const char column_magic[8] = { 'P', 'G', 'N', 'C', 'O', 'L', '0', '1' };
+
+#define PIGEON_COLUMN_HEADER_SIZE 64
+#define PIGEON_COLUMN_FIELD_OVERFLOW_BIT (PIGEON_COLUMN_MAX_FIELD_BITS - 1)
+
+#if defined(__GNUC__)
+#define PIGEON_COLUMN_VECTORS 1
+typedef int64_t pigeon_v4i64_t __attribute__((vector_size(32)));
+typedef int32_t pigeon_v8i32_t __attribute__((vector_size(32)));
+typedef uint32_t pigeon_v8u32_t __attribute__((vector_size(32)));
+typedef uint64_t pigeon_v4u64_t __attribute__((vector_size(32)));
+#endif
+
+static void pigeon_columnar_error(pigeon_columnar_writer_t * restrict writer, const char * format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(writer->error_messages, sizeof(writer->error_messages), format, ap);
+    va_end(ap);
+}
+
+static inline size_t pigeon_column_value_size(pigeon_column_type_t type)
+{
+    switch (type)
+    {
+        case PIGEON_COLUMN_INT64:
+        case PIGEON_COLUMN_BITMAP64:
+            return 8;
+
+        default:
+            return 4;
+    }
+}
+
+static char * pigeon_column_path(const char * restrict directory, const char * restrict name)
+{
+    size_t directory_length = strlen(directory);
+    size_t name_length = strlen(name);
+    char * path = pigeon_malloc(directory_length + name_length + 2);
+    if (!path)
+        return NULL;
+
+    memcpy(path, directory, directory_length);
+    path[directory_length] = '/';
+    memcpy(path + directory_length + 1, name, name_length + 1);
+    return path;
+}
+
+static FILE * pigeon_column_create_file(pigeon_columnar_writer_t * restrict writer, const char * restrict directory, const char * restrict name)
+{
+    char * path = pigeon_column_path(directory, name);
+    FILE * file = path ? fopen(path, "wb") : NULL;
+    if (!file)
+        pigeon_columnar_error(writer, "unable to create '%s/%s': %s", directory, name, strerror(errno));
+
+    pigeon_free(path);
+    return file;
+}
+
+static bool pigeon_column_writer_open(pigeon_columnar_writer_t * restrict writer, pigeon_column_writer_t * restrict column, const char * restrict directory, const char * restrict name, pigeon_column_type_t type)
+{
+    memset(column, 0, sizeof(*column));
+    column->type = type;
+
+    column->file = pigeon_column_create_file(writer, directory, name);
+    if (!column->file)
+        return false;
+
+    setvbuf(column->file, NULL, _IOFBF, 1 << 20);
+
+    // The header is rewritten with the final counts on close
+    char header[PIGEON_COLUMN_HEADER_SIZE] = { 0 };
+    if (fwrite(header, 1, sizeof(header), column->file) != sizeof(header))
+    {
+        pigeon_columnar_error(writer, "write to '%s' failed", name);
+        return false;
+    }
+
+    return true;
+}
+
+static bool pigeon_column_writer_end_block(pigeon_column_writer_t * restrict column)
+{
+    if (column->block_fill == 0)
+        return true;
+
+    if (column->stats_count + 2 > column->stats_capacity)
+    {
+        size_t new_capacity = column->stats_capacity != 0 ? column->stats_capacity * 2 : 64;
+        int64_t * stats = pigeon_realloc(column->stats, new_capacity * sizeof(*stats));
+        if (!stats)
+            return false;
+
+        column->stats = stats;
+        column->stats_capacity = new_capacity;
+    }
+
+    column->stats[column->stats_count++] = column->block_min;
+    column->stats[column->stats_count++] = column->block_max;
+    column->block_fill = 0;
+    return true;
+}
+
+static bool pigeon_column_writer_append(pigeon_column_writer_t * restrict column, int64_t value)
+{
+    if (column->block_fill == 0)
+        column->block_min = column->block_max = value;
+    else if (column->type == PIGEON_COLUMN_BITMAP64)
+    {
+        column->block_min &= value;
+        column->block_max |= value;
+    }
+    else
+    {
+        if (value < column->block_min)
+            column->block_min = value;
+        if (value > column->block_max)
+            column->block_max = value;
+    }
+
+    bool written;
+    switch (column->type)
+    {
+        case PIGEON_COLUMN_INT32:
+        {
+            int32_t narrow = (int32_t)value;
+            written = fwrite(&narrow, sizeof(narrow), 1, column->file) == 1;
+            break;
+        }
+
+        case PIGEON_COLUMN_UINT32:
+        {
+            uint32_t narrow = (uint32_t)value;
+            written = fwrite(&narrow, sizeof(narrow), 1, column->file) == 1;
+            break;
+        }
+
+        default:
+            written = fwrite(&value, sizeof(value), 1, column->file) == 1;
+            break;
+    }
+
+    if (!written)
+        return false;
+
+    ++column->row_count;
+    if (++column->block_fill == PIGEON_COLUMN_BLOCK_ROWS)
+        return pigeon_column_writer_end_block(column);
+
+    return true;
+}
+
+static bool pigeon_column_writer_close(pigeon_column_writer_t * restrict column)
+{
+    if (!column->file)
+        return false;
+
+    bool success = pigeon_column_writer_end_block(column);
+
+    // Statistics start on an 8-byte boundary after the values
+    uint64_t data_size = column->row_count * pigeon_column_value_size(column->type);
+    uint64_t stats_offset = PIGEON_COLUMN_HEADER_SIZE + ((data_size + 7) & ~(uint64_t)7);
+    static const char padding[8] = { 0 };
+    size_t padding_size = stats_offset - PIGEON_COLUMN_HEADER_SIZE - data_size;
+
+    success = success
+        && fwrite(padding, 1, padding_size, column->file) == padding_size
+        && fwrite(column->stats, sizeof(int64_t), column->stats_count, column->file) == column->stats_count;
+
+    char header[PIGEON_COLUMN_HEADER_SIZE] = { 0 };
+    uint32_t type = column->type;
+    uint32_t block_rows = PIGEON_COLUMN_BLOCK_ROWS;
+    uint64_t block_count = column->stats_count / 2;
+    memcpy(header, column_magic, sizeof(column_magic));
+    memcpy(header + 8, &type, sizeof(type));
+    memcpy(header + 12, &block_rows, sizeof(block_rows));
+    memcpy(header + 16, &column->row_count, sizeof(column->row_count));
+    memcpy(header + 24, &block_count, sizeof(block_count));
+    memcpy(header + 32, &stats_offset, sizeof(stats_offset));
+
+    success = success
+        && fseek(column->file, 0, SEEK_SET) == 0
+        && fwrite(header, 1, sizeof(header), column->file) == sizeof(header);
+
+    if (fclose(column->file) != 0)
+        success = false;
+
+    column->file = NULL;
+    pigeon_free(column->stats);
+    column->stats = NULL;
+    return success;
+}
+
+static bool pigeon_dictionary_open(pigeon_columnar_writer_t * restrict writer, pigeon_column_dictionary_t * restrict dict, const char * restrict directory, const char * restrict name)
+{
+    memset(dict, 0, sizeof(*dict));
+    if (!pigeon_map_init(&dict->ids, 1024))
+    {
+        pigeon_columnar_error(writer, "memory allocation failed");
+        return false;
+    }
+
+    dict->file = pigeon_column_create_file(writer, directory, name);
+    return dict->file != NULL;
+}
+
+static bool pigeon_dictionary_lookup(pigeon_column_dictionary_t * restrict dict, const char * restrict key, uint32_t * restrict id)
+{
+    bool inserted;
+    void ** slot = pigeon_map_insert(&dict->ids, key, &inserted);
+    if (!slot)
+        return false;
+
+    if (!inserted)
+    {
+        *id = (uint32_t)(uintptr_t)*slot;
+        return true;
+    }
+
+    if (fprintf(dict->file, "%s\n", key) < 0)
+    {
+        pigeon_map_remove(&dict->ids, key, NULL);
+        return false;
+    }
+
+    *slot = (void *)(uintptr_t)dict->count;
+    *id = dict->count++;
+    return true;
+}
+
+static bool pigeon_dictionary_close(pigeon_column_dictionary_t * restrict dict)
+{
+    pigeon_map_free(&dict->ids, NULL);
+
+    bool success = dict->file != NULL && fclose(dict->file) == 0;
+    dict->file = NULL;
+    return success;
+}
+
+bool pigeon_columnar_writer_open(pigeon_columnar_writer_t * restrict writer, const char * restrict directory)
+{
+    memset(writer, 0, sizeof(*writer));
+
+    if (mkdir(directory, 0777) != 0 && errno != EEXIST)
+    {
+        pigeon_columnar_error(writer, "unable to create directory '%s': %s", directory, strerror(errno));
+        return false;
+    }
+
+    bool success = pigeon_column_writer_open(writer, &writer->timestamp, directory, "timestamp.col", PIGEON_COLUMN_INT64)
+        && pigeon_column_writer_open(writer, &writer->sequence, directory, "sequence.col", PIGEON_COLUMN_INT32)
+        && pigeon_column_writer_open(writer, &writer->author, directory, "author.col", PIGEON_COLUMN_UINT32)
+        && pigeon_column_writer_open(writer, &writer->kind, directory, "kind.col", PIGEON_COLUMN_UINT32)
+        && pigeon_column_writer_open(writer, &writer->fields, directory, "fields.col", PIGEON_COLUMN_BITMAP64)
+        && pigeon_dictionary_open(writer, &writer->authors, directory, "author.dict")
+        && pigeon_dictionary_open(writer, &writer->kinds, directory, "kind.dict")
+        && pigeon_dictionary_open(writer, &writer->field_names, directory, "fields.dict");
+
+    if (!success)
+    {
+        char error_messages[sizeof(writer->error_messages)];
+        memcpy(error_messages, writer->error_messages, sizeof(error_messages));
+        pigeon_columnar_writer_close(writer);
+        memcpy(writer->error_messages, error_messages, sizeof(error_messages));
+    }
+
+    return success;
+}
+
+bool pigeon_columnar_writer_append(pigeon_columnar_writer_t * restrict writer, const pigeon_parsed_message_t * restrict message)
+{
+    const char * author = pigeon_encoded_value_key(&message->author, &writer->author_key);
+
+    uint32_t author_id;
+    uint32_t kind_id;
+    if (!author
+        || !pigeon_dictionary_lookup(&writer->authors, author, &author_id)
+        || !pigeon_dictionary_lookup(&writer->kinds, message->kind ? message->kind : "", &kind_id))
+    {
+        pigeon_columnar_error(writer, "unable to update dictionary");
+        return false;
+    }
+
+    uint64_t field_bits = 0;
+    const pigeon_field_t * field = pigeon_list_head((pigeon_list_t *)&message->fields);
+    for (; field != NULL; field = pigeon_list_next((void *)field))
+    {
+        uint32_t field_id;
+        // The parser leaves an empty field name NULL
+        if (!pigeon_dictionary_lookup(&writer->field_names, field->field_name ? field->field_name : "", &field_id))
+        {
+            pigeon_columnar_error(writer, "unable to update dictionary");
+            return false;
+        }
+
+        field_bits |= 1ull << (field_id < PIGEON_COLUMN_FIELD_OVERFLOW_BIT ? field_id : PIGEON_COLUMN_FIELD_OVERFLOW_BIT);
+    }
+
+    bool success = pigeon_column_writer_append(&writer->timestamp, message->timestamp)
+        && pigeon_column_writer_append(&writer->sequence, message->sequence_number)
+        && pigeon_column_writer_append(&writer->author, author_id)
+        && pigeon_column_writer_append(&writer->kind, kind_id)
+        && pigeon_column_writer_append(&writer->fields, (int64_t)field_bits);
+
+    if (!success)
+        pigeon_columnar_error(writer, "column write failed");
+
+    return success;
+}
+
+bool pigeon_columnar_writer_close(pigeon_columnar_writer_t * restrict writer)
+{
+    bool success = true;
+    pigeon_column_writer_t * columns[] = { &writer->timestamp, &writer->sequence, &writer->author, &writer->kind, &writer->fields };
+    for (size_t i = 0; i < sizeof(columns) / sizeof(columns[0]); ++i)
+        if (!pigeon_column_writer_close(columns[i]))
+            success = false;
+
+    pigeon_column_dictionary_t * dictionaries[] = { &writer->authors, &writer->kinds, &writer->field_names };
+    for (size_t i = 0; i < sizeof(dictionaries) / sizeof(dictionaries[0]); ++i)
+        if (!pigeon_dictionary_close(dictionaries[i]))
+            success = false;
+
+    pigeon_string_free(&writer->author_key);
+
+    if (!success)
+        pigeon_columnar_error(writer, "unable to finish column files");
+
+    return success;
+}
+
+bool pigeon_column_open(pigeon_column_t * restrict column, const char * restrict path)
+{
+    memset(column, 0, sizeof(*column));
+    column->fd = open(path, O_RDONLY);
+    if (column->fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(column->fd, &st) != 0 || st.st_size < PIGEON_COLUMN_HEADER_SIZE)
+        goto error;
+
+    column->map_size = st.st_size;
+    column->map = mmap(NULL, column->map_size, PROT_READ, MAP_SHARED, column->fd, 0);
+    if (column->map == MAP_FAILED)
+    {
+        column->map = NULL;
+        goto error;
+    }
+
+    const char * header = column->map;
+    uint32_t type;
+    uint64_t block_count;
+    uint64_t stats_offset;
+    memcpy(&type, header + 8, sizeof(type));
+    memcpy(&column->block_rows, header + 12, sizeof(column->block_rows));
+    memcpy(&column->row_count, header + 16, sizeof(column->row_count));
+    memcpy(&block_count, header + 24, sizeof(block_count));
+    memcpy(&stats_offset, header + 32, sizeof(stats_offset));
+
+    column->type = type;
+    column->block_count = (uint32_t)block_count;
+
+    if (0 != memcmp(header, column_magic, sizeof(column_magic))
+        || type > PIGEON_COLUMN_BITMAP64
+        || column->block_rows == 0
+        || block_count != (column->row_count + column->block_rows - 1) / column->block_rows
+        || stats_offset < PIGEON_COLUMN_HEADER_SIZE + column->row_count * pigeon_column_value_size(column->type)
+        || stats_offset + block_count * 2 * sizeof(int64_t) > column->map_size)
+        goto error;
+
+    column->data = header + PIGEON_COLUMN_HEADER_SIZE;
+    column->stats = (const int64_t *)(header + stats_offset);
+    madvise(column->map, column->map_size, MADV_SEQUENTIAL);
+    return true;
+
+error:
+    pigeon_column_close(column);
+    return false;
+}
+
+void pigeon_column_close(pigeon_column_t * restrict column)
+{
+    if (column->map)
+        munmap(column->map, column->map_size);
+    if (column->fd >= 0)
+        close(column->fd);
+
+    column->map = NULL;
+    column->fd = -1;
+}
+
+bool pigeon_column_dictionary_load(const char * restrict path, char *** restrict entries, size_t * restrict count)
+{
+    FILE * file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    char ** list = NULL;
+    size_t list_count = 0;
+    size_t list_capacity = 0;
+
+    pigeon_string_t line;
+    pigeon_string_init(&line);
+
+    bool success = true;
+    int ch;
+    while (success && (ch = fgetc(file)) != EOF)
+    {
+        if (ch != '\n')
+        {
+            success = pigeon_string_append_ch(&line, (char)ch);
+            continue;
+        }
+
+        if (list_count == list_capacity)
+        {
+            size_t new_capacity = list_capacity != 0 ? list_capacity * 2 : 64;
+            char ** new_list = pigeon_realloc(list, new_capacity * sizeof(char *));
+            if (!new_list)
+            {
+                success = false;
+                break;
+            }
+
+            list = new_list;
+            list_capacity = new_capacity;
+        }
+
+        const char * cstr = pigeon_string_cstr(&line);
+        list[list_count] = cstr ? pigeon_strdup_range(cstr, line.length) : NULL;
+        success = list[list_count++] != NULL;
+        pigeon_string_clear(&line);
+    }
+
+    pigeon_string_free(&line);
+    fclose(file);
+
+    if (!success)
+    {
+        pigeon_column_dictionary_entries_free(list, list_count);
+        return false;
+    }
+
+    *entries = list;
+    *count = list_count;
+    return true;
+}
+
+void pigeon_column_dictionary_entries_free(char ** entries, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        pigeon_free(entries[i]);
+
+    pigeon_free(entries);
+}
+
+static inline size_t pigeon_column_block_size(const pigeon_column_t * restrict column, size_t block)
+{
+    uint64_t first = (uint64_t)block * column->block_rows;
+    uint64_t remaining = column->row_count - first;
+    return remaining < column->block_rows ? (size_t)remaining : column->block_rows;
+}
+
+static uint64_t pigeon_count_range_i64(const int64_t * restrict values, size_t count, int64_t low, int64_t high)
+{
+    uint64_t total = 0;
+    size_t i = 0;
+
+#ifdef PIGEON_COLUMN_VECTORS
+    pigeon_v4i64_t vlow = { low, low, low, low };
+    pigeon_v4i64_t vhigh = { high, high, high, high };
+    pigeon_v4i64_t matches = { 0 };
+    for (; i + 4 <= count; i += 4)
+    {
+        pigeon_v4i64_t v;
+        memcpy(&v, values + i, sizeof(v));
+        matches += (v >= vlow) & (v < vhigh); // true lanes are -1
+    }
+
+    total = -(matches[0] + matches[1] + matches[2] + matches[3]);
+#endif
+
+    for (; i < count; ++i)
+        total += values[i] >= low && values[i] < high;
+
+    return total;
+}
+
+static uint64_t pigeon_count_range_i32(const int32_t * restrict values, size_t count, int32_t low, int32_t last)
+{
+    uint64_t total = 0;
+    size_t i = 0;
+
+#ifdef PIGEON_COLUMN_VECTORS
+    pigeon_v8i32_t vlow = { low, low, low, low, low, low, low, low };
+    pigeon_v8i32_t vlast = { last, last, last, last, last, last, last, last };
+    pigeon_v8i32_t matches = { 0 };
+    for (; i + 8 <= count; i += 8)
+    {
+        pigeon_v8i32_t v;
+        memcpy(&v, values + i, sizeof(v));
+        matches += (v >= vlow) & (v <= vlast);
+    }
+
+    for (unsigned lane = 0; lane < 8; ++lane)
+        total -= matches[lane];
+#endif
+
+    for (; i < count; ++i)
+        total += values[i] >= low && values[i] <= last;
+
+    return total;
+}
+
+static uint64_t pigeon_count_range_u32(const uint32_t * restrict values, size_t count, uint32_t low, uint32_t last)
+{
+    uint64_t total = 0;
+    size_t i = 0;
+
+#ifdef PIGEON_COLUMN_VECTORS
+    pigeon_v8u32_t vlow = { low, low, low, low, low, low, low, low };
+    pigeon_v8u32_t vlast = { last, last, last, last, last, last, last, last };
+    pigeon_v8i32_t matches = { 0 };
+    for (; i + 8 <= count; i += 8)
+    {
+        pigeon_v8u32_t v;
+        memcpy(&v, values + i, sizeof(v));
+        matches += (v >= vlow) & (v <= vlast);
+    }
+
+    for (unsigned lane = 0; lane < 8; ++lane)
+        total -= matches[lane];
+#endif
+
+    for (; i < count; ++i)
+        total += values[i] >= low && values[i] <= last;
+
+    return total;
+}
+
+static inline int64_t pigeon_clamp(int64_t value, int64_t min, int64_t max)
+{
+    return value < min ? min : value > max ? max : value;
+}
+
+uint64_t pigeon_column_count_range(const pigeon_column_t * restrict column, int64_t low, int64_t high)
+{
+    if (column->type == PIGEON_COLUMN_BITMAP64 || low >= high)
+        return 0;
+
+    uint64_t total = 0;
+    for (size_t block = 0; block < column->block_count; ++block)
+    {
+        int64_t block_min = column->stats[block * 2];
+        int64_t block_max = column->stats[block * 2 + 1];
+        size_t rows = pigeon_column_block_size(column, block);
+
+        if (block_max < low || block_min >= high)
+            continue;
+        else if (block_min >= low && block_max < high)
+        {
+            total += rows;
+            continue;
+        }
+
+        size_t first = (size_t)block * column->block_rows;
+        switch (column->type)
+        {
+            case PIGEON_COLUMN_INT64:
+                total += pigeon_count_range_i64((const int64_t *)column->data + first, rows, low, high);
+                break;
+
+            // The narrow kernels take an inclusive upper bound, so bounds past
+            // the type's range clamp to its limits without dropping rows
+            // equal to them. low < high, so high - 1 can't overflow.
+            case PIGEON_COLUMN_INT32:
+                total += pigeon_count_range_i32((const int32_t *)column->data + first, rows,
+                    (int32_t)pigeon_clamp(low, INT32_MIN, INT32_MAX), (int32_t)pigeon_clamp(high - 1, INT32_MIN, INT32_MAX));
+                break;
+
+            case PIGEON_COLUMN_UINT32:
+                total += pigeon_count_range_u32((const uint32_t *)column->data + first, rows,
+                    (uint32_t)pigeon_clamp(low, 0, UINT32_MAX), (uint32_t)pigeon_clamp(high - 1, 0, UINT32_MAX));
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return total;
+}
+
+bool pigeon_column_min_max(const pigeon_column_t * restrict column, int64_t * restrict min, int64_t * restrict max)
+{
+    if (column->type == PIGEON_COLUMN_BITMAP64 || column->block_count == 0)
+        return false;
+
+    // Block statistics are exact, so the data itself is never read
+    *min = column->stats[0];
+    *max = column->stats[1];
+    for (size_t block = 1; block < column->block_count; ++block)
+    {
+        if (column->stats[block * 2] < *min)
+            *min = column->stats[block * 2];
+        if (column->stats[block * 2 + 1] > *max)
+            *max = column->stats[block * 2 + 1];
+    }
+
+    return true;
+}
+
+uint64_t pigeon_column_count_bits(const pigeon_column_t * restrict column, uint64_t mask)
+{
+    if (column->type != PIGEON_COLUMN_BITMAP64)
+        return 0;
+
+    uint64_t total = 0;
+    for (size_t block = 0; block < column->block_count; ++block)
+    {
+        uint64_t block_and = (uint64_t)column->stats[block * 2];
+        uint64_t block_or = (uint64_t)column->stats[block * 2 + 1];
+        size_t rows = pigeon_column_block_size(column, block);
+
+        if ((block_or & mask) != mask)
+            continue;
+        else if ((block_and & mask) == mask)
+        {
+            total += rows;
+            continue;
+        }
+
+        const uint64_t * values = (const uint64_t *)column->data + (size_t)block * column->block_rows;
+        size_t i = 0;
+
+#ifdef PIGEON_COLUMN_VECTORS
+        pigeon_v4u64_t vmask = { mask, mask, mask, mask };
+        pigeon_v4i64_t matches = { 0 };
+        for (; i + 4 <= rows; i += 4)
+        {
+            pigeon_v4u64_t v;
+            memcpy(&v, values + i, sizeof(v));
+            matches += (pigeon_v4i64_t)((v & vmask) == vmask);
+        }
+
+        total -= matches[0] + matches[1] + matches[2] + matches[3];
+#endif
+
+        for (; i < rows; ++i)
+            total += (values[i] & mask) == mask;
+    }
+
+    return total;
+}
+
+void pigeon_column_histogram_ids(const pigeon_column_t * restrict column, uint64_t * restrict counts, size_t bucket_count)
+{
+    if (column->type != PIGEON_COLUMN_UINT32)
+        return;
+
+    const uint32_t * values = column->data;
+    for (uint64_t i = 0; i < column->row_count; ++i)
+        if (values[i] < bucket_count)
+            ++counts[values[i]];
+}
+
+void pigeon_column_histogram_buckets(const pigeon_column_t * restrict column, int64_t origin, int64_t bucket_width, uint64_t * restrict counts, size_t bucket_count)
+{
+    if (column->type != PIGEON_COLUMN_INT64 || bucket_width <= 0 || bucket_count == 0)
+        return;
+
+    int64_t end = origin + bucket_width * (int64_t)bucket_count;
+    for (size_t block = 0; block < column->block_count; ++block)
+    {
+        if (column->stats[block * 2 + 1] < origin || column->stats[block * 2] >= end)
+            continue;
+
+        const int64_t * values = (const int64_t *)column->data + (size_t)block * column->block_rows;
+        size_t rows = pigeon_column_block_size(column, block);
+        for (size_t i = 0; i < rows; ++i)
+            if (values[i] >= origin && values[i] < end)
+                ++counts[(values[i] - origin) / bucket_width];
+    }
+}
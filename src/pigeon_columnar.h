@@ -0,0 +1,117 @@
+#ifndef PIGEON_COLUMNAR_H
+#define PIGEON_COLUMNAR_H
+
+#include "pigeon_map.h"
+#include "pigeon_parser.h"
+#include "pigeon_string.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Columnar export of message headers for analytical scans. A directory
+// receives one memory-mappable file per column:
+//
+//     timestamp.col   int64
+//     sequence.col    int32
+//     author.col      uint32, ids into author.dict
+//     kind.col        uint32, ids into kind.dict
+//     fields.col      uint64 bitmap, bit n set if field name n of fields.dict
+//                     is present (names past the 63rd share bit 63)
+//
+// Dictionaries are text files with one entry per line, line n being id n.
+// Every column keeps min/max statistics per block of rows (for bitmaps: the
+// AND and OR of the block), which lets the scan kernels skip or count whole
+// blocks without touching their data.
+
+#define PIGEON_COLUMN_BLOCK_ROWS 65536
+#define PIGEON_COLUMN_MAX_FIELD_BITS 64
+
+typedef enum {
+    PIGEON_COLUMN_INT64,
+    PIGEON_COLUMN_INT32,
+    PIGEON_COLUMN_UINT32,
+    PIGEON_COLUMN_BITMAP64
+} pigeon_column_type_t;
+
+typedef struct {
+    FILE * file;
+    pigeon_column_type_t type;
+    uint64_t row_count;
+
+    int64_t block_min;
+    int64_t block_max;
+    uint32_t block_fill;
+
+    int64_t * stats; // min/max pairs
+    size_t stats_count;
+    size_t stats_capacity;
+} pigeon_column_writer_t;
+
+typedef struct {
+    pigeon_map_t ids; // entry -> id
+    uint32_t count;
+    FILE * file;
+} pigeon_column_dictionary_t;
+
+typedef struct {
+    pigeon_column_writer_t timestamp;
+    pigeon_column_writer_t sequence;
+    pigeon_column_writer_t author;
+    pigeon_column_writer_t kind;
+    pigeon_column_writer_t fields;
+
+    pigeon_column_dictionary_t authors;
+    pigeon_column_dictionary_t kinds;
+    pigeon_column_dictionary_t field_names;
+    pigeon_string_t author_key;
+
+    char error_messages[256];
+} pigeon_columnar_writer_t;
+
+typedef struct {
+    int fd;
+    void * map;
+    size_t map_size;
+
+    pigeon_column_type_t type;
+    uint64_t row_count;
+    uint32_t block_rows;
+    uint32_t block_count;
+
+    const void * data;
+    const int64_t * stats; // min/max pairs, one per block
+} pigeon_column_t;
+
+bool pigeon_columnar_writer_open(pigeon_columnar_writer_t * restrict writer, const char * restrict directory);
+
+bool pigeon_columnar_writer_append(pigeon_columnar_writer_t * restrict writer, const pigeon_parsed_message_t * restrict message);
+
+bool pigeon_columnar_writer_close(pigeon_columnar_writer_t * restrict writer);
+
+bool pigeon_column_open(pigeon_column_t * restrict column, const char * restrict path);
+
+void pigeon_column_close(pigeon_column_t * restrict column);
+
+// Loads a dictionary file into an array of strings owned by the caller;
+// free with pigeon_column_dictionary_entries_free.
+bool pigeon_column_dictionary_load(const char * restrict path, char *** restrict entries, size_t * restrict count);
+
+void pigeon_column_dictionary_entries_free(char ** entries, size_t count);
+
+// Scan kernels. Ranges are half-open, [low, high).
+uint64_t pigeon_column_count_range(const pigeon_column_t * restrict column, int64_t low, int64_t high);
+
+bool pigeon_column_min_max(const pigeon_column_t * restrict column, int64_t * restrict min, int64_t * restrict max);
+
+// Counts rows of a bitmap column that have every bit of mask set.
+uint64_t pigeon_column_count_bits(const pigeon_column_t * restrict column, uint64_t mask);
+
+// counts[id] += rows with that id, for ids below bucket_count (uint32 columns).
+void pigeon_column_histogram_ids(const pigeon_column_t * restrict column, uint64_t * restrict counts, size_t bucket_count);
+
+// counts[(value - origin) / bucket_width] += 1 for values that fall into one
+// of bucket_count buckets (int64 columns).
+void pigeon_column_histogram_buckets(const pigeon_column_t * restrict column, int64_t origin, int64_t bucket_width, uint64_t * restrict counts, size_t bucket_count);
+
+#endif
@@ -0,0 +1,374 @@
+#include "pigeon_compact.h"
+#include "pigeon_memory.h"
+#include "pigeon_string.h"
+
+#include <string.h>
+
+#define PIGEON_COMPACT_MAX_DECODED 512
+
+static const char hex_digits[] = "0123456789abcdef";
+static const char base64_digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+typedef struct {
+    char * base;   // NULL while measuring
+    size_t used;
+} pigeon_compact_builder_t;
+
+static void pigeon_compact_store(pigeon_compact_builder_t * restrict builder, pigeon_compact_str_t * restrict str, const char * restrict data, size_t length)
+{
+    str->length = (uint32_t)length;
+    if (length <= PIGEON_COMPACT_INLINE_SIZE)
+    {
+        memset(str->u.inline_data, 0, sizeof(str->u.inline_data));
+        memcpy(str->u.inline_data, data, length);
+        return;
+    }
+
+    if (builder->base)
+    {
+        memcpy(builder->base + builder->used, data, length);
+        str->u.offset = (uint32_t)builder->used;
+    }
+
+    builder->used += length;
+}
+
+// The parser leaves empty strings NULL; both are stored with length 0.
+static inline void pigeon_compact_store_cstr(pigeon_compact_builder_t * restrict builder, pigeon_compact_str_t * restrict str, const char * restrict text)
+{
+    pigeon_compact_store(builder, str, text ? text : "", text ? strlen(text) : 0);
+}
+
+static inline int pigeon_hex_value(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    else if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+
+    return -1;
+}
+
+static size_t pigeon_decode_hex(const char * restrict text, size_t length, unsigned char * restrict bytes)
+{
+    if (length == 0 || length % 2 != 0)
+        return 0;
+
+    for (size_t i = 0; i < length; i += 2)
+    {
+        int high = pigeon_hex_value(text[i]);
+        int low = pigeon_hex_value(text[i + 1]);
+        if (high < 0 || low < 0)
+            return 0;
+
+        bytes[i / 2] = (unsigned char)(high << 4 | low);
+    }
+
+    return length / 2;
+}
+
+static inline int pigeon_base64_value(char ch)
+{
+    const char * pos = ch != '\0' ? strchr(base64_digits, ch) : NULL;
+    return pos ? (int)(pos - base64_digits) : -1;
+}
+
+// Only canonical encodings are accepted, so re-encoding reproduces the text.
+static size_t pigeon_decode_base64(const char * restrict text, size_t length, unsigned char * restrict bytes)
+{
+    if (length == 0 || length % 4 != 0)
+        return 0;
+
+    size_t padding = text[length - 1] == '=' ? (text[length - 2] == '=' ? 2 : 1) : 0;
+    size_t size = 0;
+
+    for (size_t i = 0; i < length; i += 4)
+    {
+        bool last = i + 4 == length;
+        uint32_t group = 0;
+        for (size_t j = 0; j < 4; ++j)
+        {
+            int value = 0;
+            if (!(last && j >= 4 - padding))
+            {
+                value = pigeon_base64_value(text[i + j]);
+                if (value < 0)
+                    return 0;
+            }
+
+            group = group << 6 | (uint32_t)value;
+        }
+
+        if (last && padding == 2 && (group & 0xffff) != 0)
+            return 0;
+        else if (last && padding == 1 && (group & 0xff) != 0)
+            return 0;
+
+        bytes[size++] = (unsigned char)(group >> 16);
+        if (!last || padding < 2)
+            bytes[size++] = (unsigned char)(group >> 8);
+        if (!last || padding < 1)
+            bytes[size++] = (unsigned char)group;
+    }
+
+    return size;
+}
+
+static void pigeon_compact_store_hash(pigeon_compact_builder_t * restrict builder, pigeon_compact_hash_t * restrict hash, const pigeon_encoded_value_t * restrict value)
+{
+    const char * text = value->hash ? value->hash : "";
+    size_t length = strlen(text);
+
+    hash->encoding_type = (uint8_t)value->encoding_type;
+    hash->reserved = 0;
+
+    unsigned char bytes[PIGEON_COMPACT_MAX_DECODED];
+    size_t size = 0;
+    if (length <= sizeof(bytes))
+    {
+        if ((size = pigeon_decode_hex(text, length, bytes)) != 0)
+            hash->format = PIGEON_COMPACT_HASH_HEX;
+        else if ((size = pigeon_decode_base64(text, length, bytes)) != 0)
+            hash->format = PIGEON_COMPACT_HASH_BASE64;
+    }
+
+    if (size != 0)
+        pigeon_compact_store(builder, &hash->bytes, (const char *)bytes, size);
+    else
+    {
+        hash->format = PIGEON_COMPACT_HASH_TEXT;
+        pigeon_compact_store(builder, &hash->bytes, text, length);
+    }
+}
+
+static void pigeon_compact_build(pigeon_compact_builder_t * restrict builder, pigeon_compact_message_t * restrict compact, const pigeon_parsed_message_t * restrict message)
+{
+    compact->timestamp = message->timestamp;
+    compact->sequence_number = message->sequence_number;
+    pigeon_compact_store_hash(builder, &compact->author, &message->author);
+    pigeon_compact_store_hash(builder, &compact->previous, &message->previous);
+    pigeon_compact_store_hash(builder, &compact->signature, &message->signature);
+    pigeon_compact_store_cstr(builder, &compact->kind, message->kind);
+
+    uint32_t count = 0;
+    const pigeon_field_t * field = pigeon_list_head((pigeon_list_t *)&message->fields);
+    for (; field != NULL; field = pigeon_list_next((void *)field), ++count)
+    {
+        // While measuring, records go to a throwaway so no scratch block is needed.
+        pigeon_compact_field_t scratch;
+        pigeon_compact_field_t * record = builder->base ? &compact->fields[count] : &scratch;
+        record->field_type = field->field_type;
+        pigeon_compact_store_cstr(builder, &record->name, field->field_name);
+
+        switch (field->field_type)
+        {
+            case PIGEON_FIELD_STRING:
+                pigeon_compact_store_cstr(builder, &record->value.string, field->field_value.string);
+                break;
+
+            // A streamed string keeps only its length
+            case PIGEON_FIELD_INT64:
+            case PIGEON_FIELD_STREAMED:
+                memset(&record->value, 0, sizeof(record->value));
+                memcpy(record->value.int64_parts, &field->field_value.int64_, sizeof(int64_t));
+                break;
+
+            case PIGEON_FIELD_IDENTITY:
+            case PIGEON_FIELD_SIGNATURE:
+            case PIGEON_FIELD_BLOB:
+                pigeon_compact_store_hash(builder, &record->value.encoded, &field->field_value.encoded);
+                break;
+
+            default:
+                memset(&record->value, 0, sizeof(record->value));
+                break;
+        }
+    }
+}
+
+static size_t pigeon_compact_field_count(const pigeon_parsed_message_t * restrict message)
+{
+    size_t field_count = 0;
+    const pigeon_field_t * field = pigeon_list_head((pigeon_list_t *)&message->fields);
+    for (; field != NULL; field = pigeon_list_next((void *)field))
+        ++field_count;
+
+    return field_count;
+}
+
+size_t pigeon_compact_message_size(const pigeon_parsed_message_t * restrict message)
+{
+    size_t fixed_size = sizeof(pigeon_compact_message_t) + pigeon_compact_field_count(message) * sizeof(pigeon_compact_field_t);
+
+    // Only the header is written while measuring; field records are skipped.
+    pigeon_compact_message_t header;
+    pigeon_compact_builder_t builder = { NULL, fixed_size };
+    pigeon_compact_build(&builder, &header, message);
+
+    return builder.used > UINT32_MAX ? 0 : builder.used;
+}
+
+bool pigeon_compact_message_write(const pigeon_parsed_message_t * restrict message, void * restrict buffer, size_t size)
+{
+    // Measure first so nothing is written unless the message fits exactly
+    size_t needed = pigeon_compact_message_size(message);
+    if (needed == 0 || needed != size)
+        return false;
+
+    size_t field_count = pigeon_compact_field_count(message);
+    pigeon_compact_message_t * compact = buffer;
+    compact->total_size = (uint32_t)size;
+    compact->field_count = (uint32_t)field_count;
+
+    pigeon_compact_builder_t builder = { buffer, sizeof(pigeon_compact_message_t) + field_count * sizeof(pigeon_compact_field_t) };
+    pigeon_compact_build(&builder, compact, message);
+    return builder.used == size;
+}
+
+pigeon_compact_message_t * pigeon_compact_message_create(const pigeon_parsed_message_t * restrict message)
+{
+    size_t size = pigeon_compact_message_size(message);
+    if (size == 0)
+        return NULL;
+
+    pigeon_compact_message_t * compact = pigeon_malloc(size);
+    if (!compact)
+        return NULL;
+
+    if (!pigeon_compact_message_write(message, compact, size))
+    {
+        pigeon_free(compact);
+        return NULL;
+    }
+
+    return compact;
+}
+
+size_t pigeon_compact_hash_text(const pigeon_compact_message_t * restrict message, const pigeon_compact_hash_t * restrict hash, char * restrict buffer, size_t buffer_size)
+{
+    const unsigned char * bytes = (const unsigned char *)pigeon_compact_str_data(message, &hash->bytes);
+    size_t size = hash->bytes.length;
+    size_t length;
+
+    switch (hash->format)
+    {
+        case PIGEON_COMPACT_HASH_HEX:
+            length = size * 2;
+            if (length + 1 > buffer_size)
+                return 0;
+
+            for (size_t i = 0; i < size; ++i)
+            {
+                buffer[i * 2] = hex_digits[bytes[i] >> 4];
+                buffer[i * 2 + 1] = hex_digits[bytes[i] & 0x0f];
+            }
+            break;
+
+        case PIGEON_COMPACT_HASH_BASE64:
+            length = (size + 2) / 3 * 4;
+            if (length + 1 > buffer_size)
+                return 0;
+
+            for (size_t i = 0, out = 0; i < size; i += 3, out += 4)
+            {
+                uint32_t group = (uint32_t)bytes[i] << 16;
+                if (i + 1 < size)
+                    group |= (uint32_t)bytes[i + 1] << 8;
+                if (i + 2 < size)
+                    group |= bytes[i + 2];
+
+                buffer[out] = base64_digits[group >> 18];
+                buffer[out + 1] = base64_digits[(group >> 12) & 0x3f];
+                buffer[out + 2] = i + 1 < size ? base64_digits[(group >> 6) & 0x3f] : '=';
+                buffer[out + 3] = i + 2 < size ? base64_digits[group & 0x3f] : '=';
+            }
+            break;
+
+        default:
+            length = size;
+            if (length + 1 > buffer_size)
+                return 0;
+
+            memcpy(buffer, bytes, size);
+            break;
+    }
+
+    buffer[length] = '\0';
+    return length;
+}
+
+// Empty strings expand to NULL, as the parser represents them.
+static bool pigeon_compact_expand_hash(const pigeon_compact_message_t * restrict compact, const pigeon_compact_hash_t * restrict hash, pigeon_encoded_value_t * restrict value)
+{
+    value->encoding_type = hash->encoding_type;
+    value->hash = NULL;
+    if (hash->bytes.length == 0)
+        return true;
+
+    // Hex doubles the byte count, base64 needs 4 characters per 3 bytes
+    size_t buffer_size = hash->bytes.length * 2 + 4;
+    value->hash = pigeon_malloc(buffer_size);
+    return value->hash != NULL && pigeon_compact_hash_text(compact, hash, value->hash, buffer_size) == strlen(value->hash);
+}
+
+static bool pigeon_compact_expand_str(const pigeon_compact_message_t * restrict compact, const pigeon_compact_str_t * restrict str, char ** restrict text)
+{
+    *text = str->length != 0 ? pigeon_strdup_range(pigeon_compact_str_data(compact, str), str->length) : NULL;
+    return str->length == 0 || *text != NULL;
+}
+
+bool pigeon_compact_message_expand(const pigeon_compact_message_t * restrict compact, pigeon_parsed_message_t * restrict message)
+{
+    memset(message, 0, sizeof(*message));
+    pigeon_list_init(&message->fields);
+
+    message->timestamp = compact->timestamp;
+    message->sequence_number = compact->sequence_number;
+    bool success = pigeon_compact_expand_hash(compact, &compact->author, &message->author)
+        && pigeon_compact_expand_hash(compact, &compact->previous, &message->previous)
+        && pigeon_compact_expand_hash(compact, &compact->signature, &message->signature)
+        && pigeon_compact_expand_str(compact, &compact->kind, &message->kind);
+
+    for (uint32_t i = 0; success && i < compact->field_count; ++i)
+    {
+        const pigeon_compact_field_t * record = &compact->fields[i];
+        pigeon_field_t * field = pigeon_malloc(sizeof(pigeon_field_t));
+        if (!field)
+        {
+            success = false;
+            break;
+        }
+
+        memset(field, 0, sizeof(*field));
+        pigeon_list_append(&message->fields, field);
+
+        field->field_type = record->field_type;
+        success = pigeon_compact_expand_str(compact, &record->name, &field->field_name);
+
+        switch (record->field_type)
+        {
+            case PIGEON_FIELD_STRING:
+                success = success && pigeon_compact_expand_str(compact, &record->value.string, &field->field_value.string);
+                break;
+
+            case PIGEON_FIELD_INT64:
+            case PIGEON_FIELD_STREAMED:
+                field->field_value.int64_ = pigeon_compact_field_int64(record);
+                break;
+
+            case PIGEON_FIELD_IDENTITY:
+            case PIGEON_FIELD_SIGNATURE:
+            case PIGEON_FIELD_BLOB:
+                success = success && pigeon_compact_expand_hash(compact, &record->value.encoded, &field->field_value.encoded);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    if (!success)
+        pigeon_free_parsed_message(message);
+
+    return success;
+}
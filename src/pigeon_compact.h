@@ -0,0 +1,99 @@
+#ifndef PIGEON_COMPACT_H
+#define PIGEON_COMPACT_H
+
+#include "pigeon_parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Compact, read-only representation of a parsed message: one contiguous
+// block holding a fixed header, an array of fixed-size field records and a
+// trailing byte area. References into the byte area are 32-bit offsets from
+// the start of the block, so the block can be copied or shared as is.
+//
+// Strings of up to PIGEON_COMPACT_INLINE_SIZE bytes (most kinds and field
+// names) are stored inline in their reference. Hashes whose text is
+// lowercase hex or canonical base64 are stored as raw bytes and re-encoded
+// on demand.
+
+#define PIGEON_COMPACT_INLINE_SIZE 12
+
+typedef struct {
+    uint32_t length;
+    union {
+        char inline_data[PIGEON_COMPACT_INLINE_SIZE];
+        uint32_t offset;
+    } u;
+} pigeon_compact_str_t;
+
+typedef enum {
+    PIGEON_COMPACT_HASH_TEXT,   // kept as the original text
+    PIGEON_COMPACT_HASH_HEX,    // raw bytes of a lowercase hex string
+    PIGEON_COMPACT_HASH_BASE64  // raw bytes of a padded base64 string
+} pigeon_compact_hash_format_t;
+
+typedef struct {
+    uint8_t encoding_type;
+    uint8_t format;
+    uint16_t reserved;
+    pigeon_compact_str_t bytes;
+} pigeon_compact_hash_t;
+
+typedef struct {
+    uint32_t field_type;
+    pigeon_compact_str_t name;
+    union {
+        pigeon_compact_str_t string;
+        uint32_t int64_parts[2]; // keeps the record 4-byte aligned
+        pigeon_compact_hash_t encoded;
+    } value;
+} pigeon_compact_field_t;
+
+typedef struct {
+    uint32_t total_size;
+    uint32_t field_count;
+    int64_t timestamp;
+    int32_t sequence_number;
+    pigeon_compact_hash_t author;
+    pigeon_compact_hash_t previous;
+    pigeon_compact_hash_t signature;
+    pigeon_compact_str_t kind;
+
+    pigeon_compact_field_t fields[];
+} pigeon_compact_message_t;
+
+// Returns a single heap block, released with pigeon_free, or NULL if memory
+// allocation fails or the message exceeds the 32-bit offset range.
+pigeon_compact_message_t * pigeon_compact_message_create(const pigeon_parsed_message_t * restrict message);
+
+// Size in bytes of the compact form of message, or 0 if it exceeds the
+// 32-bit offset range.
+size_t pigeon_compact_message_size(const pigeon_parsed_message_t * restrict message);
+
+// Builds the compact form into a caller buffer (8-byte aligned) of exactly
+// pigeon_compact_message_size(message) bytes. Returns false, without
+// touching the buffer, if size is anything else.
+bool pigeon_compact_message_write(const pigeon_parsed_message_t * restrict message, void * restrict buffer, size_t size);
+
+static inline const char * pigeon_compact_str_data(const pigeon_compact_message_t * restrict message, const pigeon_compact_str_t * restrict str)
+{
+    return str->length <= PIGEON_COMPACT_INLINE_SIZE ? str->u.inline_data : (const char *)message + str->u.offset;
+}
+
+static inline int64_t pigeon_compact_field_int64(const pigeon_compact_field_t * restrict field)
+{
+    int64_t value;
+    memcpy(&value, field->value.int64_parts, sizeof(value));
+    return value;
+}
+
+// Writes the hash text NUL-terminated into buffer. Returns the text length,
+// or 0 if buffer is too small.
+size_t pigeon_compact_hash_text(const pigeon_compact_message_t * restrict message, const pigeon_compact_hash_t * restrict hash, char * restrict buffer, size_t buffer_size);
+
+// Rebuilds the heap representation; free it with pigeon_free_parsed_message.
+// Empty names, values and hashes come back NULL, as the parser leaves them.
+bool pigeon_compact_message_expand(const pigeon_compact_message_t * restrict compact, pigeon_parsed_message_t * restrict message);
+
+#endif
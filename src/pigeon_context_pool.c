@@ -0,0 +1,65 @@
+#include "pigeon_context_pool.h"
+#include "pigeon_memory.h"
+
+#include <pthread.h>
+
+typedef struct {
+    pigeon_parse_context_t contexts[PIGEON_CONTEXT_POOL_SIZE];
+    pigeon_parse_context_t * free_list[PIGEON_CONTEXT_POOL_SIZE];
+    unsigned free_count;
+} pigeon_context_pool_t;
+
+static _Thread_local pigeon_context_pool_t * thread_pool;
+
+// The key only exists to run the destructor at thread exit; lookups go
+// through the thread-local pointer.
+static pthread_key_t pool_key;
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+
+static void pigeon_context_pool_destroy(void * pool)
+{
+    pigeon_free(pool);
+}
+
+static void pigeon_context_pool_create_key(void)
+{
+    pthread_key_create(&pool_key, pigeon_context_pool_destroy);
+}
+
+static pigeon_context_pool_t * pigeon_context_pool_get(void)
+{
+    if (thread_pool)
+        return thread_pool;
+
+    pthread_once(&pool_key_once, pigeon_context_pool_create_key);
+
+    pigeon_context_pool_t * pool = pigeon_malloc(sizeof(pigeon_context_pool_t));
+    if (!pool)
+        return NULL;
+
+    for (unsigned i = 0; i < PIGEON_CONTEXT_POOL_SIZE; ++i)
+        pool->free_list[i] = &pool->contexts[PIGEON_CONTEXT_POOL_SIZE - 1 - i];
+    pool->free_count = PIGEON_CONTEXT_POOL_SIZE;
+
+    pthread_setspecific(pool_key, pool);
+    thread_pool = pool;
+    return pool;
+}
+
+pigeon_parse_context_t * pigeon_parse_context_acquire(void)
+{
+    pigeon_context_pool_t * pool = pigeon_context_pool_get();
+    if (pool && pool->free_count > 0)
+        return pool->free_list[--pool->free_count];
+
+    return pigeon_malloc(sizeof(pigeon_parse_context_t));
+}
+
+void pigeon_parse_context_release(pigeon_parse_context_t * ctx)
+{
+    pigeon_context_pool_t * pool = thread_pool;
+    if (pool && ctx >= pool->contexts && ctx < pool->contexts + PIGEON_CONTEXT_POOL_SIZE)
+        pool->free_list[pool->free_count++] = ctx;
+    else
+        pigeon_free(ctx);
+}
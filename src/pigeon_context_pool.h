@@ -0,0 +1,19 @@
+#ifndef PIGEON_CONTEXT_POOL_H
+#define PIGEON_CONTEXT_POOL_H
+
+#include "pigeon_parser.h"
+
+// Per-thread pool of preallocated parse contexts. Each thread gets its own
+// pool on first use, so acquire and release never take a lock; the pool is
+// freed automatically when the thread exits.
+//
+// A context must be released on the thread that acquired it. Nesting deeper
+// than PIGEON_CONTEXT_POOL_SIZE falls back to the heap.
+
+#define PIGEON_CONTEXT_POOL_SIZE 8
+
+// Returns NULL only if memory allocation fails.
+pigeon_parse_context_t * pigeon_parse_context_acquire(void);
+void pigeon_parse_context_release(pigeon_parse_context_t * ctx);
+
+#endif
@@ -0,0 +1,194 @@
+#include "pigeon_emit.h"
+#include "pigeon_memory.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Non-zero entries need escaping: the value is the character written after
+// the backslash, or 'u' for a \u00XX sequence.
+static const char json_escapes[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
+bool pigeon_emitter_init(pigeon_emitter_t * restrict emitter, int fd, size_t capacity, pthread_mutex_t * lock)
+{
+    memset(emitter, 0, sizeof(*emitter));
+    emitter->fd = fd;
+    emitter->lock = lock;
+    emitter->capacity = capacity < 4096 ? 4096 : capacity;
+    emitter->buffer = pigeon_malloc(emitter->capacity);
+    emitter->failed = emitter->buffer == NULL;
+    return !emitter->failed;
+}
+
+bool pigeon_emitter_free(pigeon_emitter_t * restrict emitter)
+{
+    bool success = pigeon_emitter_flush(emitter);
+    pigeon_free(emitter->buffer);
+    emitter->buffer = NULL;
+    emitter->capacity = 0;
+    return success;
+}
+
+bool pigeon_emitter_flush(pigeon_emitter_t * restrict emitter)
+{
+    if (emitter->failed || emitter->length == 0)
+    {
+        emitter->length = 0;
+        return !emitter->failed;
+    }
+
+    if (emitter->lock)
+        pthread_mutex_lock(emitter->lock);
+
+    const char * pos = emitter->buffer;
+    size_t remaining = emitter->length;
+    while (remaining > 0)
+    {
+        ssize_t written = write(emitter->fd, pos, remaining);
+        if (written < 0 && errno == EINTR)
+            continue;
+        else if (written <= 0)
+        {
+            emitter->failed = true;
+            break;
+        }
+
+        pos += written;
+        remaining -= written;
+    }
+
+    if (emitter->lock)
+        pthread_mutex_unlock(emitter->lock);
+
+    emitter->length = 0;
+    return !emitter->failed;
+}
+
+bool pigeon_emitter_grow(pigeon_emitter_t * restrict emitter, size_t size)
+{
+    if (emitter->failed)
+        return false;
+
+    size_t new_capacity = emitter->capacity;
+    while (new_capacity - emitter->length < size)
+        new_capacity *= 2;
+
+    char * buffer = pigeon_realloc(emitter->buffer, new_capacity);
+    if (!buffer)
+    {
+        emitter->failed = true;
+        return false;
+    }
+
+    emitter->buffer = buffer;
+    emitter->capacity = new_capacity;
+    return true;
+}
+
+void pigeon_emit_int64(pigeon_emitter_t * restrict emitter, int64_t value)
+{
+    if (!pigeon_emitter_reserve(emitter, 20))
+        return;
+
+    char digits[20];
+    char * end = digits + sizeof(digits);
+    char * pos = end;
+
+    // Work on the magnitude as unsigned so INT64_MIN does not overflow
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    while (magnitude >= 100)
+    {
+        unsigned pair = (unsigned)(magnitude % 100) * 2;
+        magnitude /= 100;
+        *--pos = digit_pairs[pair + 1];
+        *--pos = digit_pairs[pair];
+    }
+
+    if (magnitude >= 10)
+    {
+        *--pos = digit_pairs[magnitude * 2 + 1];
+        *--pos = digit_pairs[magnitude * 2];
+    }
+    else
+        *--pos = (char)('0' + magnitude);
+
+    if (value < 0)
+        *--pos = '-';
+
+    memcpy(emitter->buffer + emitter->length, pos, end - pos);
+    emitter->length += end - pos;
+}
+
+void pigeon_emit_json_string(pigeon_emitter_t * restrict emitter, const char * restrict str, size_t size)
+{
+    // Worst case every byte becomes a six-character \u00XX escape
+    if (!pigeon_emitter_reserve(emitter, size * 6 + 2))
+        return;
+
+    char * out = emitter->buffer + emitter->length;
+    const unsigned char * pos = (const unsigned char *)str;
+    const unsigned char * end = pos + size;
+
+    *out++ = '"';
+    while (pos != end)
+    {
+        const unsigned char * run = pos;
+        while (pos != end && json_escapes[*pos] == 0)
+            ++pos;
+
+        memcpy(out, run, pos - run);
+        out += pos - run;
+        if (pos == end)
+            break;
+
+        char escape = json_escapes[*pos];
+        *out++ = '\\';
+        *out++ = escape;
+        if (escape == 'u')
+        {
+            *out++ = '0';
+            *out++ = '0';
+            *out++ = hex_digits[*pos >> 4];
+            *out++ = hex_digits[*pos & 0x0f];
+        }
+
+        ++pos;
+    }
+    *out++ = '"';
+
+    emitter->length = out - emitter->buffer;
+}
+
+void pigeon_emit_tsv_string(pigeon_emitter_t * restrict emitter, const char * restrict str, size_t size)
+{
+    if (!pigeon_emitter_reserve(emitter, size * 2))
+        return;
+
+    char * out = emitter->buffer + emitter->length;
+    for (const char * end = str + size; str != end; ++str)
+    {
+        switch (*str)
+        {
+            case '\t': *out++ = '\\'; *out++ = 't'; break;
+            case '\n': *out++ = '\\'; *out++ = 'n'; break;
+            case '\r': *out++ = '\\'; *out++ = 'r'; break;
+            case '\\': *out++ = '\\'; *out++ = '\\'; break;
+            default: *out++ = *str; break;
+        }
+    }
+
+    emitter->length = out - emitter->buffer;
+}
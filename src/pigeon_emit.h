@@ -0,0 +1,85 @@
+#ifndef PIGEON_EMIT_H
+#define PIGEON_EMIT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Buffered output for NDJSON and TSV records. Values are formatted straight
+// into the buffer, which is written out once it passes half its capacity at
+// the end of a record. Records are never split across writes, so several
+// emitters can share one descriptor through a common lock. The buffer only
+// grows when a single record does not fit.
+//
+// A write or allocation failure sets failed; later output is dropped.
+
+typedef struct {
+    char * buffer;
+    size_t length;
+    size_t capacity;
+
+    int fd;
+    pthread_mutex_t * lock; // may be NULL
+    bool failed;
+} pigeon_emitter_t;
+
+bool pigeon_emitter_init(pigeon_emitter_t * restrict emitter, int fd, size_t capacity, pthread_mutex_t * lock);
+
+// Flushes remaining output before releasing the buffer.
+bool pigeon_emitter_free(pigeon_emitter_t * restrict emitter);
+
+bool pigeon_emitter_flush(pigeon_emitter_t * restrict emitter);
+
+bool pigeon_emitter_grow(pigeon_emitter_t * restrict emitter, size_t size);
+
+static inline bool pigeon_emitter_reserve(pigeon_emitter_t * restrict emitter, size_t size)
+{
+    if (emitter->capacity - emitter->length >= size)
+        return true;
+
+    return pigeon_emitter_grow(emitter, size);
+}
+
+static inline void pigeon_emit_char(pigeon_emitter_t * restrict emitter, char ch)
+{
+    if (pigeon_emitter_reserve(emitter, 1))
+        emitter->buffer[emitter->length++] = ch;
+}
+
+static inline void pigeon_emit_raw(pigeon_emitter_t * restrict emitter, const char * restrict data, size_t size)
+{
+    if (pigeon_emitter_reserve(emitter, size))
+    {
+        memcpy(emitter->buffer + emitter->length, data, size);
+        emitter->length += size;
+    }
+}
+
+static inline void pigeon_emit_str(pigeon_emitter_t * restrict emitter, const char * restrict str)
+{
+    pigeon_emit_raw(emitter, str, strlen(str));
+}
+
+void pigeon_emit_int64(pigeon_emitter_t * restrict emitter, int64_t value);
+
+// Writes str as a quoted JSON string. Bytes at or above 0x80 are passed
+// through unchanged, so valid UTF-8 input gives valid UTF-8 output.
+void pigeon_emit_json_string(pigeon_emitter_t * restrict emitter, const char * restrict str, size_t size);
+
+// Writes str with tab, newline, carriage return and backslash escaped as
+// \t, \n, \r and \\, so every value stays in its own TSV column.
+void pigeon_emit_tsv_string(pigeon_emitter_t * restrict emitter, const char * restrict str, size_t size);
+
+// Ends a record with a newline and flushes if the buffer is half full.
+static inline bool pigeon_emitter_end_record(pigeon_emitter_t * restrict emitter)
+{
+    pigeon_emit_char(emitter, '\n');
+    if (emitter->length >= emitter->capacity / 2)
+        return pigeon_emitter_flush(emitter);
+
+    return !emitter->failed;
+}
+
+#endif
@@ -0,0 +1,401 @@
+#include "pigeon_follow.h"
+#include "pigeon_memory.h"
+#include "pigeon_string.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+static const char checkpoint_magic[] = "pigeon-follow-checkpoint 1";
+
+static void pigeon_follow_error(pigeon_follow_t * restrict follow, const char * format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(follow->error_messages, sizeof(follow->error_messages), format, ap);
+    va_end(ap);
+}
+
+// Parses one "author <key> <sequence>" line into the checkpoint.
+static bool pigeon_follow_checkpoint_add(pigeon_follow_checkpoint_t * restrict checkpoint, pigeon_string_t * restrict line)
+{
+    static const char prefix[] = "author ";
+
+    if (!pigeon_string_cstr(line) || line->length <= sizeof(prefix) - 1 || 0 != memcmp(line->ptr, prefix, sizeof(prefix) - 1))
+        return false;
+
+    char * key = line->ptr + sizeof(prefix) - 1;
+    char * separator = strrchr(key, ' ');
+    if (!separator || separator == key)
+        return false;
+
+    char * end;
+    errno = 0;
+    long long sequence = strtoll(separator + 1, &end, 10);
+    if (errno != 0 || end == separator + 1 || *end != '\0')
+        return false;
+
+    *separator = '\0';
+    void ** slot = pigeon_map_insert(&checkpoint->last_sequence, key, NULL);
+    if (!slot)
+        return false;
+
+    *slot = (void *)(intptr_t)sequence;
+    return true;
+}
+
+bool pigeon_follow_checkpoint_load(pigeon_follow_checkpoint_t * restrict checkpoint, const char * restrict path)
+{
+    checkpoint->offset = 0;
+    checkpoint->line_number = 1;
+    if (!pigeon_map_init(&checkpoint->last_sequence, 64))
+        return false;
+
+    FILE * file = fopen(path, "r");
+    if (!file)
+        return errno == ENOENT; // no checkpoint yet, start from the beginning
+
+    char header[512];
+    bool success = fgets(header, sizeof(header), file) != NULL
+        && 0 == strncmp(header, checkpoint_magic, sizeof(checkpoint_magic) - 1)
+        && fscanf(file, "offset %" SCNu64 "\nline %" SCNu64 "\n", &checkpoint->offset, &checkpoint->line_number) == 2;
+
+    // Author lines are read whole, however long the key
+    pigeon_string_t line;
+    pigeon_string_init(&line);
+    bool more = success;
+    while (more)
+    {
+        int ch = fgetc(file);
+        if (ch != EOF && ch != '\n')
+        {
+            more = success = pigeon_string_append_ch(&line, (char)ch);
+            continue;
+        }
+
+        if (line.length > 0)
+            success = pigeon_follow_checkpoint_add(checkpoint, &line);
+
+        pigeon_string_clear(&line);
+        more = success && ch != EOF;
+    }
+
+    pigeon_string_free(&line);
+    if (success && ferror(file))
+        success = false;
+
+    fclose(file);
+    if (!success)
+        pigeon_follow_checkpoint_free(checkpoint);
+
+    return success;
+}
+
+bool pigeon_follow_checkpoint_save(const pigeon_follow_checkpoint_t * restrict checkpoint, const char * restrict path)
+{
+    // Write next to the target and rename, so a crash never leaves a torn file
+    size_t path_length = strlen(path);
+    char * temp_path = pigeon_malloc(path_length + 5);
+    if (!temp_path)
+        return false;
+
+    memcpy(temp_path, path, path_length);
+    memcpy(temp_path + path_length, ".tmp", 5);
+
+    FILE * file = fopen(temp_path, "w");
+    bool success = file != NULL
+        && fprintf(file, "%s\noffset %" PRIu64 "\nline %" PRIu64 "\n", checkpoint_magic, checkpoint->offset, checkpoint->line_number) > 0;
+
+    pigeon_map_entry_t * entry = NULL;
+    while (success && (entry = pigeon_map_next(&checkpoint->last_sequence, entry)) != NULL)
+        success = fprintf(file, "author %s %lld\n", entry->key, (long long)(intptr_t)entry->value) > 0;
+
+    if (file && (fflush(file) != 0 || fsync(fileno(file)) != 0))
+        success = false;
+    if (file && fclose(file) != 0)
+        success = false;
+
+    if (success)
+        success = rename(temp_path, path) == 0;
+    else if (file)
+        unlink(temp_path);
+
+    pigeon_free(temp_path);
+    return success;
+}
+
+void pigeon_follow_checkpoint_free(pigeon_follow_checkpoint_t * restrict checkpoint)
+{
+    pigeon_map_free(&checkpoint->last_sequence, NULL);
+}
+
+static void pigeon_follow_watch(pigeon_follow_t * restrict follow)
+{
+#ifdef __linux__
+    if (follow->inotify_fd >= 0)
+        close(follow->inotify_fd);
+
+    follow->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (follow->inotify_fd >= 0
+        && inotify_add_watch(follow->inotify_fd, follow->log_path, IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF) < 0)
+    {
+        // Fall back to polling
+        close(follow->inotify_fd);
+        follow->inotify_fd = -1;
+    }
+#endif
+}
+
+bool pigeon_follow_open(pigeon_follow_t * restrict follow, const char * restrict log_path, const char * restrict checkpoint_path)
+{
+    memset(follow, 0, sizeof(*follow));
+    follow->fd = -1;
+    follow->inotify_fd = -1;
+    follow->poll_interval_ms = PIGEON_FOLLOW_DEFAULT_POLL_MS;
+    follow->checkpoint_every = PIGEON_FOLLOW_DEFAULT_CHECKPOINT_EVERY;
+
+    follow->log_path = pigeon_strdup_range(log_path, strlen(log_path));
+    follow->checkpoint_path = checkpoint_path ? pigeon_strdup_range(checkpoint_path, strlen(checkpoint_path)) : NULL;
+    if (!follow->log_path || (checkpoint_path && !follow->checkpoint_path))
+    {
+        pigeon_follow_error(follow, "memory allocation failed");
+        goto error;
+    }
+
+    if (checkpoint_path)
+    {
+        if (!pigeon_follow_checkpoint_load(&follow->checkpoint, checkpoint_path))
+        {
+            pigeon_follow_error(follow, "unable to load checkpoint '%s'", checkpoint_path);
+            goto error;
+        }
+    }
+    else
+    {
+        follow->checkpoint.offset = 0;
+        follow->checkpoint.line_number = 1;
+        if (!pigeon_map_init(&follow->checkpoint.last_sequence, 64))
+        {
+            pigeon_follow_error(follow, "memory allocation failed");
+            goto error;
+        }
+    }
+
+    follow->fd = open(log_path, O_RDONLY | O_CLOEXEC);
+    if (follow->fd < 0)
+    {
+        pigeon_follow_error(follow, "unable to open '%s': %s", log_path, strerror(errno));
+        goto error;
+    }
+
+    struct stat st;
+    if (fstat(follow->fd, &st) == 0 && (uint64_t)st.st_size < follow->checkpoint.offset)
+    {
+        follow->checkpoint.offset = 0;
+        follow->checkpoint.line_number = 1;
+    }
+
+    if (lseek(follow->fd, (off_t)follow->checkpoint.offset, SEEK_SET) < 0
+        || !pigeon_log_reader_init(&follow->reader, follow->fd, 0))
+    {
+        pigeon_follow_error(follow, "unable to position '%s' at offset %" PRIu64, log_path, follow->checkpoint.offset);
+        goto error;
+    }
+
+    pigeon_log_reader_reset(&follow->reader, follow->checkpoint.offset, follow->checkpoint.line_number);
+    pigeon_follow_watch(follow);
+    return true;
+
+error:
+    {
+        char error_messages[sizeof(follow->error_messages)];
+        memcpy(error_messages, follow->error_messages, sizeof(error_messages));
+        pigeon_follow_close(follow);
+        memcpy(follow->error_messages, error_messages, sizeof(error_messages));
+    }
+    return false;
+}
+
+bool pigeon_follow_close(pigeon_follow_t * restrict follow)
+{
+    bool success = true;
+
+    // Only a follow that was fully opened has progress worth saving
+    if (follow->checkpoint_path && follow->reader.buffer)
+    {
+        success = pigeon_follow_checkpoint_save(&follow->checkpoint, follow->checkpoint_path);
+        if (!success)
+            pigeon_follow_error(follow, "unable to save checkpoint '%s'", follow->checkpoint_path);
+    }
+
+    pigeon_log_reader_free(&follow->reader);
+    pigeon_follow_checkpoint_free(&follow->checkpoint);
+    pigeon_string_free(&follow->author_key);
+
+    if (follow->fd >= 0)
+        close(follow->fd);
+    if (follow->inotify_fd >= 0)
+        close(follow->inotify_fd);
+    follow->fd = follow->inotify_fd = -1;
+
+    pigeon_free(follow->log_path);
+    pigeon_free(follow->checkpoint_path);
+    follow->log_path = follow->checkpoint_path = NULL;
+    return success;
+}
+
+static void pigeon_follow_restart(pigeon_follow_t * restrict follow)
+{
+    pigeon_log_reader_reset(&follow->reader, 0, 1);
+    follow->checkpoint.offset = 0;
+    follow->checkpoint.line_number = 1;
+}
+
+// Detects the log having been truncated in place or replaced by a new file
+// (e.g. by rotation) and rewinds to the start of the current one.
+static bool pigeon_follow_check_replaced(pigeon_follow_t * restrict follow)
+{
+    struct stat current;
+    if (fstat(follow->fd, &current) != 0)
+    {
+        pigeon_follow_error(follow, "unable to stat '%s': %s", follow->log_path, strerror(errno));
+        return false;
+    }
+
+    uint64_t read_position = follow->reader.offset + pigeon_log_reader_pending(&follow->reader);
+    if ((uint64_t)current.st_size < read_position)
+    {
+        if (lseek(follow->fd, 0, SEEK_SET) < 0)
+            return false;
+
+        pigeon_follow_restart(follow);
+        return true;
+    }
+
+    struct stat by_path;
+    if (stat(follow->log_path, &by_path) != 0 || (by_path.st_dev == current.st_dev && by_path.st_ino == current.st_ino))
+        return true;
+
+    int fd = open(follow->log_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return true; // keep the old file until the new one can be opened
+
+    close(follow->fd);
+    follow->fd = follow->reader.fd = fd;
+    pigeon_follow_restart(follow);
+    pigeon_follow_watch(follow);
+    return true;
+}
+
+static bool pigeon_follow_record(pigeon_follow_t * restrict follow, const pigeon_parsed_message_t * restrict message)
+{
+    const char * author = pigeon_encoded_value_key(&message->author, &follow->author_key);
+    if (!author)
+        return false;
+
+    void ** slot = pigeon_map_insert(&follow->checkpoint.last_sequence, author, NULL);
+    if (!slot)
+        return false;
+
+    if ((intptr_t)*slot < message->sequence_number)
+        *slot = (void *)(intptr_t)message->sequence_number;
+    return true;
+}
+
+bool pigeon_follow_poll(pigeon_follow_t * restrict follow, pigeon_follow_callback_t callback, void * user_data)
+{
+    if (!pigeon_follow_check_replaced(follow))
+        return false;
+
+    pigeon_parse_context_t ctx;
+    while (!follow->stop)
+    {
+        const char * msg_data;
+        size_t msg_size;
+        uint64_t msg_offset;
+        pigeon_log_status_t status = pigeon_log_reader_next(&follow->reader, &msg_data, &msg_size, &msg_offset);
+        if (status == PIGEON_LOG_END)
+            break;
+        else if (status == PIGEON_LOG_ERROR)
+        {
+            pigeon_follow_error(follow, "unable to read '%s': %s", follow->log_path, strerror(errno));
+            return false;
+        }
+
+        pigeon_parsed_message_t message;
+        bool parse_success = pigeon_parse_message(&ctx, msg_data, msg_size, &message);
+        if (parse_success && !pigeon_follow_record(follow, &message))
+        {
+            pigeon_free_parsed_message(&message);
+            pigeon_follow_error(follow, "memory allocation failed");
+            return false;
+        }
+
+        bool keep_going = callback(user_data, msg_data, msg_size, msg_offset, parse_success, &ctx, &message);
+        pigeon_free_parsed_message(&message);
+
+        follow->checkpoint.offset = follow->reader.offset;
+        follow->checkpoint.line_number = follow->reader.line_number;
+        if (!keep_going)
+            pigeon_follow_stop(follow);
+
+        if (follow->checkpoint_path && ++follow->unsaved_messages >= follow->checkpoint_every)
+        {
+            if (!pigeon_follow_checkpoint_save(&follow->checkpoint, follow->checkpoint_path))
+            {
+                pigeon_follow_error(follow, "unable to save checkpoint '%s'", follow->checkpoint_path);
+                return false;
+            }
+
+            follow->unsaved_messages = 0;
+        }
+    }
+
+    return true;
+}
+
+void pigeon_follow_wait(pigeon_follow_t * restrict follow, unsigned timeout_ms)
+{
+#ifdef __linux__
+    if (follow->inotify_fd >= 0)
+    {
+        struct pollfd pfd = { .fd = follow->inotify_fd, .events = POLLIN };
+        if (poll(&pfd, 1, (int)timeout_ms) > 0)
+        {
+            // Drain the queued events; the next poll re-reads the file anyway
+            char events[4096];
+            while (read(follow->inotify_fd, events, sizeof(events)) > 0)
+                ;
+        }
+        return;
+    }
+#endif
+
+    struct timespec delay = { .tv_sec = timeout_ms / 1000, .tv_nsec = (long)(timeout_ms % 1000) * 1000000 };
+    nanosleep(&delay, NULL);
+}
+
+bool pigeon_follow_run(pigeon_follow_t * restrict follow, pigeon_follow_callback_t callback, void * user_data)
+{
+    while (!follow->stop)
+    {
+        if (!pigeon_follow_poll(follow, callback, user_data))
+            return false;
+        else if (!follow->stop)
+            pigeon_follow_wait(follow, follow->poll_interval_ms);
+    }
+
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef PIGEON_FOLLOW_H
+#define PIGEON_FOLLOW_H
+
+#include "pigeon_log.h"
+#include "pigeon_map.h"
+#include "pigeon_parser.h"
+#include "pigeon_string.h"
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Follows a log file that is being appended to, parsing only the bytes added
+// since the last look. Growth is detected with inotify where available and
+// by polling otherwise. A message that is only partly written at EOF is held
+// back until its signature line is complete.
+//
+// Progress is persisted in a checkpoint file (byte offset, line number and
+// the last sequence number seen per author), so a restarted consumer
+// resumes where it stopped instead of re-reading the whole log.
+
+#define PIGEON_FOLLOW_DEFAULT_POLL_MS 500
+#define PIGEON_FOLLOW_DEFAULT_CHECKPOINT_EVERY 1000
+
+typedef struct {
+    uint64_t offset;
+    uint64_t line_number;
+    pigeon_map_t last_sequence; // "algorithm:hash" -> sequence number
+} pigeon_follow_checkpoint_t;
+
+// Called for each complete message. When parse_success is false, ctx holds
+// the error and message must not be used. message is freed after the call.
+typedef bool (*pigeon_follow_callback_t)(void * user_data, const char * msg_data, size_t msg_size, uint64_t msg_offset, bool parse_success, const pigeon_parse_context_t * ctx, pigeon_parsed_message_t * message);
+
+typedef struct {
+    char * log_path;
+    char * checkpoint_path;
+
+    int fd;
+    int inotify_fd;
+    pigeon_log_reader_t reader;
+    pigeon_follow_checkpoint_t checkpoint;
+
+    unsigned poll_interval_ms;
+    unsigned checkpoint_every;
+    unsigned unsaved_messages;
+    volatile sig_atomic_t stop;
+    pigeon_string_t author_key;
+
+    char error_messages[256];
+} pigeon_follow_t;
+
+bool pigeon_follow_checkpoint_load(pigeon_follow_checkpoint_t * restrict checkpoint, const char * restrict path);
+
+bool pigeon_follow_checkpoint_save(const pigeon_follow_checkpoint_t * restrict checkpoint, const char * restrict path);
+
+void pigeon_follow_checkpoint_free(pigeon_follow_checkpoint_t * restrict checkpoint);
+
+// checkpoint_path may be NULL to follow from the start without persisting.
+bool pigeon_follow_open(pigeon_follow_t * restrict follow, const char * restrict log_path, const char * restrict checkpoint_path);
+
+// Saves the checkpoint and releases all resources.
+bool pigeon_follow_close(pigeon_follow_t * restrict follow);
+
+// Processes every complete message currently in the file without blocking.
+// A file that shrank below the checkpoint is assumed to have been replaced
+// and is read again from the start.
+bool pigeon_follow_poll(pigeon_follow_t * restrict follow, pigeon_follow_callback_t callback, void * user_data);
+
+// Blocks until the file may have grown or timeout_ms elapses.
+void pigeon_follow_wait(pigeon_follow_t * restrict follow, unsigned timeout_ms);
+
+// Alternates pigeon_follow_poll and pigeon_follow_wait until
+// pigeon_follow_stop is called (it is async-signal-safe) or an error occurs.
+bool pigeon_follow_run(pigeon_follow_t * restrict follow, pigeon_follow_callback_t callback, void * user_data);
+
+static inline void pigeon_follow_stop(pigeon_follow_t * restrict follow)
+{
+    follow->stop = 1;
+}
+
+#endif
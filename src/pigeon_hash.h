@@ -0,0 +1,51 @@
+#ifndef PIGEON_HASH_H
+#define PIGEON_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Non-cryptographic hashing shared by the in-memory indexes. None of these
+// values are persisted, so the functions are free to change.
+
+#define PIGEON_HASH_INIT 0xcbf29ce484222325ull
+
+// 64-bit FNV-1a. Start from PIGEON_HASH_INIT, or from a previous result to
+// hash several pieces as one.
+static inline uint64_t pigeon_hash(uint64_t hash, const void * restrict data, size_t size)
+{
+    const unsigned char * bytes = data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+// A NULL string hashes like the empty one, which is how the parser stores
+// empty names and values.
+static inline uint64_t pigeon_hash_str(uint64_t hash, const char * restrict str)
+{
+    for (; str && *str; ++str)
+    {
+        hash ^= (unsigned char)*str;
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+// The splitmix64 finalizer: spreads every input bit over the whole word,
+// for hashes whose low or high bits are used on their own.
+static inline uint64_t pigeon_hash_mix(uint64_t value)
+{
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ull;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebull;
+    value ^= value >> 31;
+    return value;
+}
+
+#endif
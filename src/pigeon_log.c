@@ -0,0 +1,535 @@
+#include "pigeon_log.h"
+#include "pigeon_memory.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static const char footer_signature[] = "signature";
+
+size_t pigeon_log_skip_separators(const char * restrict data, size_t size)
+{
+    size_t skipped = 0;
+    size_t pos = 0;
+    while (pos < size)
+    {
+        char ch = data[pos++];
+        if (ch == '\n')
+            skipped = pos;
+        else if (ch != ' ' && ch != '\t' && ch != '\r')
+            break;
+    }
+
+    return skipped;
+}
+
+static inline bool pigeon_log_is_footer_line(const char * restrict line, size_t available)
+{
+    return available > sizeof(footer_signature) - 1
+        && 0 == memcmp(line, footer_signature, sizeof(footer_signature) - 1)
+        && (line[sizeof(footer_signature) - 1] == ' ' || line[sizeof(footer_signature) - 1] == '\t');
+}
+
+static inline bool pigeon_log_is_blank(const char * restrict pos, const char * restrict end)
+{
+    for (; pos != end; ++pos)
+        if (*pos != ' ' && *pos != '\t' && *pos != '\r')
+            return false;
+
+    return true;
+}
+
+// Finds the next "\ns" pair in [pos, end), the only place a signature line
+// can begin, 32 or 16 bytes at a time where the target allows it.
+static const char * pigeon_log_find_line_candidate(const char * pos, const char * end)
+{
+#if defined(__AVX2__)
+    const __m256i newline32 = _mm256_set1_epi8('\n');
+    const __m256i letter32 = _mm256_set1_epi8(footer_signature[0]);
+    for (; end - pos > 32; pos += 32)
+    {
+        __m256i current = _mm256_loadu_si256((const __m256i *)pos);
+        __m256i next = _mm256_loadu_si256((const __m256i *)(pos + 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(current, newline32), _mm256_cmpeq_epi8(next, letter32)));
+        if (mask != 0)
+            return pos + __builtin_ctz(mask);
+    }
+#endif
+
+#if defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i letter = _mm_set1_epi8(footer_signature[0]);
+    for (; end - pos > 16; pos += 16)
+    {
+        __m128i current = _mm_loadu_si128((const __m128i *)pos);
+        __m128i next = _mm_loadu_si128((const __m128i *)(pos + 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(current, newline), _mm_cmpeq_epi8(next, letter)));
+        if (mask != 0)
+            return pos + __builtin_ctz(mask);
+    }
+#endif
+
+    for (; end - pos > 1; ++pos)
+        if (pos[0] == '\n' && pos[1] == footer_signature[0])
+            return pos;
+
+    return NULL;
+}
+
+// Returns the start of the first signature line beginning after pos, or NULL.
+static const char * pigeon_log_find_footer(const char * pos, const char * end)
+{
+    while ((pos = pigeon_log_find_line_candidate(pos, end)) != NULL)
+    {
+        if (pigeon_log_is_footer_line(pos + 1, end - pos - 1))
+            return pos + 1;
+        ++pos;
+    }
+
+    return NULL;
+}
+
+size_t pigeon_log_message_end(const char * restrict data, size_t size, size_t * restrict hint)
+{
+    size_t line = hint ? *hint : 0;
+    size_t footer;
+
+    if (line < size && pigeon_log_is_footer_line(data + line, size - line))
+        footer = line;
+    else
+    {
+        const char * found = pigeon_log_find_footer(data + line, data + size);
+        if (!found)
+        {
+            // Resume from the last line, which may still become a footer
+            size_t last_line = size;
+            while (last_line > line && data[last_line - 1] != '\n')
+                --last_line;
+
+            if (hint)
+                *hint = last_line;
+            return 0;
+        }
+
+        footer = found - data;
+    }
+
+    const char * newline = memchr(data + footer, '\n', size - footer);
+    if (!newline)
+    {
+        if (hint)
+            *hint = footer;
+        return 0;
+    }
+
+    return newline - data + 1;
+}
+
+// Tells whether a message boundary falls exactly at offset, i.e. offset
+// begins a line and only blank lines separate it from a signature line or
+// the start of the data.
+static bool pigeon_log_is_boundary(const char * restrict data, size_t offset)
+{
+    if (offset == 0)
+        return true;
+    else if (data[offset - 1] != '\n')
+        return false;
+
+    size_t line_end = offset - 1;
+    for (;;)
+    {
+        size_t line_start = line_end;
+        while (line_start > 0 && data[line_start - 1] != '\n')
+            --line_start;
+
+        if (!pigeon_log_is_blank(data + line_start, data + line_end))
+            return pigeon_log_is_footer_line(data + line_start, line_end - line_start + 1);
+        else if (line_start == 0)
+            return true;
+
+        line_end = line_start - 1;
+    }
+}
+
+size_t pigeon_log_resync(const char * restrict data, size_t size, size_t offset)
+{
+    if (offset >= size)
+        return size;
+
+    if (!pigeon_log_is_boundary(data, offset))
+    {
+        size_t line_start = offset;
+        while (line_start > 0 && data[line_start - 1] != '\n')
+            --line_start;
+
+        // offset may sit inside a footer line; otherwise the next footer can
+        // begin at offset itself, so look from the preceding newline on
+        const char * footer = data + line_start;
+        if (!pigeon_log_is_footer_line(footer, size - line_start))
+            footer = pigeon_log_find_footer(data + offset - 1, data + size);
+
+        const char * newline = footer ? memchr(footer, '\n', data + size - footer) : NULL;
+        if (!newline)
+            return size;
+
+        offset = newline - data + 1;
+    }
+
+    return offset + pigeon_log_skip_separators(data + offset, size - offset);
+}
+
+bool pigeon_log_reader_init(pigeon_log_reader_t * restrict reader, int fd, size_t capacity)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = fd;
+    reader->capacity = capacity != 0 ? capacity : 64 * 1024;
+    reader->line_number = 1;
+    reader->buffer = pigeon_malloc(reader->capacity);
+    return reader->buffer != NULL;
+}
+
+void pigeon_log_reader_free(pigeon_log_reader_t * restrict reader)
+{
+    pigeon_free(reader->buffer);
+    reader->buffer = NULL;
+}
+
+void pigeon_log_reader_reset(pigeon_log_reader_t * restrict reader, uint64_t offset, uint64_t line_number)
+{
+    reader->start = reader->end = reader->scan_hint = 0;
+    reader->offset = offset;
+    reader->line_number = line_number;
+}
+
+static inline uint64_t pigeon_log_count_lines(const char * restrict data, size_t size)
+{
+    uint64_t lines = 0;
+    const char * end = data + size;
+    for (const char * pos = data; (pos = memchr(pos, '\n', end - pos)) != NULL; ++pos)
+        ++lines;
+
+    return lines;
+}
+
+static inline void pigeon_log_reader_consume(pigeon_log_reader_t * restrict reader, size_t size)
+{
+    reader->line_number += pigeon_log_count_lines(reader->buffer + reader->start, size);
+    reader->offset += size;
+    reader->start += size;
+    reader->scan_hint = 0;
+}
+
+static bool pigeon_log_reader_fill(pigeon_log_reader_t * restrict reader, bool * restrict eof)
+{
+    if (reader->start > 0)
+    {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+
+    if (reader->end == reader->capacity)
+    {
+        size_t new_capacity = reader->capacity * 2;
+        char * buffer = pigeon_realloc(reader->buffer, new_capacity);
+        if (!buffer)
+            return false;
+
+        reader->buffer = buffer;
+        reader->capacity = new_capacity;
+    }
+
+    ssize_t count;
+    do
+        count = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+    while (count < 0 && errno == EINTR);
+
+    if (count < 0)
+        return false;
+
+    reader->end += count;
+    *eof = count == 0;
+    return true;
+}
+
+pigeon_log_status_t pigeon_log_reader_next(pigeon_log_reader_t * restrict reader, const char ** restrict msg_data, size_t * restrict msg_size, uint64_t * restrict msg_offset)
+{
+    for (;;)
+    {
+        size_t available = reader->end - reader->start;
+        size_t separators = pigeon_log_skip_separators(reader->buffer + reader->start, available);
+        if (separators > 0)
+            pigeon_log_reader_consume(reader, separators);
+
+        size_t size = pigeon_log_message_end(reader->buffer + reader->start, reader->end - reader->start, &reader->scan_hint);
+        if (size > 0)
+        {
+            *msg_data = reader->buffer + reader->start;
+            *msg_size = size;
+            if (msg_offset)
+                *msg_offset = reader->offset;
+
+            pigeon_log_reader_consume(reader, size);
+            return PIGEON_LOG_MESSAGE;
+        }
+
+        bool eof;
+        if (!pigeon_log_reader_fill(reader, &eof))
+            return PIGEON_LOG_ERROR;
+        else if (eof)
+            return PIGEON_LOG_END;
+    }
+}
+
+void pigeon_log_index_init(pigeon_log_index_t * restrict index)
+{
+    memset(index, 0, sizeof(*index));
+}
+
+void pigeon_log_index_free(pigeon_log_index_t * restrict index)
+{
+    pigeon_free(index->starts);
+    pigeon_free(index->sizes);
+    pigeon_log_index_init(index);
+}
+
+static bool pigeon_log_index_reserve(pigeon_log_index_t * restrict index, size_t capacity)
+{
+    if (capacity <= index->capacity)
+        return true;
+
+    size_t new_capacity = index->capacity != 0 ? index->capacity : 1024;
+    while (new_capacity < capacity)
+        new_capacity *= 2;
+
+    uint64_t * starts = pigeon_realloc(index->starts, new_capacity * sizeof(uint64_t));
+    if (!starts)
+        return false;
+    index->starts = starts;
+
+    uint32_t * sizes = pigeon_realloc(index->sizes, new_capacity * sizeof(uint32_t));
+    if (!sizes)
+        return false;
+    index->sizes = sizes;
+
+    index->capacity = new_capacity;
+    return true;
+}
+
+bool pigeon_log_index_scan(pigeon_log_index_t * restrict index, const char * restrict data, size_t size, size_t from)
+{
+    size_t pos = pigeon_log_resync(data, size, from);
+    while (pos < size)
+    {
+        size_t msg_size = pigeon_log_message_end(data + pos, size - pos, NULL);
+        if (msg_size == 0 || msg_size > UINT32_MAX)
+            break;
+
+        if (index->count == index->capacity && !pigeon_log_index_reserve(index, index->count + 1))
+            return false;
+
+        index->starts[index->count] = pos;
+        index->sizes[index->count] = (uint32_t)msg_size;
+        ++index->count;
+
+        pos += msg_size;
+        index->covered = pos;
+        pos += pigeon_log_skip_separators(data + pos, size - pos);
+    }
+
+    return true;
+}
+
+void pigeon_log_index_reset(pigeon_log_index_t * restrict index)
+{
+    index->count = 0;
+    index->covered = 0;
+}
+
+// Maps the whole file read-only; an empty file yields a NULL map.
+static bool pigeon_log_map_file(const char * restrict path, void ** restrict map, size_t * restrict size)
+{
+    *map = NULL;
+    *size = 0;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    else if (st.st_size == 0)
+    {
+        close(fd);
+        return true;
+    }
+
+    void * data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    *map = data;
+    *size = st.st_size;
+    return true;
+}
+
+bool pigeon_log_index_file(pigeon_log_index_t * restrict index, const char * restrict path, uint64_t from)
+{
+    void * map;
+    size_t size;
+    if (!pigeon_log_map_file(path, &map, &size))
+        return false;
+    else if (!map)
+        return true;
+
+    madvise(map, size, MADV_SEQUENTIAL);
+    bool success = pigeon_log_index_scan(index, map, size, from);
+    munmap(map, size);
+    return success;
+}
+
+// Sidecar layout, native byte order: magic, covered bytes, message count,
+// then the start offsets followed by the sizes.
+static const char log_index_magic[8] = { 'P', 'G', 'N', 'L', 'I', 'D', 'X', '1' };
+
+bool pigeon_log_index_save(const pigeon_log_index_t * restrict index, const char * restrict path)
+{
+    FILE * file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    uint64_t count = index->count;
+    bool success = fwrite(log_index_magic, sizeof(log_index_magic), 1, file) == 1
+        && fwrite(&index->covered, sizeof(index->covered), 1, file) == 1
+        && fwrite(&count, sizeof(count), 1, file) == 1
+        && fwrite(index->starts, sizeof(uint64_t), index->count, file) == index->count
+        && fwrite(index->sizes, sizeof(uint32_t), index->count, file) == index->count;
+
+    if (fclose(file) != 0)
+        success = false;
+
+    return success;
+}
+
+// Entries must be non-empty, in order, non-overlapping, and end exactly
+// where the scan that produced them stopped.
+static bool pigeon_log_index_is_consistent(const pigeon_log_index_t * restrict index)
+{
+    uint64_t end = 0;
+    for (size_t i = 0; i < index->count; ++i)
+    {
+        if (index->sizes[i] == 0 || index->starts[i] < end || index->starts[i] > UINT64_MAX - index->sizes[i])
+            return false;
+
+        end = index->starts[i] + index->sizes[i];
+    }
+
+    return index->covered == end;
+}
+
+bool pigeon_log_index_load(pigeon_log_index_t * restrict index, const char * restrict path)
+{
+    pigeon_log_index_init(index);
+
+    FILE * file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    const uint64_t entry_size = sizeof(uint64_t) + sizeof(uint32_t);
+    const uint64_t header_size = sizeof(log_index_magic) + 2 * sizeof(uint64_t);
+
+    // The count is only trusted if the file holds exactly that many entries
+    struct stat st;
+    char magic[sizeof(log_index_magic)];
+    uint64_t covered;
+    uint64_t count;
+    bool success = fstat(fileno(file), &st) == 0
+        && (uint64_t)st.st_size >= header_size
+        && fread(magic, sizeof(magic), 1, file) == 1
+        && 0 == memcmp(magic, log_index_magic, sizeof(magic))
+        && fread(&covered, sizeof(covered), 1, file) == 1
+        && fread(&count, sizeof(count), 1, file) == 1
+        && count == ((uint64_t)st.st_size - header_size) / entry_size
+        && ((uint64_t)st.st_size - header_size) % entry_size == 0
+        && count <= SIZE_MAX / sizeof(uint64_t)
+        && pigeon_log_index_reserve(index, count)
+        && fread(index->starts, sizeof(uint64_t), count, file) == count
+        && fread(index->sizes, sizeof(uint32_t), count, file) == count;
+
+    fclose(file);
+    if (success)
+    {
+        index->count = count;
+        index->covered = covered;
+        success = pigeon_log_index_is_consistent(index);
+    }
+
+    if (!success)
+    {
+        pigeon_log_index_free(index);
+        return false;
+    }
+
+    return true;
+}
+
+// Tells whether the entry still describes a complete message of data.
+static bool pigeon_log_index_entry_matches(const pigeon_log_index_t * restrict index, size_t entry, const char * restrict data, size_t size)
+{
+    uint64_t start = index->starts[entry];
+    return pigeon_log_resync(data, size, start) == start
+        && pigeon_log_message_end(data + start, size - start, NULL) == index->sizes[entry];
+}
+
+bool pigeon_log_index_open(pigeon_log_index_t * restrict index, const char * restrict sidecar_path, const char * restrict log_path, bool * restrict rescanned)
+{
+    bool loaded = pigeon_log_index_load(index, sidecar_path);
+
+    void * map;
+    size_t size;
+    if (!pigeon_log_map_file(log_path, &map, &size))
+    {
+        pigeon_log_index_free(index);
+        return false;
+    }
+
+    // A sidecar is reused when the log still holds the messages it recorded
+    // at both ends; anything else, including a log that shrank, is rescanned.
+    const char * data = map;
+    bool reuse = loaded
+        && index->covered <= size
+        && (index->count == 0
+            || (pigeon_log_index_entry_matches(index, 0, data, size)
+                && pigeon_log_index_entry_matches(index, index->count - 1, data, size)));
+
+    if (!reuse)
+        pigeon_log_index_reset(index);
+
+    if (rescanned)
+        *rescanned = !reuse;
+
+    bool success = true;
+    if (map)
+    {
+        madvise(map, size, MADV_SEQUENTIAL);
+        success = pigeon_log_index_scan(index, data, size, index->covered);
+        munmap(map, size);
+    }
+
+    return success;
+}
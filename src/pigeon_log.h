@@ -0,0 +1,105 @@
+#ifndef PIGEON_LOG_H
+#define PIGEON_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A log is a sequence of messages, each ending with its "signature" footer
+// line, optionally separated by blank lines. These helpers find message
+// boundaries without running the parser.
+
+// Returns the position of the first message boundary at or after offset:
+// offset itself if a message starts there, otherwise the start of the
+// message following the next signature line. Returns size if there is none.
+size_t pigeon_log_resync(const char * restrict data, size_t size, size_t offset);
+
+// Returns the number of leading blank (whitespace-only) lines' bytes.
+size_t pigeon_log_skip_separators(const char * restrict data, size_t size);
+
+// Returns the size of the message at the start of data, up to and including
+// the newline that ends its signature line, or 0 if data does not yet hold a
+// complete message. Scanning starts at the line beginning at data + hint,
+// which lets callers resume after a previous unsuccessful call; on failure
+// *hint is set to the start of the last, incomplete line.
+size_t pigeon_log_message_end(const char * restrict data, size_t size, size_t * restrict hint);
+
+typedef enum {
+    PIGEON_LOG_MESSAGE,
+    PIGEON_LOG_END,
+    PIGEON_LOG_ERROR
+} pigeon_log_status_t;
+
+// Buffered reader that yields one complete message at a time from a file
+// descriptor. A partial message at the end of the file stays buffered, and
+// later calls pick up where the file has since grown.
+typedef struct {
+    int fd;
+    char * buffer;
+    size_t capacity;
+    size_t start;
+    size_t end;
+    size_t scan_hint;
+
+    uint64_t offset;      // file offset of buffer[start]
+    uint64_t line_number; // line number of buffer[start], from 1
+} pigeon_log_reader_t;
+
+bool pigeon_log_reader_init(pigeon_log_reader_t * restrict reader, int fd, size_t capacity);
+
+void pigeon_log_reader_free(pigeon_log_reader_t * restrict reader);
+
+// Drops buffered data and continues from the given position, which must
+// match the descriptor's current file offset.
+void pigeon_log_reader_reset(pigeon_log_reader_t * restrict reader, uint64_t offset, uint64_t line_number);
+
+// On PIGEON_LOG_MESSAGE, *msg_data stays valid until the next call.
+// *msg_offset receives the message's file offset if msg_offset is not NULL.
+pigeon_log_status_t pigeon_log_reader_next(pigeon_log_reader_t * restrict reader, const char ** restrict msg_data, size_t * restrict msg_size, uint64_t * restrict msg_offset);
+
+// Bytes of a trailing incomplete message currently buffered.
+static inline size_t pigeon_log_reader_pending(const pigeon_log_reader_t * restrict reader)
+{
+    return reader->end - reader->start;
+}
+
+// Compact index of message boundaries: start offset and size of each
+// complete message, found without running the parser. It can be persisted
+// as a sidecar file next to the log.
+typedef struct {
+    uint64_t * starts;
+    uint32_t * sizes;
+    size_t count;
+    size_t capacity;
+
+    uint64_t covered; // log bytes scanned up to the end of the last message
+} pigeon_log_index_t;
+
+void pigeon_log_index_init(pigeon_log_index_t * restrict index);
+
+void pigeon_log_index_free(pigeon_log_index_t * restrict index);
+
+// Forgets every entry but keeps the storage, for a fresh scan.
+void pigeon_log_index_reset(pigeon_log_index_t * restrict index);
+
+// Appends the boundaries of every complete message in data, beginning at the
+// first boundary at or after from (see pigeon_log_resync).
+bool pigeon_log_index_scan(pigeon_log_index_t * restrict index, const char * restrict data, size_t size, size_t from);
+
+// Maps the log at path and indexes it from the given offset.
+bool pigeon_log_index_file(pigeon_log_index_t * restrict index, const char * restrict path, uint64_t from);
+
+bool pigeon_log_index_save(const pigeon_log_index_t * restrict index, const char * restrict path);
+
+// Fails on a sidecar whose size does not match its entry count or whose
+// entries are out of order, overlap or do not end at the covered offset.
+bool pigeon_log_index_load(pigeon_log_index_t * restrict index, const char * restrict path);
+
+// Loads the sidecar for the log at log_path and brings it up to date. The
+// sidecar is kept only if its first and last entries still match the log,
+// and then just the bytes past its covered offset are scanned; a missing,
+// corrupt or stale sidecar leads to a rescan of the whole log, which is
+// reported through rescanned (may be NULL).
+bool pigeon_log_index_open(pigeon_log_index_t * restrict index, const char * restrict sidecar_path, const char * restrict log_path, bool * restrict rescanned);
+
+#endif
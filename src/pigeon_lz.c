@@ -0,0 +1,176 @@
+#include "pigeon_lz.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define PIGEON_LZ_MIN_MATCH 4
+#define PIGEON_LZ_HASH_BITS 14
+#define PIGEON_LZ_MAX_OFFSET 65535
+#define PIGEON_LZ_LAST_LITERALS 5
+
+static inline uint32_t pigeon_lz_read32(const uint8_t * p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t pigeon_lz_hash(uint32_t value)
+{
+    return (value * 2654435761u) >> (32 - PIGEON_LZ_HASH_BITS);
+}
+
+static uint8_t * pigeon_lz_write_length(uint8_t * op, const uint8_t * oend, size_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        if (op == oend)
+            return NULL;
+        *op++ = 255;
+    }
+
+    if (op == oend)
+        return NULL;
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+static uint8_t * pigeon_lz_write_sequence(uint8_t * op, const uint8_t * oend, const uint8_t * literals, size_t literal_length, size_t offset, size_t match_length)
+{
+    if (op == oend)
+        return NULL;
+
+    uint8_t * token = op++;
+    *token = (uint8_t)((literal_length < 15 ? literal_length : 15) << 4);
+    if (literal_length >= 15 && (op = pigeon_lz_write_length(op, oend, literal_length - 15)) == NULL)
+        return NULL;
+
+    if ((size_t)(oend - op) < literal_length)
+        return NULL;
+    memcpy(op, literals, literal_length);
+    op += literal_length;
+
+    if (match_length == 0)
+        return op; // final sequence, literals only
+
+    if (oend - op < 2)
+        return NULL;
+    *op++ = (uint8_t)(offset & 0xff);
+    *op++ = (uint8_t)(offset >> 8);
+
+    size_t extra = match_length - PIGEON_LZ_MIN_MATCH;
+    *token |= (uint8_t)(extra < 15 ? extra : 15);
+    if (extra >= 15 && (op = pigeon_lz_write_length(op, oend, extra - 15)) == NULL)
+        return NULL;
+
+    return op;
+}
+
+size_t pigeon_lz_compress(const char * restrict src, size_t src_size, char * restrict dst, size_t dst_capacity)
+{
+    const uint8_t * in = (const uint8_t *)src;
+    uint8_t * op = (uint8_t *)dst;
+    const uint8_t * oend = op + dst_capacity;
+
+    uint32_t table[1 << PIGEON_LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    size_t pos = 0;
+    size_t anchor = 0;
+
+    if (src_size > PIGEON_LZ_LAST_LITERALS + PIGEON_LZ_MIN_MATCH)
+    {
+        size_t match_limit = src_size - PIGEON_LZ_LAST_LITERALS;
+        while (pos + PIGEON_LZ_MIN_MATCH <= match_limit)
+        {
+            uint32_t sequence = pigeon_lz_read32(in + pos);
+            uint32_t hash = pigeon_lz_hash(sequence);
+            size_t ref = table[hash];
+            table[hash] = (uint32_t)pos;
+
+            if (ref >= pos || pos - ref > PIGEON_LZ_MAX_OFFSET || pigeon_lz_read32(in + ref) != sequence)
+            {
+                ++pos;
+                continue;
+            }
+
+            size_t match_length = PIGEON_LZ_MIN_MATCH;
+            while (pos + match_length < match_limit && in[ref + match_length] == in[pos + match_length])
+                ++match_length;
+
+            op = pigeon_lz_write_sequence(op, oend, in + anchor, pos - anchor, pos - ref, match_length);
+            if (!op)
+                return 0;
+
+            pos += match_length;
+            anchor = pos;
+        }
+    }
+
+    op = pigeon_lz_write_sequence(op, oend, in + anchor, src_size - anchor, 0, 0);
+    if (!op)
+        return 0;
+
+    return op - (uint8_t *)dst;
+}
+
+static inline bool pigeon_lz_read_length(const uint8_t ** ip, const uint8_t * iend, size_t * length)
+{
+    uint8_t byte;
+    do
+    {
+        if (*ip == iend)
+            return false;
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+bool pigeon_lz_decompress(const char * restrict src, size_t src_size, char * restrict dst, size_t dst_size)
+{
+    const uint8_t * ip = (const uint8_t *)src;
+    const uint8_t * iend = ip + src_size;
+    uint8_t * op = (uint8_t *)dst;
+    uint8_t * oend = op + dst_size;
+
+    while (ip != iend)
+    {
+        uint8_t token = *ip++;
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !pigeon_lz_read_length(&ip, iend, &literal_length))
+            return false;
+
+        if ((size_t)(iend - ip) < literal_length || (size_t)(oend - op) < literal_length)
+            return false;
+        memcpy(op, ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return false;
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+
+        size_t match_length = token & 0x0f;
+        if (match_length == 15 && !pigeon_lz_read_length(&ip, iend, &match_length))
+            return false;
+        match_length += PIGEON_LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > (size_t)(op - (uint8_t *)dst) || (size_t)(oend - op) < match_length)
+            return false;
+
+        // Matches may overlap their own output, so copy byte by byte.
+        const uint8_t * match = op - offset;
+        for (size_t i = 0; i < match_length; ++i)
+            op[i] = match[i];
+        op += match_length;
+    }
+
+    return op == oend;
+}
@@ -0,0 +1,22 @@
+#ifndef PIGEON_LZ_H
+#define PIGEON_LZ_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// A small LZ77 block codec (LZ4-style sequences) used when zlib is not
+// available at build time. Blocks are self-contained and carry no header;
+// the caller is expected to record the uncompressed size separately.
+
+static inline size_t pigeon_lz_compress_bound(size_t src_size)
+{
+    return src_size + src_size / 255 + 16;
+}
+
+// Returns the compressed size, or 0 if the output did not fit in dst_capacity.
+size_t pigeon_lz_compress(const char * restrict src, size_t src_size, char * restrict dst, size_t dst_capacity);
+
+// Succeeds only if src decodes to exactly dst_size bytes.
+bool pigeon_lz_decompress(const char * restrict src, size_t src_size, char * restrict dst, size_t dst_size);
+
+#endif
@@ -0,0 +1,136 @@
+#include "pigeon_map.h"
+#include "pigeon_hash.h"
+#include "pigeon_memory.h"
+#include "pigeon_string.h"
+
+#include <string.h>
+
+static inline uint64_t pigeon_map_hash(const char * restrict key)
+{
+    return pigeon_hash_str(PIGEON_HASH_INIT, key);
+}
+
+bool pigeon_map_init(pigeon_map_t * restrict map, size_t initial_capacity)
+{
+    size_t capacity = 16;
+    while (capacity < initial_capacity * 2)
+        capacity *= 2;
+
+    map->entries = pigeon_malloc(capacity * sizeof(pigeon_map_entry_t));
+    if (!map->entries)
+        return false;
+
+    memset(map->entries, 0, capacity * sizeof(pigeon_map_entry_t));
+    map->capacity = capacity;
+    map->count = 0;
+    return true;
+}
+
+void pigeon_map_free(pigeon_map_t * restrict map, void (*free_value)(void * value))
+{
+    for (size_t i = 0; map->entries && i < map->capacity; ++i)
+    {
+        if (!map->entries[i].key)
+            continue;
+
+        pigeon_free(map->entries[i].key);
+        if (free_value)
+            free_value(map->entries[i].value);
+    }
+
+    pigeon_free(map->entries);
+    map->entries = NULL;
+    map->capacity = map->count = 0;
+}
+
+static pigeon_map_entry_t * pigeon_map_probe(const pigeon_map_t * restrict map, const char * restrict key, uint64_t hash)
+{
+    size_t mask = map->capacity - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+    {
+        pigeon_map_entry_t * entry = &map->entries[slot];
+        if (!entry->key || (entry->hash == hash && 0 == strcmp(entry->key, key)))
+            return entry;
+    }
+}
+
+void ** pigeon_map_find(const pigeon_map_t * restrict map, const char * restrict key)
+{
+    pigeon_map_entry_t * entry = pigeon_map_probe(map, key, pigeon_map_hash(key));
+    return entry->key ? &entry->value : NULL;
+}
+
+static bool pigeon_map_grow(pigeon_map_t * restrict map)
+{
+    pigeon_map_t grown;
+    if (!pigeon_map_init(&grown, map->capacity))
+        return false;
+
+    for (size_t i = 0; i < map->capacity; ++i)
+        if (map->entries[i].key)
+            *pigeon_map_probe(&grown, map->entries[i].key, map->entries[i].hash) = map->entries[i];
+
+    grown.count = map->count;
+    pigeon_free(map->entries);
+    *map = grown;
+    return true;
+}
+
+void ** pigeon_map_insert(pigeon_map_t * restrict map, const char * restrict key, bool * restrict inserted)
+{
+    uint64_t hash = pigeon_map_hash(key);
+    pigeon_map_entry_t * entry = pigeon_map_probe(map, key, hash);
+    if (entry->key)
+    {
+        if (inserted)
+            *inserted = false;
+        return &entry->value;
+    }
+
+    if ((map->count + 1) * 2 > map->capacity)
+    {
+        if (!pigeon_map_grow(map))
+            return NULL;
+        entry = pigeon_map_probe(map, key, hash);
+    }
+
+    entry->key = pigeon_strdup_range(key, strlen(key));
+    if (!entry->key)
+        return NULL;
+
+    entry->hash = hash;
+    entry->value = NULL;
+    ++map->count;
+    if (inserted)
+        *inserted = true;
+    return &entry->value;
+}
+
+bool pigeon_map_remove(pigeon_map_t * restrict map, const char * restrict key, void ** restrict value)
+{
+    pigeon_map_entry_t * entry = pigeon_map_probe(map, key, pigeon_map_hash(key));
+    if (!entry->key)
+        return false;
+
+    if (value)
+        *value = entry->value;
+    pigeon_free(entry->key);
+
+    // Backward-shift deletion: pull later entries of the probe run into the
+    // hole unless that would move them before their home slot.
+    size_t mask = map->capacity - 1;
+    size_t hole = entry - map->entries;
+    for (size_t slot = (hole + 1) & mask; map->entries[slot].key; slot = (slot + 1) & mask)
+    {
+        size_t home = map->entries[slot].hash & mask;
+        if (((slot - home) & mask) >= ((slot - hole) & mask))
+        {
+            map->entries[hole] = map->entries[slot];
+            hole = slot;
+        }
+    }
+
+    memset(&map->entries[hole], 0, sizeof(pigeon_map_entry_t));
+    --map->count;
+    return true;
+}
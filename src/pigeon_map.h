@@ -0,0 +1,49 @@
+#ifndef PIGEON_MAP_H
+#define PIGEON_MAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Open-addressing hash map from NUL-terminated strings to opaque values.
+// Keys are copied into the map.
+
+typedef struct {
+    char * key;
+    void * value;
+    uint64_t hash;
+} pigeon_map_entry_t;
+
+typedef struct {
+    pigeon_map_entry_t * entries;
+    size_t capacity;
+    size_t count;
+} pigeon_map_t;
+
+bool pigeon_map_init(pigeon_map_t * restrict map, size_t initial_capacity);
+
+// free_value may be NULL.
+void pigeon_map_free(pigeon_map_t * restrict map, void (*free_value)(void * value));
+
+// Returns the value slot for key, or NULL if the key is absent.
+void ** pigeon_map_find(const pigeon_map_t * restrict map, const char * restrict key);
+
+// Returns the value slot for key, inserting it with a NULL value if absent.
+// Returns NULL if memory allocation fails.
+void ** pigeon_map_insert(pigeon_map_t * restrict map, const char * restrict key, bool * restrict inserted);
+
+// Removes key, storing its value in *value if value is not NULL. Returns
+// false if the key is absent. Invalidates pointers returned by find/insert.
+bool pigeon_map_remove(pigeon_map_t * restrict map, const char * restrict key, void ** restrict value);
+
+static inline pigeon_map_entry_t * pigeon_map_next(const pigeon_map_t * restrict map, pigeon_map_entry_t * entry)
+{
+    pigeon_map_entry_t * end = map->entries + map->capacity;
+    for (entry = entry ? entry + 1 : map->entries; entry != end; ++entry)
+        if (entry->key)
+            return entry;
+
+    return NULL;
+}
+
+#endif
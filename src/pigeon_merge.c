@@ -0,0 +1,316 @@
+#include "pigeon_merge.h"
+#include "pigeon_memory.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PIGEON_MERGE_ARITY 4
+
+static void pigeon_merge_error(pigeon_merge_t * restrict merge, const char * format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(merge->error_messages, sizeof(merge->error_messages), format, ap);
+    va_end(ap);
+}
+
+static inline int pigeon_merge_compare(const pigeon_parsed_message_t * restrict lhs, const pigeon_parsed_message_t * restrict rhs)
+{
+    if (lhs->timestamp != rhs->timestamp)
+        return lhs->timestamp < rhs->timestamp ? -1 : 1;
+
+    if (lhs->author.encoding_type != rhs->author.encoding_type)
+        return lhs->author.encoding_type < rhs->author.encoding_type ? -1 : 1;
+
+    int cmp = strcmp(lhs->author.hash ? lhs->author.hash : "", rhs->author.hash ? rhs->author.hash : "");
+    if (cmp != 0)
+        return cmp;
+
+    if (lhs->sequence_number != rhs->sequence_number)
+        return lhs->sequence_number < rhs->sequence_number ? -1 : 1;
+
+    return 0;
+}
+
+static inline bool pigeon_merge_less(const pigeon_merge_t * restrict merge, unsigned lhs, unsigned rhs)
+{
+    int cmp = pigeon_merge_compare(&merge->inputs[lhs].message, &merge->inputs[rhs].message);
+    return cmp < 0 || (cmp == 0 && lhs < rhs); // ties keep input order
+}
+
+static void pigeon_merge_sift_down(pigeon_merge_t * restrict merge, size_t pos)
+{
+    unsigned * heap = merge->heap;
+    unsigned moving = heap[pos];
+
+    for (;;)
+    {
+        size_t first_child = pos * PIGEON_MERGE_ARITY + 1;
+        if (first_child >= merge->heap_size)
+            break;
+
+        size_t last_child = first_child + PIGEON_MERGE_ARITY;
+        if (last_child > merge->heap_size)
+            last_child = merge->heap_size;
+
+        size_t best = first_child;
+        for (size_t child = first_child + 1; child < last_child; ++child)
+            if (pigeon_merge_less(merge, heap[child], heap[best]))
+                best = child;
+
+        if (!pigeon_merge_less(merge, heap[best], moving))
+            break;
+
+        heap[pos] = heap[best];
+        pos = best;
+    }
+
+    heap[pos] = moving;
+}
+
+static void pigeon_merge_skip(pigeon_merge_t * restrict merge, const pigeon_merge_input_t * restrict input, uint64_t line_number, const char * restrict reason)
+{
+    ++merge->skipped;
+    if (merge->skip_callback)
+        merge->skip_callback(merge->skip_user_data, input->path, line_number, reason);
+}
+
+// Closes an input's file and frees its read-ahead buffer. The reader keeps
+// its offset and line number, which is where reading resumes.
+static void pigeon_merge_release(pigeon_merge_t * restrict merge, pigeon_merge_input_t * restrict input)
+{
+    if (input->fd < 0)
+        return;
+
+    pigeon_log_reader_free(&input->reader);
+    close(input->fd);
+    input->fd = -1;
+    --merge->open_count;
+}
+
+// Moves the current message of an open input out of its read-ahead buffer
+// and releases the input.
+static bool pigeon_merge_park(pigeon_merge_t * restrict merge, pigeon_merge_input_t * restrict input)
+{
+    if (input->msg_data)
+    {
+        if (input->msg_size > input->parked_capacity)
+        {
+            char * parked_data = pigeon_realloc(input->parked_data, input->msg_size);
+            if (!parked_data)
+                return false;
+
+            input->parked_data = parked_data;
+            input->parked_capacity = input->msg_size;
+        }
+
+        memcpy(input->parked_data, input->msg_data, input->msg_size);
+        input->msg_data = input->parked_data;
+    }
+
+    pigeon_merge_release(merge, input);
+    return true;
+}
+
+// Makes sure the input is open, parking others to stay within max_open.
+static bool pigeon_merge_resume(pigeon_merge_t * restrict merge, size_t index)
+{
+    pigeon_merge_input_t * input = &merge->inputs[index];
+    if (input->fd >= 0)
+        return true;
+
+    size_t max_open = merge->max_open != 0 ? merge->max_open : 1;
+    for (size_t tries = 0; merge->open_count >= max_open && tries < merge->input_count; ++tries)
+    {
+        size_t victim = merge->clock++ % merge->input_count;
+        if (victim != index && merge->inputs[victim].fd >= 0 && !pigeon_merge_park(merge, &merge->inputs[victim]))
+        {
+            pigeon_merge_error(merge, "memory allocation failed");
+            return false;
+        }
+    }
+
+    uint64_t offset = input->reader.offset;
+    uint64_t line_number = input->reader.line_number;
+
+    input->fd = open(input->path, O_RDONLY | O_CLOEXEC);
+    if (input->fd < 0)
+    {
+        pigeon_merge_error(merge, "unable to open '%s': %s", input->path, strerror(errno));
+        return false;
+    }
+
+    ++merge->open_count;
+    if (offset != 0 && lseek(input->fd, (off_t)offset, SEEK_SET) < 0)
+    {
+        pigeon_merge_error(merge, "unable to seek in '%s': %s", input->path, strerror(errno));
+        return false;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(input->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    if (!pigeon_log_reader_init(&input->reader, input->fd, PIGEON_MERGE_READ_AHEAD))
+    {
+        pigeon_merge_error(merge, "memory allocation failed");
+        return false;
+    }
+
+    pigeon_log_reader_reset(&input->reader, offset, line_number);
+    return true;
+}
+
+// Moves input to its next message that parses. Returns false on error;
+// *exhausted is set when the input has no more messages.
+static bool pigeon_merge_advance(pigeon_merge_t * restrict merge, size_t index, bool * restrict exhausted)
+{
+    pigeon_merge_input_t * input = &merge->inputs[index];
+    if (input->msg_data)
+    {
+        pigeon_free_parsed_message(&input->message);
+        input->msg_data = NULL;
+    }
+
+    if (!pigeon_merge_resume(merge, index))
+        return false;
+
+    for (;;)
+    {
+        const char * msg_data;
+        size_t msg_size;
+        uint64_t line_number = input->reader.line_number;
+        pigeon_log_status_t status = pigeon_log_reader_next(&input->reader, &msg_data, &msg_size, NULL);
+        if (status == PIGEON_LOG_ERROR)
+        {
+            pigeon_merge_error(merge, "unable to read '%s': %s", input->path, strerror(errno));
+            return false;
+        }
+        else if (status == PIGEON_LOG_END)
+        {
+            if (pigeon_log_reader_pending(&input->reader) > 0)
+                pigeon_merge_skip(merge, input, input->reader.line_number, "incomplete message at end of file");
+
+            pigeon_merge_release(merge, input);
+            *exhausted = true;
+            return true;
+        }
+
+        if (pigeon_parse_message(&merge->ctx, msg_data, msg_size, &input->message))
+        {
+            input->msg_data = msg_data;
+            input->msg_size = msg_size;
+            *exhausted = false;
+            return true;
+        }
+
+        pigeon_free_parsed_message(&input->message);
+        pigeon_merge_skip(merge, input, line_number, pigeon_get_error_messages(&merge->ctx));
+    }
+}
+
+bool pigeon_merge_open(pigeon_merge_t * restrict merge, const char * const * paths, size_t path_count)
+{
+    memset(merge, 0, sizeof(*merge));
+    merge->max_open = PIGEON_MERGE_DEFAULT_MAX_OPEN;
+
+    merge->inputs = pigeon_malloc((path_count != 0 ? path_count : 1) * sizeof(pigeon_merge_input_t));
+    merge->heap = pigeon_malloc((path_count != 0 ? path_count : 1) * sizeof(unsigned));
+    if (!merge->inputs || !merge->heap)
+    {
+        pigeon_merge_error(merge, "memory allocation failed");
+        pigeon_merge_close(merge);
+        return false;
+    }
+
+    for (; merge->input_count < path_count; ++merge->input_count)
+    {
+        pigeon_merge_input_t * input = &merge->inputs[merge->input_count];
+        memset(input, 0, sizeof(*input));
+        input->path = paths[merge->input_count];
+        input->fd = -1;
+        input->reader.line_number = 1;
+    }
+
+    return true;
+}
+
+void pigeon_merge_close(pigeon_merge_t * restrict merge)
+{
+    for (size_t i = 0; i < merge->input_count; ++i)
+    {
+        pigeon_merge_input_t * input = &merge->inputs[i];
+        if (input->msg_data)
+            pigeon_free_parsed_message(&input->message);
+
+        pigeon_merge_release(merge, input);
+        pigeon_free(input->parked_data);
+    }
+
+    pigeon_free(merge->inputs);
+    pigeon_free(merge->heap);
+    merge->inputs = NULL;
+    merge->heap = NULL;
+    merge->input_count = merge->heap_size = 0;
+}
+
+// Reads the first message of every input and builds the heap.
+static bool pigeon_merge_start(pigeon_merge_t * restrict merge)
+{
+    merge->started = true;
+    for (size_t i = 0; i < merge->input_count; ++i)
+    {
+        bool exhausted;
+        if (!pigeon_merge_advance(merge, i, &exhausted))
+            return false;
+
+        if (!exhausted)
+            merge->heap[merge->heap_size++] = (unsigned)i;
+    }
+
+    for (size_t pos = merge->heap_size / PIGEON_MERGE_ARITY + 1; pos-- > 0;)
+        if (pos < merge->heap_size)
+            pigeon_merge_sift_down(merge, pos);
+
+    return true;
+}
+
+bool pigeon_merge_next(pigeon_merge_t * restrict merge, const char ** restrict msg_data, size_t * restrict msg_size, const pigeon_parsed_message_t ** restrict message)
+{
+    merge->error_messages[0] = '\0';
+
+    if (!merge->started && !pigeon_merge_start(merge))
+        return false;
+
+    if (merge->has_current)
+    {
+        // The returned input is still at the top of the heap
+        bool exhausted;
+        if (!pigeon_merge_advance(merge, merge->current, &exhausted))
+            return false;
+
+        if (exhausted)
+            merge->heap[0] = merge->heap[--merge->heap_size];
+
+        if (merge->heap_size > 0)
+            pigeon_merge_sift_down(merge, 0);
+
+        merge->has_current = false;
+    }
+
+    if (merge->heap_size == 0)
+        return false;
+
+    merge->current = merge->heap[0];
+    merge->has_current = true;
+
+    pigeon_merge_input_t * input = &merge->inputs[merge->current];
+    *msg_data = input->msg_data;
+    *msg_size = input->msg_size;
+    *message = &input->message;
+    return true;
+}
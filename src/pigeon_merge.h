@@ -0,0 +1,83 @@
+#ifndef PIGEON_MERGE_H
+#define PIGEON_MERGE_H
+
+#include "pigeon_log.h"
+#include "pigeon_parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming k-way merge of many feed logs into a single timeline ordered by
+// (timestamp, author, sequence). Only the current message of each input is
+// held parsed, so memory grows with the number of feeds rather than with the
+// size of the logs.
+//
+// At most max_open inputs hold a file descriptor and a read-ahead buffer at
+// a time. When another input has to be read, the least recently touched
+// open one is parked: its current message is copied aside and its file is
+// closed, to be reopened at the same offset when it is needed again. This
+// keeps a merge of thousands of feeds below RLIMIT_NOFILE.
+//
+// Inputs are kept in a 4-ary min-heap of input indices. Each input should
+// already be in timeline order (a single author's feed always is); the
+// merge does not reorder messages within one input.
+
+#define PIGEON_MERGE_READ_AHEAD (64 * 1024)
+#define PIGEON_MERGE_DEFAULT_MAX_OPEN 64
+
+// Called for each message that is skipped because it does not parse or is
+// cut short at the end of its file.
+typedef void (*pigeon_merge_skip_callback_t)(void * user_data, const char * path, uint64_t line_number, const char * reason);
+
+typedef struct {
+    const char * path;
+    int fd; // -1 while parked
+    pigeon_log_reader_t reader;
+
+    const char * msg_data;
+    size_t msg_size;
+    pigeon_parsed_message_t message;
+
+    char * parked_data; // copy of the current message while parked
+    size_t parked_capacity;
+} pigeon_merge_input_t;
+
+typedef struct {
+    pigeon_merge_input_t * inputs;
+    size_t input_count;
+
+    unsigned * heap;
+    size_t heap_size;
+    bool started;
+
+    // Input whose message was returned last; it is advanced on the next call
+    size_t current;
+    bool has_current;
+
+    size_t max_open;
+    size_t open_count;
+    size_t clock; // next input considered for parking
+
+    pigeon_merge_skip_callback_t skip_callback;
+    void * skip_user_data;
+    uint64_t skipped;
+
+    pigeon_parse_context_t ctx;
+    char error_messages[256];
+} pigeon_merge_t;
+
+// The path strings must outlive the merge. Files are opened on the first
+// call to pigeon_merge_next, so max_open and the skip callback may be set in
+// between.
+bool pigeon_merge_open(pigeon_merge_t * restrict merge, const char * const * paths, size_t path_count);
+
+void pigeon_merge_close(pigeon_merge_t * restrict merge);
+
+// Returns the next message in timeline order. msg_data and message belong
+// to the merge and stay valid until the next call. Messages that cannot be
+// parsed are counted in skipped, reported to the skip callback and left
+// out. Returns false at the end of all inputs or on error; error_messages
+// is empty in the former case.
+bool pigeon_merge_next(pigeon_merge_t * restrict merge, const char ** restrict msg_data, size_t * restrict msg_size, const pigeon_parsed_message_t ** restrict message);
+
+#endif
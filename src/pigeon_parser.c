@@ -1,5 +1,6 @@
 
 #include "pigeon_parser.h"
+#include "pigeon_schema.h"
 #include "pigeon_string.h"
 #include "pigeon_memory.h"
 #include "pigeon_list.h"
@@ -11,6 +12,18 @@
 #include <stdlib.h>
 #include <stdarg.h>
 
+#if defined(__GNUC__)
+#define PIGEON_PARSE_INLINE inline __attribute__((always_inline))
+#else
+#define PIGEON_PARSE_INLINE inline
+#endif
+
+typedef enum {
+    PIGEON_PARSE_MODE_VALIDATE, // grammar check only, nothing is allocated
+    PIGEON_PARSE_MODE_BUILD,    // header and field list are fully materialized
+    PIGEON_PARSE_MODE_CALLBACK  // header is materialized, fields are handed to a callback one by one
+} pigeon_parse_mode_t;
+
 static const char encoding_str_sha256[] = "sha256";
 static const char encoding_str_ed25519[] = "ed25519";
 
@@ -30,13 +43,13 @@ static void pigeon_parse_error(pigeon_parse_context_t * restrict ctx, const char
     memcpy(&ctx->error_messages[sizeof(ctx->error_messages) - remaining], "\n", 2);
 }
 
-static const char * pigeon_make_temp_str_range(const char * restrict start, const char * end)
+// Copies a range into a caller-supplied buffer for use in error messages;
+// the buffer lives on the caller's stack so concurrent parses never share it.
+static const char * pigeon_make_temp_str_range(char * restrict buffer, size_t buffer_size, const char * restrict start, const char * end)
 {
-    static char buffer[256];
-
-    unsigned size = end - start;
-    if (size >= sizeof(buffer) - 1)
-        size = sizeof(buffer) - 1;
+    size_t size = end - start;
+    if (size >= buffer_size)
+        size = buffer_size - 1;
 
     memcpy(buffer, start, size);
     buffer[size] = '\0';
@@ -75,6 +88,14 @@ static void pigeon_free_field(pigeon_field_t * restrict field)
         case PIGEON_FIELD_STRING:
             pigeon_free(field->field_value.string);
             break;
+
+        case PIGEON_FIELD_STREAMED:
+            // Only the length is kept; the sink owns the data
+            break;
+
+        case PIGEON_FIELD_EMPTY:
+        case PIGEON_FIELD_INT64:
+            break;
     }
 
     field->field_type = PIGEON_FIELD_EMPTY;
@@ -165,7 +186,7 @@ static pigeon_message_size_t pigeon_skip_ws(pigeon_parse_context_t * restrict ct
     return skipped_bytes;
 }
 
-static bool pigeon_parse_encoded_value(pigeon_parse_context_t * restrict ctx, pigeon_encoded_value_t * restrict decoded)
+static PIGEON_PARSE_INLINE bool pigeon_parse_encoded_value(pigeon_parse_context_t * restrict ctx, pigeon_encoded_value_t * restrict decoded, const pigeon_parse_mode_t mode)
 {
     if (ctx->remaining == 0)
         false;
@@ -203,7 +224,8 @@ static bool pigeon_parse_encoded_value(pigeon_parse_context_t * restrict ctx, pi
         decoded->encoding_type = PIGEON_ENCODING_TYPE_ED25519;
     else
     {
-        pigeon_parse_error(ctx, "unknown algorithm specified '%s'", pigeon_make_temp_str_range(algo_spec_start, algo_spec_end));
+        char temp[128];
+        pigeon_parse_error(ctx, "unknown algorithm specified '%s'", pigeon_make_temp_str_range(temp, sizeof(temp), algo_spec_start, algo_spec_end));
         return false;
     }
 
@@ -218,13 +240,38 @@ static bool pigeon_parse_encoded_value(pigeon_parse_context_t * restrict ctx, pi
 
     pos = ctx->msg_pos;
     const char * hash_end = pigeon_scan_base64(ctx);
-    decoded->hash = pigeon_strdup_range(pos, hash_end - pos);
+    if (mode != PIGEON_PARSE_MODE_VALIDATE)
+        decoded->hash = pigeon_strdup_range(pos, hash_end - pos);
 
     pigeon_move_to(ctx, hash_end);
     return true;
 }
 
-static bool pigeon_parse_string(pigeon_parse_context_t * restrict ctx, char ** restrict str)
+static inline bool pigeon_is_string_char(char ch)
+{
+    return ch != '"' && ch != '\\' && isprint(ch);
+}
+
+// Delivers the collected piece of a streamed value and starts a new one.
+static bool pigeon_flush_string_chunk(pigeon_parse_context_t * restrict ctx, pigeon_field_t * restrict field, pigeon_string_t * restrict chunk, bool last)
+{
+    const pigeon_string_sink_t * sink = ctx->string_sink;
+    field->field_type = PIGEON_FIELD_STREAMED;
+    if (!sink->write(sink->user_data, field, chunk->ptr, chunk->length, last))
+    {
+        pigeon_parse_error(ctx, "parse aborted by string sink");
+        return false;
+    }
+
+    field->field_value.int64_ += chunk->length;
+    pigeon_string_clear(chunk);
+    return true;
+}
+
+// With sink_field set (data field values while a string sink is installed),
+// at most threshold bytes are collected; a full piece is handed to the sink
+// only once more of the value follows, so values that fit stay strings.
+static PIGEON_PARSE_INLINE bool pigeon_parse_string(pigeon_parse_context_t * restrict ctx, char ** restrict str, const pigeon_parse_mode_t mode, pigeon_field_t * restrict sink_field)
 {
     if (ctx->remaining == 0)
     {
@@ -241,11 +288,41 @@ static bool pigeon_parse_string(pigeon_parse_context_t * restrict ctx, char ** r
         return false;
     }
 
+    bool streaming = mode != PIGEON_PARSE_MODE_VALIDATE && sink_field != NULL && ctx->string_sink->threshold > 0;
+    size_t threshold = streaming ? ctx->string_sink->threshold : 0;
+    if (streaming)
+        sink_field->field_value.int64_ = 0;
+
     const char * pos = ctx->msg_pos;
     const char * end = ctx->msg_pos + ctx->remaining;
     while (pos != end)
     {
-        if (*pos == '"')
+        // Copy runs of plain characters at once
+        const char * run = pos;
+        while (pos != end && pigeon_is_string_char(*pos))
+            ++pos;
+
+        while (mode != PIGEON_PARSE_MODE_VALIDATE && run != pos)
+        {
+            if (streaming && tmp_str.length == threshold && !pigeon_flush_string_chunk(ctx, sink_field, &tmp_str, false))
+                goto error;
+
+            size_t size = pos - run;
+            if (streaming && size > threshold - tmp_str.length)
+                size = threshold - tmp_str.length;
+
+            if (!pigeon_string_append(&tmp_str, run, size))
+            {
+                pigeon_parse_error(ctx, "memory allocation failed");
+                goto error;
+            }
+
+            run += size;
+        }
+
+        if (pos == end)
+            break;
+        else if (*pos == '"')
         {
             ++pos;
             break;
@@ -255,7 +332,13 @@ static bool pigeon_parse_string(pigeon_parse_context_t * restrict ctx, char ** r
             if (++pos != end)
             {
                 if (*pos == '"')
-                    pigeon_string_append_ch(&tmp_str, '"');
+                {
+                    if (streaming && tmp_str.length == threshold && !pigeon_flush_string_chunk(ctx, sink_field, &tmp_str, false))
+                        goto error;
+                    if (mode != PIGEON_PARSE_MODE_VALIDATE)
+                        pigeon_string_append_ch(&tmp_str, '"');
+                    ++pos;
+                }
                 else
                 {
                     char seq[3] = { '\\', *pos, '\0' };
@@ -269,11 +352,6 @@ static bool pigeon_parse_string(pigeon_parse_context_t * restrict ctx, char ** r
                 goto error;
             }
         }
-        else if (isprint(*pos))
-        {
-            pigeon_string_append_ch(&tmp_str, *pos);
-            ++pos;
-        }
         else if (*pos == '\n')
         {
             pigeon_parse_error(ctx, "expected '\"' marker before end of line");
@@ -286,7 +364,17 @@ static bool pigeon_parse_string(pigeon_parse_context_t * restrict ctx, char ** r
         }
     }
 
-    *str = pigeon_string_release(&tmp_str);
+    if (streaming && sink_field->field_type == PIGEON_FIELD_STREAMED)
+    {
+        if (!pigeon_flush_string_chunk(ctx, sink_field, &tmp_str, true))
+            goto error;
+        pigeon_string_free(&tmp_str);
+    }
+    else if (mode != PIGEON_PARSE_MODE_VALIDATE)
+        *str = pigeon_string_release(&tmp_str);
+    else
+        pigeon_string_free(&tmp_str);
+
     pigeon_advance_pos(ctx, pos - ctx->msg_pos);
     return true;
     
@@ -308,7 +396,7 @@ static pigeon_field_type_t pigeon_deduce_field_type(char ch)
     return PIGEON_FIELD_STRING;
 }
 
-static bool pigeon_parse_field_value(pigeon_parse_context_t * restrict ctx, pigeon_field_t * restrict field)
+static PIGEON_PARSE_INLINE bool pigeon_parse_field_value(pigeon_parse_context_t * restrict ctx, pigeon_field_t * restrict field, const pigeon_parse_mode_t mode, bool streamable)
 {
     if (ctx->remaining == 0)
     {
@@ -325,11 +413,11 @@ static bool pigeon_parse_field_value(pigeon_parse_context_t * restrict ctx, pige
             pigeon_advance_pos(ctx, 1);
             pigeon_skip_ws(ctx);
             field->field_type = pigeon_deduce_field_type(ch);
-            return pigeon_parse_encoded_value(ctx, &field->field_value.encoded);
+            return pigeon_parse_encoded_value(ctx, &field->field_value.encoded, mode);
 
         case '"':
             field->field_type = PIGEON_FIELD_STRING;
-            return pigeon_parse_string(ctx, &field->field_value.string);
+            return pigeon_parse_string(ctx, &field->field_value.string, mode, streamable ? field : NULL);
 
         default:
             break;
@@ -377,7 +465,7 @@ static bool pigeon_parse_field_value(pigeon_parse_context_t * restrict ctx, pige
     return true;
 }
 
-void pigeon_scan_bareword(pigeon_parse_context_t * restrict ctx)
+static void pigeon_scan_bareword(pigeon_parse_context_t * restrict ctx)
 {
     const char * pos = ctx->msg_pos;
     const char * end = ctx->msg_pos + ctx->remaining;
@@ -394,12 +482,19 @@ static const char header_sequence[] = "sequence";
 static const char header_kind[] = "kind";
 static const char header_previous[] = "previous";
 static const char header_timestamp[] = "timestamp";
+static const char footer_signature[] = "signature";
 
-bool pigeon_parse_header_or_footer(pigeon_parse_context_t * restrict ctx, pigeon_field_t * restrict field)
+#define PIGEON_NAME_EQUALS(name, name_length, constant) \
+    (0 == pigeon_safe_memcmp((name), (name_length), (constant), sizeof(constant) - 1))
+
+// Header and footer names are matched in place against the message buffer,
+// so they never need a heap copy regardless of the parse mode.
+static PIGEON_PARSE_INLINE bool pigeon_parse_header_or_footer(pigeon_parse_context_t * restrict ctx, const char ** restrict name, size_t * restrict name_length, pigeon_field_t * restrict field, const pigeon_parse_mode_t mode)
 {
     const char * field_name_start = ctx->msg_pos;
     pigeon_scan_bareword(ctx);
-    field->field_name = pigeon_strdup_range(field_name_start, ctx->msg_pos - field_name_start);
+    *name = field_name_start;
+    *name_length = ctx->msg_pos - field_name_start;
 
     if (0 == pigeon_skip_ws(ctx))
     {
@@ -414,7 +509,7 @@ bool pigeon_parse_header_or_footer(pigeon_parse_context_t * restrict ctx, pigeon
 
     pigeon_skip_ws(ctx);
 
-    if (!pigeon_parse_field_value(ctx, field))
+    if (!pigeon_parse_field_value(ctx, field, mode, false))
         return false;
 
     pigeon_skip_ws(ctx);
@@ -436,18 +531,22 @@ bool pigeon_parse_header_or_footer(pigeon_parse_context_t * restrict ctx, pigeon
     return true;
 }
 
-bool pigeon_parse_header(pigeon_parse_context_t * restrict ctx, pigeon_parsed_message_t * restrict decoded_msg)
+static PIGEON_PARSE_INLINE bool pigeon_parse_header(pigeon_parse_context_t * restrict ctx, pigeon_parsed_message_t * restrict decoded_msg, unsigned * restrict header, const pigeon_parse_mode_t mode)
 {
+    const char * name;
+    size_t name_length;
     pigeon_field_t field;
     pigeon_init_field(&field);
-    if (!pigeon_parse_header_or_footer(ctx, &field))
+    if (!pigeon_parse_header_or_footer(ctx, &name, &name_length, &field, mode))
         goto error;
 
-    if (strcmp(field.field_name, header_author) == 0)
+    if (PIGEON_NAME_EQUALS(name, name_length, header_author))
     {
+        *header = PIGEON_HEADER_AUTHOR;
         if (field.field_type == PIGEON_FIELD_IDENTITY)
         {
-            decoded_msg->author = field.field_value.encoded;
+            if (mode != PIGEON_PARSE_MODE_VALIDATE)
+                decoded_msg->author = field.field_value.encoded;
             pigeon_release_field_value(&field);
         }
         else
@@ -456,11 +555,13 @@ bool pigeon_parse_header(pigeon_parse_context_t * restrict ctx, pigeon_parsed_me
             goto error;
         }
     }
-    else if (strcmp(field.field_name, header_sequence) == 0)
+    else if (PIGEON_NAME_EQUALS(name, name_length, header_sequence))
     {
+        *header = PIGEON_HEADER_SEQUENCE;
         if (field.field_type == PIGEON_FIELD_INT64)
         {
-            decoded_msg->sequence_number = field.field_value.int64_;
+            if (mode != PIGEON_PARSE_MODE_VALIDATE)
+                decoded_msg->sequence_number = field.field_value.int64_;
             pigeon_release_field_value(&field);
         }
         else
@@ -469,11 +570,13 @@ bool pigeon_parse_header(pigeon_parse_context_t * restrict ctx, pigeon_parsed_me
             goto error;
         }
     }
-    else if (strcmp(field.field_name, header_kind) == 0)
+    else if (PIGEON_NAME_EQUALS(name, name_length, header_kind))
     {
+        *header = PIGEON_HEADER_KIND;
         if (field.field_type == PIGEON_FIELD_STRING)
         {
-            decoded_msg->kind = field.field_value.string;
+            if (mode != PIGEON_PARSE_MODE_VALIDATE)
+                decoded_msg->kind = field.field_value.string;
             pigeon_release_field_value(&field);
         }
         else
@@ -482,11 +585,13 @@ bool pigeon_parse_header(pigeon_parse_context_t * restrict ctx, pigeon_parsed_me
             goto error;
         }
     }
-    else if (strcmp(field.field_name, header_previous) == 0)
+    else if (PIGEON_NAME_EQUALS(name, name_length, header_previous))
     {
+        *header = PIGEON_HEADER_PREVIOUS;
         if (field.field_type == PIGEON_FIELD_SIGNATURE)
         {
-            decoded_msg->previous = field.field_value.encoded;
+            if (mode != PIGEON_PARSE_MODE_VALIDATE)
+                decoded_msg->previous = field.field_value.encoded;
             pigeon_release_field_value(&field);
         }
         else
@@ -495,11 +600,13 @@ bool pigeon_parse_header(pigeon_parse_context_t * restrict ctx, pigeon_parsed_me
             goto error;
         }
     }
-    else if (strcmp(field.field_name, header_timestamp) == 0)
+    else if (PIGEON_NAME_EQUALS(name, name_length, header_timestamp))
     {
+        *header = PIGEON_HEADER_TIMESTAMP;
         if (field.field_type == PIGEON_FIELD_INT64)
         {
-            decoded_msg->timestamp = field.field_value.int64_;
+            if (mode != PIGEON_PARSE_MODE_VALIDATE)
+                decoded_msg->timestamp = field.field_value.int64_;
             pigeon_release_field_value(&field);
         }
         else
@@ -509,7 +616,11 @@ bool pigeon_parse_header(pigeon_parse_context_t * restrict ctx, pigeon_parsed_me
         }
     }
     else
+    {
+        char temp[128];
+        pigeon_parse_error(ctx, "unknown header field '%s'", pigeon_make_temp_str_range(temp, sizeof(temp), name, name + name_length));
         goto error;
+    }
 
     pigeon_free_field(&field);
     return true;
@@ -519,9 +630,107 @@ error:
     return false;
 }
 
-static bool pigeon_parse_data_field(pigeon_parse_context_t * restrict ctx, pigeon_field_t * restrict field)
+// Schema checks; ctx->schema is only set by pigeon_parse_message_checked.
+static bool pigeon_select_schema(pigeon_parse_context_t * restrict ctx, const pigeon_schema_registry_t * restrict schemas, const pigeon_parsed_message_t * restrict decoded_msg)
 {
-    if (!pigeon_parse_string(ctx, &field->field_name))
+    const char * kind = decoded_msg->kind ? decoded_msg->kind : "";
+    ctx->schema = pigeon_schema_registry_find(schemas, kind);
+    ctx->schema_seen = 0;
+
+    if (!ctx->schema && (schemas->flags & PIGEON_SCHEMA_REQUIRE_KIND))
+    {
+        pigeon_parse_error(ctx, "no schema for kind '%s'", kind);
+        return false;
+    }
+
+    return true;
+}
+
+// Runs before the value is parsed, so unknown fields are rejected early.
+static PIGEON_PARSE_INLINE bool pigeon_check_field_name(pigeon_parse_context_t * restrict ctx, const pigeon_field_t * restrict field, int * restrict rule_index)
+{
+    // An empty name is parsed as NULL
+    const pigeon_schema_t * schema = ctx->schema;
+    const char * name = field->field_name ? field->field_name : "";
+    int index = pigeon_schema_lookup(schema, name, strlen(name));
+    *rule_index = index;
+
+    if (index < 0)
+    {
+        if (schema->flags & PIGEON_SCHEMA_ALLOW_EXTRA)
+            return true;
+
+        pigeon_parse_error(ctx, "field '%s' is not allowed for kind '%s'", name, schema->kind);
+        return false;
+    }
+
+    uint64_t bit = 1ull << index;
+    if (ctx->schema_seen & bit)
+    {
+        pigeon_parse_error(ctx, "duplicate field '%s'", name);
+        return false;
+    }
+
+    ctx->schema_seen |= bit;
+    return true;
+}
+
+static bool pigeon_check_field_value(pigeon_parse_context_t * restrict ctx, const pigeon_schema_rule_t * restrict rule, const pigeon_field_t * restrict field)
+{
+    bool streamed = field->field_type == PIGEON_FIELD_STREAMED;
+    pigeon_field_type_t field_type = streamed ? PIGEON_FIELD_STRING : field->field_type;
+    if (field_type != rule->type)
+    {
+        pigeon_parse_error(ctx, "field '%s' must be %s, not %s", rule->name, pigeon_field_type_name(rule->type), pigeon_field_type_name(field_type));
+        return false;
+    }
+
+    if (field_type == PIGEON_FIELD_INT64 && rule->bounded && (field->field_value.int64_ < rule->min || field->field_value.int64_ > rule->max))
+    {
+        pigeon_parse_error(ctx, "field '%s' value %lld is outside [%lld, %lld]", rule->name,
+            (long long)field->field_value.int64_, (long long)rule->min, (long long)rule->max);
+        return false;
+    }
+
+    if (field_type == PIGEON_FIELD_STRING && rule->max_length)
+    {
+        uint64_t length = streamed ? (uint64_t)field->field_value.int64_
+            : field->field_value.string ? strlen(field->field_value.string) : 0;
+        if (length > rule->max_length)
+        {
+            pigeon_parse_error(ctx, "field '%s' is %llu bytes long, more than %llu", rule->name,
+                (unsigned long long)length, (unsigned long long)rule->max_length);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool pigeon_check_required(pigeon_parse_context_t * restrict ctx)
+{
+    uint64_t missing = ctx->schema->required & ~ctx->schema_seen;
+    if (missing == 0)
+        return true;
+
+    unsigned index = 0;
+    while ((missing & 1) == 0)
+    {
+        missing >>= 1;
+        ++index;
+    }
+
+    pigeon_parse_error(ctx, "required field '%s' is missing", ctx->schema->rules[index].name);
+    return false;
+}
+
+static PIGEON_PARSE_INLINE bool pigeon_parse_data_field(pigeon_parse_context_t * restrict ctx, pigeon_field_t * restrict field, const pigeon_parse_mode_t mode)
+{
+    if (!pigeon_parse_string(ctx, &field->field_name, mode, NULL))
+        return false;
+
+    int rule_index = -1;
+    if (ctx->schema && !pigeon_check_field_name(ctx, field, &rule_index))
         return false;
 
     pigeon_skip_ws(ctx);
@@ -540,7 +749,10 @@ static bool pigeon_parse_data_field(pigeon_parse_context_t * restrict ctx, pigeo
     pigeon_advance_pos(ctx, 1);
     pigeon_skip_ws(ctx);
 
-    if (!pigeon_parse_field_value(ctx, field))
+    if (!pigeon_parse_field_value(ctx, field, mode, ctx->string_sink != NULL))
+        return false;
+
+    if (rule_index >= 0 && !pigeon_check_field_value(ctx, &ctx->schema->rules[rule_index], field))
         return false;
 
     pigeon_skip_ws(ctx);
@@ -562,7 +774,7 @@ static bool pigeon_parse_data_field(pigeon_parse_context_t * restrict ctx, pigeo
     return true;
 }
 
-bool pigeon_parse_data_fields(pigeon_parse_context_t * restrict ctx, pigeon_list_t * restrict fields)
+static PIGEON_PARSE_INLINE bool pigeon_parse_data_fields(pigeon_parse_context_t * restrict ctx, pigeon_parsed_message_t * restrict decoded_msg, const pigeon_parse_mode_t mode, pigeon_field_callback_t callback, void * user_data)
 {
     while (ctx->remaining > 0)
     {
@@ -570,6 +782,26 @@ bool pigeon_parse_data_fields(pigeon_parse_context_t * restrict ctx, pigeon_list
         if (*ctx->msg_pos == '\n')
             break;
 
+        if (mode != PIGEON_PARSE_MODE_BUILD)
+        {
+            // Validation and callback modes never keep fields past the
+            // current line, so the field lives on the stack.
+            pigeon_field_t field;
+            pigeon_init_field(&field);
+            bool success = pigeon_parse_data_field(ctx, &field, mode);
+            if (success && mode == PIGEON_PARSE_MODE_CALLBACK && !callback(user_data, decoded_msg, &field))
+            {
+                pigeon_parse_error(ctx, "parse aborted by field callback");
+                success = false;
+            }
+
+            pigeon_free_field(&field);
+            if (!success)
+                return false;
+
+            continue;
+        }
+
         pigeon_field_t * field = malloc(sizeof(pigeon_field_t));
         if (!field)
         {
@@ -578,28 +810,31 @@ bool pigeon_parse_data_fields(pigeon_parse_context_t * restrict ctx, pigeon_list
         }
 
         pigeon_init_field(field);
-        if (!pigeon_parse_data_field(ctx, field))
+        if (!pigeon_parse_data_field(ctx, field, mode))
         {
             pigeon_free_field(field);
             pigeon_free(field);
             return false;
         }
 
-        pigeon_list_append(fields, field);
+        pigeon_list_append(&decoded_msg->fields, field);
     }
 
     return true;
 }
 
-bool pigeon_parse_footer(pigeon_parse_context_t * restrict ctx, pigeon_parsed_message_t * restrict decoded_msg)
+static PIGEON_PARSE_INLINE bool pigeon_parse_footer(pigeon_parse_context_t * restrict ctx, pigeon_parsed_message_t * restrict decoded_msg, const pigeon_parse_mode_t mode)
 {
+    const char * name;
+    size_t name_length;
     pigeon_field_t field;
     pigeon_init_field(&field);
-    if (!pigeon_parse_header_or_footer(ctx, &field))
+    if (!pigeon_parse_header_or_footer(ctx, &name, &name_length, &field, mode))
         goto error;
-    else if (0 != strcmp(field.field_name, "signature"))
+    else if (!PIGEON_NAME_EQUALS(name, name_length, footer_signature))
     {
-        pigeon_parse_error(ctx, "invalid footer field name '%s'", field.field_name);
+        char temp[128];
+        pigeon_parse_error(ctx, "invalid footer field name '%s'", pigeon_make_temp_str_range(temp, sizeof(temp), name, name + name_length));
         goto error;
     }
     else if (field.field_type != PIGEON_FIELD_SIGNATURE)
@@ -608,7 +843,8 @@ bool pigeon_parse_footer(pigeon_parse_context_t * restrict ctx, pigeon_parsed_me
         goto error;
     }
 
-    decoded_msg->signature = field.field_value.encoded;
+    if (mode != PIGEON_PARSE_MODE_VALIDATE)
+        decoded_msg->signature = field.field_value.encoded;
     pigeon_release_field_value(&field);
     pigeon_free_field(&field);
     return true;
@@ -618,10 +854,19 @@ error:
     return false;
 }
 
-bool pigeon_parse_message(pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size, pigeon_parsed_message_t * restrict decoded_msg)
+// The grammar is written once here. Each public entry point below passes a
+// constant mode, so every instantiation is inlined with the mode checks
+// folded away rather than tested at runtime inside the scanning loops.
+//
+// If header_filter is set it is consulted after every header line and once
+// more at the end of the header block; as soon as it rejects the message the
+// remainder is skipped unparsed and *matched is set to false.
+static PIGEON_PARSE_INLINE bool pigeon_parse_message_core(pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size, pigeon_parsed_message_t * restrict decoded_msg, const pigeon_parse_mode_t mode, pigeon_field_callback_t callback, void * user_data, pigeon_header_filter_t header_filter, void * filter_data, bool * restrict matched, const pigeon_string_sink_t * string_sink, const pigeon_schema_registry_t * schemas)
 {
-    memset(ctx, 0, sizeof(ctx));
-    memset(decoded_msg, 0, sizeof(*decoded_msg));
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->string_sink = string_sink;
+    if (mode != PIGEON_PARSE_MODE_VALIDATE)
+        memset(decoded_msg, 0, sizeof(*decoded_msg));
 
     ctx->msg_data = msg_data;
     ctx->msg_size = msg_size;
@@ -630,13 +875,20 @@ bool pigeon_parse_message(pigeon_parse_context_t * restrict ctx, const char * re
     ctx->line_number = 1;
     ctx->line_start = msg_data;
 
+    unsigned known_headers = 0;
     while (ctx->remaining > 0)
     {
         pigeon_skip_ws(ctx);
         if (*ctx->msg_pos == '\n')
             break;
-        else if (!pigeon_parse_header(ctx, decoded_msg))
+
+        unsigned header;
+        if (!pigeon_parse_header(ctx, decoded_msg, &header, mode))
             goto error;
+
+        known_headers |= header;
+        if (header_filter && !header_filter(filter_data, decoded_msg, known_headers))
+            goto filtered;
     }
 
     if (ctx->remaining == 0)
@@ -644,14 +896,24 @@ bool pigeon_parse_message(pigeon_parse_context_t * restrict ctx, const char * re
     else if (*ctx->msg_pos != '\n')
         goto error; // expected blank line
 
+    if (header_filter && !header_filter(filter_data, decoded_msg, known_headers | PIGEON_HEADERS_COMPLETE))
+        goto filtered;
+
     ++ctx->line_number;
     pigeon_advance_pos(ctx, 1);
 
     if (ctx->remaining == 0)
         goto error; // unexpected EOF
     
-    pigeon_list_init(&decoded_msg->fields);
-    if (!pigeon_parse_data_fields(ctx, &decoded_msg->fields))
+    if (schemas && !pigeon_select_schema(ctx, schemas, decoded_msg))
+        goto error;
+
+    if (mode != PIGEON_PARSE_MODE_VALIDATE)
+        pigeon_list_init(&decoded_msg->fields);
+    if (!pigeon_parse_data_fields(ctx, decoded_msg, mode, callback, user_data))
+        goto error;
+
+    if (ctx->schema && !pigeon_check_required(ctx))
         goto error;
 
     if (ctx->remaining == 0)
@@ -669,7 +931,7 @@ bool pigeon_parse_message(pigeon_parse_context_t * restrict ctx, const char * re
     ++ctx->line_number;
     pigeon_advance_pos(ctx, 1);
 
-    if (!pigeon_parse_footer(ctx, decoded_msg))
+    if (!pigeon_parse_footer(ctx, decoded_msg, mode))
         goto error;
 
     if (ctx->remaining > 0)
@@ -678,6 +940,13 @@ bool pigeon_parse_message(pigeon_parse_context_t * restrict ctx, const char * re
         goto error;  // extra data at end
     }
 
+    if (matched)
+        *matched = true;
+    return true;
+
+filtered:
+    if (matched)
+        *matched = false;
     return true;
 
 error:
@@ -685,6 +954,36 @@ error:
     return false;
 }
 
+bool pigeon_parse_message(pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size, pigeon_parsed_message_t * restrict decoded_msg)
+{
+    return pigeon_parse_message_core(ctx, msg_data, msg_size, decoded_msg, PIGEON_PARSE_MODE_BUILD, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+}
+
+bool pigeon_validate_message(pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size)
+{
+    return pigeon_parse_message_core(ctx, msg_data, msg_size, NULL, PIGEON_PARSE_MODE_VALIDATE, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+}
+
+bool pigeon_visit_message(pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size, pigeon_parsed_message_t * restrict decoded_msg, pigeon_field_callback_t callback, void * user_data)
+{
+    return pigeon_parse_message_core(ctx, msg_data, msg_size, decoded_msg, PIGEON_PARSE_MODE_CALLBACK, callback, user_data, NULL, NULL, NULL, NULL, NULL);
+}
+
+bool pigeon_parse_message_filtered(pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size, pigeon_parsed_message_t * restrict decoded_msg, pigeon_header_filter_t header_filter, void * filter_data, bool * restrict matched)
+{
+    return pigeon_parse_message_core(ctx, msg_data, msg_size, decoded_msg, PIGEON_PARSE_MODE_BUILD, NULL, NULL, header_filter, filter_data, matched, NULL, NULL);
+}
+
+bool pigeon_parse_message_streamed(pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size, pigeon_parsed_message_t * restrict decoded_msg, const pigeon_string_sink_t * sink)
+{
+    return pigeon_parse_message_core(ctx, msg_data, msg_size, decoded_msg, PIGEON_PARSE_MODE_BUILD, NULL, NULL, NULL, NULL, NULL, sink, NULL);
+}
+
+bool pigeon_parse_message_checked(pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size, pigeon_parsed_message_t * restrict decoded_msg, const pigeon_schema_registry_t * schemas)
+{
+    return pigeon_parse_message_core(ctx, msg_data, msg_size, decoded_msg, PIGEON_PARSE_MODE_BUILD, NULL, NULL, NULL, NULL, NULL, NULL, schemas);
+}
+
 void pigeon_free_parsed_message(pigeon_parsed_message_t * restrict msg)
 {
     pigeon_free_encoded_value(&msg->author);
@@ -694,3 +993,15 @@ void pigeon_free_parsed_message(pigeon_parsed_message_t * restrict msg)
     pigeon_free_encoded_value(&msg->signature);
     pigeon_free_field_list(&msg->fields);
 }
+
+const char * pigeon_encoded_value_key(const pigeon_encoded_value_t * restrict value, pigeon_string_t * restrict buffer)
+{
+    const char * name = pigeon_encoding_name(value->encoding_type);
+    pigeon_string_clear(buffer);
+    if (!pigeon_string_append(buffer, name, strlen(name))
+        || !pigeon_string_append_ch(buffer, ':')
+        || (value->hash && !pigeon_string_append(buffer, value->hash, strlen(value->hash))))
+        return NULL;
+
+    return pigeon_string_cstr(buffer);
+}
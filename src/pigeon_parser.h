@@ -2,12 +2,13 @@
 #define PIGEON_PARSER_H
 
 #include "pigeon_list.h"
+#include "pigeon_string.h"
 #include <stdbool.h>
 #include <stdint.h>
 
 typedef int32_t pigeon_sequence_number_t;
 typedef int64_t pigeon_timestamp_t;
-typedef int32_t pigeon_message_size_t;
+typedef int64_t pigeon_message_size_t;
 
 typedef enum {
     PIGEON_ENCODING_TYPE_SHA256,
@@ -19,15 +20,43 @@ typedef struct {
     char * hash;
 } pigeon_encoded_value_t;
 
+static inline const char * pigeon_encoding_name(pigeon_encoding_type_t encoding_type)
+{
+    switch (encoding_type)
+    {
+        case PIGEON_ENCODING_TYPE_SHA256: return "sha256";
+        case PIGEON_ENCODING_TYPE_ED25519: return "ed25519";
+    }
+
+    return "unknown";
+}
+
 typedef enum {
     PIGEON_FIELD_EMPTY,
     PIGEON_FIELD_STRING,
     PIGEON_FIELD_INT64,
     PIGEON_FIELD_IDENTITY,
     PIGEON_FIELD_SIGNATURE,
-    PIGEON_FIELD_BLOB
+    PIGEON_FIELD_BLOB,
+    PIGEON_FIELD_STREAMED // string handed to a pigeon_string_sink_t; int64_ holds its length
 } pigeon_field_type_t;
 
+static inline const char * pigeon_field_type_name(pigeon_field_type_t field_type)
+{
+    switch (field_type)
+    {
+        case PIGEON_FIELD_EMPTY: return "EMPTY";
+        case PIGEON_FIELD_STRING: return "STRING";
+        case PIGEON_FIELD_INT64: return "INT64";
+        case PIGEON_FIELD_IDENTITY: return "IDENTITY";
+        case PIGEON_FIELD_SIGNATURE: return "SIGNATURE";
+        case PIGEON_FIELD_BLOB: return "BLOB";
+        case PIGEON_FIELD_STREAMED: return "STREAMED";
+    }
+
+    return "unknown";
+}
+
 typedef struct {
     pigeon_list_elem_t elem;
 
@@ -52,6 +81,9 @@ typedef struct {
     pigeon_list_t fields;
 } pigeon_parsed_message_t;
 
+struct pigeon_schema_t;
+struct pigeon_schema_registry_t;
+
 typedef struct {
     const char * msg_data;
     const char * msg_pos;
@@ -61,13 +93,72 @@ typedef struct {
     unsigned line_number;
     const char * line_start;
 
+    const struct pigeon_string_sink_t * string_sink;
+    const struct pigeon_schema_t * schema; // schema of the message being parsed, if any
+    uint64_t schema_seen;                  // bit i is set once rule i has matched
+
     char error_messages[256];
 } pigeon_parse_context_t;
 
+typedef enum {
+    PIGEON_HEADER_AUTHOR = 1 << 0,
+    PIGEON_HEADER_SEQUENCE = 1 << 1,
+    PIGEON_HEADER_KIND = 1 << 2,
+    PIGEON_HEADER_PREVIOUS = 1 << 3,
+    PIGEON_HEADER_TIMESTAMP = 1 << 4,
+    PIGEON_HEADERS_COMPLETE = 1 << 5  // set once the whole header block has been read
+} pigeon_header_flags_t;
+
+typedef bool (*pigeon_field_callback_t)(void * user_data, const pigeon_parsed_message_t * header, const pigeon_field_t * field);
+
 bool pigeon_parse_message(pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size, pigeon_parsed_message_t * restrict decoded_msg);
 
+// Checks that a message is well formed without allocating anything.
+bool pigeon_validate_message(pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size);
+
+// Parses the header into decoded_msg, but passes each data field to callback
+// instead of appending it to decoded_msg->fields. The field is only valid for
+// the duration of the call; returning false from the callback aborts the parse.
+bool pigeon_visit_message(pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size, pigeon_parsed_message_t * restrict decoded_msg, pigeon_field_callback_t callback, void * user_data);
+
+// known_headers is a mask of pigeon_header_flags_t for the header values
+// already stored in header. Returning false rejects the message.
+typedef bool (*pigeon_header_filter_t)(void * user_data, const pigeon_parsed_message_t * header, unsigned known_headers);
+
+// Like pigeon_parse_message, but stops as soon as header_filter rejects the
+// message, without parsing its data fields or footer. Returns false only on a
+// parse error; *matched tells whether the message passed the filter. A
+// rejected message may hold a partial header and still needs
+// pigeon_free_parsed_message.
+bool pigeon_parse_message_filtered(pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size, pigeon_parsed_message_t * restrict decoded_msg, pigeon_header_filter_t header_filter, void * filter_data, bool * restrict matched);
+
+// Receives data field strings longer than threshold bytes in pieces of at
+// most threshold bytes, instead of having them collected in memory. During
+// the calls the field is PIGEON_FIELD_STREAMED and its int64_ value counts
+// the bytes already delivered; last is set on the final piece. Returning
+// false aborts the parse.
+typedef struct pigeon_string_sink_t {
+    size_t threshold;
+    bool (*write)(void * user_data, const pigeon_field_t * field, const char * chunk, size_t size, bool last);
+    void * user_data;
+} pigeon_string_sink_t;
+
+// Like pigeon_parse_message, but long string values go to sink and are left
+// in the field list as PIGEON_FIELD_STREAMED entries holding their length.
+bool pigeon_parse_message_streamed(pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size, pigeon_parsed_message_t * restrict decoded_msg, const pigeon_string_sink_t * sink);
+
+// Like pigeon_parse_message, but data fields must also satisfy the schema
+// registered for the message kind (see pigeon_schema.h). The message is
+// rejected at the first field that does not, like any other parse error.
+bool pigeon_parse_message_checked(pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size, pigeon_parsed_message_t * restrict decoded_msg, const struct pigeon_schema_registry_t * schemas);
+
 void pigeon_free_parsed_message(pigeon_parsed_message_t * restrict msg);
 
+// Formats value as "algo:hash", the form used to key feeds by author, into
+// buffer and returns it. A NULL hash formats as "algo:". The buffer can be
+// reused between calls; returns NULL if memory allocation fails.
+const char * pigeon_encoded_value_key(const pigeon_encoded_value_t * restrict value, pigeon_string_t * restrict buffer);
+
 static inline const char * pigeon_get_error_messages(const pigeon_parse_context_t * restrict ctx)
 {
     return ctx->error_messages;
@@ -0,0 +1,499 @@
+#include "pigeon_query.h"
+#include "pigeon_memory.h"
+#include "pigeon_string.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PIGEON_QUERY_MAX_DEPTH 64
+
+typedef struct {
+    pigeon_query_t * query;
+    const char * text;
+    const char * pos;
+} pigeon_query_compiler_t;
+
+static const struct {
+    const char * name;
+    pigeon_header_flags_t header;
+} query_headers[] = {
+    { "author", PIGEON_HEADER_AUTHOR },
+    { "sequence", PIGEON_HEADER_SEQUENCE },
+    { "kind", PIGEON_HEADER_KIND },
+    { "previous", PIGEON_HEADER_PREVIOUS },
+    { "timestamp", PIGEON_HEADER_TIMESTAMP },
+};
+
+static const char encoding_str_sha256[] = "sha256";
+static const char encoding_str_ed25519[] = "ed25519";
+
+static bool pigeon_query_error(pigeon_query_compiler_t * restrict compiler, const char * format, ...)
+{
+    char * buffer = compiler->query->error_messages;
+    size_t size = sizeof(compiler->query->error_messages);
+    int length = snprintf(buffer, size, "Error, column %u: ", (unsigned)(compiler->pos - compiler->text + 1));
+
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(buffer + length, size - length, format, ap);
+    va_end(ap);
+    return false;
+}
+
+static void pigeon_query_skip_ws(pigeon_query_compiler_t * restrict compiler)
+{
+    while (isspace((unsigned char)*compiler->pos))
+        ++compiler->pos;
+}
+
+static bool pigeon_query_accept(pigeon_query_compiler_t * restrict compiler, const char * restrict token)
+{
+    pigeon_query_skip_ws(compiler);
+
+    size_t length = strlen(token);
+    if (0 != strncmp(compiler->pos, token, length))
+        return false;
+
+    compiler->pos += length;
+    return true;
+}
+
+static bool pigeon_query_emit(pigeon_query_compiler_t * restrict compiler, pigeon_query_node_type_t type, unsigned predicate)
+{
+    pigeon_query_t * query = compiler->query;
+    if (query->node_count == query->node_capacity)
+    {
+        size_t new_capacity = query->node_capacity != 0 ? query->node_capacity * 2 : 16;
+        pigeon_query_node_t * nodes = pigeon_realloc(query->nodes, new_capacity * sizeof(*nodes));
+        if (!nodes)
+            return pigeon_query_error(compiler, "memory allocation failed");
+
+        query->nodes = nodes;
+        query->node_capacity = new_capacity;
+    }
+
+    query->nodes[query->node_count].type = type;
+    query->nodes[query->node_count].predicate = predicate;
+    ++query->node_count;
+    return true;
+}
+
+static pigeon_query_predicate_t * pigeon_query_new_predicate(pigeon_query_compiler_t * restrict compiler)
+{
+    pigeon_query_t * query = compiler->query;
+    if (query->predicate_count == query->predicate_capacity)
+    {
+        size_t new_capacity = query->predicate_capacity != 0 ? query->predicate_capacity * 2 : 8;
+        pigeon_query_predicate_t * predicates = pigeon_realloc(query->predicates, new_capacity * sizeof(*predicates));
+        if (!predicates)
+        {
+            pigeon_query_error(compiler, "memory allocation failed");
+            return NULL;
+        }
+
+        query->predicates = predicates;
+        query->predicate_capacity = new_capacity;
+    }
+
+    pigeon_query_predicate_t * predicate = &query->predicates[query->predicate_count++];
+    memset(predicate, 0, sizeof(*predicate));
+    return predicate;
+}
+
+static bool pigeon_query_parse_int(pigeon_query_compiler_t * restrict compiler, int64_t * restrict value)
+{
+    pigeon_query_skip_ws(compiler);
+
+    char * end;
+    long long parsed = strtoll(compiler->pos, &end, 10);
+    if (end == compiler->pos)
+        return pigeon_query_error(compiler, "integer literal expected");
+
+    compiler->pos = end;
+    *value = parsed;
+    return true;
+}
+
+static bool pigeon_query_parse_string(pigeon_query_compiler_t * restrict compiler, char ** restrict value)
+{
+    pigeon_query_skip_ws(compiler);
+    if (*compiler->pos != '"')
+        return pigeon_query_error(compiler, "string literal expected");
+
+    pigeon_string_t str;
+    pigeon_string_init(&str);
+
+    const char * pos = compiler->pos + 1;
+    for (; *pos != '"'; ++pos)
+    {
+        if (*pos == '\0')
+        {
+            pigeon_string_free(&str);
+            return pigeon_query_error(compiler, "unterminated string literal");
+        }
+        else if (*pos == '\\' && pos[1] == '"')
+            ++pos;
+
+        pigeon_string_append_ch(&str, *pos);
+    }
+
+    const char * cstr = pigeon_string_cstr(&str);
+    *value = pigeon_strdup_range(cstr, str.length);
+    pigeon_string_free(&str);
+    compiler->pos = pos + 1;
+    return *value != NULL || pigeon_query_error(compiler, "memory allocation failed");
+}
+
+static bool pigeon_query_parse_encoded(pigeon_query_compiler_t * restrict compiler, char sigil, pigeon_query_predicate_t * restrict predicate)
+{
+    pigeon_query_skip_ws(compiler);
+    if (*compiler->pos != sigil)
+        return pigeon_query_error(compiler, "'%c' value expected", sigil);
+
+    const char * algo = ++compiler->pos;
+    while (isalnum((unsigned char)*compiler->pos))
+        ++compiler->pos;
+
+    size_t algo_length = compiler->pos - algo;
+    if (algo_length == sizeof(encoding_str_sha256) - 1 && 0 == memcmp(algo, encoding_str_sha256, algo_length))
+        predicate->encoding_type = PIGEON_ENCODING_TYPE_SHA256;
+    else if (algo_length == sizeof(encoding_str_ed25519) - 1 && 0 == memcmp(algo, encoding_str_ed25519, algo_length))
+        predicate->encoding_type = PIGEON_ENCODING_TYPE_ED25519;
+    else
+        return pigeon_query_error(compiler, "unknown algorithm specified");
+
+    if (*compiler->pos != ':')
+        return pigeon_query_error(compiler, "expected ':' after algorithm specifier");
+
+    const char * hash = ++compiler->pos;
+    while (isalnum((unsigned char)*compiler->pos) || (*compiler->pos != '\0' && strchr("-_=/+", *compiler->pos) != NULL))
+        ++compiler->pos;
+
+    predicate->string = pigeon_strdup_range(hash, compiler->pos - hash);
+    return predicate->string != NULL || pigeon_query_error(compiler, "memory allocation failed");
+}
+
+static bool pigeon_query_compile_predicate(pigeon_query_compiler_t * restrict compiler)
+{
+    pigeon_query_skip_ws(compiler);
+
+    const char * name = compiler->pos;
+    while (isalpha((unsigned char)*compiler->pos))
+        ++compiler->pos;
+
+    size_t name_length = compiler->pos - name;
+    pigeon_header_flags_t header = 0;
+    for (size_t i = 0; i < sizeof(query_headers) / sizeof(query_headers[0]); ++i)
+        if (name_length == strlen(query_headers[i].name) && 0 == memcmp(name, query_headers[i].name, name_length))
+            header = query_headers[i].header;
+
+    if (header == 0)
+    {
+        compiler->pos = name;
+        return pigeon_query_error(compiler, "header name expected");
+    }
+
+    pigeon_query_predicate_t * predicate = pigeon_query_new_predicate(compiler);
+    if (!predicate)
+        return false;
+
+    unsigned predicate_index = compiler->query->predicate_count - 1;
+    predicate->header = header;
+    compiler->query->header_mask |= header;
+
+    if (pigeon_query_accept(compiler, "=="))
+        predicate->op = PIGEON_QUERY_OP_EQ;
+    else if (pigeon_query_accept(compiler, "!="))
+        predicate->op = PIGEON_QUERY_OP_NE;
+    else if (pigeon_query_accept(compiler, "<="))
+        predicate->op = PIGEON_QUERY_OP_LE;
+    else if (pigeon_query_accept(compiler, "<"))
+        predicate->op = PIGEON_QUERY_OP_LT;
+    else if (pigeon_query_accept(compiler, ">="))
+        predicate->op = PIGEON_QUERY_OP_GE;
+    else if (pigeon_query_accept(compiler, ">"))
+        predicate->op = PIGEON_QUERY_OP_GT;
+    else if (pigeon_query_accept(compiler, "in") && !isalnum((unsigned char)*compiler->pos))
+        predicate->op = PIGEON_QUERY_OP_IN;
+    else
+        return pigeon_query_error(compiler, "comparison operator expected");
+
+    bool numeric = header == PIGEON_HEADER_SEQUENCE || header == PIGEON_HEADER_TIMESTAMP;
+    if (!numeric && predicate->op != PIGEON_QUERY_OP_EQ && predicate->op != PIGEON_QUERY_OP_NE)
+        return pigeon_query_error(compiler, "only == and != apply to %.*s", (int)name_length, name);
+
+    if (predicate->op == PIGEON_QUERY_OP_IN)
+    {
+        if (pigeon_query_accept(compiler, "["))
+            predicate->low_inclusive = true;
+        else if (!pigeon_query_accept(compiler, "("))
+            return pigeon_query_error(compiler, "'[' or '(' expected");
+
+        if (!pigeon_query_parse_int(compiler, &predicate->low))
+            return false;
+        else if (!pigeon_query_accept(compiler, ","))
+            return pigeon_query_error(compiler, "',' expected");
+        else if (!pigeon_query_parse_int(compiler, &predicate->high))
+            return false;
+
+        if (pigeon_query_accept(compiler, "]"))
+            predicate->high_inclusive = true;
+        else if (!pigeon_query_accept(compiler, ")"))
+            return pigeon_query_error(compiler, "']' or ')' expected");
+    }
+    else if (numeric)
+    {
+        if (!pigeon_query_parse_int(compiler, &predicate->low))
+            return false;
+    }
+    else if (header == PIGEON_HEADER_KIND)
+    {
+        if (!pigeon_query_parse_string(compiler, &predicate->string))
+            return false;
+    }
+    else if (!pigeon_query_parse_encoded(compiler, header == PIGEON_HEADER_AUTHOR ? '@' : '%', predicate))
+        return false;
+
+    return pigeon_query_emit(compiler, PIGEON_QUERY_NODE_PREDICATE, predicate_index);
+}
+
+static bool pigeon_query_compile_or(pigeon_query_compiler_t * restrict compiler, unsigned nesting);
+
+static bool pigeon_query_compile_unary(pigeon_query_compiler_t * restrict compiler, unsigned nesting)
+{
+    if (nesting > PIGEON_QUERY_MAX_DEPTH)
+        return pigeon_query_error(compiler, "expression nested too deeply");
+
+    if (pigeon_query_accept(compiler, "!"))
+        return pigeon_query_compile_unary(compiler, nesting + 1)
+            && pigeon_query_emit(compiler, PIGEON_QUERY_NODE_NOT, 0);
+
+    if (pigeon_query_accept(compiler, "("))
+    {
+        if (!pigeon_query_compile_or(compiler, nesting + 1))
+            return false;
+        else if (!pigeon_query_accept(compiler, ")"))
+            return pigeon_query_error(compiler, "')' expected");
+
+        return true;
+    }
+
+    return pigeon_query_compile_predicate(compiler);
+}
+
+static bool pigeon_query_compile_and(pigeon_query_compiler_t * restrict compiler, unsigned nesting)
+{
+    if (!pigeon_query_compile_unary(compiler, nesting))
+        return false;
+
+    while (pigeon_query_accept(compiler, "&&"))
+    {
+        if (!pigeon_query_compile_unary(compiler, nesting) || !pigeon_query_emit(compiler, PIGEON_QUERY_NODE_AND, 0))
+            return false;
+    }
+
+    return true;
+}
+
+static bool pigeon_query_compile_or(pigeon_query_compiler_t * restrict compiler, unsigned nesting)
+{
+    if (!pigeon_query_compile_and(compiler, nesting))
+        return false;
+
+    while (pigeon_query_accept(compiler, "||"))
+    {
+        if (!pigeon_query_compile_and(compiler, nesting) || !pigeon_query_emit(compiler, PIGEON_QUERY_NODE_OR, 0))
+            return false;
+    }
+
+    return true;
+}
+
+bool pigeon_query_compile(pigeon_query_t * restrict query, const char * restrict text)
+{
+    memset(query, 0, sizeof(*query));
+
+    pigeon_query_compiler_t compiler;
+    compiler.query = query;
+    compiler.text = text;
+    compiler.pos = text;
+
+    if (!pigeon_query_compile_or(&compiler, 0))
+        goto error;
+
+    pigeon_query_skip_ws(&compiler);
+    if (*compiler.pos != '\0')
+    {
+        pigeon_query_error(&compiler, "unexpected characters after expression");
+        goto error;
+    }
+
+    // Work out how deep the evaluation stack gets
+    size_t depth = 0;
+    for (size_t i = 0; i < query->node_count; ++i)
+    {
+        if (query->nodes[i].type == PIGEON_QUERY_NODE_PREDICATE)
+            ++depth;
+        else if (query->nodes[i].type != PIGEON_QUERY_NODE_NOT)
+            --depth;
+
+        if (depth > query->max_depth)
+            query->max_depth = depth;
+    }
+
+    if (query->max_depth > PIGEON_QUERY_MAX_DEPTH)
+    {
+        pigeon_query_error(&compiler, "expression too complex");
+        goto error;
+    }
+
+    return true;
+
+error:
+    {
+        char error_messages[sizeof(query->error_messages)];
+        memcpy(error_messages, query->error_messages, sizeof(error_messages));
+        pigeon_query_free(query);
+        memcpy(query->error_messages, error_messages, sizeof(error_messages));
+    }
+    return false;
+}
+
+void pigeon_query_free(pigeon_query_t * restrict query)
+{
+    for (size_t i = 0; i < query->predicate_count; ++i)
+        pigeon_free(query->predicates[i].string);
+
+    pigeon_free(query->predicates);
+    pigeon_free(query->nodes);
+    memset(query, 0, sizeof(*query));
+}
+
+static inline bool pigeon_query_compare_int(const pigeon_query_predicate_t * restrict predicate, int64_t value)
+{
+    switch (predicate->op)
+    {
+        case PIGEON_QUERY_OP_EQ: return value == predicate->low;
+        case PIGEON_QUERY_OP_NE: return value != predicate->low;
+        case PIGEON_QUERY_OP_LT: return value < predicate->low;
+        case PIGEON_QUERY_OP_LE: return value <= predicate->low;
+        case PIGEON_QUERY_OP_GT: return value > predicate->low;
+        case PIGEON_QUERY_OP_GE: return value >= predicate->low;
+        case PIGEON_QUERY_OP_IN:
+            return (predicate->low_inclusive ? value >= predicate->low : value > predicate->low)
+                && (predicate->high_inclusive ? value <= predicate->high : value < predicate->high);
+    }
+
+    return false;
+}
+
+static inline bool pigeon_query_compare_encoded(const pigeon_query_predicate_t * restrict predicate, const pigeon_encoded_value_t * restrict value)
+{
+    bool equal = value->hash != NULL
+        && value->encoding_type == predicate->encoding_type
+        && 0 == strcmp(value->hash, predicate->string);
+
+    return predicate->op == PIGEON_QUERY_OP_EQ ? equal : !equal;
+}
+
+static pigeon_query_result_t pigeon_query_evaluate_predicate(const pigeon_query_predicate_t * restrict predicate, const pigeon_parsed_message_t * restrict header, unsigned known_headers)
+{
+    if ((known_headers & predicate->header) == 0)
+        return (known_headers & PIGEON_HEADERS_COMPLETE) ? PIGEON_QUERY_FALSE : PIGEON_QUERY_UNKNOWN;
+
+    bool result = false;
+    switch (predicate->header)
+    {
+        case PIGEON_HEADER_AUTHOR:
+            result = pigeon_query_compare_encoded(predicate, &header->author);
+            break;
+
+        case PIGEON_HEADER_PREVIOUS:
+            result = pigeon_query_compare_encoded(predicate, &header->previous);
+            break;
+
+        case PIGEON_HEADER_SEQUENCE:
+            result = pigeon_query_compare_int(predicate, header->sequence_number);
+            break;
+
+        case PIGEON_HEADER_TIMESTAMP:
+            result = pigeon_query_compare_int(predicate, header->timestamp);
+            break;
+
+        case PIGEON_HEADER_KIND:
+            // The parser leaves an empty kind NULL
+            result = 0 == strcmp(header->kind ? header->kind : "", predicate->string);
+            if (predicate->op == PIGEON_QUERY_OP_NE)
+                result = !result;
+            break;
+
+        default:
+            break;
+    }
+
+    return result ? PIGEON_QUERY_TRUE : PIGEON_QUERY_FALSE;
+}
+
+pigeon_query_result_t pigeon_query_evaluate(const pigeon_query_t * restrict query, const pigeon_parsed_message_t * restrict header, unsigned known_headers)
+{
+    pigeon_query_result_t stack[PIGEON_QUERY_MAX_DEPTH];
+    size_t depth = 0;
+
+    for (size_t i = 0; i < query->node_count; ++i)
+    {
+        const pigeon_query_node_t * node = &query->nodes[i];
+        switch (node->type)
+        {
+            case PIGEON_QUERY_NODE_PREDICATE:
+                stack[depth++] = pigeon_query_evaluate_predicate(&query->predicates[node->predicate], header, known_headers);
+                break;
+
+            case PIGEON_QUERY_NODE_NOT:
+                if (stack[depth - 1] != PIGEON_QUERY_UNKNOWN)
+                    stack[depth - 1] = stack[depth - 1] == PIGEON_QUERY_TRUE ? PIGEON_QUERY_FALSE : PIGEON_QUERY_TRUE;
+                break;
+
+            case PIGEON_QUERY_NODE_AND:
+            {
+                pigeon_query_result_t rhs = stack[--depth];
+                pigeon_query_result_t lhs = stack[depth - 1];
+                if (lhs == PIGEON_QUERY_FALSE || rhs == PIGEON_QUERY_FALSE)
+                    stack[depth - 1] = PIGEON_QUERY_FALSE;
+                else if (lhs == PIGEON_QUERY_TRUE && rhs == PIGEON_QUERY_TRUE)
+                    stack[depth - 1] = PIGEON_QUERY_TRUE;
+                else
+                    stack[depth - 1] = PIGEON_QUERY_UNKNOWN;
+                break;
+            }
+
+            case PIGEON_QUERY_NODE_OR:
+            {
+                pigeon_query_result_t rhs = stack[--depth];
+                pigeon_query_result_t lhs = stack[depth - 1];
+                if (lhs == PIGEON_QUERY_TRUE || rhs == PIGEON_QUERY_TRUE)
+                    stack[depth - 1] = PIGEON_QUERY_TRUE;
+                else if (lhs == PIGEON_QUERY_FALSE && rhs == PIGEON_QUERY_FALSE)
+                    stack[depth - 1] = PIGEON_QUERY_FALSE;
+                else
+                    stack[depth - 1] = PIGEON_QUERY_UNKNOWN;
+                break;
+            }
+        }
+    }
+
+    return depth != 0 ? stack[0] : PIGEON_QUERY_TRUE;
+}
+
+bool pigeon_query_header_filter(void * user_data, const pigeon_parsed_message_t * header, unsigned known_headers)
+{
+    const pigeon_query_t * query = user_data;
+
+    // Nothing to decide until a header the query looks at has arrived
+    if ((known_headers & PIGEON_HEADERS_COMPLETE) == 0 && (known_headers & query->header_mask) == 0)
+        return true;
+
+    return pigeon_query_evaluate(query, header, known_headers) != PIGEON_QUERY_FALSE;
+}
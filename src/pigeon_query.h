@@ -0,0 +1,97 @@
+#ifndef PIGEON_QUERY_H
+#define PIGEON_QUERY_H
+
+#include "pigeon_parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A small filter language over message headers, compiled into a plan that
+// runs inside the parser (see pigeon_parse_message_filtered):
+//
+//     kind == "post" && timestamp in [1000, 2000) && author == @ed25519:abc=
+//
+// Predicates compare one header (author, sequence, kind, previous,
+// timestamp) with a literal using ==, !=, <, <=, >, >= or a half-open or
+// closed interval with 'in'. They combine with &&, ||, ! and parentheses.
+// Ordering operators and intervals apply to sequence and timestamp only.
+//
+// Evaluation is three-valued: a predicate on a header that has not been
+// read yet is unknown, so a message is rejected as soon as the known headers
+// make the whole expression false.
+
+typedef enum {
+    PIGEON_QUERY_FALSE,
+    PIGEON_QUERY_TRUE,
+    PIGEON_QUERY_UNKNOWN
+} pigeon_query_result_t;
+
+typedef enum {
+    PIGEON_QUERY_OP_EQ,
+    PIGEON_QUERY_OP_NE,
+    PIGEON_QUERY_OP_LT,
+    PIGEON_QUERY_OP_LE,
+    PIGEON_QUERY_OP_GT,
+    PIGEON_QUERY_OP_GE,
+    PIGEON_QUERY_OP_IN
+} pigeon_query_op_t;
+
+typedef struct {
+    pigeon_header_flags_t header;
+    pigeon_query_op_t op;
+
+    int64_t low;
+    int64_t high;
+    bool low_inclusive;
+    bool high_inclusive;
+
+    pigeon_encoding_type_t encoding_type;
+    char * string;
+} pigeon_query_predicate_t;
+
+typedef enum {
+    PIGEON_QUERY_NODE_PREDICATE,
+    PIGEON_QUERY_NODE_AND,
+    PIGEON_QUERY_NODE_OR,
+    PIGEON_QUERY_NODE_NOT
+} pigeon_query_node_type_t;
+
+typedef struct {
+    pigeon_query_node_type_t type;
+    unsigned predicate;
+} pigeon_query_node_t;
+
+typedef struct {
+    // Plan in postfix order
+    pigeon_query_node_t * nodes;
+    size_t node_count;
+    size_t node_capacity;
+
+    pigeon_query_predicate_t * predicates;
+    size_t predicate_count;
+    size_t predicate_capacity;
+
+    size_t max_depth;
+    unsigned header_mask; // headers referenced by the query
+
+    char error_messages[256];
+} pigeon_query_t;
+
+bool pigeon_query_compile(pigeon_query_t * restrict query, const char * restrict text);
+
+void pigeon_query_free(pigeon_query_t * restrict query);
+
+// known_headers is a pigeon_header_flags_t mask. With PIGEON_HEADERS_COMPLETE
+// set, headers that are still missing compare false and the result is never
+// unknown.
+pigeon_query_result_t pigeon_query_evaluate(const pigeon_query_t * restrict query, const pigeon_parsed_message_t * restrict header, unsigned known_headers);
+
+// A pigeon_header_filter_t taking the compiled query as user_data.
+bool pigeon_query_header_filter(void * user_data, const pigeon_parsed_message_t * header, unsigned known_headers);
+
+static inline bool pigeon_query_parse_message(const pigeon_query_t * restrict query, pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size, pigeon_parsed_message_t * restrict decoded_msg, bool * restrict matched)
+{
+    return pigeon_parse_message_filtered(ctx, msg_data, msg_size, decoded_msg, pigeon_query_header_filter, (void *)query, matched);
+}
+
+#endif
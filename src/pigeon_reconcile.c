@@ -0,0 +1,523 @@
+#include "pigeon_reconcile.h"
+#include "pigeon_memory.h"
+#include "pigeon_string.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PIGEON_HEADER_KEY (PIGEON_HEADER_AUTHOR | PIGEON_HEADER_SEQUENCE)
+
+static void pigeon_summary_error(pigeon_summary_t * restrict summary, const char * format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(summary->error_messages, sizeof(summary->error_messages), format, ap);
+    va_end(ap);
+}
+
+// Fingerprints are compared with other nodes, so the hashes behind them are
+// part of the protocol and, unlike those in pigeon_hash.h, must never
+// change. Authors hash with 64-bit FNV-1a followed by the splitmix64
+// finalizer; a range hashes its bounds, truncated to 32 bits each, mixed
+// with the author's hash. test_reconcile.c pins known answers.
+static inline uint64_t pigeon_fingerprint_mix(uint64_t value)
+{
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ull;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebull;
+    value ^= value >> 31;
+    return value;
+}
+
+static inline uint64_t pigeon_range_hash(uint64_t seed, int64_t first, int64_t last)
+{
+    uint64_t bits = ((uint64_t)(uint32_t)first << 32) | (uint32_t)last;
+    return pigeon_fingerprint_mix(seed ^ pigeon_fingerprint_mix(bits + 0x9e3779b97f4a7c15ull));
+}
+
+static uint64_t pigeon_author_hash(const char * restrict author)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (; *author; ++author)
+    {
+        hash ^= (unsigned char)*author;
+        hash *= 0x100000001b3ull;
+    }
+
+    return pigeon_fingerprint_mix(hash);
+}
+
+void pigeon_range_set_init(pigeon_range_set_t * restrict set, uint64_t seed)
+{
+    memset(set, 0, sizeof(*set));
+    set->seed = seed;
+}
+
+void pigeon_range_set_free(pigeon_range_set_t * restrict set)
+{
+    pigeon_free(set->ranges);
+    set->ranges = NULL;
+    set->count = 0;
+    set->capacity = 0;
+    set->fingerprint = 0;
+}
+
+static bool pigeon_range_set_reserve(pigeon_range_set_t * restrict set, size_t count)
+{
+    if (count <= set->capacity)
+        return true;
+
+    size_t capacity = set->capacity ? set->capacity * 2 : 4;
+    pigeon_range_t * ranges = pigeon_realloc(set->ranges, capacity * sizeof(pigeon_range_t));
+    if (!ranges)
+        return false;
+
+    set->ranges = ranges;
+    set->capacity = capacity;
+    return true;
+}
+
+// First range that ends at or after value - 1, i.e. that value could extend.
+static size_t pigeon_range_set_lower_bound(const pigeon_range_set_t * restrict set, int64_t value)
+{
+    size_t low = 0;
+    size_t high = set->count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if ((int64_t)set->ranges[middle].last + 1 < value)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+bool pigeon_range_set_add(pigeon_range_set_t * restrict set, pigeon_sequence_number_t first, pigeon_sequence_number_t last)
+{
+    if (first > last)
+        return true;
+
+    // Messages mostly arrive in order and extend the last range
+    if (set->count > 0)
+    {
+        pigeon_range_t * tail = &set->ranges[set->count - 1];
+        if (first >= tail->first && (int64_t)first <= (int64_t)tail->last + 1)
+        {
+            if (last > tail->last)
+            {
+                set->fingerprint ^= pigeon_range_hash(set->seed, tail->first, tail->last) ^ pigeon_range_hash(set->seed, tail->first, last);
+                tail->last = last;
+            }
+            return true;
+        }
+    }
+
+    size_t low = pigeon_range_set_lower_bound(set, first);
+    size_t high = low;
+    while (high < set->count && (int64_t)set->ranges[high].first <= (int64_t)last + 1)
+        ++high;
+
+    pigeon_range_t merged = { first, last };
+    if (low < high)
+    {
+        if (set->ranges[low].first < merged.first)
+            merged.first = set->ranges[low].first;
+        if (set->ranges[high - 1].last > merged.last)
+            merged.last = set->ranges[high - 1].last;
+    }
+    else if (!pigeon_range_set_reserve(set, set->count + 1))
+        return false;
+
+    for (size_t i = low; i < high; ++i)
+        set->fingerprint ^= pigeon_range_hash(set->seed, set->ranges[i].first, set->ranges[i].last);
+    set->fingerprint ^= pigeon_range_hash(set->seed, merged.first, merged.last);
+
+    // Replace ranges [low, high) with the single merged range
+    size_t removed = high - low;
+    if (removed != 1)
+        memmove(&set->ranges[low + 1], &set->ranges[high], (set->count - high) * sizeof(pigeon_range_t));
+
+    set->ranges[low] = merged;
+    set->count = set->count + 1 - removed;
+    return true;
+}
+
+bool pigeon_range_set_contains(const pigeon_range_set_t * restrict set, pigeon_sequence_number_t sequence)
+{
+    size_t index = pigeon_range_set_lower_bound(set, (int64_t)sequence + 1);
+    return index < set->count && set->ranges[index].first <= sequence;
+}
+
+uint64_t pigeon_range_set_size(const pigeon_range_set_t * restrict set)
+{
+    uint64_t size = 0;
+    for (size_t i = 0; i < set->count; ++i)
+        size += (uint64_t)((int64_t)set->ranges[i].last - set->ranges[i].first + 1);
+
+    return size;
+}
+
+bool pigeon_range_set_difference(const pigeon_range_set_t * restrict a, const pigeon_range_set_t * restrict b, pigeon_range_callback_t callback, void * user_data)
+{
+    size_t j = 0;
+    for (size_t i = 0; i < a->count; ++i)
+    {
+        pigeon_range_t range = a->ranges[i];
+        int64_t next = range.first; // first value of range not yet accounted for
+
+        while (j < b->count && b->ranges[j].last < range.first)
+            ++j;
+
+        // b's ranges are kept (not skipped) when they reach past this range,
+        // since they may cover the next one as well
+        for (size_t k = j; k < b->count && b->ranges[k].first <= range.last; ++k)
+        {
+            if (b->ranges[k].first > next)
+            {
+                pigeon_range_t gap = { (pigeon_sequence_number_t)next, b->ranges[k].first - 1 };
+                if (!callback(user_data, gap))
+                    return false;
+            }
+
+            if ((int64_t)b->ranges[k].last + 1 > next)
+                next = (int64_t)b->ranges[k].last + 1;
+            if (b->ranges[k].last >= range.last)
+                break;
+            j = k + 1;
+        }
+
+        if (next <= range.last)
+        {
+            pigeon_range_t gap = { (pigeon_sequence_number_t)next, range.last };
+            if (!callback(user_data, gap))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool pigeon_summary_init(pigeon_summary_t * restrict summary)
+{
+    memset(summary, 0, sizeof(*summary));
+    return pigeon_map_init(&summary->feeds, 64);
+}
+
+static void pigeon_summary_free_feed(void * value)
+{
+    pigeon_summary_feed_t * feed = value;
+    pigeon_range_set_free(&feed->ranges);
+    pigeon_free(feed->author);
+    pigeon_free(feed);
+}
+
+void pigeon_summary_free(pigeon_summary_t * restrict summary)
+{
+    pigeon_map_free(&summary->feeds, pigeon_summary_free_feed);
+    memset(summary->bucket_feeds, 0, sizeof(summary->bucket_feeds));
+}
+
+static inline unsigned pigeon_summary_bucket(uint64_t seed)
+{
+    return (unsigned)(seed & (PIGEON_RECONCILE_BUCKETS - 1));
+}
+
+bool pigeon_summary_add(pigeon_summary_t * restrict summary, const char * restrict author, pigeon_sequence_number_t first, pigeon_sequence_number_t last)
+{
+    bool inserted;
+    void ** slot = pigeon_map_insert(&summary->feeds, author, &inserted);
+    if (!slot)
+    {
+        pigeon_summary_error(summary, "out of memory");
+        return false;
+    }
+
+    pigeon_summary_feed_t * feed = *slot;
+    if (inserted)
+    {
+        uint64_t seed = pigeon_author_hash(author);
+        feed = pigeon_malloc(sizeof(pigeon_summary_feed_t));
+        char * copy = pigeon_strdup_range(author, strlen(author));
+        if (!feed || !copy)
+        {
+            pigeon_free(feed);
+            pigeon_free(copy);
+            pigeon_map_remove(&summary->feeds, author, NULL);
+            pigeon_summary_error(summary, "out of memory");
+            return false;
+        }
+
+        feed->author = copy;
+        pigeon_range_set_init(&feed->ranges, seed);
+
+        unsigned bucket = pigeon_summary_bucket(seed);
+        feed->next = summary->bucket_feeds[bucket];
+        summary->bucket_feeds[bucket] = feed;
+        *slot = feed;
+    }
+
+    uint64_t before = feed->ranges.fingerprint;
+    if (!pigeon_range_set_add(&feed->ranges, first, last))
+    {
+        pigeon_summary_error(summary, "out of memory");
+        return false;
+    }
+
+    uint64_t delta = before ^ feed->ranges.fingerprint;
+    unsigned bucket = pigeon_summary_bucket(feed->ranges.seed);
+    summary->buckets[bucket] ^= delta;
+    summary->blocks[bucket / PIGEON_RECONCILE_FANOUT] ^= delta;
+
+    if (last >= first)
+        summary->messages += (uint64_t)((int64_t)last - first + 1);
+
+    return true;
+}
+
+static bool pigeon_summary_header_filter(void * user_data, const pigeon_parsed_message_t * header, unsigned known_headers)
+{
+    (void)user_data;
+    (void)header;
+
+    // Nothing past the author and sequence is needed
+    return (known_headers & PIGEON_HEADER_KEY) != PIGEON_HEADER_KEY;
+}
+
+bool pigeon_summary_add_message(pigeon_summary_t * restrict summary, pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size)
+{
+    pigeon_parsed_message_t message;
+    bool matched;
+    bool result = pigeon_parse_message_filtered(ctx, msg_data, msg_size, &message, pigeon_summary_header_filter, NULL, &matched);
+
+    if (!result)
+        pigeon_summary_error(summary, "%s", pigeon_get_error_messages(ctx));
+    else if (matched)
+    {
+        // The filter only lets messages through that lack either header
+        pigeon_summary_error(summary, "message has no author or sequence");
+        result = false;
+    }
+    else
+    {
+        pigeon_string_t buffer;
+        pigeon_string_init(&buffer);
+        const char * author = pigeon_encoded_value_key(&message.author, &buffer);
+        if (!author)
+        {
+            pigeon_summary_error(summary, "out of memory");
+            result = false;
+        }
+        else
+            result = pigeon_summary_add(summary, author, message.sequence_number, message.sequence_number);
+
+        pigeon_string_free(&buffer);
+    }
+
+    pigeon_free_parsed_message(&message);
+    return result;
+}
+
+const pigeon_summary_feed_t * pigeon_summary_find(const pigeon_summary_t * restrict summary, const char * restrict author)
+{
+    void ** slot = pigeon_map_find(&summary->feeds, author);
+    return slot ? *slot : NULL;
+}
+
+static bool pigeon_reconcile_local_fingerprints(void * user_data, unsigned block, uint64_t fingerprints[PIGEON_RECONCILE_FANOUT])
+{
+    const pigeon_summary_t * summary = user_data;
+    if (block == PIGEON_RECONCILE_TOP)
+        memcpy(fingerprints, summary->blocks, sizeof(summary->blocks));
+    else if (block < PIGEON_RECONCILE_FANOUT)
+        memcpy(fingerprints, &summary->buckets[block * PIGEON_RECONCILE_FANOUT], PIGEON_RECONCILE_FANOUT * sizeof(uint64_t));
+    else
+        return false;
+
+    return true;
+}
+
+static bool pigeon_reconcile_local_bucket(void * user_data, unsigned bucket, pigeon_reconcile_feed_callback_t feed_callback, void * feed_data)
+{
+    const pigeon_summary_t * summary = user_data;
+    if (bucket >= PIGEON_RECONCILE_BUCKETS)
+        return false;
+
+    for (const pigeon_summary_feed_t * feed = summary->bucket_feeds[bucket]; feed != NULL; feed = feed->next)
+        if (!feed_callback(feed_data, feed->author, &feed->ranges))
+            return false;
+
+    return true;
+}
+
+void pigeon_reconcile_local_peer(pigeon_reconcile_peer_t * restrict peer, const pigeon_summary_t * restrict summary)
+{
+    peer->fingerprints = pigeon_reconcile_local_fingerprints;
+    peer->bucket = pigeon_reconcile_local_bucket;
+    peer->user_data = (void *)summary;
+}
+
+typedef struct {
+    const pigeon_summary_t * local;
+    pigeon_reconcile_callback_t callback;
+    void * user_data;
+    pigeon_reconcile_stats_t * stats;
+
+    pigeon_reconcile_direction_t direction;
+    const char * author;
+
+    pigeon_map_t seen; // authors the peer listed in the current bucket
+    bool failed;
+} pigeon_reconcile_state_t;
+
+static bool pigeon_reconcile_emit(void * user_data, pigeon_range_t range)
+{
+    pigeon_reconcile_state_t * state = user_data;
+    uint64_t size = (uint64_t)((int64_t)range.last - range.first + 1);
+    if (state->direction == PIGEON_RECONCILE_HAVE)
+    {
+        ++state->stats->have_ranges;
+        state->stats->have_messages += size;
+    }
+    else
+    {
+        ++state->stats->need_ranges;
+        state->stats->need_messages += size;
+    }
+
+    return state->callback(state->user_data, state->direction, state->author, range);
+}
+
+static bool pigeon_reconcile_diff(pigeon_reconcile_state_t * restrict state, const char * restrict author, const pigeon_range_set_t * restrict local, const pigeon_range_set_t * restrict remote)
+{
+    static const pigeon_range_set_t empty = { NULL, 0, 0, 0, 0 };
+    if (!local)
+        local = &empty;
+    if (!remote)
+        remote = &empty;
+
+    // Equal range counts and equal 64-bit XOR fingerprints are taken to mean
+    // equal feeds. A collision would hide a difference; that risk is
+    // accepted rather than comparing every range set.
+    ++state->stats->feeds;
+    if (local->count == remote->count && local->fingerprint == remote->fingerprint)
+        return true;
+
+    state->author = author;
+    state->direction = PIGEON_RECONCILE_NEED;
+    if (!pigeon_range_set_difference(remote, local, pigeon_reconcile_emit, state))
+        return false;
+
+    state->direction = PIGEON_RECONCILE_HAVE;
+    return pigeon_range_set_difference(local, remote, pigeon_reconcile_emit, state);
+}
+
+static bool pigeon_reconcile_remote_feed(void * feed_data, const char * author, const pigeon_range_set_t * ranges)
+{
+    pigeon_reconcile_state_t * state = feed_data;
+    state->stats->bytes += strlen(author) + 1 + 8 + ranges->count * sizeof(pigeon_range_t);
+
+    bool inserted;
+    if (!pigeon_map_insert(&state->seen, author, &inserted))
+    {
+        state->failed = true;
+        return false;
+    }
+
+    const pigeon_summary_feed_t * local = pigeon_summary_find(state->local, author);
+    if (!pigeon_reconcile_diff(state, author, local ? &local->ranges : NULL, ranges))
+    {
+        state->failed = true;
+        return false;
+    }
+
+    return true;
+}
+
+static bool pigeon_reconcile_bucket(pigeon_reconcile_state_t * restrict state, const pigeon_reconcile_peer_t * restrict peer, unsigned bucket)
+{
+    ++state->stats->buckets;
+    ++state->stats->requests;
+
+    pigeon_map_free(&state->seen, NULL);
+    if (!pigeon_map_init(&state->seen, 16))
+        return false;
+
+    if (!peer->bucket(peer->user_data, bucket, pigeon_reconcile_remote_feed, state) || state->failed)
+        return false;
+
+    // Whatever the peer did not list, it does not have at all
+    for (const pigeon_summary_feed_t * feed = state->local->bucket_feeds[bucket]; feed != NULL; feed = feed->next)
+        if (!pigeon_map_find(&state->seen, feed->author) && !pigeon_reconcile_diff(state, feed->author, &feed->ranges, NULL))
+            return false;
+
+    return true;
+}
+
+bool pigeon_reconcile(const pigeon_summary_t * restrict local, const pigeon_reconcile_peer_t * restrict peer, pigeon_reconcile_callback_t callback, void * user_data, pigeon_reconcile_stats_t * restrict stats)
+{
+    pigeon_reconcile_stats_t ignored;
+    if (!stats)
+        stats = &ignored;
+    memset(stats, 0, sizeof(*stats));
+
+    pigeon_reconcile_state_t state;
+    memset(&state, 0, sizeof(state));
+    state.local = local;
+    state.callback = callback;
+    state.user_data = user_data;
+    state.stats = stats;
+    if (!pigeon_map_init(&state.seen, 16))
+        return false;
+
+    // Each level's requests are independent of each other, so a transport
+    // can batch them: one round trip per level that has anything to ask.
+    uint64_t remote_blocks[PIGEON_RECONCILE_FANOUT];
+    ++stats->round_trips;
+    ++stats->requests;
+    stats->bytes += sizeof(remote_blocks);
+    bool success = peer->fingerprints(peer->user_data, PIGEON_RECONCILE_TOP, remote_blocks);
+
+    unsigned differing[PIGEON_RECONCILE_FANOUT];
+    unsigned differing_count = 0;
+    for (unsigned block = 0; success && block < PIGEON_RECONCILE_FANOUT; ++block)
+        if (remote_blocks[block] != local->blocks[block])
+            differing[differing_count++] = block;
+
+    uint64_t (* remote_buckets)[PIGEON_RECONCILE_FANOUT] = NULL;
+    if (success && differing_count > 0)
+    {
+        ++stats->round_trips;
+        remote_buckets = pigeon_malloc(differing_count * sizeof(*remote_buckets));
+        success = remote_buckets != NULL;
+        for (unsigned i = 0; success && i < differing_count; ++i)
+        {
+            ++stats->requests;
+            stats->bytes += sizeof(remote_buckets[i]);
+            success = peer->fingerprints(peer->user_data, differing[i], remote_buckets[i]);
+        }
+    }
+
+    bool exchanged = false;
+    for (unsigned i = 0; success && i < differing_count; ++i)
+    {
+        for (unsigned j = 0; success && j < PIGEON_RECONCILE_FANOUT; ++j)
+        {
+            unsigned bucket = differing[i] * PIGEON_RECONCILE_FANOUT + j;
+            if (remote_buckets[i][j] == local->buckets[bucket])
+                continue;
+
+            if (!exchanged)
+                ++stats->round_trips;
+            exchanged = true;
+            success = pigeon_reconcile_bucket(&state, peer, bucket);
+        }
+    }
+
+    pigeon_free(remote_buckets);
+    pigeon_map_free(&state.seen, NULL);
+    return success;
+}
@@ -0,0 +1,132 @@
+#ifndef PIGEON_RECONCILE_H
+#define PIGEON_RECONCILE_H
+
+#include "pigeon_map.h"
+#include "pigeon_parser.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Works out which messages two nodes are missing from each other without
+// looking at the messages themselves. Each node keeps a summary: for every
+// author, the set of sequence numbers it holds as sorted, merged ranges.
+//
+// Every range set carries a fingerprint (the XOR of its range hashes), and
+// feeds are hashed into PIGEON_RECONCILE_FANOUT^2 buckets whose fingerprints
+// are grouped into PIGEON_RECONCILE_FANOUT blocks. All of these are updated
+// in place as ranges are added. Reconciling compares block fingerprints,
+// then bucket fingerprints of differing blocks, then range sets of the feeds
+// in differing buckets, so the work grows with the differences rather than
+// with the size of either log.
+//
+// Fingerprints are exchanged between nodes, so their hash functions are
+// fixed and shared by every build. Feeds with equal fingerprints and range
+// counts are treated as equal; a 64-bit collision would go unnoticed.
+
+#define PIGEON_RECONCILE_FANOUT 64
+#define PIGEON_RECONCILE_BUCKETS (PIGEON_RECONCILE_FANOUT * PIGEON_RECONCILE_FANOUT)
+#define PIGEON_RECONCILE_TOP PIGEON_RECONCILE_FANOUT // block index of the top level
+
+// Inclusive range of sequence numbers.
+typedef struct {
+    pigeon_sequence_number_t first;
+    pigeon_sequence_number_t last;
+} pigeon_range_t;
+
+typedef struct {
+    pigeon_range_t * ranges; // sorted, disjoint and not adjacent
+    size_t count;
+    size_t capacity;
+    uint64_t seed;           // mixed into every range hash
+    uint64_t fingerprint;
+} pigeon_range_set_t;
+
+typedef bool (*pigeon_range_callback_t)(void * user_data, pigeon_range_t range);
+
+void pigeon_range_set_init(pigeon_range_set_t * restrict set, uint64_t seed);
+
+void pigeon_range_set_free(pigeon_range_set_t * restrict set);
+
+// Amortized O(1) when ranges arrive in order, O(log n) to find the place
+// otherwise. Returns false if memory allocation fails.
+bool pigeon_range_set_add(pigeon_range_set_t * restrict set, pigeon_sequence_number_t first, pigeon_sequence_number_t last);
+
+bool pigeon_range_set_contains(const pigeon_range_set_t * restrict set, pigeon_sequence_number_t sequence);
+
+uint64_t pigeon_range_set_size(const pigeon_range_set_t * restrict set);
+
+// Calls callback, in order, with the ranges of a that are not in b. Takes
+// O(a->count + b->count). Returns false if the callback does.
+bool pigeon_range_set_difference(const pigeon_range_set_t * restrict a, const pigeon_range_set_t * restrict b, pigeon_range_callback_t callback, void * user_data);
+
+typedef struct pigeon_summary_feed_t {
+    char * author;  // "algo:hash", as in pigeon_encoding_name
+    pigeon_range_set_t ranges;
+    struct pigeon_summary_feed_t * next; // next feed in the same bucket
+} pigeon_summary_feed_t;
+
+typedef struct {
+    pigeon_map_t feeds; // author -> pigeon_summary_feed_t
+    pigeon_summary_feed_t * bucket_feeds[PIGEON_RECONCILE_BUCKETS];
+    uint64_t buckets[PIGEON_RECONCILE_BUCKETS];
+    uint64_t blocks[PIGEON_RECONCILE_FANOUT];
+    uint64_t messages; // sequence numbers added, counting repeats
+
+    char error_messages[256];
+} pigeon_summary_t;
+
+bool pigeon_summary_init(pigeon_summary_t * restrict summary);
+
+void pigeon_summary_free(pigeon_summary_t * restrict summary);
+
+bool pigeon_summary_add(pigeon_summary_t * restrict summary, const char * restrict author, pigeon_sequence_number_t first, pigeon_sequence_number_t last);
+
+// Parses only the header of a message and records its author and sequence.
+bool pigeon_summary_add_message(pigeon_summary_t * restrict summary, pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size);
+
+const pigeon_summary_feed_t * pigeon_summary_find(const pigeon_summary_t * restrict summary, const char * restrict author);
+
+typedef bool (*pigeon_reconcile_feed_callback_t)(void * feed_data, const char * author, const pigeon_range_set_t * ranges);
+
+// The remote side of a reconciliation, one request per call. A network
+// transport implements these by asking the other node; the range set passed
+// to feed only needs to live for the duration of the call.
+typedef struct {
+    // Fills fingerprints with the block fingerprints for PIGEON_RECONCILE_TOP,
+    // otherwise with the bucket fingerprints of the given block.
+    bool (*fingerprints)(void * user_data, unsigned block, uint64_t fingerprints[PIGEON_RECONCILE_FANOUT]);
+
+    // Calls feed for every feed hashed to bucket.
+    bool (*bucket)(void * user_data, unsigned bucket, pigeon_reconcile_feed_callback_t feed, void * feed_data);
+
+    void * user_data;
+} pigeon_reconcile_peer_t;
+
+// Serves requests straight from a summary in the same process.
+void pigeon_reconcile_local_peer(pigeon_reconcile_peer_t * restrict peer, const pigeon_summary_t * restrict summary);
+
+typedef enum {
+    PIGEON_RECONCILE_HAVE, // held locally, missing on the peer
+    PIGEON_RECONCILE_NEED  // held by the peer, missing locally
+} pigeon_reconcile_direction_t;
+
+typedef bool (*pigeon_reconcile_callback_t)(void * user_data, pigeon_reconcile_direction_t direction, const char * author, pigeon_range_t range);
+
+typedef struct {
+    unsigned round_trips;
+    uint64_t requests;
+    uint64_t bytes;          // approximate size of the replies on the wire
+    uint64_t buckets;        // buckets whose feeds were exchanged
+    uint64_t feeds;          // feeds whose range sets were compared
+    uint64_t have_ranges;
+    uint64_t have_messages;
+    uint64_t need_ranges;
+    uint64_t need_messages;
+} pigeon_reconcile_stats_t;
+
+// Reports every range the two sides differ by, as HAVE or NEED. stats may
+// be NULL. Returns false if the peer or the callback fail.
+bool pigeon_reconcile(const pigeon_summary_t * restrict local, const pigeon_reconcile_peer_t * restrict peer, pigeon_reconcile_callback_t callback, void * user_data, pigeon_reconcile_stats_t * restrict stats);
+
+#endif
@@ -0,0 +1,202 @@
+#include "pigeon_schema.h"
+#include "pigeon_memory.h"
+#include "pigeon_string.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+// Table sizes tried for a perfect hash, starting at twice the field count.
+#define PIGEON_SCHEMA_MAX_TABLE 4096
+#define PIGEON_SCHEMA_SEED_TRIES 256
+
+static void pigeon_schema_error(pigeon_schema_registry_t * restrict registry, const char * format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(registry->error_messages, sizeof(registry->error_messages), format, ap);
+    va_end(ap);
+}
+
+static void pigeon_schema_free(void * value)
+{
+    pigeon_schema_t * schema = value;
+    for (size_t i = 0; i < schema->rule_count; ++i)
+        pigeon_free(schema->rules[i].name);
+
+    pigeon_free(schema->rules);
+    pigeon_free(schema->table);
+    pigeon_free(schema->kind);
+    pigeon_free(schema);
+}
+
+bool pigeon_schema_registry_init(pigeon_schema_registry_t * restrict registry, unsigned flags)
+{
+    memset(registry, 0, sizeof(*registry));
+    registry->flags = flags;
+    return pigeon_map_init(&registry->schemas, 16);
+}
+
+void pigeon_schema_registry_free(pigeon_schema_registry_t * restrict registry)
+{
+    pigeon_map_free(&registry->schemas, pigeon_schema_free);
+}
+
+// Tries seeds until every rule name lands in a slot of its own.
+static bool pigeon_schema_place(pigeon_schema_t * restrict schema, uint32_t size)
+{
+    uint8_t * table = pigeon_malloc(size);
+    if (!table)
+        return false;
+
+    uint64_t seed = PIGEON_HASH_INIT;
+    for (unsigned attempt = 0; attempt < PIGEON_SCHEMA_SEED_TRIES; ++attempt)
+    {
+        memset(table, 0, size);
+        size_t placed = 0;
+        for (; placed < schema->rule_count; ++placed)
+        {
+            const pigeon_schema_rule_t * rule = &schema->rules[placed];
+            uint32_t slot = pigeon_schema_slot(seed, size - 1, rule->name, rule->name_length);
+            if (table[slot] != 0)
+                break;
+
+            table[slot] = (uint8_t)(placed + 1);
+        }
+
+        if (placed == schema->rule_count)
+        {
+            schema->seed = seed;
+            schema->table_mask = size - 1;
+            schema->table = table;
+            return true;
+        }
+
+        seed = seed * 0x5851f42d4c957f2dull + 0x14057b7ef767814full;
+    }
+
+    pigeon_free(table);
+    return false;
+}
+
+static bool pigeon_schema_compile(pigeon_schema_registry_t * restrict registry, pigeon_schema_t * restrict schema, const pigeon_schema_field_t * restrict fields, size_t count)
+{
+    schema->rules = pigeon_malloc((count ? count : 1) * sizeof(pigeon_schema_rule_t));
+    if (!schema->rules)
+    {
+        pigeon_schema_error(registry, "out of memory");
+        return false;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const pigeon_schema_field_t * field = &fields[i];
+        size_t length = field->name ? strlen(field->name) : 0;
+        if (length == 0 || length > UINT32_MAX)
+        {
+            pigeon_schema_error(registry, "field %zu of kind '%s' has no name", i, schema->kind);
+            return false;
+        }
+
+        for (size_t j = 0; j < i; ++j)
+        {
+            if (strcmp(fields[j].name, field->name) == 0)
+            {
+                pigeon_schema_error(registry, "field '%s' of kind '%s' is listed twice", field->name, schema->kind);
+                return false;
+            }
+        }
+
+        if (field->bounded && field->min > field->max)
+        {
+            pigeon_schema_error(registry, "field '%s' of kind '%s' has an empty range", field->name, schema->kind);
+            return false;
+        }
+
+        pigeon_schema_rule_t * rule = &schema->rules[i];
+        rule->name = pigeon_strdup_range(field->name, length);
+        if (!rule->name)
+        {
+            pigeon_schema_error(registry, "out of memory");
+            return false;
+        }
+
+        rule->name_length = (uint32_t)length;
+        rule->type = field->type;
+        rule->bounded = field->bounded;
+        rule->min = field->min;
+        rule->max = field->max;
+        rule->max_length = field->max_length;
+        schema->rule_count = i + 1;
+
+        if (field->required)
+            schema->required |= 1ull << i;
+    }
+
+    for (uint32_t size = 8; size <= PIGEON_SCHEMA_MAX_TABLE; size *= 2)
+    {
+        if (size < 2 * count)
+            continue;
+
+        if (pigeon_schema_place(schema, size))
+            return true;
+    }
+
+    pigeon_schema_error(registry, "cannot build a field table for kind '%s'", schema->kind);
+    return false;
+}
+
+bool pigeon_schema_registry_add(pigeon_schema_registry_t * restrict registry, const char * restrict kind, const pigeon_schema_field_t * restrict fields, size_t count, unsigned flags)
+{
+    if (count > PIGEON_SCHEMA_MAX_FIELDS)
+    {
+        pigeon_schema_error(registry, "kind '%s' has %zu fields, more than %d", kind, count, PIGEON_SCHEMA_MAX_FIELDS);
+        return false;
+    }
+
+    if (pigeon_map_find(&registry->schemas, kind))
+    {
+        pigeon_schema_error(registry, "kind '%s' already has a schema", kind);
+        return false;
+    }
+
+    pigeon_schema_t * schema = pigeon_malloc(sizeof(pigeon_schema_t));
+    if (!schema)
+    {
+        pigeon_schema_error(registry, "out of memory");
+        return false;
+    }
+
+    memset(schema, 0, sizeof(*schema));
+    schema->flags = flags;
+    schema->kind = pigeon_strdup_range(kind, strlen(kind));
+    if (!schema->kind)
+    {
+        pigeon_schema_error(registry, "out of memory");
+        pigeon_schema_free(schema);
+        return false;
+    }
+
+    if (!pigeon_schema_compile(registry, schema, fields, count))
+    {
+        pigeon_schema_free(schema);
+        return false;
+    }
+
+    bool inserted;
+    void ** slot = pigeon_map_insert(&registry->schemas, kind, &inserted);
+    if (!slot)
+    {
+        pigeon_schema_error(registry, "out of memory");
+        pigeon_schema_free(schema);
+        return false;
+    }
+
+    *slot = schema;
+    return true;
+}
+
+const pigeon_schema_t * pigeon_schema_registry_find(const pigeon_schema_registry_t * restrict registry, const char * restrict kind)
+{
+    void ** slot = pigeon_map_find(&registry->schemas, kind);
+    return slot ? *slot : NULL;
+}
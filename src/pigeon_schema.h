@@ -0,0 +1,103 @@
+#ifndef PIGEON_SCHEMA_H
+#define PIGEON_SCHEMA_H
+
+#include "pigeon_hash.h"
+#include "pigeon_map.h"
+#include "pigeon_parser.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Per-kind rules for data fields, checked by pigeon_parse_message_checked
+// while the fields are parsed rather than by walking the field list after.
+//
+// Each schema is compiled once: its field names go into a collision-free
+// hash table (the seed is searched for at compile time), so looking up a
+// field costs one hash and one compare, and its required fields become a
+// bitmask that is checked with a single test once the fields end.
+
+#define PIGEON_SCHEMA_MAX_FIELDS 64
+
+// Schema flags
+enum {
+    PIGEON_SCHEMA_ALLOW_EXTRA = 1 << 0 // accept fields the schema does not list
+};
+
+// Registry flags
+enum {
+    PIGEON_SCHEMA_REQUIRE_KIND = 1 << 0 // reject kinds without a schema
+};
+
+typedef struct {
+    const char * name;
+    pigeon_field_type_t type;
+    bool required;
+
+    bool bounded;       // INT64 values must lie in [min, max]
+    int64_t min;
+    int64_t max;
+    uint64_t max_length; // STRING values longer than this are rejected; 0 for no limit
+} pigeon_schema_field_t;
+
+typedef struct {
+    char * name;
+    uint32_t name_length;
+    pigeon_field_type_t type;
+    bool bounded;
+    int64_t min;
+    int64_t max;
+    uint64_t max_length;
+} pigeon_schema_rule_t;
+
+typedef struct pigeon_schema_t {
+    char * kind;
+    unsigned flags;
+
+    uint64_t seed;
+    uint32_t table_mask;
+    uint8_t * table;     // rule index + 1 per slot, 0 for empty
+    pigeon_schema_rule_t * rules;
+    size_t rule_count;
+    uint64_t required;   // bit i is set if rules[i] is required
+} pigeon_schema_t;
+
+typedef struct pigeon_schema_registry_t {
+    pigeon_map_t schemas; // kind -> pigeon_schema_t
+    unsigned flags;
+
+    char error_messages[256];
+} pigeon_schema_registry_t;
+
+bool pigeon_schema_registry_init(pigeon_schema_registry_t * restrict registry, unsigned flags);
+
+void pigeon_schema_registry_free(pigeon_schema_registry_t * restrict registry);
+
+// Compiles and registers the schema of a kind; a kind can be registered
+// once. At most PIGEON_SCHEMA_MAX_FIELDS fields, with distinct names.
+bool pigeon_schema_registry_add(pigeon_schema_registry_t * restrict registry, const char * restrict kind, const pigeon_schema_field_t * restrict fields, size_t count, unsigned flags);
+
+const pigeon_schema_t * pigeon_schema_registry_find(const pigeon_schema_registry_t * restrict registry, const char * restrict kind);
+
+static inline uint32_t pigeon_schema_slot(uint64_t seed, uint32_t mask, const char * restrict name, size_t length)
+{
+    uint64_t hash = pigeon_hash(seed ^ length, name, length);
+    return (uint32_t)(hash ^ (hash >> 29)) & mask;
+}
+
+// Returns the index of the rule for a field name, or -1 if it has none.
+static inline int pigeon_schema_lookup(const pigeon_schema_t * restrict schema, const char * restrict name, size_t length)
+{
+    unsigned index = schema->table[pigeon_schema_slot(schema->seed, schema->table_mask, name, length)];
+    if (index == 0)
+        return -1;
+
+    const pigeon_schema_rule_t * rule = &schema->rules[index - 1];
+    if (rule->name_length != length || memcmp(rule->name, name, length) != 0)
+        return -1;
+
+    return (int)index - 1;
+}
+
+#endif
@@ -0,0 +1,315 @@
+#include "pigeon_seen_filter.h"
+#include "pigeon_hash.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bits of filter memory budgeted per key in a generation.
+#define PIGEON_SEEN_FILTER_BITS_PER_KEY 12
+
+static const char header_author[] = "author";
+static const char header_sequence[] = "sequence";
+static const char footer_signature[] = "signature";
+
+static void pigeon_seen_filter_clear(pigeon_seen_filter_block_t * restrict blocks, size_t block_count)
+{
+    for (size_t i = 0; i < block_count; ++i)
+        for (unsigned w = 0; w < PIGEON_SEEN_FILTER_BLOCK_WORDS; ++w)
+            atomic_store_explicit(&blocks[i].words[w], 0, memory_order_relaxed);
+}
+
+bool pigeon_seen_filter_init(pigeon_seen_filter_t * restrict filter, size_t generation_capacity)
+{
+    memset(filter, 0, sizeof(*filter));
+
+    size_t wanted_blocks = (generation_capacity * PIGEON_SEEN_FILTER_BITS_PER_KEY + 511) / 512;
+    size_t block_count = 1;
+    while (block_count < wanted_blocks)
+        block_count *= 2;
+
+    for (unsigned g = 0; g < 2; ++g)
+    {
+        filter->generations[g] = aligned_alloc(sizeof(pigeon_seen_filter_block_t), block_count * sizeof(pigeon_seen_filter_block_t));
+        if (!filter->generations[g])
+        {
+            pigeon_seen_filter_free(filter);
+            return false;
+        }
+
+        pigeon_seen_filter_clear(filter->generations[g], block_count);
+    }
+
+    filter->block_mask = block_count - 1;
+    filter->generation_capacity = generation_capacity != 0 ? generation_capacity : 1;
+    atomic_init(&filter->current, 0);
+    atomic_init(&filter->inserted, 0);
+    pthread_mutex_init(&filter->rotate_lock, NULL);
+    return true;
+}
+
+void pigeon_seen_filter_free(pigeon_seen_filter_t * restrict filter)
+{
+    if (filter->generations[0] && filter->generations[1])
+        pthread_mutex_destroy(&filter->rotate_lock);
+
+    free(filter->generations[0]);
+    free(filter->generations[1]);
+    filter->generations[0] = filter->generations[1] = NULL;
+}
+
+static const char * pigeon_skip_blanks(const char * pos, const char * end)
+{
+    while (pos != end && (*pos == ' ' || *pos == '\t'))
+        ++pos;
+    return pos;
+}
+
+static inline bool pigeon_line_has_name(const char * pos, const char * end, const char * name, size_t name_length)
+{
+    return (size_t)(end - pos) > name_length
+        && 0 == memcmp(pos, name, name_length)
+        && (pos[name_length] == ' ' || pos[name_length] == '\t');
+}
+
+static uint64_t pigeon_hash_encoded(uint64_t hash, pigeon_encoding_type_t encoding_type, const char * restrict value, size_t size)
+{
+    const char * name = pigeon_encoding_name(encoding_type);
+    hash = pigeon_hash(hash, name, strlen(name));
+    hash = pigeon_hash(hash, ":", 1);
+    return pigeon_hash(hash, value, size);
+}
+
+// Both ways of building a key end here, so that they agree on every message.
+static uint64_t pigeon_message_key_parts(pigeon_encoding_type_t author_type, const char * restrict author, size_t author_size, uint64_t sequence, pigeon_encoding_type_t signature_type, const char * restrict signature, size_t signature_size)
+{
+    uint64_t author_hash = pigeon_hash_encoded(PIGEON_HASH_INIT, author_type, author, author_size);
+    uint64_t signature_hash = pigeon_hash_encoded(PIGEON_HASH_INIT, signature_type, signature, signature_size);
+    uint64_t key = pigeon_hash_mix(author_hash ^ pigeon_hash_mix(sequence + 0x9e3779b97f4a7c15ull));
+    return pigeon_hash_mix(key ^ signature_hash);
+}
+
+static inline bool pigeon_is_hash_char(char ch)
+{
+    return isalnum((unsigned char)ch) || ch == '-' || ch == '_' || ch == '=' || ch == '/' || ch == '+';
+}
+
+// Reads an encoded value the way the parser does: sigil, algorithm, ':' and
+// the base64 hash, with blanks allowed around the ':'.
+static bool pigeon_scan_encoded(const char * pos, const char * end, char sigil, pigeon_encoding_type_t * restrict encoding_type, const char ** restrict value, size_t * restrict size)
+{
+    if (pos == end || *pos != sigil)
+        return false;
+
+    pos = pigeon_skip_blanks(pos + 1, end);
+    const char * algo = pos;
+    while (pos != end && isalnum((unsigned char)*pos))
+        ++pos;
+
+    size_t algo_length = pos - algo;
+    if (algo_length == 6 && memcmp(algo, "sha256", 6) == 0)
+        *encoding_type = PIGEON_ENCODING_TYPE_SHA256;
+    else if (algo_length == 7 && memcmp(algo, "ed25519", 7) == 0)
+        *encoding_type = PIGEON_ENCODING_TYPE_ED25519;
+    else
+        return false;
+
+    pos = pigeon_skip_blanks(pos, end);
+    if (pos == end || *pos != ':')
+        return false;
+
+    pos = pigeon_skip_blanks(pos + 1, end);
+    *value = pos;
+    while (pos != end && pigeon_is_hash_char(*pos))
+        ++pos;
+
+    *size = pos - *value;
+    return true;
+}
+
+// The footer is the last non-blank line of the message.
+static bool pigeon_scan_signature(const char * restrict msg_data, size_t msg_size, pigeon_encoding_type_t * restrict encoding_type, const char ** restrict value, size_t * restrict size)
+{
+    const char * end = msg_data + msg_size;
+    while (end != msg_data && (end[-1] == '\n' || end[-1] == ' ' || end[-1] == '\t'))
+        --end;
+
+    const char * pos = end;
+    while (pos != msg_data && pos[-1] != '\n')
+        --pos;
+
+    pos = pigeon_skip_blanks(pos, end);
+    if (!pigeon_line_has_name(pos, end, footer_signature, sizeof(footer_signature) - 1))
+        return false;
+
+    pos = pigeon_skip_blanks(pos + sizeof(footer_signature) - 1, end);
+    return pigeon_scan_encoded(pos, end, '%', encoding_type, value, size);
+}
+
+// Finds the author, and the sequence number unless sequence is NULL, in the
+// header block.
+static bool pigeon_scan_header(const char * restrict msg_data, size_t msg_size, pigeon_encoding_type_t * restrict author_type, const char ** restrict author, size_t * restrict author_size, uint64_t * restrict sequence)
+{
+    const char * pos = msg_data;
+    const char * end = msg_data + msg_size;
+
+    *author = NULL;
+    bool have_sequence = sequence == NULL;
+
+    while (pos != end && !(*author && have_sequence))
+    {
+        const char * line_end = memchr(pos, '\n', end - pos);
+        if (!line_end)
+            line_end = end;
+
+        pos = pigeon_skip_blanks(pos, line_end);
+        if (pos == line_end)
+            break; // blank line terminates the header block
+
+        if (pigeon_line_has_name(pos, line_end, header_author, sizeof(header_author) - 1))
+        {
+            pos = pigeon_skip_blanks(pos + sizeof(header_author) - 1, line_end);
+            if (!pigeon_scan_encoded(pos, line_end, '@', author_type, author, author_size))
+                return false;
+        }
+        else if (sequence && pigeon_line_has_name(pos, line_end, header_sequence, sizeof(header_sequence) - 1))
+        {
+            pos = pigeon_skip_blanks(pos + sizeof(header_sequence) - 1, line_end);
+            if (pos == line_end || *pos < '0' || *pos > '9')
+                return false;
+
+            for (*sequence = 0; pos != line_end && *pos >= '0' && *pos <= '9'; ++pos)
+                *sequence = *sequence * 10 + (*pos - '0');
+            have_sequence = true;
+        }
+
+        pos = line_end != end ? line_end + 1 : end;
+    }
+
+    return *author && have_sequence;
+}
+
+bool pigeon_message_key(const char * restrict msg_data, size_t msg_size, uint64_t * restrict key)
+{
+    pigeon_encoding_type_t author_type = PIGEON_ENCODING_TYPE_ED25519;
+    const char * author;
+    size_t author_size = 0;
+    uint64_t sequence = 0;
+
+    pigeon_encoding_type_t signature_type;
+    const char * signature;
+    size_t signature_size;
+    if (!pigeon_scan_header(msg_data, msg_size, &author_type, &author, &author_size, &sequence)
+        || !pigeon_scan_signature(msg_data, msg_size, &signature_type, &signature, &signature_size))
+        return false;
+
+    // Narrowed like the parser narrows it, so both keys agree
+    sequence = (uint64_t)(pigeon_sequence_number_t)sequence;
+    *key = pigeon_message_key_parts(author_type, author, author_size, sequence, signature_type, signature, signature_size);
+    return true;
+}
+
+bool pigeon_message_author_key(const char * restrict msg_data, size_t msg_size, uint64_t * restrict key)
+{
+    pigeon_encoding_type_t author_type = PIGEON_ENCODING_TYPE_ED25519;
+    const char * author;
+    size_t author_size = 0;
+    if (!pigeon_scan_header(msg_data, msg_size, &author_type, &author, &author_size, NULL))
+        return false;
+
+    *key = pigeon_hash_encoded(PIGEON_HASH_INIT, author_type, author, author_size);
+    return true;
+}
+
+uint64_t pigeon_message_author_key_of(const pigeon_parsed_message_t * restrict message)
+{
+    const char * author = message->author.hash ? message->author.hash : "";
+    return pigeon_hash_encoded(PIGEON_HASH_INIT, message->author.encoding_type, author, strlen(author));
+}
+
+uint64_t pigeon_message_key_of(const pigeon_parsed_message_t * restrict message)
+{
+    const char * author = message->author.hash ? message->author.hash : "";
+    const char * signature = message->signature.hash ? message->signature.hash : "";
+    return pigeon_message_key_parts(message->author.encoding_type, author, strlen(author), (uint64_t)message->sequence_number,
+        message->signature.encoding_type, signature, strlen(signature));
+}
+
+static inline pigeon_seen_filter_block_t * pigeon_seen_filter_block(const pigeon_seen_filter_t * restrict filter, unsigned generation, uint64_t key)
+{
+    return &filter->generations[generation][key & filter->block_mask];
+}
+
+// One bit per 64-bit word of the block, each chosen by 6 bits of a second
+// hash of the key.
+static inline uint64_t pigeon_seen_filter_bit(uint64_t pattern, unsigned word)
+{
+    return 1ull << ((pattern >> (word * 6)) & 63);
+}
+
+static bool pigeon_seen_filter_block_contains(pigeon_seen_filter_block_t * restrict block, uint64_t pattern)
+{
+    for (unsigned w = 0; w < PIGEON_SEEN_FILTER_BLOCK_WORDS; ++w)
+    {
+        uint64_t bit = pigeon_seen_filter_bit(pattern, w);
+        if ((atomic_load_explicit(&block->words[w], memory_order_relaxed) & bit) == 0)
+            return false;
+    }
+
+    return true;
+}
+
+bool pigeon_seen_filter_contains(pigeon_seen_filter_t * restrict filter, uint64_t key)
+{
+    uint64_t pattern = pigeon_hash_mix(key ^ 0x5851f42d4c957f2dull);
+    unsigned current = atomic_load_explicit(&filter->current, memory_order_acquire);
+
+    return pigeon_seen_filter_block_contains(pigeon_seen_filter_block(filter, current, key), pattern)
+        || pigeon_seen_filter_block_contains(pigeon_seen_filter_block(filter, current ^ 1, key), pattern);
+}
+
+static void pigeon_seen_filter_rotate(pigeon_seen_filter_t * restrict filter, unsigned generation)
+{
+    pthread_mutex_lock(&filter->rotate_lock);
+
+    // Another thread may have rotated while we waited for the lock.
+    if (atomic_load(&filter->current) == generation && atomic_load(&filter->inserted) >= filter->generation_capacity)
+    {
+        // Inserts racing with the rotation may land in the generation being
+        // cleared; they are simply forgotten early, which only costs a
+        // redundant parse later.
+        pigeon_seen_filter_clear(filter->generations[generation ^ 1], filter->block_mask + 1);
+        atomic_store(&filter->inserted, 0);
+        atomic_store_explicit(&filter->current, generation ^ 1, memory_order_release);
+    }
+
+    pthread_mutex_unlock(&filter->rotate_lock);
+}
+
+bool pigeon_seen_filter_check_and_insert(pigeon_seen_filter_t * restrict filter, uint64_t key)
+{
+    uint64_t pattern = pigeon_hash_mix(key ^ 0x5851f42d4c957f2dull);
+    unsigned current = atomic_load_explicit(&filter->current, memory_order_acquire);
+
+    pigeon_seen_filter_block_t * block = pigeon_seen_filter_block(filter, current, key);
+    if (pigeon_seen_filter_block_contains(block, pattern)
+        || pigeon_seen_filter_block_contains(pigeon_seen_filter_block(filter, current ^ 1, key), pattern))
+        return true;
+
+    for (unsigned w = 0; w < PIGEON_SEEN_FILTER_BLOCK_WORDS; ++w)
+        atomic_fetch_or_explicit(&block->words[w], pigeon_seen_filter_bit(pattern, w), memory_order_relaxed);
+
+    if (atomic_fetch_add_explicit(&filter->inserted, 1, memory_order_relaxed) + 1 >= filter->generation_capacity)
+        pigeon_seen_filter_rotate(filter, current);
+
+    return false;
+}
+
+bool pigeon_seen_filter_check_message(pigeon_seen_filter_t * restrict filter, const char * restrict msg_data, size_t msg_size)
+{
+    uint64_t key;
+    if (!pigeon_message_key(msg_data, msg_size, &key))
+        return false;
+
+    return pigeon_seen_filter_check_and_insert(filter, key);
+}
@@ -0,0 +1,68 @@
+#ifndef PIGEON_SEEN_FILTER_H
+#define PIGEON_SEEN_FILTER_H
+
+#include "pigeon_parser.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A fixed-size, thread-safe filter of recently seen messages, used to drop
+// gossip duplicates before they reach pigeon_parse_message. Messages are
+// keyed by (author, sequence, signature), read straight from the message
+// text without allocating; the signature keeps forks, which share an author
+// and sequence, apart.
+//
+// The filter is a blocked Bloom filter: every key touches a single 64-byte,
+// cache-line-aligned block. Two generations are kept; once the current one
+// has absorbed its capacity, the older one is cleared and takes over, so
+// memory stays constant and keys age out after one to two generations.
+
+#define PIGEON_SEEN_FILTER_BLOCK_WORDS 8
+
+typedef struct {
+    _Alignas(64) _Atomic uint64_t words[PIGEON_SEEN_FILTER_BLOCK_WORDS];
+} pigeon_seen_filter_block_t;
+
+typedef struct {
+    pigeon_seen_filter_block_t * generations[2];
+    size_t block_mask;
+    size_t generation_capacity;
+
+    atomic_uint current;
+    atomic_size_t inserted;
+    pthread_mutex_t rotate_lock;
+} pigeon_seen_filter_t;
+
+// Sizes each generation for generation_capacity keys at roughly a 1% false
+// positive rate.
+bool pigeon_seen_filter_init(pigeon_seen_filter_t * restrict filter, size_t generation_capacity);
+
+void pigeon_seen_filter_free(pigeon_seen_filter_t * restrict filter);
+
+// Extracts the (author, sequence, signature) key of a message by scanning
+// its header lines and footer only. Fails if any of them is missing.
+bool pigeon_message_key(const char * restrict msg_data, size_t msg_size, uint64_t * restrict key);
+
+// The same key for a message that was already parsed.
+uint64_t pigeon_message_key_of(const pigeon_parsed_message_t * restrict message);
+
+// Hash of the author alone, equal to hashing pigeon_encoded_value_key of the
+// parsed author with pigeon_hash_str; used to partition messages by feed.
+bool pigeon_message_author_key(const char * restrict msg_data, size_t msg_size, uint64_t * restrict key);
+
+uint64_t pigeon_message_author_key_of(const pigeon_parsed_message_t * restrict message);
+
+bool pigeon_seen_filter_contains(pigeon_seen_filter_t * restrict filter, uint64_t key);
+
+// Returns true if the key was (probably) seen before; otherwise records it.
+bool pigeon_seen_filter_check_and_insert(pigeon_seen_filter_t * restrict filter, uint64_t key);
+
+// Convenience wrapper over pigeon_message_key and
+// pigeon_seen_filter_check_and_insert. Messages whose key cannot be
+// extracted are reported as unseen so the full parser can reject them.
+bool pigeon_seen_filter_check_message(pigeon_seen_filter_t * restrict filter, const char * restrict msg_data, size_t msg_size);
+
+#endif
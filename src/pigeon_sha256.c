@@ -0,0 +1,339 @@
+#include "pigeon_sha256.h"
+
+#include <string.h>
+
+// The SHA extension path is built when the compiler targets it outright, or
+// when CMake found per-function target support (PIGEON_HAVE_SHA_NI); in the
+// latter case it is only used if the CPU reports the extension.
+#if defined(__SHA__) && defined(__SSE4_1__)
+#define PIGEON_SHA256_SHA_NI 1
+#define PIGEON_SHA256_SHA_NI_TARGET
+#elif defined(PIGEON_HAVE_SHA_NI)
+#define PIGEON_SHA256_SHA_NI 1
+#define PIGEON_SHA256_SHA_NI_TARGET __attribute__((target("sha,sse4.1")))
+#include <cpuid.h>
+#include <pthread.h>
+#endif
+
+#ifdef PIGEON_SHA256_SHA_NI
+#include <immintrin.h>
+#endif
+
+static const uint32_t round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t pigeon_rotr32(uint32_t value, unsigned count)
+{
+    return value >> count | value << (32 - count);
+}
+
+static inline uint32_t pigeon_load_be32(const unsigned char * restrict data)
+{
+    return (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 8 | data[3];
+}
+
+static inline void pigeon_store_be32(unsigned char * restrict data, uint32_t value)
+{
+    data[0] = (unsigned char)(value >> 24);
+    data[1] = (unsigned char)(value >> 16);
+    data[2] = (unsigned char)(value >> 8);
+    data[3] = (unsigned char)value;
+}
+
+#ifdef PIGEON_SHA256_SHA_NI
+
+// SHA extensions: the state is kept as ABEF/CDGH pairs, each rnds2 step
+// runs two rounds and msg1/msg2 extend the message schedule four words at
+// a time.
+PIGEON_SHA256_SHA_NI_TARGET
+static void pigeon_sha256_blocks_sha_ni(uint32_t state[8], const unsigned char * restrict data, size_t count)
+{
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bll, 0x0405060700010203ll);
+
+    __m128i dcba = _mm_loadu_si128((const __m128i *)&state[0]);
+    __m128i hgfe = _mm_loadu_si128((const __m128i *)&state[4]);
+    __m128i cdab = _mm_shuffle_epi32(dcba, 0xb1);
+    __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1b);
+    __m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+    __m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xf0);
+
+    for (; count > 0; --count, data += 64)
+    {
+        __m128i saved_abef = abef;
+        __m128i saved_cdgh = cdgh;
+
+        __m128i w[16];
+        for (unsigned i = 0; i < 4; ++i)
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i * 16)), byte_swap);
+        for (unsigned i = 4; i < 16; ++i)
+            w[i] = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(w[i - 4], w[i - 3]), _mm_alignr_epi8(w[i - 1], w[i - 2], 4)), w[i - 1]);
+
+        for (unsigned i = 0; i < 16; ++i)
+        {
+            __m128i words = _mm_add_epi32(w[i], _mm_loadu_si128((const __m128i *)&round_constants[i * 4]));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, words);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(words, 0x0e));
+        }
+
+        abef = _mm_add_epi32(abef, saved_abef);
+        cdgh = _mm_add_epi32(cdgh, saved_cdgh);
+    }
+
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(feba, dchg, 0xf0));
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(dchg, feba, 8));
+}
+
+#endif
+
+static void pigeon_sha256_blocks_generic(uint32_t state[8], const unsigned char * restrict data, size_t count)
+{
+    for (; count > 0; --count, data += 64)
+    {
+        uint32_t w[64];
+        for (unsigned i = 0; i < 16; ++i)
+            w[i] = pigeon_load_be32(data + i * 4);
+
+        for (unsigned i = 16; i < 64; ++i)
+        {
+            uint32_t s0 = pigeon_rotr32(w[i - 15], 7) ^ pigeon_rotr32(w[i - 15], 18) ^ w[i - 15] >> 3;
+            uint32_t s1 = pigeon_rotr32(w[i - 2], 17) ^ pigeon_rotr32(w[i - 2], 19) ^ w[i - 2] >> 10;
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (unsigned i = 0; i < 64; ++i)
+        {
+            uint32_t s1 = pigeon_rotr32(e, 6) ^ pigeon_rotr32(e, 11) ^ pigeon_rotr32(e, 25);
+            uint32_t choose = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + choose + round_constants[i] + w[i];
+            uint32_t s0 = pigeon_rotr32(a, 2) ^ pigeon_rotr32(a, 13) ^ pigeon_rotr32(a, 22);
+            uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + majority;
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+#if defined(PIGEON_SHA256_SHA_NI) && !(defined(__SHA__) && defined(__SSE4_1__))
+
+static bool sha_ni_supported;
+static pthread_once_t sha_ni_once = PTHREAD_ONCE_INIT;
+
+static void pigeon_sha256_detect(void)
+{
+    // SSE4.1 is bit 19 of ECX in leaf 1, SHA bit 29 of EBX in leaf 7
+    unsigned eax, ebx, ecx, edx;
+    bool sse41 = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1u << 19)) != 0;
+    bool sha = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 29)) != 0;
+    sha_ni_supported = sse41 && sha;
+}
+
+static inline bool pigeon_sha256_use_sha_ni(void)
+{
+    pthread_once(&sha_ni_once, pigeon_sha256_detect);
+    return sha_ni_supported;
+}
+
+#elif defined(PIGEON_SHA256_SHA_NI)
+
+static inline bool pigeon_sha256_use_sha_ni(void)
+{
+    return true;
+}
+
+#endif
+
+static void pigeon_sha256_blocks(uint32_t state[8], const unsigned char * restrict data, size_t count)
+{
+    if (count == 0)
+        return;
+
+#ifdef PIGEON_SHA256_SHA_NI
+    if (pigeon_sha256_use_sha_ni())
+    {
+        pigeon_sha256_blocks_sha_ni(state, data, count);
+        return;
+    }
+#endif
+
+    pigeon_sha256_blocks_generic(state, data, count);
+}
+
+void pigeon_sha256_init(pigeon_sha256_t * restrict sha)
+{
+    static const uint32_t initial_state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    memcpy(sha->state, initial_state, sizeof(initial_state));
+    sha->total_size = 0;
+    sha->block_size = 0;
+}
+
+void pigeon_sha256_update(pigeon_sha256_t * restrict sha, const void * restrict data, size_t size)
+{
+    const unsigned char * pos = data;
+    sha->total_size += size;
+
+    if (sha->block_size > 0)
+    {
+        size_t count = 64 - sha->block_size;
+        if (count > size)
+            count = size;
+
+        memcpy(sha->block + sha->block_size, pos, count);
+        sha->block_size += count;
+        pos += count;
+        size -= count;
+
+        if (sha->block_size < 64)
+            return;
+
+        pigeon_sha256_blocks(sha->state, sha->block, 1);
+        sha->block_size = 0;
+    }
+
+    // Whole blocks are hashed straight from the input
+    pigeon_sha256_blocks(sha->state, pos, size / 64);
+    pos += size & ~(size_t)63;
+    size &= 63;
+
+    memcpy(sha->block, pos, size);
+    sha->block_size = size;
+}
+
+void pigeon_sha256_final(pigeon_sha256_t * restrict sha, unsigned char digest[PIGEON_SHA256_DIGEST_SIZE])
+{
+    uint64_t bit_count = sha->total_size * 8;
+
+    sha->block[sha->block_size++] = 0x80;
+    if (sha->block_size > 56)
+    {
+        memset(sha->block + sha->block_size, 0, 64 - sha->block_size);
+        pigeon_sha256_blocks(sha->state, sha->block, 1);
+        sha->block_size = 0;
+    }
+
+    memset(sha->block + sha->block_size, 0, 56 - sha->block_size);
+    pigeon_store_be32(sha->block + 56, (uint32_t)(bit_count >> 32));
+    pigeon_store_be32(sha->block + 60, (uint32_t)bit_count);
+    pigeon_sha256_blocks(sha->state, sha->block, 1);
+
+    for (unsigned i = 0; i < 8; ++i)
+        pigeon_store_be32(digest + i * 4, sha->state[i]);
+}
+
+void pigeon_sha256(const void * restrict data, size_t size, unsigned char digest[PIGEON_SHA256_DIGEST_SIZE])
+{
+    pigeon_sha256_t sha;
+    pigeon_sha256_init(&sha);
+    pigeon_sha256_update(&sha, data, size);
+    pigeon_sha256_final(&sha, digest);
+}
+
+static inline int pigeon_sha256_hex_value(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    else if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    else if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+
+    return -1;
+}
+
+static inline int pigeon_sha256_base64_value(char ch)
+{
+    if (ch >= 'A' && ch <= 'Z')
+        return ch - 'A';
+    else if (ch >= 'a' && ch <= 'z')
+        return ch - 'a' + 26;
+    else if (ch >= '0' && ch <= '9')
+        return ch - '0' + 52;
+    else if (ch == '+' || ch == '-')
+        return 62;
+    else if (ch == '/' || ch == '_')
+        return 63;
+
+    return -1;
+}
+
+bool pigeon_sha256_decode(const char * restrict text, unsigned char digest[PIGEON_SHA256_DIGEST_SIZE])
+{
+    size_t length = strlen(text);
+    if (length == 64)
+    {
+        for (size_t i = 0; i < 32; ++i)
+        {
+            int high = pigeon_sha256_hex_value(text[i * 2]);
+            int low = pigeon_sha256_hex_value(text[i * 2 + 1]);
+            if (high < 0 || low < 0)
+                return false;
+
+            digest[i] = (unsigned char)(high << 4 | low);
+        }
+
+        return true;
+    }
+
+    // 32 bytes are 43 base64 characters plus one '=' of padding
+    if (length != 44 && !(length == 43 && text[42] != '='))
+        return false;
+    else if (length == 44 && text[43] != '=')
+        return false;
+
+    uint32_t bits = 0;
+    unsigned bit_count = 0;
+    size_t size = 0;
+    for (size_t i = 0; i < 43; ++i)
+    {
+        int value = pigeon_sha256_base64_value(text[i]);
+        if (value < 0)
+            return false;
+
+        bits = bits << 6 | (uint32_t)value;
+        bit_count += 6;
+        if (bit_count >= 8)
+        {
+            bit_count -= 8;
+            digest[size++] = (unsigned char)(bits >> bit_count);
+        }
+    }
+
+    return size == 32;
+}
+
+void pigeon_sha256_format_hex(const unsigned char digest[PIGEON_SHA256_DIGEST_SIZE], char text[PIGEON_SHA256_DIGEST_SIZE * 2 + 1])
+{
+    static const char hex_digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < PIGEON_SHA256_DIGEST_SIZE; ++i)
+    {
+        text[i * 2] = hex_digits[digest[i] >> 4];
+        text[i * 2 + 1] = hex_digits[digest[i] & 0x0f];
+    }
+
+    text[PIGEON_SHA256_DIGEST_SIZE * 2] = '\0';
+}
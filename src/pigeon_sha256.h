@@ -0,0 +1,36 @@
+#ifndef PIGEON_SHA256_H
+#define PIGEON_SHA256_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming SHA-256 (FIPS 180-4). Message hashes in the previous header and
+// blob references are SHA-256 digests, so the parser's tools need one that
+// does not pull in an external crypto library.
+
+#define PIGEON_SHA256_DIGEST_SIZE 32
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t total_size;
+    unsigned char block[64];
+    size_t block_size;
+} pigeon_sha256_t;
+
+void pigeon_sha256_init(pigeon_sha256_t * restrict sha);
+
+void pigeon_sha256_update(pigeon_sha256_t * restrict sha, const void * restrict data, size_t size);
+
+void pigeon_sha256_final(pigeon_sha256_t * restrict sha, unsigned char digest[PIGEON_SHA256_DIGEST_SIZE]);
+
+void pigeon_sha256(const void * restrict data, size_t size, unsigned char digest[PIGEON_SHA256_DIGEST_SIZE]);
+
+// Decodes a digest written as 64 hex digits or as base64, with or without
+// its '=' padding; the URL-safe alphabet is accepted too.
+bool pigeon_sha256_decode(const char * restrict text, unsigned char digest[PIGEON_SHA256_DIGEST_SIZE]);
+
+// Writes 64 lowercase hex digits and a terminating NUL.
+void pigeon_sha256_format_hex(const unsigned char digest[PIGEON_SHA256_DIGEST_SIZE], char text[PIGEON_SHA256_DIGEST_SIZE * 2 + 1]);
+
+#endif
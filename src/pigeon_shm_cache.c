@@ -0,0 +1,361 @@
+#include "pigeon_shm_cache.h"
+#include "pigeon_seen_filter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PIGEON_SHM_CACHE_MAGIC 0x314d485345474950ull // "PIGESHM1"
+#define PIGEON_SHM_CACHE_LINE 64
+
+// Everything below lives in the segment, so it holds no pointers.
+struct pigeon_shm_cache_header_t {
+    _Atomic uint64_t magic; // stored last, once the segment is initialized
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t slot_count;
+    uint64_t slot_size;     // stride; the payload starts one line in
+    uint64_t bucket_count;
+    uint64_t segment_size;
+
+    _Alignas(PIGEON_SHM_CACHE_LINE) _Atomic uint64_t head;
+};
+
+struct pigeon_shm_cache_entry_t {
+    _Atomic uint64_t key;
+    _Atomic uint64_t position; // position + 1, 0 while empty
+};
+
+typedef struct {
+    _Atomic uint64_t sequence; // 2 * position + 1 while writing, + 2 once written
+    _Atomic uint64_t key;
+    _Atomic uint32_t size;
+} pigeon_shm_cache_slot_t;
+
+static void pigeon_shm_cache_error(pigeon_shm_cache_t * restrict cache, const char * format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(cache->error_messages, sizeof(cache->error_messages), format, ap);
+    va_end(ap);
+}
+
+static size_t pigeon_shm_cache_index_offset(void)
+{
+    return (sizeof(pigeon_shm_cache_header_t) + PIGEON_SHM_CACHE_LINE - 1) & ~(size_t)(PIGEON_SHM_CACHE_LINE - 1);
+}
+
+static size_t pigeon_shm_cache_slots_offset(uint64_t bucket_count)
+{
+    return pigeon_shm_cache_index_offset() + bucket_count * PIGEON_SHM_CACHE_WAYS * sizeof(pigeon_shm_cache_entry_t);
+}
+
+static void pigeon_shm_cache_map(pigeon_shm_cache_t * restrict cache, void * segment, size_t size)
+{
+    cache->header = segment;
+    cache->index = (pigeon_shm_cache_entry_t *)((char *)segment + pigeon_shm_cache_index_offset());
+    cache->slots = (char *)segment + pigeon_shm_cache_slots_offset(cache->header->bucket_count);
+    cache->mapped_size = size;
+}
+
+static inline pigeon_shm_cache_slot_t * pigeon_shm_cache_slot(const pigeon_shm_cache_t * restrict cache, uint64_t position)
+{
+    const pigeon_shm_cache_header_t * header = cache->header;
+    return (pigeon_shm_cache_slot_t *)(cache->slots + (position & (header->slot_count - 1)) * header->slot_size);
+}
+
+static inline char * pigeon_shm_cache_payload(pigeon_shm_cache_slot_t * restrict slot)
+{
+    return (char *)slot + PIGEON_SHM_CACHE_LINE;
+}
+
+bool pigeon_shm_cache_create(pigeon_shm_cache_t * restrict cache, const char * restrict name, size_t slot_count, size_t slot_capacity)
+{
+    memset(cache, 0, sizeof(*cache));
+
+    if (slot_count == 0 || slot_capacity < sizeof(pigeon_compact_message_t) || slot_capacity > UINT32_MAX)
+    {
+        pigeon_shm_cache_error(cache, "invalid cache geometry: %zu slots of %zu bytes", slot_count, slot_capacity);
+        return false;
+    }
+
+    uint64_t count = 1;
+    while (count < slot_count)
+        count <<= 1;
+
+    uint64_t slot_size = (PIGEON_SHM_CACHE_LINE + slot_capacity + PIGEON_SHM_CACHE_LINE - 1) & ~(uint64_t)(PIGEON_SHM_CACHE_LINE - 1);
+    uint64_t bucket_count = count >= 2 ? count / 2 : 1;
+    uint64_t slots_offset = pigeon_shm_cache_slots_offset(bucket_count);
+
+    if (count > (SIZE_MAX - slots_offset) / slot_size)
+    {
+        pigeon_shm_cache_error(cache, "cache of %zu slots of %zu bytes is too large", slot_count, slot_capacity);
+        return false;
+    }
+
+    size_t size = slots_offset + count * slot_size;
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        pigeon_shm_cache_error(cache, "cannot create '%s': %s", name, strerror(errno));
+        return false;
+    }
+
+    if (ftruncate(fd, (off_t)size) != 0)
+    {
+        pigeon_shm_cache_error(cache, "cannot size '%s': %s", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+
+    void * segment = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED)
+    {
+        pigeon_shm_cache_error(cache, "cannot map '%s': %s", name, strerror(errno));
+        shm_unlink(name);
+        return false;
+    }
+
+    // ftruncate zero-fills, so slots, index entries and head start out empty.
+    pigeon_shm_cache_header_t * header = segment;
+    header->version = PIGEON_SHM_CACHE_VERSION;
+    header->slot_count = count;
+    header->slot_size = slot_size;
+    header->bucket_count = bucket_count;
+    header->segment_size = size;
+    atomic_store_explicit(&header->magic, PIGEON_SHM_CACHE_MAGIC, memory_order_release);
+
+    pigeon_shm_cache_map(cache, segment, size);
+    cache->writable = true;
+    return true;
+}
+
+bool pigeon_shm_cache_attach(pigeon_shm_cache_t * restrict cache, const char * restrict name)
+{
+    memset(cache, 0, sizeof(*cache));
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        pigeon_shm_cache_error(cache, "cannot open '%s': %s", name, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < pigeon_shm_cache_slots_offset(1))
+    {
+        pigeon_shm_cache_error(cache, "'%s' is not a message cache", name);
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void * segment = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED)
+    {
+        pigeon_shm_cache_error(cache, "cannot map '%s': %s", name, strerror(errno));
+        return false;
+    }
+
+    // The producer may still be initializing, or the segment may be foreign;
+    // check every field the layout depends on before trusting it.
+    const pigeon_shm_cache_header_t * header = segment;
+    bool valid = atomic_load_explicit(&header->magic, memory_order_acquire) == PIGEON_SHM_CACHE_MAGIC
+        && header->version == PIGEON_SHM_CACHE_VERSION
+        && header->segment_size == size
+        && header->slot_count != 0 && (header->slot_count & (header->slot_count - 1)) == 0
+        && header->bucket_count != 0 && (header->bucket_count & (header->bucket_count - 1)) == 0
+        && header->slot_size >= PIGEON_SHM_CACHE_LINE + sizeof(pigeon_compact_message_t)
+        && header->slot_size % PIGEON_SHM_CACHE_LINE == 0
+        && header->bucket_count <= size / (PIGEON_SHM_CACHE_WAYS * sizeof(pigeon_shm_cache_entry_t))
+        && pigeon_shm_cache_slots_offset(header->bucket_count) <= size
+        && header->slot_count <= (size - pigeon_shm_cache_slots_offset(header->bucket_count)) / header->slot_size;
+
+    if (!valid)
+    {
+        pigeon_shm_cache_error(cache, "'%s' is not a ready message cache", name);
+        munmap(segment, size);
+        return false;
+    }
+
+    pigeon_shm_cache_map(cache, segment, size);
+    return true;
+}
+
+void pigeon_shm_cache_close(pigeon_shm_cache_t * restrict cache)
+{
+    if (cache->header)
+        munmap(cache->header, cache->mapped_size);
+
+    cache->header = NULL;
+    cache->index = NULL;
+    cache->slots = NULL;
+    cache->mapped_size = 0;
+}
+
+bool pigeon_shm_cache_unlink(const char * restrict name)
+{
+    return shm_unlink(name) == 0;
+}
+
+// Entries are written and read without a lock, so a reader may pair a key
+// with a stale position. That only costs a miss: lookups check the key
+// stored in the slot itself.
+static void pigeon_shm_cache_index(pigeon_shm_cache_t * restrict cache, uint64_t key, uint64_t position)
+{
+    pigeon_shm_cache_entry_t * bucket = &cache->index[(key & (cache->header->bucket_count - 1)) * PIGEON_SHM_CACHE_WAYS];
+    pigeon_shm_cache_entry_t * victim = bucket;
+    uint64_t victim_position = UINT64_MAX;
+
+    for (unsigned way = 0; way < PIGEON_SHM_CACHE_WAYS; ++way)
+    {
+        uint64_t entry_position = atomic_load_explicit(&bucket[way].position, memory_order_relaxed);
+        if (entry_position != 0 && atomic_load_explicit(&bucket[way].key, memory_order_relaxed) == key)
+        {
+            victim = &bucket[way];
+            break;
+        }
+
+        if (entry_position < victim_position)
+        {
+            victim = &bucket[way];
+            victim_position = entry_position;
+        }
+    }
+
+    atomic_store_explicit(&victim->key, key, memory_order_relaxed);
+    atomic_store_explicit(&victim->position, position + 1, memory_order_release);
+}
+
+bool pigeon_shm_cache_publish(pigeon_shm_cache_t * restrict cache, const pigeon_parsed_message_t * restrict message, uint64_t * restrict position)
+{
+    if (!cache->writable)
+    {
+        pigeon_shm_cache_error(cache, "cache is attached read-only");
+        return false;
+    }
+
+    size_t size = pigeon_compact_message_size(message);
+    size_t capacity = pigeon_shm_cache_slot_capacity(cache);
+    if (size == 0 || size > capacity)
+    {
+        pigeon_shm_cache_error(cache, "message does not fit a %zu byte slot", capacity);
+        return false;
+    }
+
+    pigeon_shm_cache_header_t * header = cache->header;
+    uint64_t next = atomic_load_explicit(&header->head, memory_order_relaxed);
+    uint64_t key = pigeon_message_key_of(message);
+    pigeon_shm_cache_slot_t * slot = pigeon_shm_cache_slot(cache, next);
+
+    // Seqlock write: the odd value must be visible before any payload byte.
+    atomic_store_explicit(&slot->sequence, 2 * next + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&slot->key, key, memory_order_relaxed);
+    atomic_store_explicit(&slot->size, (uint32_t)size, memory_order_relaxed);
+    pigeon_compact_message_write(message, pigeon_shm_cache_payload(slot), size);
+
+    atomic_store_explicit(&slot->sequence, 2 * next + 2, memory_order_release);
+
+    pigeon_shm_cache_index(cache, key, next);
+    atomic_store_explicit(&header->head, next + 1, memory_order_release);
+
+    if (position)
+        *position = next;
+
+    return true;
+}
+
+bool pigeon_shm_cache_parse(pigeon_shm_cache_t * restrict cache, pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size, uint64_t * restrict position)
+{
+    pigeon_parsed_message_t message;
+    bool result = pigeon_parse_message(ctx, msg_data, msg_size, &message);
+    if (!result)
+        pigeon_shm_cache_error(cache, "%s", pigeon_get_error_messages(ctx));
+    else
+        result = pigeon_shm_cache_publish(cache, &message, position);
+
+    pigeon_free_parsed_message(&message);
+    return result;
+}
+
+uint64_t pigeon_shm_cache_head(const pigeon_shm_cache_t * restrict cache)
+{
+    return atomic_load_explicit(&cache->header->head, memory_order_acquire);
+}
+
+uint64_t pigeon_shm_cache_tail(const pigeon_shm_cache_t * restrict cache)
+{
+    uint64_t head = pigeon_shm_cache_head(cache);
+    return head > cache->header->slot_count ? head - cache->header->slot_count : 0;
+}
+
+size_t pigeon_shm_cache_slot_capacity(const pigeon_shm_cache_t * restrict cache)
+{
+    return cache->header->slot_size - PIGEON_SHM_CACHE_LINE;
+}
+
+static pigeon_shm_cache_status_t pigeon_shm_cache_copy(const pigeon_shm_cache_t * restrict cache, uint64_t position, void * restrict buffer, size_t buffer_size, size_t * restrict size, uint64_t * restrict key)
+{
+    pigeon_shm_cache_slot_t * slot = pigeon_shm_cache_slot(cache, position);
+    uint64_t expected = 2 * position + 2;
+
+    // Only the producer moves a slot forward, so any change of sequence
+    // during the copy means the position was overwritten; no retry helps.
+    uint64_t before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (before < expected)
+        return PIGEON_SHM_CACHE_PENDING;
+    if (before > expected)
+        return PIGEON_SHM_CACHE_OVERWRITTEN;
+
+    uint64_t slot_key = atomic_load_explicit(&slot->key, memory_order_relaxed);
+    size_t slot_size = atomic_load_explicit(&slot->size, memory_order_relaxed);
+    bool fits = slot_size <= buffer_size && slot_size <= pigeon_shm_cache_slot_capacity(cache);
+    if (fits)
+        memcpy(buffer, pigeon_shm_cache_payload(slot), slot_size);
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) != before)
+        return PIGEON_SHM_CACHE_OVERWRITTEN;
+
+    *size = slot_size;
+    if (key)
+        *key = slot_key;
+
+    return fits ? PIGEON_SHM_CACHE_OK : PIGEON_SHM_CACHE_TOO_SMALL;
+}
+
+pigeon_shm_cache_status_t pigeon_shm_cache_read(const pigeon_shm_cache_t * restrict cache, uint64_t position, void * restrict buffer, size_t buffer_size, size_t * restrict size)
+{
+    return pigeon_shm_cache_copy(cache, position, buffer, buffer_size, size, NULL);
+}
+
+pigeon_shm_cache_status_t pigeon_shm_cache_lookup(const pigeon_shm_cache_t * restrict cache, uint64_t key, void * restrict buffer, size_t buffer_size, size_t * restrict size)
+{
+    const pigeon_shm_cache_entry_t * bucket = &cache->index[(key & (cache->header->bucket_count - 1)) * PIGEON_SHM_CACHE_WAYS];
+
+    for (unsigned way = 0; way < PIGEON_SHM_CACHE_WAYS; ++way)
+    {
+        uint64_t entry_position = atomic_load_explicit(&bucket[way].position, memory_order_acquire);
+        if (entry_position == 0 || atomic_load_explicit(&bucket[way].key, memory_order_relaxed) != key)
+            continue;
+
+        uint64_t slot_key;
+        pigeon_shm_cache_status_t status = pigeon_shm_cache_copy(cache, entry_position - 1, buffer, buffer_size, size, &slot_key);
+        if ((status == PIGEON_SHM_CACHE_OK || status == PIGEON_SHM_CACHE_TOO_SMALL) && slot_key == key)
+            return status;
+    }
+
+    return PIGEON_SHM_CACHE_NOT_FOUND;
+}
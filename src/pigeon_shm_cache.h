@@ -0,0 +1,88 @@
+#ifndef PIGEON_SHM_CACHE_H
+#define PIGEON_SHM_CACHE_H
+
+#include "pigeon_compact.h"
+#include "pigeon_parser.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Shared-memory ring of parsed messages, so that several processes on a node
+// can share one parse of each incoming message. A single producer parses
+// and publishes; any number of reader processes attach read-only.
+//
+// Messages are stored in their compact form (see pigeon_compact.h), which
+// only uses offsets and is therefore valid at any mapping address. Slot n
+// holds publication positions n, n + slot_count, ... and is guarded by a
+// seqlock whose value encodes the position it holds, so readers never take
+// a lock or write to the segment: a read either copies a consistent message
+// or reports that the slot has moved on. A small hash index maps message
+// keys (see pigeon_message_key) to their latest position.
+
+#if ATOMIC_LLONG_LOCK_FREE != 2
+#error "pigeon_shm_cache needs lock-free 64-bit atomics"
+#endif
+
+#define PIGEON_SHM_CACHE_VERSION 1
+#define PIGEON_SHM_CACHE_WAYS 4
+
+typedef struct pigeon_shm_cache_header_t pigeon_shm_cache_header_t;
+typedef struct pigeon_shm_cache_entry_t pigeon_shm_cache_entry_t;
+
+typedef struct {
+    pigeon_shm_cache_header_t * header;
+    pigeon_shm_cache_entry_t * index;
+    char * slots;
+    size_t mapped_size;
+    bool writable;
+
+    char error_messages[256];
+} pigeon_shm_cache_t;
+
+typedef enum {
+    PIGEON_SHM_CACHE_OK,
+    PIGEON_SHM_CACHE_PENDING,     // not published yet
+    PIGEON_SHM_CACHE_OVERWRITTEN, // the ring has moved past it
+    PIGEON_SHM_CACHE_NOT_FOUND,   // no published message has this key
+    PIGEON_SHM_CACHE_TOO_SMALL    // *size holds the buffer size needed
+} pigeon_shm_cache_status_t;
+
+// Creates the segment called name (a POSIX shm name such as "/pigeon"),
+// replacing any previous one; readers of the old segment must re-attach.
+// slot_count is rounded up to a power of two; slot_capacity bounds the
+// compact size of a single message.
+bool pigeon_shm_cache_create(pigeon_shm_cache_t * restrict cache, const char * restrict name, size_t slot_count, size_t slot_capacity);
+
+// Maps an existing segment read-only.
+bool pigeon_shm_cache_attach(pigeon_shm_cache_t * restrict cache, const char * restrict name);
+
+void pigeon_shm_cache_close(pigeon_shm_cache_t * restrict cache);
+
+bool pigeon_shm_cache_unlink(const char * restrict name);
+
+// Producer side; not thread-safe, and there must be a single producer per
+// segment. On success *position, if not NULL, receives the message position.
+bool pigeon_shm_cache_publish(pigeon_shm_cache_t * restrict cache, const pigeon_parsed_message_t * restrict message, uint64_t * restrict position);
+
+// Parses with pigeon_parse_message and publishes the result.
+bool pigeon_shm_cache_parse(pigeon_shm_cache_t * restrict cache, pigeon_parse_context_t * restrict ctx, const char * restrict msg_data, pigeon_message_size_t msg_size, uint64_t * restrict position);
+
+// Number of messages published so far, i.e. the next position.
+uint64_t pigeon_shm_cache_head(const pigeon_shm_cache_t * restrict cache);
+
+// Oldest position that may still be readable.
+uint64_t pigeon_shm_cache_tail(const pigeon_shm_cache_t * restrict cache);
+
+size_t pigeon_shm_cache_slot_capacity(const pigeon_shm_cache_t * restrict cache);
+
+// Copies the compact message at position into buffer, which must be 8-byte
+// aligned; a buffer of pigeon_shm_cache_slot_capacity bytes always fits.
+// Never blocks or retries.
+pigeon_shm_cache_status_t pigeon_shm_cache_read(const pigeon_shm_cache_t * restrict cache, uint64_t position, void * restrict buffer, size_t buffer_size, size_t * restrict size);
+
+// Like pigeon_shm_cache_read, for the latest message published with key.
+pigeon_shm_cache_status_t pigeon_shm_cache_lookup(const pigeon_shm_cache_t * restrict cache, uint64_t key, void * restrict buffer, size_t buffer_size, size_t * restrict size);
+
+#endif
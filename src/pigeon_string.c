@@ -54,6 +54,23 @@ bool pigeon_string_append_ch(pigeon_string_t * restrict str, char ch)
     return true;
 }
 
+bool pigeon_string_append(pigeon_string_t * restrict str, const char * restrict data, size_t size)
+{
+    if (str->capacity - str->length < size)
+    {
+        size_t capacity = str->capacity != 0 ? str->capacity : PIGEON_MIN_STRING_SIZE;
+        while (capacity - str->length < size)
+            capacity = capacity * 3 / 2;
+
+        if (!pigeon_string_expand_to(str, capacity))
+            return false;
+    }
+
+    memcpy(str->ptr + str->length, data, size);
+    str->length += size;
+    return true;
+}
+
 const char * pigeon_string_cstr(pigeon_string_t * restrict str)
 {
     if (str->capacity == 0)
@@ -27,6 +27,8 @@ static inline void pigeon_string_clear(pigeon_string_t * restrict str)
 
 bool pigeon_string_append_ch(pigeon_string_t * restrict str, char ch);
 
+bool pigeon_string_append(pigeon_string_t * restrict str, const char * restrict data, size_t size);
+
 const char * pigeon_string_cstr(pigeon_string_t * restrict str);
 
 char * pigeon_string_release(pigeon_string_t * restrict str);
@@ -0,0 +1,214 @@
+#include "pigeon_context_pool.h"
+#include "pigeon_log.h"
+#include "pigeon_memory.h"
+#include "pigeon_reconcile.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// pigeon_sync: summarizes two sets of logs and reconciles them as if they
+// were held by two nodes, printing the ranges each side would have to send.
+// The second set plays the peer, served in process through
+// pigeon_reconcile_local_peer.
+
+#define SYNC_READ_BUFFER (1 << 20)
+
+typedef struct {
+    unsigned long long limit;
+    unsigned long long printed;
+} sync_report_t;
+
+static void sync_usage(FILE * out)
+{
+    fputs("Usage: pigeon_sync [OPTIONS] LOCAL REMOTE\n"
+        "Compares the feeds held in two logs, or two directories of logs, and\n"
+        "prints the sequence ranges each side is missing.\n"
+        "\n"
+        "  -m COUNT    print at most COUNT ranges (default all)\n"
+        "  -q          do not print the summary to stderr\n", out);
+}
+
+static bool sync_load_file(pigeon_summary_t * restrict summary, pigeon_parse_context_t * restrict ctx, const char * restrict path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "pigeon_sync: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    pigeon_log_reader_t reader;
+    if (!pigeon_log_reader_init(&reader, fd, SYNC_READ_BUFFER))
+    {
+        fprintf(stderr, "pigeon_sync: %s: out of memory\n", path);
+        close(fd);
+        return false;
+    }
+
+    const char * msg_data;
+    size_t msg_size;
+    uint64_t msg_offset;
+    pigeon_log_status_t status;
+    bool success = true;
+    while ((status = pigeon_log_reader_next(&reader, &msg_data, &msg_size, &msg_offset)) == PIGEON_LOG_MESSAGE)
+    {
+        if (!pigeon_summary_add_message(summary, ctx, msg_data, (pigeon_message_size_t)msg_size))
+        {
+            fprintf(stderr, "pigeon_sync: %s:%llu: %s\n", path, (unsigned long long)msg_offset, summary->error_messages);
+            success = false;
+        }
+    }
+
+    if (status == PIGEON_LOG_ERROR)
+    {
+        fprintf(stderr, "pigeon_sync: %s: read error\n", path);
+        success = false;
+    }
+    else if (pigeon_log_reader_pending(&reader) > 0)
+    {
+        fprintf(stderr, "pigeon_sync: %s:%llu: incomplete message at end of file\n", path, (unsigned long long)reader.offset);
+        success = false;
+    }
+
+    pigeon_log_reader_free(&reader);
+    close(fd);
+    return success;
+}
+
+static bool sync_load(pigeon_summary_t * restrict summary, pigeon_parse_context_t * restrict ctx, const char * restrict path)
+{
+    struct stat info;
+    if (stat(path, &info) != 0 || !S_ISDIR(info.st_mode))
+        return sync_load_file(summary, ctx, path);
+
+    DIR * dir = opendir(path);
+    if (!dir)
+    {
+        fprintf(stderr, "pigeon_sync: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    bool success = true;
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        size_t length = strlen(path) + strlen(entry->d_name) + 2;
+        char * child = pigeon_malloc(length);
+        if (!child)
+        {
+            fprintf(stderr, "pigeon_sync: %s: out of memory\n", path);
+            success = false;
+            break;
+        }
+
+        snprintf(child, length, "%s/%s", path, entry->d_name);
+        success &= sync_load(summary, ctx, child);
+        pigeon_free(child);
+    }
+
+    closedir(dir);
+    return success;
+}
+
+static bool sync_report(void * user_data, pigeon_reconcile_direction_t direction, const char * author, pigeon_range_t range)
+{
+    sync_report_t * report = user_data;
+    if (report->limit && report->printed >= report->limit)
+        return true;
+
+    ++report->printed;
+    printf("%s @%s %d-%d\n", direction == PIGEON_RECONCILE_HAVE ? "have" : "need", author, range.first, range.last);
+    return true;
+}
+
+static double sync_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char ** argv)
+{
+    sync_report_t report = { 0, 0 };
+    bool quiet = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:qh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'm': report.limit = strtoull(optarg, NULL, 10); break;
+            case 'q': quiet = true; break;
+
+            case 'h':
+                sync_usage(stdout);
+                return 0;
+
+            default:
+                sync_usage(stderr);
+                return 2;
+        }
+    }
+
+    if (argc - optind != 2)
+    {
+        sync_usage(stderr);
+        return 2;
+    }
+
+    // Summaries hold their bucket tables inline, so keep them off the stack
+    static pigeon_summary_t local;
+    static pigeon_summary_t remote;
+    pigeon_parse_context_t * ctx = pigeon_parse_context_acquire();
+    if (!ctx || !pigeon_summary_init(&local) || !pigeon_summary_init(&remote))
+    {
+        fputs("pigeon_sync: out of memory\n", stderr);
+        return 1;
+    }
+
+    double start = sync_now();
+    bool success = sync_load(&local, ctx, argv[optind]);
+    success &= sync_load(&remote, ctx, argv[optind + 1]);
+    double loaded = sync_now();
+
+    pigeon_reconcile_peer_t peer;
+    pigeon_reconcile_local_peer(&peer, &remote);
+
+    pigeon_reconcile_stats_t stats;
+    if (!pigeon_reconcile(&local, &peer, sync_report, &report, &stats))
+    {
+        fputs("pigeon_sync: reconciliation failed\n", stderr);
+        success = false;
+    }
+    double reconciled = sync_now();
+
+    fflush(stdout);
+    if (!quiet)
+    {
+        fprintf(stderr, "pigeon_sync: local %zu feeds, %llu messages; remote %zu feeds, %llu messages; summarized in %.3f s\n",
+            local.feeds.count, (unsigned long long)local.messages, remote.feeds.count, (unsigned long long)remote.messages, loaded - start);
+        fprintf(stderr, "pigeon_sync: have %llu ranges (%llu messages), need %llu ranges (%llu messages); "
+            "%u round trips, %llu requests, %llu bytes, %llu buckets, %llu feeds compared in %.6f s\n",
+            (unsigned long long)stats.have_ranges, (unsigned long long)stats.have_messages,
+            (unsigned long long)stats.need_ranges, (unsigned long long)stats.need_messages,
+            stats.round_trips, (unsigned long long)stats.requests, (unsigned long long)stats.bytes,
+            (unsigned long long)stats.buckets, (unsigned long long)stats.feeds, reconciled - loaded);
+    }
+
+    pigeon_summary_free(&local);
+    pigeon_summary_free(&remote);
+    pigeon_parse_context_release(ctx);
+    return success ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+#ifndef PIGEON_TEST_H
+#define PIGEON_TEST_H
+
+#include "pigeon_parser.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Minimal helpers shared by the test programs. Each program runs its checks
+// in order and exits non-zero if any of them failed, which is all ctest
+// needs.
+
+static unsigned pigeon_test_failures;
+
+#define PIGEON_CHECK(cond) \
+    do { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++pigeon_test_failures; \
+        } \
+    } while (0)
+
+#define PIGEON_CHECK_STR(actual, expected) \
+    do { \
+        const char * pigeon_actual_ = (actual); \
+        const char * pigeon_expected_ = (expected); \
+        if (pigeon_actual_ == NULL || strcmp(pigeon_actual_, pigeon_expected_) != 0) \
+        { \
+            fprintf(stderr, "%s:%d: expected \"%s\", got \"%s\"\n", __FILE__, __LINE__, pigeon_expected_, pigeon_actual_ ? pigeon_actual_ : "(null)"); \
+            ++pigeon_test_failures; \
+        } \
+    } while (0)
+
+static inline int pigeon_test_result(const char * restrict name)
+{
+    if (pigeon_test_failures != 0)
+    {
+        fprintf(stderr, "%s: %u checks failed\n", name, pigeon_test_failures);
+        return 1;
+    }
+
+    printf("%s: all checks passed\n", name);
+    return 0;
+}
+
+// Formats one message of the given feed into buffer. fields holds the data
+// field lines, each ending with a newline, and may be empty.
+static inline size_t pigeon_test_message(char * restrict buffer, size_t size, const char * restrict author, int sequence, int64_t timestamp, const char * restrict kind, const char * restrict fields)
+{
+    int length = snprintf(buffer, size,
+        "author @ed25519:%s\n"
+        "sequence %d\n"
+        "kind \"%s\"\n"
+        "previous %%sha256:%064d\n"
+        "timestamp %" PRId64 "\n"
+        "\n"
+        "%s"
+        "\n"
+        "signature %%ed25519:sig%s%d\n",
+        author, sequence, kind, sequence - 1, timestamp, fields, author, sequence);
+
+    return length > 0 && (size_t)length < size ? (size_t)length : 0;
+}
+
+static inline bool pigeon_test_parse(const char * restrict text, pigeon_parsed_message_t * restrict message)
+{
+    pigeon_parse_context_t ctx;
+    bool success = pigeon_parse_message(&ctx, text, strlen(text), message);
+    if (!success)
+        fprintf(stderr, "parse failed: %s", pigeon_get_error_messages(&ctx));
+
+    return success;
+}
+
+// Returns a fresh path for a scratch file; the caller unlinks it.
+static inline const char * pigeon_test_path(char * restrict buffer, size_t size, const char * restrict name)
+{
+    static unsigned counter;
+    const char * dir = getenv("TMPDIR");
+    snprintf(buffer, size, "%s/pigeon_%s_%ld_%u", dir && *dir ? dir : "/tmp", name, (long)getpid(), counter++);
+    return buffer;
+}
+
+static inline bool pigeon_test_write_file(const char * restrict path, const char * restrict data, size_t size)
+{
+    FILE * file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    bool success = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && success;
+}
+
+#endif
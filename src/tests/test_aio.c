@@ -0,0 +1,177 @@
+#include "pigeon_test.h"
+#include "pigeon_aio.h"
+
+#include <errno.h>
+#include <sys/stat.h>
+
+#define FILES 10
+#define BUFFER_SIZE 4096
+
+typedef struct {
+    unsigned seen[FILES];
+    size_t sizes[FILES];
+    int errors[FILES];
+    bool content_ok;
+    unsigned stop_after; // 0 never stops
+    unsigned calls;
+} collector_t;
+
+static const size_t file_sizes[FILES] = { 0, 1, 100, BUFFER_SIZE - 1, BUFFER_SIZE, BUFFER_SIZE + 1, 3 * BUFFER_SIZE + 7, 200000, 0, 0 };
+
+static bool collect_file(void * user_data, const pigeon_aio_file_t * file)
+{
+    collector_t * collector = user_data;
+    ++collector->calls;
+    if (file->index >= FILES)
+    {
+        collector->content_ok = false;
+        return false;
+    }
+
+    ++collector->seen[file->index];
+    collector->sizes[file->index] = file->size;
+    collector->errors[file->index] = file->error;
+    for (size_t i = 0; i < file->size; ++i)
+    {
+        if (file->data[i] != (char)('a' + (file->index + i) % 26))
+        {
+            collector->content_ok = false;
+            break;
+        }
+    }
+
+    return collector->stop_after == 0 || collector->calls < collector->stop_after;
+}
+
+// Files 0-7 exist with the sizes above; 8 is missing and 9 has an empty path.
+static void make_files(const char * restrict dir, char paths[FILES][256])
+{
+    PIGEON_CHECK(mkdir(dir, 0755) == 0);
+
+    static char data[200000];
+    for (size_t index = 0; index < FILES; ++index)
+    {
+        int length = snprintf(paths[index], sizeof(paths[index]), "%s/%zu.log", dir, index);
+        PIGEON_CHECK(length > 0 && (size_t)length < sizeof(paths[index]));
+        if (index == 9)
+            paths[index][0] = '\0';
+        if (index >= 8)
+            continue;
+
+        for (size_t i = 0; i < file_sizes[index]; ++i)
+            data[i] = (char)('a' + (index + i) % 26);
+        PIGEON_CHECK(pigeon_test_write_file(paths[index], data, file_sizes[index]));
+    }
+}
+
+static void remove_files(const char * restrict dir, char paths[FILES][256])
+{
+    for (size_t index = 0; index < 8; ++index)
+        unlink(paths[index]);
+    rmdir(dir);
+}
+
+static void check_run(const char * const * paths, pigeon_aio_backend_t backend, unsigned depth)
+{
+    pigeon_aio_options_t options = { backend, depth, BUFFER_SIZE };
+    collector_t collector;
+    memset(&collector, 0, sizeof(collector));
+    collector.content_ok = true;
+
+    pigeon_aio_result_t result;
+    bool success = pigeon_aio_read_files(paths, FILES, &options, collect_file, &collector, &result);
+    if (!success && backend == PIGEON_AIO_URING && strstr(result.error_messages, "not available"))
+        return; // kernel or headers without io_uring
+
+    PIGEON_CHECK(success);
+    PIGEON_CHECK(backend == PIGEON_AIO_AUTO || result.backend == backend);
+    PIGEON_CHECK(collector.content_ok);
+    PIGEON_CHECK(result.files == FILES && collector.calls == FILES);
+    PIGEON_CHECK(result.errors == 2);
+
+    uint64_t bytes = 0;
+    for (size_t index = 0; index < FILES; ++index)
+    {
+        PIGEON_CHECK(collector.seen[index] == 1);
+        if (index < 8)
+        {
+            PIGEON_CHECK(collector.errors[index] == 0);
+            PIGEON_CHECK(collector.sizes[index] == file_sizes[index]);
+            bytes += file_sizes[index];
+        }
+        else
+        {
+            PIGEON_CHECK(collector.errors[index] == ENOENT);
+            PIGEON_CHECK(collector.sizes[index] == 0);
+        }
+    }
+
+    PIGEON_CHECK(result.bytes == bytes);
+}
+
+static void check_stop(const char * const * paths, pigeon_aio_backend_t backend)
+{
+    pigeon_aio_options_t options = { backend, 3, BUFFER_SIZE };
+    collector_t collector;
+    memset(&collector, 0, sizeof(collector));
+    collector.content_ok = true;
+    collector.stop_after = 2;
+
+    pigeon_aio_result_t result;
+    bool success = pigeon_aio_read_files(paths, FILES, &options, collect_file, &collector, &result);
+    if (!success && backend == PIGEON_AIO_URING && strstr(result.error_messages, "not available"))
+        return;
+
+    // Reads in flight are drained without further callbacks
+    PIGEON_CHECK(!success);
+    PIGEON_CHECK_STR(result.error_messages, "stopped by callback");
+    PIGEON_CHECK(collector.calls == 2 && result.files == 2);
+    PIGEON_CHECK(collector.content_ok);
+}
+
+static void test_backends(void)
+{
+    // Leaves room in paths for "/<index>.log"
+    char dir[224];
+    char paths[FILES][256];
+    pigeon_test_path(dir, sizeof(dir), "aio");
+    make_files(dir, paths);
+
+    const char * list[FILES];
+    for (size_t i = 0; i < FILES; ++i)
+        list[i] = paths[i];
+
+    static const pigeon_aio_backend_t backends[] = { PIGEON_AIO_THREADS, PIGEON_AIO_URING, PIGEON_AIO_AUTO };
+    static const unsigned depths[] = { 1, 2, 64 };
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); ++b)
+    {
+        for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); ++d)
+            check_run(list, backends[b], depths[d]);
+        check_stop(list, backends[b]);
+    }
+
+    remove_files(dir, paths);
+}
+
+static void test_options(void)
+{
+    collector_t collector;
+    memset(&collector, 0, sizeof(collector));
+    pigeon_aio_result_t result;
+
+    // Nothing to read is not an error
+    PIGEON_CHECK(pigeon_aio_read_files(NULL, 0, NULL, collect_file, &collector, &result));
+    PIGEON_CHECK(result.files == 0 && collector.calls == 0);
+
+    const char * paths[] = { "", "" };
+    pigeon_aio_options_t options = { PIGEON_AIO_THREADS, 2, SIZE_MAX };
+    PIGEON_CHECK(!pigeon_aio_read_files(paths, 2, &options, collect_file, &collector, &result));
+    PIGEON_CHECK(strstr(result.error_messages, "invalid depth") != NULL);
+}
+
+int main(void)
+{
+    test_backends();
+    test_options();
+    return pigeon_test_result("aio_test");
+}
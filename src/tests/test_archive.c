@@ -0,0 +1,264 @@
+#include "pigeon_test.h"
+#include "pigeon_archive.h"
+#include "pigeon_memory.h"
+
+#include <stdatomic.h>
+
+#define MESSAGE_COUNT 200
+
+typedef struct {
+    atomic_uint messages;
+    atomic_uint failures;
+    atomic_uint sequence_sum;
+} replay_counts_t;
+
+static bool count_message(void * user_data, uint64_t ordinal, const char * msg_data, size_t msg_size, bool parse_success, const pigeon_parse_context_t * ctx, pigeon_parsed_message_t * message)
+{
+    (void)ordinal;
+    (void)msg_data;
+    (void)msg_size;
+    (void)ctx;
+
+    replay_counts_t * counts = user_data;
+    atomic_fetch_add(&counts->messages, 1);
+    if (parse_success)
+        atomic_fetch_add(&counts->sequence_sum, (unsigned)message->sequence_number);
+    else
+        atomic_fetch_add(&counts->failures, 1);
+    return true;
+}
+
+static void put_u32(char * restrict dst, uint32_t value)
+{
+    for (unsigned i = 0; i < 4; ++i)
+        dst[i] = (char)(value >> (i * 8));
+}
+
+static void put_u64(char * restrict dst, uint64_t value)
+{
+    for (unsigned i = 0; i < 8; ++i)
+        dst[i] = (char)(value >> (i * 8));
+}
+
+static void test_round_trip(pigeon_archive_codec_t codec)
+{
+    char path[256];
+    pigeon_test_path(path, sizeof(path), "archive");
+
+    pigeon_archive_writer_t writer;
+    PIGEON_CHECK(pigeon_archive_writer_open(&writer, path, 2048));
+    writer.codec = codec;
+
+    // Messages separated by blank lines, as in a log file, with one
+    // malformed message in the middle
+    uint64_t offsets[MESSAGE_COUNT];
+    uint64_t log_offset = 1; // a leading blank line
+    unsigned expected_sum = 0;
+    for (int i = 0; i < MESSAGE_COUNT; ++i)
+    {
+        char text[1024];
+        size_t size = pigeon_test_message(text, sizeof(text), "archiveauthor", i + 1, 1000 + i, "post", "\"text\":\"hello\"\n");
+        if (i == 50)
+            size = (size_t)snprintf(text, sizeof(text), "author @ed25519:x\nnonsense\n");
+        else
+            expected_sum += i + 1;
+
+        offsets[i] = log_offset;
+        PIGEON_CHECK(pigeon_archive_writer_append(&writer, text, size, log_offset));
+        log_offset += size + 2;
+    }
+
+    PIGEON_CHECK(!pigeon_archive_writer_append(&writer, "x", 1, 0));
+    PIGEON_CHECK(pigeon_archive_writer_close(&writer));
+
+    pigeon_archive_reader_t reader;
+    PIGEON_CHECK(pigeon_archive_reader_open(&reader, path));
+    PIGEON_CHECK(reader.message_count == MESSAGE_COUNT);
+    PIGEON_CHECK(reader.block_count > 1);
+
+    // Blocks cover the log from its start without gaps, and the repeated
+    // message text shrinks under every codec
+    uint64_t next = 0;
+    for (size_t i = 0; i < reader.block_count; ++i)
+    {
+        PIGEON_CHECK(reader.blocks[i].log_offset == next);
+        PIGEON_CHECK(reader.blocks[i].codec == codec);
+        next = reader.blocks[i].log_offset + reader.blocks[i].log_size;
+    }
+
+    PIGEON_CHECK(reader.log_size == log_offset - 2);
+
+    for (int i = 0; i < MESSAGE_COUNT; i += 37)
+    {
+        size_t by_ordinal, by_offset, by_separator;
+        PIGEON_CHECK(pigeon_archive_find_by_ordinal(&reader, (uint64_t)i, &by_ordinal));
+        PIGEON_CHECK(pigeon_archive_find_by_offset(&reader, offsets[i], &by_offset));
+        PIGEON_CHECK(by_ordinal == by_offset);
+
+        // The separator in front of a message belongs to the same block
+        PIGEON_CHECK(pigeon_archive_find_by_offset(&reader, offsets[i] - 1, &by_separator));
+        PIGEON_CHECK(by_separator == by_offset);
+    }
+
+    size_t block_index;
+    PIGEON_CHECK(!pigeon_archive_find_by_ordinal(&reader, MESSAGE_COUNT, &block_index));
+    PIGEON_CHECK(!pigeon_archive_find_by_offset(&reader, log_offset, &block_index));
+
+    char * raw;
+    size_t raw_size;
+    PIGEON_CHECK(pigeon_archive_read_block(&reader, 0, &raw, &raw_size));
+    PIGEON_CHECK(raw_size > 4);
+    pigeon_free(raw);
+
+    replay_counts_t counts;
+    atomic_init(&counts.messages, 0);
+    atomic_init(&counts.failures, 0);
+    atomic_init(&counts.sequence_sum, 0);
+    PIGEON_CHECK(pigeon_archive_replay(&reader, 0, reader.block_count, 4, count_message, &counts));
+    PIGEON_CHECK(atomic_load(&counts.messages) == MESSAGE_COUNT);
+    PIGEON_CHECK(atomic_load(&counts.failures) == 1);
+    PIGEON_CHECK(atomic_load(&counts.sequence_sum) == expected_sum);
+
+    PIGEON_CHECK(!pigeon_archive_replay(&reader, 1, reader.block_count, 1, count_message, &counts));
+
+    pigeon_archive_reader_close(&reader);
+    unlink(path);
+}
+
+// A stored block that ends with fewer bytes than a size prefix needs must
+// be reported as truncated rather than read past.
+static void test_truncated_block(void)
+{
+    static const char magic[8] = { 'P', 'G', 'N', 'A', 'R', 'C', '0', '1' };
+    static const char index_magic[8] = { 'P', 'G', 'N', 'A', 'I', 'D', 'X', '1' };
+
+    char file[8 + 2 + 48 + 24];
+    memset(file, 0, sizeof(file));
+    memcpy(file, magic, sizeof(magic));
+    file[8] = 5;
+    file[9] = 0;
+
+    char * entry = file + 10;
+    put_u64(entry, 8);        // file offset
+    put_u64(entry + 8, 0);    // first ordinal
+    put_u64(entry + 16, 0);   // log offset
+    put_u64(entry + 24, 2);   // log size
+    put_u32(entry + 32, 2);   // compressed size
+    put_u32(entry + 36, 2);   // raw size
+    put_u32(entry + 40, 1);   // message count
+    put_u32(entry + 44, PIGEON_ARCHIVE_CODEC_STORED);
+
+    char * footer = entry + 48;
+    put_u64(footer, 10);
+    put_u64(footer + 8, 1);
+    memcpy(footer + 16, index_magic, sizeof(index_magic));
+
+    char path[256];
+    pigeon_test_path(path, sizeof(path), "archive_truncated");
+    PIGEON_CHECK(pigeon_test_write_file(path, file, sizeof(file)));
+
+    pigeon_archive_reader_t reader;
+    PIGEON_CHECK(pigeon_archive_reader_open(&reader, path));
+
+    replay_counts_t counts;
+    atomic_init(&counts.messages, 0);
+    atomic_init(&counts.failures, 0);
+    atomic_init(&counts.sequence_sum, 0);
+    PIGEON_CHECK(!pigeon_archive_replay(&reader, 0, 1, 1, count_message, &counts));
+    PIGEON_CHECK(strstr(reader.error_messages, "truncated") != NULL);
+    PIGEON_CHECK(atomic_load(&counts.messages) == 0);
+
+    pigeon_archive_reader_close(&reader);
+    unlink(path);
+}
+
+static void check_corrupt_index(const char * restrict name, const char * restrict file, size_t size)
+{
+    char path[256];
+    pigeon_test_path(path, sizeof(path), name);
+    PIGEON_CHECK(pigeon_test_write_file(path, file, size));
+
+    pigeon_archive_reader_t reader;
+    PIGEON_CHECK(!pigeon_archive_reader_open(&reader, path));
+    PIGEON_CHECK(strstr(reader.error_messages, "corrupt block index") != NULL);
+    unlink(path);
+}
+
+// Footers and index entries that point outside the file must be rejected
+// when the archive is opened, before anything is allocated from them.
+static void test_corrupt_index(void)
+{
+    static const char magic[8] = { 'P', 'G', 'N', 'A', 'R', 'C', '0', '1' };
+    static const char index_magic[8] = { 'P', 'G', 'N', 'A', 'I', 'D', 'X', '1' };
+
+    // A block count whose index size wraps around to fit the file
+    char empty[8 + 24];
+    memcpy(empty, magic, sizeof(magic));
+    put_u64(empty + 8, 8);
+    put_u64(empty + 16, 1ull << 60);
+    memcpy(empty + 24, index_magic, sizeof(index_magic));
+    check_corrupt_index("archive_wrapped_count", empty, sizeof(empty));
+
+    put_u64(empty + 16, 0xffffffffffffffffull);
+    check_corrupt_index("archive_max_count", empty, sizeof(empty));
+
+    // An index offset inside the header
+    put_u64(empty + 8, 0);
+    put_u64(empty + 16, 0);
+    check_corrupt_index("archive_header_index", empty, sizeof(empty));
+
+    char file[8 + 2 + 48 + 24];
+    memset(file, 0, sizeof(file));
+    memcpy(file, magic, sizeof(magic));
+
+    char * entry = file + 10;
+    put_u64(entry, 8);
+    put_u32(entry + 32, 2);
+    put_u32(entry + 36, 2);
+    put_u32(entry + 40, 1);
+    put_u32(entry + 44, PIGEON_ARCHIVE_CODEC_STORED);
+
+    char * footer = entry + 48;
+    put_u64(footer, 10);
+    put_u64(footer + 8, 1);
+    memcpy(footer + 16, index_magic, sizeof(index_magic));
+
+    // The intact archive opens
+    char path[256];
+    pigeon_test_path(path, sizeof(path), "archive_entry");
+    PIGEON_CHECK(pigeon_test_write_file(path, file, sizeof(file)));
+    pigeon_archive_reader_t reader;
+    PIGEON_CHECK(pigeon_archive_reader_open(&reader, path));
+    pigeon_archive_reader_close(&reader);
+    unlink(path);
+
+    // A payload running into the index
+    put_u32(entry + 32, 3);
+    check_corrupt_index("archive_entry_size", file, sizeof(file));
+
+    // A payload whose end wraps around
+    put_u64(entry, 0xfffffffffffffff0ull);
+    put_u32(entry + 32, 0x20);
+    check_corrupt_index("archive_entry_wrap", file, sizeof(file));
+
+    // A payload inside the header
+    put_u64(entry, 4);
+    put_u32(entry + 32, 2);
+    check_corrupt_index("archive_entry_header", file, sizeof(file));
+
+    // A wrong block count for the index size
+    put_u64(entry, 8);
+    put_u64(footer + 8, 2);
+    check_corrupt_index("archive_entry_count", file, sizeof(file));
+}
+
+int main(void)
+{
+#ifdef PIGEON_HAVE_ZLIB
+    test_round_trip(PIGEON_ARCHIVE_CODEC_ZLIB);
+#endif
+    test_round_trip(PIGEON_ARCHIVE_CODEC_LZ);
+    test_truncated_block();
+    test_corrupt_index();
+    return pigeon_test_result("archive_test");
+}
@@ -0,0 +1,184 @@
+#include "pigeon_test.h"
+#include "pigeon_blob.h"
+#include "pigeon_memory.h"
+
+#include <pthread.h>
+
+#define THREADS 4
+#define BLOBS 8
+
+typedef struct {
+    pigeon_blob_store_t * store;
+    unsigned char (*digests)[PIGEON_SHA256_DIGEST_SIZE];
+    unsigned failures;
+} reader_t;
+
+static void remove_tree(const char * restrict root)
+{
+    char command[512];
+    snprintf(command, sizeof(command), "rm -rf '%s'", root);
+    if (system(command) != 0)
+        fprintf(stderr, "cannot remove %s\n", root);
+}
+
+static void test_put_get(const char * restrict root)
+{
+    pigeon_blob_store_t store;
+    PIGEON_CHECK(pigeon_blob_store_open(&store, root, 0));
+
+    unsigned char digest[PIGEON_SHA256_DIGEST_SIZE];
+    char hex[PIGEON_SHA256_DIGEST_SIZE * 2 + 1];
+    PIGEON_CHECK(pigeon_blob_store_put(&store, "hello", 5, digest));
+    pigeon_sha256_format_hex(digest, hex);
+    PIGEON_CHECK_STR(hex, "2cf24dba5fb0a30e26e83b2ac5b9e29e1b161e5c1fa7425e73043362938b9824");
+    PIGEON_CHECK(pigeon_blob_store_contains(&store, digest));
+
+    pigeon_blob_t blob;
+    PIGEON_CHECK(pigeon_blob_store_get(&store, digest, &blob));
+    PIGEON_CHECK(blob.size == 5 && memcmp(blob.data, "hello", 5) == 0);
+    pigeon_blob_release(&store, &blob);
+
+    // An empty blob is stored and read back like any other
+    unsigned char empty[PIGEON_SHA256_DIGEST_SIZE];
+    PIGEON_CHECK(pigeon_blob_store_put(&store, "", 0, empty));
+    pigeon_sha256_format_hex(empty, hex);
+    PIGEON_CHECK_STR(hex, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+
+    size_t size = 1;
+    void * copy = pigeon_blob_store_read(&store, empty, &size);
+    PIGEON_CHECK(copy != NULL && size == 0);
+    pigeon_free(copy);
+
+    // A writer with the wrong expected digest publishes nothing
+    unsigned char wrong[PIGEON_SHA256_DIGEST_SIZE];
+    memset(wrong, 0x11, sizeof(wrong));
+    pigeon_blob_writer_t writer;
+    PIGEON_CHECK(pigeon_blob_writer_open(&store, &writer, wrong));
+    PIGEON_CHECK(pigeon_blob_writer_write(&writer, "abc", 3));
+    PIGEON_CHECK(!pigeon_blob_writer_close(&writer, NULL));
+    PIGEON_CHECK(!pigeon_blob_store_contains(&store, wrong));
+
+    char error[256];
+    pigeon_blob_store_error(&store, error, sizeof(error));
+    PIGEON_CHECK(strstr(error, "not the expected digest") != NULL);
+
+    PIGEON_CHECK(!pigeon_blob_store_get(&store, wrong, &blob));
+    PIGEON_CHECK(blob.mapping == NULL);
+
+    pigeon_blob_store_close(&store);
+}
+
+static void test_fields(const char * restrict root)
+{
+    pigeon_blob_store_t store;
+    PIGEON_CHECK(pigeon_blob_store_open(&store, root, 0));
+
+    unsigned char digest[PIGEON_SHA256_DIGEST_SIZE];
+    PIGEON_CHECK(pigeon_blob_store_put(&store, "hello", 5, digest));
+
+    char message[1024];
+    pigeon_test_message(message, sizeof(message), "blobs", 1, 10, "post",
+        "\"\":&sha256:2cf24dba5fb0a30e26e83b2ac5b9e29e1b161e5c1fa7425e73043362938b9824\n"
+        "\"empty\":\"\"\n");
+
+    pigeon_parsed_message_t parsed;
+    PIGEON_CHECK(pigeon_test_parse(message, &parsed));
+
+    const pigeon_field_t * unnamed = pigeon_list_head(&parsed.fields);
+    const pigeon_field_t * empty = unnamed ? pigeon_list_next((void *)unnamed) : NULL;
+    PIGEON_CHECK(unnamed != NULL && empty != NULL);
+    if (unnamed && empty)
+    {
+        pigeon_blob_t blob;
+        PIGEON_CHECK(pigeon_blob_resolve_field(&store, unnamed, &blob));
+        PIGEON_CHECK(blob.size == 5 && memcmp(blob.data, "hello", 5) == 0);
+        pigeon_blob_release(&store, &blob);
+
+        PIGEON_CHECK(!pigeon_blob_resolve_field(&store, empty, &blob));
+        char error[256];
+        pigeon_blob_store_error(&store, error, sizeof(error));
+        PIGEON_CHECK_STR(error, "field 'empty' is not a sha256 blob reference");
+    }
+
+    pigeon_free_parsed_message(&parsed);
+    pigeon_blob_store_close(&store);
+}
+
+static void * reader_main(void * arg)
+{
+    reader_t * reader = arg;
+    unsigned char missing[PIGEON_SHA256_DIGEST_SIZE];
+    memset(missing, 0x22, sizeof(missing));
+
+    for (unsigned round = 0; round < 200; ++round)
+    {
+        unsigned index = round % BLOBS;
+        pigeon_blob_t blob;
+        if (!pigeon_blob_store_get(reader->store, reader->digests[index], &blob))
+            ++reader->failures;
+        else
+        {
+            if (blob.size != 4096 || ((const unsigned char *)blob.data)[0] != index)
+                ++reader->failures;
+            pigeon_blob_release(reader->store, &blob);
+        }
+
+        // Failed lookups report errors while other threads map blobs
+        if (pigeon_blob_store_get(reader->store, missing, &blob))
+            ++reader->failures;
+    }
+
+    return NULL;
+}
+
+static void test_threads(const char * restrict root)
+{
+    pigeon_blob_store_t store;
+    // Room for two blobs only, so readers keep evicting each other
+    PIGEON_CHECK(pigeon_blob_store_open(&store, root, 2 * 4096));
+
+    unsigned char digests[BLOBS][PIGEON_SHA256_DIGEST_SIZE];
+    unsigned char data[4096];
+    for (unsigned i = 0; i < BLOBS; ++i)
+    {
+        memset(data, (int)i, sizeof(data));
+        PIGEON_CHECK(pigeon_blob_store_put(&store, data, sizeof(data), digests[i]));
+    }
+
+    pthread_t threads[THREADS];
+    reader_t readers[THREADS];
+    for (unsigned i = 0; i < THREADS; ++i)
+    {
+        readers[i].store = &store;
+        readers[i].digests = digests;
+        readers[i].failures = 0;
+        PIGEON_CHECK(pthread_create(&threads[i], NULL, reader_main, &readers[i]) == 0);
+    }
+
+    for (unsigned i = 0; i < THREADS; ++i)
+    {
+        pthread_join(threads[i], NULL);
+        PIGEON_CHECK(readers[i].failures == 0);
+    }
+
+    PIGEON_CHECK(store.cache_size <= store.cache_limit);
+
+    char error[256];
+    pigeon_blob_store_error(&store, error, sizeof(error));
+    PIGEON_CHECK(strncmp(error, "cannot open blob 2222", 21) == 0);
+
+    pigeon_blob_store_close(&store);
+}
+
+int main(void)
+{
+    char root[256];
+    pigeon_test_path(root, sizeof(root), "blob");
+
+    test_put_get(root);
+    test_fields(root);
+    test_threads(root);
+
+    remove_tree(root);
+    return pigeon_test_result("blob_test");
+}
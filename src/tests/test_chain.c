@@ -0,0 +1,188 @@
+#include "pigeon_test.h"
+#include "pigeon_chain.h"
+#include "pigeon_sha256.h"
+
+typedef struct {
+    unsigned counts[PIGEON_CHAIN_INCOMPLETE + 1];
+} issue_counts_t;
+
+static void count_issue(void * user_data, const char * path, uint64_t offset, pigeon_chain_issue_t issue, const char * details)
+{
+    (void)path;
+    (void)offset;
+    (void)details;
+
+    issue_counts_t * counts = user_data;
+    ++counts->counts[issue];
+}
+
+typedef struct {
+    char * data;
+    size_t size;
+    size_t capacity;
+    unsigned char last_digest[2][PIGEON_SHA256_DIGEST_SIZE];
+} log_builder_t;
+
+// Appends a message of feed author_index whose previous header is the digest
+// of that feed's last message, unless previous is given.
+static void append_message(log_builder_t * restrict log, int author_index, const char * restrict author_line, int sequence, int64_t timestamp, const char * restrict previous)
+{
+    char digest_text[PIGEON_SHA256_DIGEST_SIZE * 2 + 1];
+    if (!previous)
+    {
+        pigeon_sha256_format_hex(log->last_digest[author_index], digest_text);
+        previous = digest_text;
+    }
+
+    char * start = log->data + log->size;
+    int length = snprintf(start, log->capacity - log->size,
+        "%s\n"
+        "sequence %d\n"
+        "kind \"post\"\n"
+        "previous %%sha256:%s\n"
+        "timestamp %lld\n"
+        "\n"
+        "\"\":\"\"\n"
+        "\"text\":\"hello\"\n"
+        "\n"
+        "signature %%ed25519:sig%d%d\n",
+        author_line, sequence, previous, (long long)timestamp, author_index, sequence);
+
+    PIGEON_CHECK(length > 0 && (size_t)length < log->capacity - log->size);
+    pigeon_sha256(start, (size_t)length, log->last_digest[author_index]);
+    log->size += (size_t)length;
+    log->size += (size_t)snprintf(log->data + log->size, log->capacity - log->size, "\n");
+}
+
+static bool run_chain(const char * restrict path, unsigned threads, bool allow_partial, issue_counts_t * restrict counts, pigeon_chain_result_t * restrict result)
+{
+    memset(counts, 0, sizeof(*counts));
+    pigeon_chain_options_t options = { threads, allow_partial, count_issue, counts };
+    const char * paths[] = { path };
+    return pigeon_chain_validate(paths, 1, &options, result);
+}
+
+static void test_valid_feeds(void)
+{
+    static char data[64 * 1024];
+    log_builder_t log = { data, 0, sizeof(data), { { 0 } } };
+
+    // The same feed is written with different spacing of its author line;
+    // every spelling must reach the same worker.
+    static const char * const spellings[] = {
+        "author @ed25519:alice",
+        "author   @ed25519:  alice  ",
+        "author\t@ed25519:alice",
+        "author @ed25519 : alice",
+    };
+
+    for (int i = 1; i <= 40; ++i)
+    {
+        append_message(&log, 0, spellings[i % 4], i, 100 + i, i == 1 ? "0000000000000000000000000000000000000000000000000000000000000000" : NULL);
+        append_message(&log, 1, "author @ed25519:bob", i, 100 + i, i == 1 ? "0000000000000000000000000000000000000000000000000000000000000000" : NULL);
+    }
+
+    char path[256];
+    pigeon_test_path(path, sizeof(path), "chain_valid");
+    PIGEON_CHECK(pigeon_test_write_file(path, log.data, log.size));
+
+    for (unsigned threads = 1; threads <= 7; threads += 3)
+    {
+        issue_counts_t counts;
+        pigeon_chain_result_t result;
+        PIGEON_CHECK(run_chain(path, threads, false, &counts, &result));
+        PIGEON_CHECK(result.messages == 80);
+        PIGEON_CHECK(result.authors == 2);
+        PIGEON_CHECK(result.issues == 0);
+        PIGEON_CHECK(result.bytes == log.size);
+    }
+
+    unlink(path);
+}
+
+static void test_issues(void)
+{
+    static char data[64 * 1024];
+    log_builder_t log = { data, 0, sizeof(data), { { 0 } } };
+    static const char zero[] = "0000000000000000000000000000000000000000000000000000000000000000";
+
+    append_message(&log, 0, "author @ed25519:carol", 1, 100, zero);
+    append_message(&log, 0, "author @ed25519:carol", 2, 90, NULL);        // timestamp regression
+    append_message(&log, 0, "author @ed25519:carol", 4, 110, NULL);       // sequence gap
+    append_message(&log, 0, "author @ed25519:carol", 4, 120, NULL);       // sequence repeat
+    append_message(&log, 0, "author @ed25519:carol", 5, 130, zero);       // previous mismatch
+    append_message(&log, 0, "author @ed25519:carol", 6, 140, "nothex");   // previous invalid
+    append_message(&log, 1, "author @ed25519:dave", 3, 100, zero);        // feed start
+    log.size += (size_t)snprintf(log.data + log.size, log.capacity - log.size, "author @ed25519:dave\nnonsense\nsignature %%ed25519:x\n\n");
+    log.size += (size_t)snprintf(log.data + log.size, log.capacity - log.size, "author @ed25519:dave\nsequence 4\n");
+
+    char path[256];
+    pigeon_test_path(path, sizeof(path), "chain_issues");
+    PIGEON_CHECK(pigeon_test_write_file(path, log.data, log.size));
+
+    for (unsigned threads = 1; threads <= 3; threads += 2)
+    {
+        issue_counts_t counts;
+        pigeon_chain_result_t result;
+        PIGEON_CHECK(run_chain(path, threads, false, &counts, &result));
+        PIGEON_CHECK(counts.counts[PIGEON_CHAIN_TIMESTAMP_REGRESSION] == 1);
+        PIGEON_CHECK(counts.counts[PIGEON_CHAIN_SEQUENCE_GAP] == 1);
+        PIGEON_CHECK(counts.counts[PIGEON_CHAIN_SEQUENCE_REPEAT] == 1);
+        PIGEON_CHECK(counts.counts[PIGEON_CHAIN_PREVIOUS_MISMATCH] == 1);
+        PIGEON_CHECK(counts.counts[PIGEON_CHAIN_PREVIOUS_INVALID] == 1);
+        PIGEON_CHECK(counts.counts[PIGEON_CHAIN_FEED_START] == 1);
+        PIGEON_CHECK(counts.counts[PIGEON_CHAIN_PARSE_ERROR] == 1);
+        PIGEON_CHECK(counts.counts[PIGEON_CHAIN_INCOMPLETE] == 1);
+        PIGEON_CHECK(result.issues == 8);
+        PIGEON_CHECK(result.authors == 2);
+
+        // A trimmed snapshot may start anywhere
+        PIGEON_CHECK(run_chain(path, threads, true, &counts, &result));
+        PIGEON_CHECK(counts.counts[PIGEON_CHAIN_FEED_START] == 0);
+        PIGEON_CHECK(result.issues == 7);
+    }
+
+    unlink(path);
+}
+
+// A feed that starts at sequence 0 links into sequence 1, which carries no
+// previous digest to compare.
+static void test_sequence_zero(void)
+{
+    static char data[16 * 1024];
+    log_builder_t log = { data, 0, sizeof(data), { { 0 } } };
+    static const char zero[] = "0000000000000000000000000000000000000000000000000000000000000000";
+
+    append_message(&log, 0, "author @ed25519:erin", 0, 100, zero);
+    append_message(&log, 0, "author @ed25519:erin", 1, 110, zero);
+    append_message(&log, 0, "author @ed25519:erin", 2, 120, NULL);
+
+    char path[256];
+    pigeon_test_path(path, sizeof(path), "chain_zero");
+    PIGEON_CHECK(pigeon_test_write_file(path, log.data, log.size));
+
+    issue_counts_t counts;
+    pigeon_chain_result_t result;
+    PIGEON_CHECK(run_chain(path, 1, true, &counts, &result));
+    PIGEON_CHECK(result.issues == 0);
+    PIGEON_CHECK(result.messages == 3);
+
+    unlink(path);
+}
+
+static void test_missing_file(void)
+{
+    issue_counts_t counts;
+    pigeon_chain_result_t result;
+    PIGEON_CHECK(!run_chain("/nonexistent/pigeon/log", 2, false, &counts, &result));
+    PIGEON_CHECK(result.error_messages[0] != '\0');
+}
+
+int main(void)
+{
+    test_valid_feeds();
+    test_issues();
+    test_sequence_zero();
+    test_missing_file();
+    return pigeon_test_result("chain_test");
+}
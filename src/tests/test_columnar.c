@@ -0,0 +1,168 @@
+#include "pigeon_test.h"
+#include "pigeon_columnar.h"
+
+#define ROW_COUNT 1000
+
+static const char * const column_files[] = {
+    "timestamp.col", "sequence.col", "author.col", "kind.col", "fields.col",
+    "author.dict", "kind.dict", "fields.dict"
+};
+
+static const char * column_path(char * restrict buffer, size_t size, const char * restrict directory, const char * restrict name)
+{
+    snprintf(buffer, size, "%s/%s", directory, name);
+    return buffer;
+}
+
+static void test_export(void)
+{
+    char directory[256];
+    pigeon_test_path(directory, sizeof(directory), "columnar");
+
+    // Two authors that only differ past the 256th character
+    char long_a[400];
+    char long_b[400];
+    memset(long_a, 'a', 300);
+    memcpy(long_b, long_a, 300);
+    strcpy(long_a + 300, "A");
+    strcpy(long_b + 300, "B");
+
+    pigeon_columnar_writer_t writer;
+    PIGEON_CHECK(pigeon_columnar_writer_open(&writer, directory));
+
+    for (int i = 0; i < ROW_COUNT; ++i)
+    {
+        char text[2048];
+        const char * author = i % 3 == 0 ? long_a : i % 3 == 1 ? long_b : "short";
+        const char * fields = i % 2 == 0 ? "\"\":\"unnamed\"\n\"text\":\"\"\n" : "\"text\":\"x\"\n";
+        pigeon_test_message(text, sizeof(text), author, i + 1, 1000 + i, i % 10 == 0 ? "" : "post", fields);
+
+        pigeon_parsed_message_t message;
+        if (pigeon_test_parse(text, &message))
+            PIGEON_CHECK(pigeon_columnar_writer_append(&writer, &message));
+        else
+            PIGEON_CHECK(!"message parses");
+        pigeon_free_parsed_message(&message);
+    }
+
+    PIGEON_CHECK(pigeon_columnar_writer_close(&writer));
+
+    char path[512];
+    char ** entries;
+    size_t count;
+    PIGEON_CHECK(pigeon_column_dictionary_load(column_path(path, sizeof(path), directory, "author.dict"), &entries, &count));
+    PIGEON_CHECK(count == 3);
+    if (count == 3)
+    {
+        PIGEON_CHECK(strlen(entries[0]) == strlen("ed25519:") + 301);
+        PIGEON_CHECK(strcmp(entries[0], entries[1]) != 0);
+        PIGEON_CHECK_STR(entries[2], "ed25519:short");
+    }
+    pigeon_column_dictionary_entries_free(entries, count);
+
+    // The empty field name is an entry of its own, before "text"
+    PIGEON_CHECK(pigeon_column_dictionary_load(column_path(path, sizeof(path), directory, "fields.dict"), &entries, &count));
+    PIGEON_CHECK(count == 2);
+    if (count == 2)
+    {
+        PIGEON_CHECK_STR(entries[0], "");
+        PIGEON_CHECK_STR(entries[1], "text");
+    }
+    pigeon_column_dictionary_entries_free(entries, count);
+
+    PIGEON_CHECK(pigeon_column_dictionary_load(column_path(path, sizeof(path), directory, "kind.dict"), &entries, &count));
+    PIGEON_CHECK(count == 2);
+    if (count == 2)
+    {
+        PIGEON_CHECK_STR(entries[0], "");
+        PIGEON_CHECK_STR(entries[1], "post");
+    }
+    pigeon_column_dictionary_entries_free(entries, count);
+
+    pigeon_column_t column;
+    PIGEON_CHECK(pigeon_column_open(&column, column_path(path, sizeof(path), directory, "timestamp.col")));
+    PIGEON_CHECK(column.row_count == ROW_COUNT);
+    int64_t min, max;
+    PIGEON_CHECK(pigeon_column_min_max(&column, &min, &max));
+    PIGEON_CHECK(min == 1000 && max == 1000 + ROW_COUNT - 1);
+    PIGEON_CHECK(pigeon_column_count_range(&column, 1100, 1200) == 100);
+    uint64_t buckets[4] = { 0 };
+    pigeon_column_histogram_buckets(&column, 1000, 250, buckets, 4);
+    PIGEON_CHECK(buckets[0] == 250 && buckets[3] == 250);
+    pigeon_column_close(&column);
+
+    PIGEON_CHECK(pigeon_column_open(&column, column_path(path, sizeof(path), directory, "author.col")));
+    uint64_t authors[3] = { 0 };
+    pigeon_column_histogram_ids(&column, authors, 3);
+    PIGEON_CHECK(authors[0] == 334 && authors[1] == 333 && authors[2] == 333);
+    pigeon_column_close(&column);
+
+    PIGEON_CHECK(pigeon_column_open(&column, column_path(path, sizeof(path), directory, "fields.col")));
+    PIGEON_CHECK(pigeon_column_count_bits(&column, 1) == ROW_COUNT / 2);
+    PIGEON_CHECK(pigeon_column_count_bits(&column, 2) == ROW_COUNT);
+    pigeon_column_close(&column);
+
+    PIGEON_CHECK(!pigeon_column_open(&column, column_path(path, sizeof(path), directory, "author.dict")));
+
+    for (size_t i = 0; i < sizeof(column_files) / sizeof(column_files[0]); ++i)
+        unlink(column_path(path, sizeof(path), directory, column_files[i]));
+    rmdir(directory);
+}
+
+// Range bounds past the limits of a narrow column type must still count
+// the rows equal to those limits.
+static void test_count_range_limits(void)
+{
+    enum { REPEAT = 8 };
+    int32_t signed_values[4 * REPEAT];
+    uint32_t unsigned_values[3 * REPEAT];
+    for (size_t i = 0; i < REPEAT; ++i)
+    {
+        signed_values[i * 4] = INT32_MIN;
+        signed_values[i * 4 + 1] = 0;
+        signed_values[i * 4 + 2] = 5;
+        signed_values[i * 4 + 3] = INT32_MAX;
+        unsigned_values[i * 3] = 0;
+        unsigned_values[i * 3 + 1] = 5;
+        unsigned_values[i * 3 + 2] = UINT32_MAX;
+    }
+
+    // One row of each value, then enough for the vector kernels
+    for (size_t repeat = 1; repeat <= REPEAT; repeat += REPEAT - 1)
+    {
+        int64_t signed_stats[2] = { INT32_MIN, INT32_MAX };
+        pigeon_column_t column;
+        memset(&column, 0, sizeof(column));
+        column.type = PIGEON_COLUMN_INT32;
+        column.row_count = 4 * repeat;
+        column.block_rows = PIGEON_COLUMN_BLOCK_ROWS;
+        column.block_count = 1;
+        column.data = signed_values;
+        column.stats = signed_stats;
+
+        PIGEON_CHECK(pigeon_column_count_range(&column, 1, 1ll << 40) == 2 * repeat);
+        PIGEON_CHECK(pigeon_column_count_range(&column, -(1ll << 40), 1) == 2 * repeat);
+        PIGEON_CHECK(pigeon_column_count_range(&column, -(1ll << 40), INT32_MIN + 1ll) == repeat);
+        PIGEON_CHECK(pigeon_column_count_range(&column, INT32_MAX, INT64_MAX) == repeat);
+        PIGEON_CHECK(pigeon_column_count_range(&column, 0, INT32_MAX) == 2 * repeat);
+        PIGEON_CHECK(pigeon_column_count_range(&column, INT64_MIN, INT64_MAX) == 4 * repeat);
+
+        int64_t unsigned_stats[2] = { 0, UINT32_MAX };
+        column.type = PIGEON_COLUMN_UINT32;
+        column.row_count = 3 * repeat;
+        column.data = unsigned_values;
+        column.stats = unsigned_stats;
+
+        PIGEON_CHECK(pigeon_column_count_range(&column, 1, 1ll << 40) == 2 * repeat);
+        PIGEON_CHECK(pigeon_column_count_range(&column, -5, 5) == repeat);
+        PIGEON_CHECK(pigeon_column_count_range(&column, UINT32_MAX, INT64_MAX) == repeat);
+        PIGEON_CHECK(pigeon_column_count_range(&column, 0, UINT32_MAX) == 2 * repeat);
+    }
+}
+
+int main(void)
+{
+    test_export();
+    test_count_range_limits();
+    return pigeon_test_result("columnar_test");
+}
@@ -0,0 +1,202 @@
+#include "pigeon_test.h"
+#include "pigeon_compact.h"
+#include "pigeon_memory.h"
+
+static bool same_str(const char * lhs, const char * rhs)
+{
+    return lhs == rhs || (lhs && rhs && 0 == strcmp(lhs, rhs));
+}
+
+static bool same_value(const pigeon_encoded_value_t * lhs, const pigeon_encoded_value_t * rhs)
+{
+    return lhs->encoding_type == rhs->encoding_type && same_str(lhs->hash, rhs->hash);
+}
+
+// Compares two messages, NULL-ness of strings included.
+static void check_same(const pigeon_parsed_message_t * restrict expected, const pigeon_parsed_message_t * restrict actual)
+{
+    PIGEON_CHECK(same_value(&expected->author, &actual->author));
+    PIGEON_CHECK(same_value(&expected->previous, &actual->previous));
+    PIGEON_CHECK(same_value(&expected->signature, &actual->signature));
+    PIGEON_CHECK(expected->sequence_number == actual->sequence_number);
+    PIGEON_CHECK(expected->timestamp == actual->timestamp);
+    PIGEON_CHECK(same_str(expected->kind, actual->kind));
+
+    const pigeon_field_t * lhs = pigeon_list_head((pigeon_list_t *)&expected->fields);
+    const pigeon_field_t * rhs = pigeon_list_head((pigeon_list_t *)&actual->fields);
+    for (; lhs && rhs; lhs = pigeon_list_next((void *)lhs), rhs = pigeon_list_next((void *)rhs))
+    {
+        PIGEON_CHECK(lhs->field_type == rhs->field_type);
+        PIGEON_CHECK(same_str(lhs->field_name, rhs->field_name));
+        if (lhs->field_type == PIGEON_FIELD_STRING)
+            PIGEON_CHECK(same_str(lhs->field_value.string, rhs->field_value.string));
+        else if (lhs->field_type == PIGEON_FIELD_INT64 || lhs->field_type == PIGEON_FIELD_STREAMED)
+            PIGEON_CHECK(lhs->field_value.int64_ == rhs->field_value.int64_);
+        else
+            PIGEON_CHECK(same_value(&lhs->field_value.encoded, &rhs->field_value.encoded));
+    }
+
+    PIGEON_CHECK(lhs == NULL && rhs == NULL);
+}
+
+static void check_compact(const pigeon_parsed_message_t * restrict message)
+{
+    pigeon_compact_message_t * compact = pigeon_compact_message_create(message);
+    PIGEON_CHECK(compact != NULL);
+    if (compact)
+    {
+        PIGEON_CHECK(compact->total_size == pigeon_compact_message_size(message));
+
+        pigeon_parsed_message_t expanded;
+        PIGEON_CHECK(pigeon_compact_message_expand(compact, &expanded));
+        check_same(message, &expanded);
+        pigeon_free_parsed_message(&expanded);
+        pigeon_free(compact);
+    }
+}
+
+static void check_round_trip(const char * restrict text)
+{
+    pigeon_parsed_message_t message;
+    PIGEON_CHECK(pigeon_test_parse(text, &message));
+    check_compact(&message);
+    pigeon_free_parsed_message(&message);
+}
+
+static void test_round_trip(void)
+{
+    char text[2048];
+
+    // Hex, base64 and plain hashes, short and long strings
+    pigeon_test_message(text, sizeof(text), "ajgdylxeifojlxpbmen3exlnsbx8buspsjh37b/ipvi=", 23, 23123123123, "example",
+        "\"foo\":&sha256:3f79bb7b435b05321651daefd374cdc681dc06faa65e374e38337b88ca046dea\n"
+        "\"baz\":\"bar\"\n"
+        "\"my_friend\":@ed25519:abcdef1234567890\n"
+        "\"a_rather_long_field_name\":\"a value that does not fit inline\"\n");
+    check_round_trip(text);
+
+    // Empty kind, field name and values stay NULL through the round trip
+    pigeon_test_message(text, sizeof(text), "emptyauthor", 1, 0, "",
+        "\"\":\"unnamed\"\n"
+        "\"empty\":\"\"\n"
+        "\"\":\"\"\n");
+    check_round_trip(text);
+
+    pigeon_test_message(text, sizeof(text), "nofields", 2, 5, "post", "");
+    check_round_trip(text);
+}
+
+static void test_hash_text(void)
+{
+    char text[1024];
+    pigeon_test_message(text, sizeof(text), "AAECAwQFBgc=", 1, 0, "post", "");
+
+    pigeon_parsed_message_t message;
+    PIGEON_CHECK(pigeon_test_parse(text, &message));
+
+    pigeon_compact_message_t * compact = pigeon_compact_message_create(&message);
+    PIGEON_CHECK(compact != NULL);
+    if (compact)
+    {
+        PIGEON_CHECK(compact->author.format == PIGEON_COMPACT_HASH_BASE64);
+        PIGEON_CHECK(compact->author.bytes.length == 8);
+        PIGEON_CHECK(compact->previous.format == PIGEON_COMPACT_HASH_HEX);
+
+        char hash[128];
+        PIGEON_CHECK(pigeon_compact_hash_text(compact, &compact->author, hash, sizeof(hash)) == 12);
+        PIGEON_CHECK_STR(hash, "AAECAwQFBgc=");
+        PIGEON_CHECK(pigeon_compact_hash_text(compact, &compact->author, hash, 12) == 0);
+        pigeon_free(compact);
+    }
+
+    pigeon_free_parsed_message(&message);
+}
+
+static bool skip_piece(void * user_data, const pigeon_field_t * field, const char * chunk, size_t size, bool last)
+{
+    (void)user_data;
+    (void)field;
+    (void)chunk;
+    (void)size;
+    (void)last;
+    return true;
+}
+
+// Streamed strings keep their length through the compact form.
+static void test_streamed(void)
+{
+    char text[2048];
+    size_t size = pigeon_test_message(text, sizeof(text), "streamed", 1, 0, "post",
+        "\"long\":\"abcdefghij\"\n"
+        "\"\":\"0123456789abcdef\"\n"
+        "\"short\":\"ab\"\n"
+        "\"empty\":\"\"\n");
+
+    pigeon_parsed_message_t message;
+    pigeon_parse_context_t ctx;
+    pigeon_string_sink_t sink = { 4, skip_piece, NULL };
+    PIGEON_CHECK(pigeon_parse_message_streamed(&ctx, text, size, &message, &sink));
+    check_compact(&message);
+
+    pigeon_compact_message_t * compact = pigeon_compact_message_create(&message);
+    PIGEON_CHECK(compact != NULL && compact->field_count == 4);
+    if (compact && compact->field_count == 4)
+    {
+        PIGEON_CHECK(compact->fields[0].field_type == PIGEON_FIELD_STREAMED);
+        PIGEON_CHECK(pigeon_compact_field_int64(&compact->fields[0]) == 10);
+        PIGEON_CHECK(compact->fields[1].field_type == PIGEON_FIELD_STREAMED);
+        PIGEON_CHECK(compact->fields[1].name.length == 0);
+        PIGEON_CHECK(pigeon_compact_field_int64(&compact->fields[1]) == 16);
+    }
+    pigeon_free(compact);
+
+    pigeon_free_parsed_message(&message);
+}
+
+// A buffer of any size but the exact one is rejected before anything is
+// written to it.
+static void test_write_size(void)
+{
+    char text[2048];
+    pigeon_test_message(text, sizeof(text), "writesize", 1, 0, "",
+        "\"a_rather_long_field_name\":\"a value that does not fit inline\"\n"
+        "\"\":\"\"\n");
+
+    pigeon_parsed_message_t message;
+    PIGEON_CHECK(pigeon_test_parse(text, &message));
+
+    size_t size = pigeon_compact_message_size(&message);
+    PIGEON_CHECK(size > sizeof(pigeon_compact_message_t) + 2 * sizeof(pigeon_compact_field_t));
+
+    // Undersized down to just the fixed part, and oversized
+    char * buffer = pigeon_malloc(size + 8);
+    PIGEON_CHECK(buffer != NULL);
+    if (buffer)
+    {
+        const size_t sizes[] = { 0, sizeof(pigeon_compact_message_t) + 2 * sizeof(pigeon_compact_field_t), size - 1, size + 8 };
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+        {
+            memset(buffer, 0x5a, size + 8);
+            PIGEON_CHECK(!pigeon_compact_message_write(&message, buffer, sizes[i]));
+
+            bool untouched = true;
+            for (size_t j = 0; j < size + 8; ++j)
+                untouched = untouched && buffer[j] == 0x5a;
+            PIGEON_CHECK(untouched);
+        }
+
+        PIGEON_CHECK(pigeon_compact_message_write(&message, buffer, size));
+        pigeon_free(buffer);
+    }
+
+    pigeon_free_parsed_message(&message);
+}
+
+int main(void)
+{
+    test_round_trip();
+    test_hash_text();
+    test_streamed();
+    test_write_size();
+    return pigeon_test_result("compact_test");
+}
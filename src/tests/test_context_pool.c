@@ -0,0 +1,87 @@
+#include "pigeon_test.h"
+#include "pigeon_context_pool.h"
+#include "pigeon_hash.h"
+
+#include <pthread.h>
+
+#define THREAD_COUNT 4
+
+static void test_nesting(void)
+{
+    // Nesting past the pool size still hands out distinct contexts
+    pigeon_parse_context_t * contexts[PIGEON_CONTEXT_POOL_SIZE + 2];
+    for (size_t i = 0; i < sizeof(contexts) / sizeof(contexts[0]); ++i)
+    {
+        contexts[i] = pigeon_parse_context_acquire();
+        PIGEON_CHECK(contexts[i] != NULL);
+        for (size_t j = 0; j < i; ++j)
+            PIGEON_CHECK(contexts[i] != contexts[j]);
+    }
+
+    for (size_t i = sizeof(contexts) / sizeof(contexts[0]); i-- > 0;)
+        pigeon_parse_context_release(contexts[i]);
+
+    // A released context is handed out again
+    pigeon_parse_context_t * ctx = pigeon_parse_context_acquire();
+    PIGEON_CHECK(ctx == contexts[0]);
+    pigeon_parse_context_release(ctx);
+}
+
+// Parses a message with an empty field name and value on a pooled context
+// and hashes the result the way the benchmark does.
+static void * parse_on_thread(void * arg)
+{
+    uint64_t * checksum = arg;
+
+    char text[1024];
+    pigeon_test_message(text, sizeof(text), "poolauthor", 1, 10, "post", "\"\":\"\"\n\"name\":\"value\"\n");
+
+    for (int round = 0; round < 100; ++round)
+    {
+        pigeon_parse_context_t * ctx = pigeon_parse_context_acquire();
+        PIGEON_CHECK(ctx != NULL);
+        if (!ctx)
+            break;
+
+        pigeon_parsed_message_t message;
+        if (pigeon_parse_message(ctx, text, strlen(text), &message))
+        {
+            uint64_t hash = pigeon_hash_str(message.sequence_number, message.author.hash);
+            pigeon_field_t * field = pigeon_list_head(&message.fields);
+            for (; field != NULL; field = pigeon_list_next(field))
+                hash += pigeon_hash_str(field->field_type, field->field_name);
+
+            *checksum = hash;
+            pigeon_free_parsed_message(&message);
+        }
+        else
+            PIGEON_CHECK(false);
+
+        pigeon_parse_context_release(ctx);
+    }
+
+    return NULL;
+}
+
+static void test_threads(void)
+{
+    pthread_t threads[THREAD_COUNT];
+    uint64_t checksums[THREAD_COUNT] = { 0 };
+    for (unsigned i = 0; i < THREAD_COUNT; ++i)
+        PIGEON_CHECK(pthread_create(&threads[i], NULL, parse_on_thread, &checksums[i]) == 0);
+    for (unsigned i = 0; i < THREAD_COUNT; ++i)
+        pthread_join(threads[i], NULL);
+
+    uint64_t expected = pigeon_hash_str(1, "poolauthor") + pigeon_hash_str(PIGEON_FIELD_STRING, "") + pigeon_hash_str(PIGEON_FIELD_STRING, "name");
+    for (unsigned i = 0; i < THREAD_COUNT; ++i)
+        PIGEON_CHECK(checksums[i] == expected);
+
+    PIGEON_CHECK(pigeon_hash_str(7, NULL) == 7);
+}
+
+int main(void)
+{
+    test_nesting();
+    test_threads();
+    return pigeon_test_result("context_pool_test");
+}
@@ -0,0 +1,90 @@
+#include "pigeon_test.h"
+#include "pigeon_emit.h"
+
+#include <fcntl.h>
+#include <signal.h>
+
+// Emits into a scratch file and returns what reached it, NUL-terminated.
+static size_t read_back(const char * restrict path, char * restrict buffer, size_t size)
+{
+    FILE * file = fopen(path, "rb");
+    if (!file)
+        return 0;
+
+    size_t length = fread(buffer, 1, size - 1, file);
+    buffer[length] = '\0';
+    fclose(file);
+    return length;
+}
+
+static void test_records(void)
+{
+    char path[256];
+    pigeon_test_path(path, sizeof(path), "emit");
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    PIGEON_CHECK(fd >= 0);
+
+    pigeon_emitter_t emitter;
+    PIGEON_CHECK(pigeon_emitter_init(&emitter, fd, 0, NULL));
+
+    static const char json_input[] = "a\"b\\c\n\x01\xc3\xa9";
+    pigeon_emit_json_string(&emitter, json_input, sizeof(json_input) - 1);
+    pigeon_emit_char(&emitter, ' ');
+    pigeon_emit_json_string(&emitter, "", 0);
+    PIGEON_CHECK(pigeon_emitter_end_record(&emitter));
+
+    pigeon_emit_tsv_string(&emitter, "a\tb\nc\\d\re", 9);
+    pigeon_emit_char(&emitter, '\t');
+    pigeon_emit_int64(&emitter, INT64_MIN);
+    pigeon_emit_char(&emitter, '\t');
+    pigeon_emit_int64(&emitter, INT64_MAX);
+    pigeon_emit_char(&emitter, '\t');
+    pigeon_emit_int64(&emitter, 0);
+    PIGEON_CHECK(pigeon_emitter_end_record(&emitter));
+
+    // A record larger than the buffer grows it rather than being split
+    char big[10000];
+    memset(big, 'x', sizeof(big));
+    pigeon_emit_raw(&emitter, big, sizeof(big));
+    PIGEON_CHECK(pigeon_emitter_end_record(&emitter));
+
+    PIGEON_CHECK(pigeon_emitter_free(&emitter));
+    close(fd);
+
+    static char output[16384];
+    size_t length = read_back(path, output, sizeof(output));
+
+    static const char expected[] =
+        "\"a\\\"b\\\\c\\n\\u0001\xc3\xa9\" \"\"\n"
+        "a\\tb\\nc\\\\d\\re\t-9223372036854775808\t9223372036854775807\t0\n";
+    PIGEON_CHECK(length == sizeof(expected) - 1 + sizeof(big) + 1);
+    PIGEON_CHECK(0 == memcmp(output, expected, sizeof(expected) - 1));
+    PIGEON_CHECK(output[length - 1] == '\n' && output[length - 2] == 'x');
+
+    unlink(path);
+}
+
+static void test_write_failure(void)
+{
+    int fds[2];
+    PIGEON_CHECK(pipe(fds) == 0);
+    close(fds[0]);
+
+    pigeon_emitter_t emitter;
+    PIGEON_CHECK(pigeon_emitter_init(&emitter, fds[1], 0, NULL));
+    pigeon_emit_str(&emitter, "lost");
+
+    // Writing to a pipe without a reader fails; SIGPIPE is ignored here
+    signal(SIGPIPE, SIG_IGN);
+    PIGEON_CHECK(!pigeon_emitter_flush(&emitter));
+    PIGEON_CHECK(emitter.failed);
+    PIGEON_CHECK(!pigeon_emitter_free(&emitter));
+    close(fds[1]);
+}
+
+int main(void)
+{
+    test_records();
+    test_write_failure();
+    return pigeon_test_result("emit_test");
+}
@@ -0,0 +1,172 @@
+#include "pigeon_test.h"
+#include "pigeon_follow.h"
+
+#include <fcntl.h>
+
+typedef struct {
+    unsigned messages;
+    unsigned failures;
+    int last_sequence;
+    bool empty_kind_seen;
+} follow_counts_t;
+
+static bool count_message(void * user_data, const char * msg_data, size_t msg_size, uint64_t msg_offset, bool parse_success, const pigeon_parse_context_t * ctx, pigeon_parsed_message_t * message)
+{
+    (void)msg_data;
+    (void)msg_size;
+    (void)msg_offset;
+    (void)ctx;
+
+    follow_counts_t * counts = user_data;
+    ++counts->messages;
+    if (!parse_success)
+    {
+        ++counts->failures;
+        return true;
+    }
+
+    counts->last_sequence = message->sequence_number;
+    if (!message->kind)
+        counts->empty_kind_seen = true;
+    return true;
+}
+
+static bool append_file(const char * restrict path, const char * restrict data, size_t size)
+{
+    FILE * file = fopen(path, "ab");
+    if (!file)
+        return false;
+
+    bool success = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && success;
+}
+
+static void test_follow(void)
+{
+    // Longer than any fixed buffer the checkpoint once used
+    char author[600];
+    memset(author, 'a', sizeof(author) - 1);
+    author[sizeof(author) - 1] = '\0';
+
+    char log_path[256];
+    char checkpoint_path[256];
+    pigeon_test_path(log_path, sizeof(log_path), "follow");
+    pigeon_test_path(checkpoint_path, sizeof(checkpoint_path), "follow_checkpoint");
+
+    char text[2048];
+    size_t size = pigeon_test_message(text, sizeof(text), author, 1, 100, "", "\"text\":\"\"\n");
+    PIGEON_CHECK(size > 0);
+    PIGEON_CHECK(pigeon_test_write_file(log_path, text, size));
+
+    // The second message is only partly written at first
+    size = pigeon_test_message(text, sizeof(text), author, 2, 200, "post", "\"text\":\"hi\"\n");
+    PIGEON_CHECK(append_file(log_path, "\n", 1));
+    PIGEON_CHECK(append_file(log_path, text, size - 10));
+
+    pigeon_follow_t follow;
+    PIGEON_CHECK(pigeon_follow_open(&follow, log_path, checkpoint_path));
+
+    follow_counts_t counts = { 0 };
+    PIGEON_CHECK(pigeon_follow_poll(&follow, count_message, &counts));
+    PIGEON_CHECK(counts.messages == 1 && counts.failures == 0);
+    PIGEON_CHECK(counts.empty_kind_seen);
+
+    PIGEON_CHECK(append_file(log_path, text + size - 10, 10));
+    PIGEON_CHECK(pigeon_follow_poll(&follow, count_message, &counts));
+    PIGEON_CHECK(counts.messages == 2 && counts.last_sequence == 2);
+    PIGEON_CHECK(pigeon_follow_close(&follow));
+
+    // The checkpoint keeps the full author key and the position
+    pigeon_follow_checkpoint_t checkpoint;
+    PIGEON_CHECK(pigeon_follow_checkpoint_load(&checkpoint, checkpoint_path));
+    PIGEON_CHECK(checkpoint.last_sequence.count == 1);
+
+    char key[sizeof(author) + 16];
+    snprintf(key, sizeof(key), "ed25519:%s", author);
+    void ** slot = pigeon_map_find(&checkpoint.last_sequence, key);
+    PIGEON_CHECK(slot != NULL && (intptr_t)*slot == 2);
+    pigeon_follow_checkpoint_free(&checkpoint);
+
+    // A restarted follower only sees what was appended since
+    size = pigeon_test_message(text, sizeof(text), author, 3, 300, "post", "");
+    PIGEON_CHECK(append_file(log_path, text, size));
+
+    PIGEON_CHECK(pigeon_follow_open(&follow, log_path, checkpoint_path));
+    memset(&counts, 0, sizeof(counts));
+    PIGEON_CHECK(pigeon_follow_poll(&follow, count_message, &counts));
+    PIGEON_CHECK(counts.messages == 1 && counts.last_sequence == 3);
+
+    // A log truncated in place is read again from the start
+    size = pigeon_test_message(text, sizeof(text), author, 1, 100, "post", "");
+    PIGEON_CHECK(pigeon_test_write_file(log_path, text, size));
+    memset(&counts, 0, sizeof(counts));
+    PIGEON_CHECK(pigeon_follow_poll(&follow, count_message, &counts));
+    PIGEON_CHECK(counts.messages == 1 && counts.last_sequence == 1);
+    PIGEON_CHECK(pigeon_follow_close(&follow));
+
+    unlink(log_path);
+    unlink(checkpoint_path);
+}
+
+static void test_bad_checkpoint(void)
+{
+    static const char * const checkpoints[] = {
+        "something else\n",
+        "pigeon-follow-checkpoint 1\noffset 10\nline 2\nauthor ed25519:x\n",
+        "pigeon-follow-checkpoint 1\noffset 10\nline 2\nauthor ed25519:x 12z\n",
+        "pigeon-follow-checkpoint 1\noffset 10\nline 2\nfeed ed25519:x 12\n",
+    };
+
+    char path[256];
+    pigeon_test_path(path, sizeof(path), "follow_bad_checkpoint");
+    for (size_t i = 0; i < sizeof(checkpoints) / sizeof(checkpoints[0]); ++i)
+    {
+        PIGEON_CHECK(pigeon_test_write_file(path, checkpoints[i], strlen(checkpoints[i])));
+
+        pigeon_follow_checkpoint_t checkpoint;
+        PIGEON_CHECK(!pigeon_follow_checkpoint_load(&checkpoint, path));
+    }
+
+    // A missing checkpoint starts from the beginning
+    unlink(path);
+    pigeon_follow_checkpoint_t checkpoint;
+    PIGEON_CHECK(pigeon_follow_checkpoint_load(&checkpoint, path));
+    PIGEON_CHECK(checkpoint.offset == 0 && checkpoint.last_sequence.count == 0);
+    pigeon_follow_checkpoint_free(&checkpoint);
+}
+
+// A message that fails to parse after its header and first field were read
+// must be reported and freed like any other.
+static void test_malformed(void)
+{
+    char log_path[256];
+    pigeon_test_path(log_path, sizeof(log_path), "follow_malformed");
+
+    char text[2048];
+    size_t size = pigeon_test_message(text, sizeof(text), "followauthor", 1, 100, "post", "\"text\":\"hi\"\n\"\":\"\"\n\"broken\n");
+    PIGEON_CHECK(size > 0);
+    PIGEON_CHECK(pigeon_test_write_file(log_path, text, size));
+
+    size = pigeon_test_message(text, sizeof(text), "followauthor", 2, 200, "post", "\"text\":\"ok\"\n");
+    PIGEON_CHECK(append_file(log_path, "\n", 1));
+    PIGEON_CHECK(append_file(log_path, text, size));
+
+    pigeon_follow_t follow;
+    PIGEON_CHECK(pigeon_follow_open(&follow, log_path, NULL));
+
+    follow_counts_t counts = { 0 };
+    PIGEON_CHECK(pigeon_follow_poll(&follow, count_message, &counts));
+    PIGEON_CHECK(counts.messages == 2 && counts.failures == 1);
+    PIGEON_CHECK(counts.last_sequence == 2);
+    PIGEON_CHECK(pigeon_follow_close(&follow));
+
+    unlink(log_path);
+}
+
+int main(void)
+{
+    test_follow();
+    test_malformed();
+    test_bad_checkpoint();
+    return pigeon_test_result("follow_test");
+}
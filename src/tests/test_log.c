@@ -0,0 +1,228 @@
+#include "pigeon_test.h"
+#include "pigeon_log.h"
+
+#include <fcntl.h>
+
+#define MESSAGE_COUNT 40
+
+// Writes a log of count messages starting at sequence first, separated by
+// blank lines, with an empty kind and an empty field value in some of them.
+static size_t write_log(char * restrict log, size_t capacity, int first, int count, uint64_t * restrict starts)
+{
+    size_t size = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        int sequence = first + i;
+        if (starts)
+            starts[i] = size;
+
+        size += pigeon_test_message(log + size, capacity - size, "logauthor", sequence, 100 + sequence, sequence % 3 == 0 ? "" : "post", sequence % 2 == 0 ? "\"text\":\"\"\n" : "\"text\":\"hi\"\n");
+        size += (size_t)snprintf(log + size, capacity - size, "\n");
+    }
+
+    return size;
+}
+
+static void check_entries(const pigeon_log_index_t * restrict index, const uint64_t * restrict starts, size_t count)
+{
+    PIGEON_CHECK(index->count == count);
+    for (size_t i = 0; i < count && i < index->count; ++i)
+        PIGEON_CHECK(index->starts[i] == starts[i]);
+}
+
+static void test_reader(void)
+{
+    static char log[MESSAGE_COUNT * 512];
+    uint64_t starts[MESSAGE_COUNT];
+    size_t size = write_log(log, sizeof(log), 1, MESSAGE_COUNT, starts);
+
+    char path[256];
+    pigeon_test_path(path, sizeof(path), "log_reader");
+    // Leave the last message incomplete
+    PIGEON_CHECK(pigeon_test_write_file(path, log, size - 20));
+
+    int fd = open(path, O_RDONLY);
+    PIGEON_CHECK(fd >= 0);
+
+    pigeon_log_reader_t reader;
+    PIGEON_CHECK(pigeon_log_reader_init(&reader, fd, 64));
+
+    const char * msg_data;
+    size_t msg_size;
+    uint64_t msg_offset;
+    size_t count = 0;
+    pigeon_log_status_t status;
+    while ((status = pigeon_log_reader_next(&reader, &msg_data, &msg_size, &msg_offset)) == PIGEON_LOG_MESSAGE)
+    {
+        PIGEON_CHECK(count < MESSAGE_COUNT && msg_offset == starts[count]);
+
+        pigeon_parsed_message_t message;
+        char text[512];
+        memcpy(text, msg_data, msg_size);
+        text[msg_size] = '\0';
+        PIGEON_CHECK(pigeon_test_parse(text, &message));
+        PIGEON_CHECK(message.sequence_number == (pigeon_sequence_number_t)(count + 1));
+        pigeon_free_parsed_message(&message);
+        ++count;
+    }
+
+    PIGEON_CHECK(status == PIGEON_LOG_END);
+    PIGEON_CHECK(count == MESSAGE_COUNT - 1);
+    PIGEON_CHECK(pigeon_log_reader_pending(&reader) > 0);
+
+    pigeon_log_reader_free(&reader);
+    close(fd);
+    unlink(path);
+}
+
+static void test_scan_and_resync(void)
+{
+    static char log[MESSAGE_COUNT * 512];
+    uint64_t starts[MESSAGE_COUNT];
+    size_t size = write_log(log, sizeof(log), 1, MESSAGE_COUNT, starts);
+
+    pigeon_log_index_t index;
+    pigeon_log_index_init(&index);
+    PIGEON_CHECK(pigeon_log_index_scan(&index, log, size, 0));
+    check_entries(&index, starts, MESSAGE_COUNT);
+    PIGEON_CHECK(index.covered == size - 1);
+
+    // Starting in the middle of a message skips to the next one
+    PIGEON_CHECK(pigeon_log_resync(log, size, starts[5] + 10) == starts[6]);
+    PIGEON_CHECK(pigeon_log_resync(log, size, starts[5]) == starts[5]);
+
+    pigeon_log_index_reset(&index);
+    PIGEON_CHECK(index.count == 0 && index.covered == 0);
+    PIGEON_CHECK(pigeon_log_index_scan(&index, log, size, starts[5] + 10));
+    check_entries(&index, starts + 6, MESSAGE_COUNT - 6);
+
+    pigeon_log_index_free(&index);
+}
+
+static void test_sidecar(void)
+{
+    static char log[MESSAGE_COUNT * 512];
+    uint64_t starts[MESSAGE_COUNT];
+    size_t size = write_log(log, sizeof(log), 1, MESSAGE_COUNT, starts);
+
+    char log_path[256];
+    char sidecar_path[256];
+    pigeon_test_path(log_path, sizeof(log_path), "log");
+    pigeon_test_path(sidecar_path, sizeof(sidecar_path), "log_index");
+
+    // Index the first half, then let the log grow
+    size_t half = starts[MESSAGE_COUNT / 2];
+    PIGEON_CHECK(pigeon_test_write_file(log_path, log, half));
+
+    pigeon_log_index_t index;
+    pigeon_log_index_init(&index);
+    PIGEON_CHECK(pigeon_log_index_file(&index, log_path, 0));
+    PIGEON_CHECK(index.count == MESSAGE_COUNT / 2);
+    PIGEON_CHECK(pigeon_log_index_save(&index, sidecar_path));
+    pigeon_log_index_free(&index);
+
+    PIGEON_CHECK(pigeon_log_index_load(&index, sidecar_path));
+    check_entries(&index, starts, MESSAGE_COUNT / 2);
+    pigeon_log_index_free(&index);
+
+    PIGEON_CHECK(pigeon_test_write_file(log_path, log, size));
+    bool rescanned = true;
+    PIGEON_CHECK(pigeon_log_index_open(&index, sidecar_path, log_path, &rescanned));
+    PIGEON_CHECK(!rescanned);
+    check_entries(&index, starts, MESSAGE_COUNT);
+    pigeon_log_index_free(&index);
+
+    // A log rewritten with different messages invalidates the sidecar
+    static char other[MESSAGE_COUNT * 512];
+    uint64_t other_starts[MESSAGE_COUNT];
+    size_t other_size = write_log(other, sizeof(other), 1000, MESSAGE_COUNT, other_starts);
+    PIGEON_CHECK(pigeon_test_write_file(log_path, other, other_size));
+    PIGEON_CHECK(pigeon_log_index_open(&index, sidecar_path, log_path, &rescanned));
+    PIGEON_CHECK(rescanned);
+    check_entries(&index, other_starts, MESSAGE_COUNT);
+    pigeon_log_index_free(&index);
+
+    // So does a log that shrank below the covered offset
+    PIGEON_CHECK(pigeon_test_write_file(log_path, log, starts[3]));
+    PIGEON_CHECK(pigeon_log_index_open(&index, sidecar_path, log_path, &rescanned));
+    PIGEON_CHECK(rescanned);
+    check_entries(&index, starts, 3);
+    pigeon_log_index_free(&index);
+
+    // A missing sidecar means a full scan
+    unlink(sidecar_path);
+    PIGEON_CHECK(pigeon_log_index_open(&index, sidecar_path, log_path, &rescanned));
+    PIGEON_CHECK(rescanned);
+    check_entries(&index, starts, 3);
+    pigeon_log_index_free(&index);
+
+    unlink(log_path);
+}
+
+static void test_corrupt_sidecar(void)
+{
+    static char log[MESSAGE_COUNT * 512];
+    uint64_t starts[MESSAGE_COUNT];
+    size_t size = write_log(log, sizeof(log), 1, 4, starts);
+
+    pigeon_log_index_t index;
+    pigeon_log_index_init(&index);
+    PIGEON_CHECK(pigeon_log_index_scan(&index, log, size, 0));
+
+    char path[256];
+    pigeon_test_path(path, sizeof(path), "log_index_corrupt");
+    PIGEON_CHECK(pigeon_log_index_save(&index, path));
+    pigeon_log_index_free(&index);
+
+    FILE * file = fopen(path, "rb");
+    PIGEON_CHECK(file != NULL);
+    char sidecar[8 + 8 + 8 + 4 * 12];
+    PIGEON_CHECK(fread(sidecar, 1, sizeof(sidecar), file) == sizeof(sidecar));
+    fclose(file);
+
+    char corrupt[sizeof(sidecar)];
+    uint64_t value;
+
+    // A count larger than the file holds
+    memcpy(corrupt, sidecar, sizeof(sidecar));
+    value = UINT64_MAX / 16;
+    memcpy(corrupt + 16, &value, sizeof(value));
+    PIGEON_CHECK(pigeon_test_write_file(path, corrupt, sizeof(corrupt)));
+    PIGEON_CHECK(!pigeon_log_index_load(&index, path));
+    PIGEON_CHECK(index.count == 0 && index.starts == NULL);
+
+    // A truncated file
+    PIGEON_CHECK(pigeon_test_write_file(path, sidecar, sizeof(sidecar) - 3));
+    PIGEON_CHECK(!pigeon_log_index_load(&index, path));
+
+    // Overlapping entries
+    memcpy(corrupt, sidecar, sizeof(sidecar));
+    memcpy(corrupt + 24 + 8, corrupt + 24, sizeof(uint64_t));
+    PIGEON_CHECK(pigeon_test_write_file(path, corrupt, sizeof(corrupt)));
+    PIGEON_CHECK(!pigeon_log_index_load(&index, path));
+
+    // A covered offset past the last entry
+    memcpy(corrupt, sidecar, sizeof(sidecar));
+    memcpy(&value, corrupt + 8, sizeof(value));
+    value += 100;
+    memcpy(corrupt + 8, &value, sizeof(value));
+    PIGEON_CHECK(pigeon_test_write_file(path, corrupt, sizeof(corrupt)));
+    PIGEON_CHECK(!pigeon_log_index_load(&index, path));
+
+    // The untouched sidecar still loads
+    PIGEON_CHECK(pigeon_test_write_file(path, sidecar, sizeof(sidecar)));
+    PIGEON_CHECK(pigeon_log_index_load(&index, path));
+    check_entries(&index, starts, 4);
+    pigeon_log_index_free(&index);
+
+    unlink(path);
+}
+
+int main(void)
+{
+    test_reader();
+    test_scan_and_resync();
+    test_sidecar();
+    test_corrupt_sidecar();
+    return pigeon_test_result("log_test");
+}
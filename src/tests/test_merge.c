@@ -0,0 +1,111 @@
+#include "pigeon_test.h"
+#include "pigeon_merge.h"
+
+#define FEED_COUNT 12
+#define FEED_MESSAGES 30
+#define MAX_OPEN 3
+
+typedef struct {
+    unsigned count;
+    char last_path[256];
+} skip_report_t;
+
+static void record_skip(void * user_data, const char * path, uint64_t line_number, const char * reason)
+{
+    (void)line_number;
+    (void)reason;
+
+    skip_report_t * report = user_data;
+    ++report->count;
+    snprintf(report->last_path, sizeof(report->last_path), "%s", path);
+}
+
+// Feed f holds messages with timestamps f, f + FEED_COUNT, ..., so the
+// merged timeline visits the feeds round-robin.
+static size_t write_feed(char * restrict log, size_t capacity, int feed)
+{
+    char author[32];
+    snprintf(author, sizeof(author), "feed%02d", feed);
+
+    size_t size = 0;
+    for (int i = 0; i < FEED_MESSAGES; ++i)
+    {
+        if (feed == 3 && i == 10)
+            size += (size_t)snprintf(log + size, capacity - size, "author @ed25519:%s\nbroken line\nsignature %%ed25519:x\n\n", author);
+
+        size += pigeon_test_message(log + size, capacity - size, author, i + 1, (int64_t)i * FEED_COUNT + feed, feed == 5 ? "" : "post", "\"text\":\"\"\n");
+        size += (size_t)snprintf(log + size, capacity - size, "\n");
+    }
+
+    // One feed ends with a message that is still being written
+    if (feed == 7)
+        size += (size_t)snprintf(log + size, capacity - size, "author @ed25519:%s\nsequence 31\n", author);
+
+    return size;
+}
+
+static void test_merge(void)
+{
+    char paths[FEED_COUNT + 1][256];
+    const char * path_list[FEED_COUNT + 1];
+    static char log[FEED_MESSAGES * 512];
+    for (int feed = 0; feed < FEED_COUNT; ++feed)
+    {
+        pigeon_test_path(paths[feed], sizeof(paths[feed]), "merge");
+        PIGEON_CHECK(pigeon_test_write_file(paths[feed], log, write_feed(log, sizeof(log), feed)));
+        path_list[feed] = paths[feed];
+    }
+
+    // An empty feed
+    pigeon_test_path(paths[FEED_COUNT], sizeof(paths[FEED_COUNT]), "merge_empty");
+    PIGEON_CHECK(pigeon_test_write_file(paths[FEED_COUNT], "", 0));
+    path_list[FEED_COUNT] = paths[FEED_COUNT];
+
+    pigeon_merge_t merge;
+    PIGEON_CHECK(pigeon_merge_open(&merge, path_list, FEED_COUNT + 1));
+    merge.max_open = MAX_OPEN;
+
+    skip_report_t report = { 0 };
+    merge.skip_callback = record_skip;
+    merge.skip_user_data = &report;
+
+    const char * msg_data;
+    size_t msg_size;
+    const pigeon_parsed_message_t * message;
+    int64_t expected_timestamp = 0;
+    unsigned empty_kinds = 0;
+    while (pigeon_merge_next(&merge, &msg_data, &msg_size, &message))
+    {
+        PIGEON_CHECK(message->timestamp == expected_timestamp);
+        PIGEON_CHECK(merge.open_count <= MAX_OPEN);
+        PIGEON_CHECK(msg_size > 0 && 0 == memcmp(msg_data, "author ", 7));
+        if (!message->kind)
+            ++empty_kinds;
+
+        ++expected_timestamp;
+    }
+
+    PIGEON_CHECK(merge.error_messages[0] == '\0');
+    PIGEON_CHECK(expected_timestamp == FEED_COUNT * FEED_MESSAGES);
+    PIGEON_CHECK(empty_kinds == FEED_MESSAGES);
+    PIGEON_CHECK(merge.skipped == 2);
+    PIGEON_CHECK(report.count == 2);
+    PIGEON_CHECK_STR(report.last_path, paths[7]);
+    pigeon_merge_close(&merge);
+
+    // A missing input is an error
+    unlink(paths[0]);
+    PIGEON_CHECK(pigeon_merge_open(&merge, path_list, FEED_COUNT + 1));
+    PIGEON_CHECK(!pigeon_merge_next(&merge, &msg_data, &msg_size, &message));
+    PIGEON_CHECK(strstr(merge.error_messages, "unable to open") != NULL);
+    pigeon_merge_close(&merge);
+
+    for (int feed = 0; feed <= FEED_COUNT; ++feed)
+        unlink(paths[feed]);
+}
+
+int main(void)
+{
+    test_merge();
+    return pigeon_test_result("merge_test");
+}
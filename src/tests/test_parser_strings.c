@@ -0,0 +1,74 @@
+#include "pigeon_test.h"
+
+static const pigeon_field_t * find_field(const pigeon_parsed_message_t * restrict message, const char * restrict name)
+{
+    const pigeon_field_t * field = pigeon_list_head((pigeon_list_t *)&message->fields);
+    while (field != NULL && strcmp(field->field_name ? field->field_name : "", name) != 0)
+        field = pigeon_list_next((void *)field);
+
+    return field;
+}
+
+// An escaped quote must be consumed together with its backslash; the string
+// goes on after it rather than ending there.
+static void test_escaped_quotes(void)
+{
+    char text[1024];
+    pigeon_test_message(text, sizeof(text), "escapes", 1, 10, "say \\\"hi\\\"",
+        "\"middle\":\"say \\\"hi\\\" twice\"\n"
+        "\"only\":\"\\\"\"\n"
+        "\"end\":\"quoted \\\"\"\n"
+        "\"after\":\"plain\"\n");
+
+    pigeon_parsed_message_t message;
+    PIGEON_CHECK(pigeon_test_parse(text, &message));
+    PIGEON_CHECK_STR(message.kind, "say \"hi\"");
+
+    const pigeon_field_t * field = find_field(&message, "middle");
+    PIGEON_CHECK(field != NULL && field->field_type == PIGEON_FIELD_STRING);
+    if (field)
+        PIGEON_CHECK_STR(field->field_value.string, "say \"hi\" twice");
+
+    field = find_field(&message, "only");
+    if (field)
+        PIGEON_CHECK_STR(field->field_value.string, "\"");
+    PIGEON_CHECK(field != NULL);
+
+    field = find_field(&message, "end");
+    if (field)
+        PIGEON_CHECK_STR(field->field_value.string, "quoted \"");
+    PIGEON_CHECK(field != NULL);
+
+    field = find_field(&message, "after");
+    if (field)
+        PIGEON_CHECK_STR(field->field_value.string, "plain");
+    PIGEON_CHECK(field != NULL);
+
+    pigeon_free_parsed_message(&message);
+}
+
+static void test_bad_escapes(void)
+{
+    static const char * const fields[] = {
+        "\"text\":\"tab\\there\"\n",   // unsupported escape
+        "\"text\":\"open \\\"\n",      // the escaped quote does not close the string
+    };
+
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i)
+    {
+        char text[1024];
+        size_t size = pigeon_test_message(text, sizeof(text), "escapes", 1, 10, "post", fields[i]);
+
+        pigeon_parse_context_t ctx;
+        pigeon_parsed_message_t message;
+        PIGEON_CHECK(!pigeon_parse_message(&ctx, text, size, &message));
+        pigeon_free_parsed_message(&message);
+    }
+}
+
+int main(void)
+{
+    test_escaped_quotes();
+    test_bad_escapes();
+    return pigeon_test_result("parser_strings_test");
+}
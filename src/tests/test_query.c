@@ -0,0 +1,121 @@
+#include "pigeon_test.h"
+#include "pigeon_query.h"
+
+// Runs a query through the filtered parse; returns -1 on a parse error.
+static int query_matches(const char * restrict text, const char * restrict message)
+{
+    pigeon_query_t query;
+    if (!pigeon_query_compile(&query, text))
+    {
+        fprintf(stderr, "cannot compile '%s': %s\n", text, query.error_messages);
+        return -1;
+    }
+
+    pigeon_parse_context_t ctx;
+    pigeon_parsed_message_t decoded;
+    bool matched = false;
+    int result = pigeon_query_parse_message(&query, &ctx, message, strlen(message), &decoded, &matched) ? matched : -1;
+    pigeon_free_parsed_message(&decoded);
+    pigeon_query_free(&query);
+    return result;
+}
+
+static void test_predicates(void)
+{
+    char message[1024];
+    pigeon_test_message(message, sizeof(message), "carol", 5, 1500, "post", "\"text\":\"hi\"\n");
+
+    PIGEON_CHECK(query_matches("kind == \"post\"", message) == 1);
+    PIGEON_CHECK(query_matches("kind != \"post\"", message) == 0);
+    PIGEON_CHECK(query_matches("timestamp in [1000, 2000)", message) == 1);
+    PIGEON_CHECK(query_matches("timestamp in [1000, 1500)", message) == 0);
+    PIGEON_CHECK(query_matches("timestamp in [1000, 1500]", message) == 1);
+    PIGEON_CHECK(query_matches("sequence >= 5 && sequence < 6", message) == 1);
+    PIGEON_CHECK(query_matches("sequence > 5 || kind == \"like\"", message) == 0);
+    PIGEON_CHECK(query_matches("!(sequence > 5)", message) == 1);
+    PIGEON_CHECK(query_matches("author == @ed25519:carol", message) == 1);
+    PIGEON_CHECK(query_matches("author == @sha256:carol", message) == 0);
+    PIGEON_CHECK(query_matches("author != @ed25519:dave && (kind == \"post\" || kind == \"like\")", message) == 1);
+
+    // An empty kind is parsed as NULL but still compares as ""
+    char anonymous[1024];
+    pigeon_test_message(anonymous, sizeof(anonymous), "carol", 6, 1500, "", "");
+    PIGEON_CHECK(query_matches("kind == \"\"", anonymous) == 1);
+    PIGEON_CHECK(query_matches("kind != \"\"", anonymous) == 0);
+    PIGEON_CHECK(query_matches("kind != \"post\"", anonymous) == 1);
+}
+
+static void test_early_rejection(void)
+{
+    pigeon_query_t query;
+    PIGEON_CHECK(pigeon_query_compile(&query, "sequence == 1 && timestamp > 10"));
+
+    pigeon_parsed_message_t header;
+    memset(&header, 0, sizeof(header));
+    header.sequence_number = 2;
+
+    // Decided as soon as the sequence is known, whatever the timestamp
+    PIGEON_CHECK(pigeon_query_evaluate(&query, &header, 0) == PIGEON_QUERY_UNKNOWN);
+    PIGEON_CHECK(pigeon_query_evaluate(&query, &header, PIGEON_HEADER_SEQUENCE) == PIGEON_QUERY_FALSE);
+    header.sequence_number = 1;
+    PIGEON_CHECK(pigeon_query_evaluate(&query, &header, PIGEON_HEADER_SEQUENCE) == PIGEON_QUERY_UNKNOWN);
+    PIGEON_CHECK(pigeon_query_evaluate(&query, &header, PIGEON_HEADER_SEQUENCE | PIGEON_HEADERS_COMPLETE) == PIGEON_QUERY_FALSE);
+    pigeon_query_free(&query);
+
+    // A rejected message stops before its (here malformed) data fields, and
+    // matched may be omitted
+    const char * broken =
+        "author @ed25519:carol\n"
+        "sequence 9\n"
+        "kind \"post\"\n"
+        "\n"
+        "not a field\n";
+    PIGEON_CHECK(pigeon_query_compile(&query, "sequence < 5"));
+    pigeon_parse_context_t ctx;
+    pigeon_parsed_message_t decoded;
+    bool matched = true;
+    PIGEON_CHECK(pigeon_query_parse_message(&query, &ctx, broken, strlen(broken), &decoded, &matched));
+    PIGEON_CHECK(!matched);
+    pigeon_free_parsed_message(&decoded);
+    PIGEON_CHECK(pigeon_parse_message_filtered(&ctx, broken, strlen(broken), &decoded, pigeon_query_header_filter, &query, NULL));
+    pigeon_free_parsed_message(&decoded);
+    pigeon_query_free(&query);
+}
+
+static void test_compile_errors(void)
+{
+    static const char * const invalid[] = {
+        "",
+        "kind ==",
+        "kind == post",
+        "size == 3",
+        "kind < \"post\"",
+        "sequence in [1, 2",
+        "(sequence == 1",
+        "sequence == 1 &&",
+        "author == @md5:abc",
+        "kind == \"unterminated",
+    };
+
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i)
+    {
+        pigeon_query_t query;
+        bool compiled = pigeon_query_compile(&query, invalid[i]);
+        if (compiled)
+        {
+            fprintf(stderr, "'%s' compiled\n", invalid[i]);
+            pigeon_query_free(&query);
+        }
+        else
+            PIGEON_CHECK(query.error_messages[0] != '\0');
+        PIGEON_CHECK(!compiled);
+    }
+}
+
+int main(void)
+{
+    test_predicates();
+    test_early_rejection();
+    test_compile_errors();
+    return pigeon_test_result("query_test");
+}
@@ -0,0 +1,190 @@
+#include "pigeon_test.h"
+#include "pigeon_reconcile.h"
+
+typedef struct {
+    char text[1024];
+} collected_t;
+
+static bool collect_range(void * user_data, pigeon_range_t range)
+{
+    collected_t * collected = user_data;
+    size_t length = strlen(collected->text);
+    snprintf(collected->text + length, sizeof(collected->text) - length, "%d-%d;", range.first, range.last);
+    return true;
+}
+
+static bool collect_difference(void * user_data, pigeon_reconcile_direction_t direction, const char * author, pigeon_range_t range)
+{
+    collected_t * collected = user_data;
+    size_t length = strlen(collected->text);
+    snprintf(collected->text + length, sizeof(collected->text) - length, "%s %s %d-%d;",
+        direction == PIGEON_RECONCILE_HAVE ? "have" : "need", author, range.first, range.last);
+    return true;
+}
+
+static void test_range_set(void)
+{
+    pigeon_range_set_t set;
+    pigeon_range_set_init(&set, 1);
+
+    PIGEON_CHECK(pigeon_range_set_add(&set, 1, 3));
+    PIGEON_CHECK(pigeon_range_set_add(&set, 4, 4)); // adjacent, extends 1-3
+    PIGEON_CHECK(pigeon_range_set_add(&set, 10, 12));
+    PIGEON_CHECK(pigeon_range_set_add(&set, 7, 7));
+    PIGEON_CHECK(set.count == 3);
+    PIGEON_CHECK(pigeon_range_set_size(&set) == 8);
+    PIGEON_CHECK(pigeon_range_set_contains(&set, 4) && pigeon_range_set_contains(&set, 7));
+    PIGEON_CHECK(!pigeon_range_set_contains(&set, 5) && !pigeon_range_set_contains(&set, 13));
+
+    // The fingerprint depends only on the ranges, not the insertion order
+    pigeon_range_set_t other;
+    pigeon_range_set_init(&other, 1);
+    PIGEON_CHECK(pigeon_range_set_add(&other, 7, 7));
+    PIGEON_CHECK(pigeon_range_set_add(&other, 10, 12));
+    PIGEON_CHECK(pigeon_range_set_add(&other, 2, 4));
+    PIGEON_CHECK(pigeon_range_set_add(&other, 1, 1));
+    PIGEON_CHECK(other.fingerprint == set.fingerprint);
+
+    // Filling the gaps merges everything into one range
+    PIGEON_CHECK(pigeon_range_set_add(&other, 5, 9));
+    PIGEON_CHECK(other.count == 1 && other.ranges[0].first == 1 && other.ranges[0].last == 12);
+
+    collected_t collected = { "" };
+    PIGEON_CHECK(pigeon_range_set_difference(&other, &set, collect_range, &collected));
+    PIGEON_CHECK_STR(collected.text, "5-6;8-9;");
+
+    collected.text[0] = '\0';
+    PIGEON_CHECK(pigeon_range_set_difference(&set, &other, collect_range, &collected));
+    PIGEON_CHECK_STR(collected.text, "");
+
+    pigeon_range_set_free(&set);
+    pigeon_range_set_free(&other);
+}
+
+static bool add_message(pigeon_summary_t * restrict summary, const char * restrict author, int sequence)
+{
+    char text[1024];
+    size_t length = pigeon_test_message(text, sizeof(text), author, sequence, 10, "", "\"\":\"\"\n");
+
+    pigeon_parse_context_t ctx;
+    return pigeon_summary_add_message(summary, &ctx, text, length);
+}
+
+static void test_summary_authors(void)
+{
+    static pigeon_summary_t summary;
+    PIGEON_CHECK(pigeon_summary_init(&summary));
+
+    // An empty author hash still keys a feed of its own
+    PIGEON_CHECK(add_message(&summary, "", 1));
+    PIGEON_CHECK(add_message(&summary, "", 2));
+    const pigeon_summary_feed_t * feed = pigeon_summary_find(&summary, "ed25519:");
+    PIGEON_CHECK(feed != NULL && pigeon_range_set_size(&feed->ranges) == 2);
+
+    // Long authors that only differ at the end are not cut to one key
+    char first[400];
+    char second[400];
+    memset(first, 'a', sizeof(first) - 1);
+    first[sizeof(first) - 1] = '\0';
+    memcpy(second, first, sizeof(second));
+    second[sizeof(second) - 2] = 'b';
+
+    PIGEON_CHECK(add_message(&summary, first, 1));
+    PIGEON_CHECK(add_message(&summary, second, 5));
+    PIGEON_CHECK(summary.feeds.count == 3);
+    PIGEON_CHECK(summary.messages == 4);
+
+    char key[512];
+    snprintf(key, sizeof(key), "ed25519:%s", second);
+    feed = pigeon_summary_find(&summary, key);
+    PIGEON_CHECK(feed != NULL && feed->ranges.count == 1 && feed->ranges.ranges[0].first == 5);
+
+    // A message without a sequence is refused
+    const char * broken = "author @ed25519:x\nkind \"\"\n";
+    pigeon_parse_context_t ctx;
+    PIGEON_CHECK(!pigeon_summary_add_message(&summary, &ctx, broken, strlen(broken)));
+
+    pigeon_summary_free(&summary);
+}
+
+// Fingerprints are exchanged between nodes, so their values must not change
+// from one build to the next.
+static void test_known_answers(void)
+{
+    static pigeon_summary_t summary;
+    PIGEON_CHECK(pigeon_summary_init(&summary));
+    PIGEON_CHECK(pigeon_summary_add(&summary, "ed25519:abc", 1, 3));
+    PIGEON_CHECK(pigeon_summary_add(&summary, "ed25519:abc", 7, 7));
+    PIGEON_CHECK(pigeon_summary_add(&summary, "ed25519:", 1, 1));
+
+    const pigeon_summary_feed_t * feed = pigeon_summary_find(&summary, "ed25519:abc");
+    PIGEON_CHECK(feed != NULL);
+    if (feed)
+    {
+        PIGEON_CHECK(feed->ranges.seed == 0xaeff64d711f48c1aull);
+        PIGEON_CHECK(feed->ranges.fingerprint == 0x03dc20b37f4544ecull);
+        PIGEON_CHECK(summary.buckets[0xc1a] == 0x03dc20b37f4544ecull);
+        PIGEON_CHECK(summary.blocks[0xc1a / PIGEON_RECONCILE_FANOUT] == 0x03dc20b37f4544ecull);
+    }
+
+    feed = pigeon_summary_find(&summary, "ed25519:");
+    PIGEON_CHECK(feed != NULL);
+    if (feed)
+    {
+        PIGEON_CHECK(feed->ranges.seed == 0x25b8f250f3dc4971ull);
+        PIGEON_CHECK(feed->ranges.fingerprint == 0xfe4b89c23ea5855full);
+    }
+
+    pigeon_summary_free(&summary);
+}
+
+static void test_reconcile(void)
+{
+    static pigeon_summary_t local;
+    static pigeon_summary_t remote;
+    PIGEON_CHECK(pigeon_summary_init(&local));
+    PIGEON_CHECK(pigeon_summary_init(&remote));
+
+    PIGEON_CHECK(pigeon_summary_add(&local, "ed25519:a", 1, 10));
+    PIGEON_CHECK(pigeon_summary_add(&local, "ed25519:", 1, 2));
+    PIGEON_CHECK(pigeon_summary_add(&remote, "ed25519:a", 1, 5));
+    PIGEON_CHECK(pigeon_summary_add(&remote, "ed25519:a", 8, 12));
+    PIGEON_CHECK(pigeon_summary_add(&remote, "ed25519:b", 1, 3));
+    PIGEON_CHECK(pigeon_summary_add(&remote, "ed25519:", 1, 2));
+
+    pigeon_reconcile_peer_t peer;
+    pigeon_reconcile_local_peer(&peer, &remote);
+
+    collected_t collected = { "" };
+    pigeon_reconcile_stats_t stats;
+    PIGEON_CHECK(pigeon_reconcile(&local, &peer, collect_difference, &collected, &stats));
+    PIGEON_CHECK(strstr(collected.text, "have ed25519:a 6-7;") != NULL);
+    PIGEON_CHECK(strstr(collected.text, "need ed25519:a 11-12;") != NULL);
+    PIGEON_CHECK(strstr(collected.text, "need ed25519:b 1-3;") != NULL);
+    PIGEON_CHECK(strstr(collected.text, "ed25519: ") == NULL);
+    PIGEON_CHECK(stats.have_ranges == 1 && stats.have_messages == 2);
+    PIGEON_CHECK(stats.need_ranges == 2 && stats.need_messages == 5);
+
+    // Once both sides hold the same, one exchange of block fingerprints
+    // settles it
+    PIGEON_CHECK(pigeon_summary_add(&local, "ed25519:a", 11, 12));
+    PIGEON_CHECK(pigeon_summary_add(&local, "ed25519:b", 1, 3));
+    PIGEON_CHECK(pigeon_summary_add(&remote, "ed25519:a", 6, 7));
+
+    collected.text[0] = '\0';
+    PIGEON_CHECK(pigeon_reconcile(&local, &peer, collect_difference, &collected, &stats));
+    PIGEON_CHECK_STR(collected.text, "");
+    PIGEON_CHECK(stats.round_trips == 1 && stats.feeds == 0);
+
+    pigeon_summary_free(&local);
+    pigeon_summary_free(&remote);
+}
+
+int main(void)
+{
+    test_range_set();
+    test_summary_authors();
+    test_known_answers();
+    test_reconcile();
+    return pigeon_test_result("reconcile_test");
+}
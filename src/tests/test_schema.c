@@ -0,0 +1,173 @@
+#include "pigeon_test.h"
+#include "pigeon_schema.h"
+
+static const pigeon_schema_field_t post_fields[] = {
+    { .name = "text", .type = PIGEON_FIELD_STRING, .required = true, .max_length = 5 },
+    { .name = "count", .type = PIGEON_FIELD_INT64, .bounded = true, .min = 1, .max = 10 },
+    { .name = "ref", .type = PIGEON_FIELD_BLOB }
+};
+
+static const pigeon_schema_field_t note_fields[] = {
+    { .name = "text", .type = PIGEON_FIELD_STRING }
+};
+
+// Parses a message of the given kind against registry; on failure, error
+// receives the parser's message without its position prefix.
+static bool check(const pigeon_schema_registry_t * restrict registry, const char * restrict kind, const char * restrict fields, char * restrict error, size_t error_size)
+{
+    char text[2048];
+    size_t length = pigeon_test_message(text, sizeof(text), "schema", 1, 10, kind, fields);
+
+    pigeon_parse_context_t ctx;
+    pigeon_parsed_message_t message;
+    bool success = pigeon_parse_message_checked(&ctx, text, length, &message, registry);
+    pigeon_free_parsed_message(&message);
+
+    error[0] = '\0';
+    if (!success)
+        snprintf(error, error_size, "%s", pigeon_get_error_messages(&ctx));
+    return success;
+}
+
+static void expect_error(const pigeon_schema_registry_t * restrict registry, const char * restrict kind, const char * restrict fields, const char * restrict expected)
+{
+    char error[512];
+    PIGEON_CHECK(!check(registry, kind, fields, error, sizeof(error)));
+    if (strstr(error, expected) == NULL)
+    {
+        fprintf(stderr, "expected an error containing \"%s\", got \"%s\"\n", expected, error);
+        ++pigeon_test_failures;
+    }
+}
+
+static void expect_ok(const pigeon_schema_registry_t * restrict registry, const char * restrict kind, const char * restrict fields)
+{
+    char error[512];
+    bool success = check(registry, kind, fields, error, sizeof(error));
+    PIGEON_CHECK(success);
+    if (!success)
+        fprintf(stderr, "unexpected error: %s\n", error);
+}
+
+static void test_registry(void)
+{
+    pigeon_schema_registry_t registry;
+    PIGEON_CHECK(pigeon_schema_registry_init(&registry, 0));
+    PIGEON_CHECK(pigeon_schema_registry_add(&registry, "post", post_fields, 3, 0));
+    PIGEON_CHECK(pigeon_schema_registry_find(&registry, "post") != NULL);
+    PIGEON_CHECK(pigeon_schema_registry_find(&registry, "note") == NULL);
+
+    PIGEON_CHECK(!pigeon_schema_registry_add(&registry, "post", post_fields, 3, 0));
+    PIGEON_CHECK(strstr(registry.error_messages, "already has a schema") != NULL);
+
+    pigeon_schema_field_t unnamed[] = { { .name = "", .type = PIGEON_FIELD_STRING } };
+    PIGEON_CHECK(!pigeon_schema_registry_add(&registry, "unnamed", unnamed, 1, 0));
+    PIGEON_CHECK(strstr(registry.error_messages, "has no name") != NULL);
+    unnamed[0].name = NULL;
+    PIGEON_CHECK(!pigeon_schema_registry_add(&registry, "unnamed", unnamed, 1, 0));
+
+    pigeon_schema_field_t twice[] = { { .name = "a", .type = PIGEON_FIELD_STRING }, { .name = "a", .type = PIGEON_FIELD_INT64 } };
+    PIGEON_CHECK(!pigeon_schema_registry_add(&registry, "twice", twice, 2, 0));
+    PIGEON_CHECK(strstr(registry.error_messages, "listed twice") != NULL);
+
+    pigeon_schema_field_t empty_range[] = { { .name = "n", .type = PIGEON_FIELD_INT64, .bounded = true, .min = 2, .max = 1 } };
+    PIGEON_CHECK(!pigeon_schema_registry_add(&registry, "range", empty_range, 1, 0));
+    PIGEON_CHECK(strstr(registry.error_messages, "empty range") != NULL);
+
+    static pigeon_schema_field_t many[PIGEON_SCHEMA_MAX_FIELDS + 1];
+    static char names[PIGEON_SCHEMA_MAX_FIELDS + 1][8];
+    for (int i = 0; i <= PIGEON_SCHEMA_MAX_FIELDS; ++i)
+    {
+        snprintf(names[i], sizeof(names[i]), "f%d", i);
+        many[i].name = names[i];
+        many[i].type = PIGEON_FIELD_INT64;
+        many[i].required = true;
+    }
+
+    PIGEON_CHECK(!pigeon_schema_registry_add(&registry, "many", many, PIGEON_SCHEMA_MAX_FIELDS + 1, 0));
+    PIGEON_CHECK(pigeon_schema_registry_add(&registry, "many", many, PIGEON_SCHEMA_MAX_FIELDS, 0));
+
+    // Every name of a full schema resolves to its own rule
+    const pigeon_schema_t * schema = pigeon_schema_registry_find(&registry, "many");
+    PIGEON_CHECK(schema != NULL);
+    for (int i = 0; schema && i < PIGEON_SCHEMA_MAX_FIELDS; ++i)
+        PIGEON_CHECK(pigeon_schema_lookup(schema, names[i], strlen(names[i])) == i);
+    PIGEON_CHECK(schema && pigeon_schema_lookup(schema, "", 0) == -1);
+
+    // The last required field is still reported missing with 64 rules
+    char fields[2048] = "";
+    for (int i = 0; i < PIGEON_SCHEMA_MAX_FIELDS - 1; ++i)
+    {
+        size_t length = strlen(fields);
+        snprintf(fields + length, sizeof(fields) - length, "\"f%d\":%d\n", i, i);
+    }
+
+    expect_error(&registry, "many", fields, "required field 'f63' is missing");
+
+    pigeon_schema_registry_free(&registry);
+}
+
+static void test_fields(void)
+{
+    pigeon_schema_registry_t registry;
+    PIGEON_CHECK(pigeon_schema_registry_init(&registry, 0));
+    PIGEON_CHECK(pigeon_schema_registry_add(&registry, "post", post_fields, 3, 0));
+    PIGEON_CHECK(pigeon_schema_registry_add(&registry, "note", note_fields, 1, PIGEON_SCHEMA_ALLOW_EXTRA));
+    PIGEON_CHECK(pigeon_schema_registry_add(&registry, "", note_fields, 1, 0));
+
+    expect_ok(&registry, "post", "\"text\":\"hello\"\n\"count\":10\n");
+    expect_ok(&registry, "post", "\"count\":1\n\"text\":\"\"\n");
+    expect_ok(&registry, "post", "\"text\":\"hi\"\n\"ref\":&sha256:2cf24dba5fb0a30e26e83b2ac5b9e29e1b161e5c1fa7425e73043362938b9824\n");
+
+    // Required
+    expect_error(&registry, "post", "", "required field 'text' is missing");
+    expect_error(&registry, "post", "\"count\":1\n", "required field 'text' is missing");
+
+    // Extra, including a field with an empty name
+    expect_error(&registry, "post", "\"text\":\"hi\"\n\"other\":1\n", "field 'other' is not allowed for kind 'post'");
+    expect_error(&registry, "post", "\"\":\"hi\"\n", "field '' is not allowed for kind 'post'");
+    expect_error(&registry, "post", "\"text\":\"hi\"\n\"\":\"\"\n", "field '' is not allowed for kind 'post'");
+    expect_ok(&registry, "note", "\"\":\"\"\n\"other\":1\n");
+    expect_ok(&registry, "note", "\"text\":\"\"\n\"\":5\n");
+
+    // Duplicates and types
+    expect_error(&registry, "post", "\"text\":\"a\"\n\"text\":\"b\"\n", "duplicate field 'text'");
+    expect_error(&registry, "post", "\"text\":5\n", "field 'text' must be STRING, not INT64");
+    expect_error(&registry, "post", "\"text\":\"a\"\n\"count\":\"1\"\n", "field 'count' must be INT64, not STRING");
+
+    // Bounded
+    expect_error(&registry, "post", "\"text\":\"a\"\n\"count\":11\n", "field 'count' value 11 is outside [1, 10]");
+    expect_error(&registry, "post", "\"text\":\"a\"\n\"count\":0\n", "field 'count' value 0 is outside [1, 10]");
+
+    // Max length
+    expect_error(&registry, "post", "\"text\":\"hello!\"\n", "field 'text' is 6 bytes long, more than 5");
+    expect_ok(&registry, "post", "\"text\":\"he\\\"lo\"\n");
+
+    // An empty kind has its own schema; kinds without one pass unchecked
+    expect_ok(&registry, "", "\"text\":\"\"\n");
+    expect_error(&registry, "", "\"\":\"\"\n", "field '' is not allowed for kind ''");
+    expect_ok(&registry, "other", "\"\":\"\"\n\"anything\":1\n");
+
+    pigeon_schema_registry_free(&registry);
+}
+
+static void test_require_kind(void)
+{
+    pigeon_schema_registry_t registry;
+    PIGEON_CHECK(pigeon_schema_registry_init(&registry, PIGEON_SCHEMA_REQUIRE_KIND));
+    PIGEON_CHECK(pigeon_schema_registry_add(&registry, "note", note_fields, 1, 0));
+
+    expect_ok(&registry, "note", "\"text\":\"x\"\n");
+    expect_error(&registry, "other", "\"text\":\"x\"\n", "no schema for kind 'other'");
+    expect_error(&registry, "", "", "no schema for kind ''");
+
+    pigeon_schema_registry_free(&registry);
+}
+
+int main(void)
+{
+    test_registry();
+    test_fields();
+    test_require_kind();
+    return pigeon_test_result("schema_test");
+}
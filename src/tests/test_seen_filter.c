@@ -0,0 +1,116 @@
+#include "pigeon_test.h"
+#include "pigeon_hash.h"
+#include "pigeon_seen_filter.h"
+
+static uint64_t text_key(const char * restrict text)
+{
+    uint64_t key = 0;
+    PIGEON_CHECK(pigeon_message_key(text, strlen(text), &key));
+    return key;
+}
+
+static uint64_t parsed_key(const char * restrict text)
+{
+    pigeon_parsed_message_t message;
+    uint64_t key = 0;
+    if (pigeon_test_parse(text, &message))
+        key = pigeon_message_key_of(&message);
+    else
+        PIGEON_CHECK(!"message parses");
+
+    pigeon_free_parsed_message(&message);
+    return key;
+}
+
+static void test_keys(void)
+{
+    char message[1024];
+    char fork[1024];
+    char other[1024];
+    pigeon_test_message(message, sizeof(message), "alice", 7, 100, "post", "\"text\":\"one\"\n");
+    pigeon_test_message(other, sizeof(other), "alice", 8, 100, "post", "\"text\":\"one\"\n");
+
+    // Same author and sequence, different content and signature
+    pigeon_test_message(fork, sizeof(fork), "alice", 7, 100, "post", "\"text\":\"two\"\n");
+    char * signature = strstr(fork, "signature");
+    signature[strlen(signature) - 2] = 'X';
+
+    PIGEON_CHECK(text_key(message) == parsed_key(message));
+    PIGEON_CHECK(text_key(fork) == parsed_key(fork));
+    PIGEON_CHECK(text_key(message) != text_key(fork));
+    PIGEON_CHECK(text_key(message) != text_key(other));
+
+    // Blanks the parser accepts inside encoded values do not change the key
+    const char * spaced =
+        "author @ ed25519 : alice  \n"
+        "sequence 7\n"
+        "kind \"post\"\n"
+        "previous %sha256:0000000000000000000000000000000000000000000000000000000000000006\n"
+        "timestamp 100\n"
+        "\n"
+        "\"text\":\"one\"\n"
+        "\n"
+        "signature % ed25519 : sigalice7\n";
+    PIGEON_CHECK(text_key(spaced) == parsed_key(spaced));
+    PIGEON_CHECK(text_key(spaced) == text_key(message));
+
+    // Each part of the key is required
+    const char * unsigned_message = "author @ed25519:a\nsequence 1\n\n";
+    const char * anonymous = "sequence 1\n\n\nsignature %ed25519:x\n";
+    uint64_t key;
+    PIGEON_CHECK(!pigeon_message_key(unsigned_message, strlen(unsigned_message), &key));
+    PIGEON_CHECK(!pigeon_message_key(anonymous, strlen(anonymous), &key));
+
+    // The author key hashes the same text as pigeon_encoded_value_key
+    pigeon_parsed_message_t parsed;
+    PIGEON_CHECK(pigeon_test_parse(spaced, &parsed));
+    pigeon_string_t author;
+    pigeon_string_init(&author);
+    uint64_t author_key = pigeon_hash_str(PIGEON_HASH_INIT, pigeon_encoded_value_key(&parsed.author, &author));
+    PIGEON_CHECK(pigeon_message_author_key_of(&parsed) == author_key);
+    PIGEON_CHECK(pigeon_message_author_key(spaced, strlen(spaced), &key) && key == author_key);
+    PIGEON_CHECK(pigeon_message_author_key(fork, strlen(fork), &key) && key == author_key);
+    PIGEON_CHECK(pigeon_message_author_key(unsigned_message, strlen(unsigned_message), &key) && key != author_key);
+    PIGEON_CHECK(!pigeon_message_author_key(anonymous, strlen(anonymous), &key));
+    pigeon_string_free(&author);
+    pigeon_free_parsed_message(&parsed);
+}
+
+static void test_filter(void)
+{
+    pigeon_seen_filter_t filter;
+    PIGEON_CHECK(pigeon_seen_filter_init(&filter, 1000));
+
+    char message[1024];
+    char fork[1024];
+    pigeon_test_message(message, sizeof(message), "bob", 1, 100, "post", "");
+    pigeon_test_message(fork, sizeof(fork), "bob", 1, 100, "post", "\"x\":1\n");
+    char * signature = strstr(fork, "signature");
+    signature[strlen(signature) - 2] = 'Y';
+
+    PIGEON_CHECK(!pigeon_seen_filter_check_message(&filter, message, strlen(message)));
+    PIGEON_CHECK(pigeon_seen_filter_check_message(&filter, message, strlen(message)));
+    PIGEON_CHECK(!pigeon_seen_filter_check_message(&filter, fork, strlen(fork)));
+    PIGEON_CHECK(pigeon_seen_filter_contains(&filter, text_key(fork)));
+
+    // Keys survive one rotation and age out after two
+    uint64_t first = text_key(message);
+    unsigned false_positives = 0;
+    for (uint64_t i = 1; i < 1000; ++i)
+        false_positives += pigeon_seen_filter_check_and_insert(&filter, pigeon_hash_mix(i));
+    PIGEON_CHECK(pigeon_seen_filter_contains(&filter, first));
+    PIGEON_CHECK(false_positives < 50);
+
+    for (uint64_t i = 1000; i < 3000; ++i)
+        pigeon_seen_filter_check_and_insert(&filter, pigeon_hash_mix(i));
+    PIGEON_CHECK(!pigeon_seen_filter_contains(&filter, first));
+
+    pigeon_seen_filter_free(&filter);
+}
+
+int main(void)
+{
+    test_keys();
+    test_filter();
+    return pigeon_test_result("seen_filter_test");
+}
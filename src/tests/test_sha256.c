@@ -0,0 +1,75 @@
+#include "pigeon_test.h"
+#include "pigeon_memory.h"
+#include "pigeon_sha256.h"
+
+static void check_digest(const void * restrict data, size_t size, const char * restrict expected)
+{
+    unsigned char digest[PIGEON_SHA256_DIGEST_SIZE];
+    char text[PIGEON_SHA256_DIGEST_SIZE * 2 + 1];
+
+    pigeon_sha256(data, size, digest);
+    pigeon_sha256_format_hex(digest, text);
+    PIGEON_CHECK_STR(text, expected);
+
+    // Every split point has to give the same digest as the one-shot call
+    for (size_t split = 0; split <= size && split < 200; ++split)
+    {
+        pigeon_sha256_t sha;
+        pigeon_sha256_init(&sha);
+        pigeon_sha256_update(&sha, data, split);
+        pigeon_sha256_update(&sha, (const unsigned char *)data + split, size - split);
+        pigeon_sha256_final(&sha, digest);
+        pigeon_sha256_format_hex(digest, text);
+        PIGEON_CHECK_STR(text, expected);
+    }
+}
+
+static void test_vectors(void)
+{
+    check_digest("", 0, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    check_digest("abc", 3, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    const char * two_blocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    check_digest(two_blocks, strlen(two_blocks), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+    size_t size = 1000000;
+    char * million = pigeon_malloc(size);
+    PIGEON_CHECK(million != NULL);
+    if (million)
+    {
+        memset(million, 'a', size);
+        check_digest(million, size, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+        pigeon_free(million);
+    }
+}
+
+static void test_decode(void)
+{
+    unsigned char digest[PIGEON_SHA256_DIGEST_SIZE];
+    char text[PIGEON_SHA256_DIGEST_SIZE * 2 + 1];
+    const char * empty_hex = "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855";
+
+    PIGEON_CHECK(pigeon_sha256_decode(empty_hex, digest));
+    pigeon_sha256_format_hex(digest, text);
+    PIGEON_CHECK_STR(text, empty_hex);
+
+    memset(digest, 0, sizeof(digest));
+    PIGEON_CHECK(pigeon_sha256_decode("47DEQpj8HBSa+/TImW+5JCeuQeRkm5NMpJWZG3hSuFU=", digest));
+    pigeon_sha256_format_hex(digest, text);
+    PIGEON_CHECK_STR(text, empty_hex);
+
+    memset(digest, 0, sizeof(digest));
+    PIGEON_CHECK(pigeon_sha256_decode("47DEQpj8HBSa-_TImW-5JCeuQeRkm5NMpJWZG3hSuFU", digest));
+    pigeon_sha256_format_hex(digest, text);
+    PIGEON_CHECK_STR(text, empty_hex);
+
+    PIGEON_CHECK(!pigeon_sha256_decode("", digest));
+    PIGEON_CHECK(!pigeon_sha256_decode("e3b0c442", digest));
+}
+
+int main(void)
+{
+    test_vectors();
+    test_decode();
+    return pigeon_test_result("sha256_test");
+}
@@ -0,0 +1,112 @@
+#include "pigeon_test.h"
+#include "pigeon_seen_filter.h"
+#include "pigeon_shm_cache.h"
+
+#define SLOT_CAPACITY 1024
+
+static _Alignas(8) char buffer[SLOT_CAPACITY];
+
+static void test_empty_names(const char * restrict name)
+{
+    pigeon_shm_cache_t cache;
+    PIGEON_CHECK(pigeon_shm_cache_create(&cache, name, 4, SLOT_CAPACITY));
+
+    char text[1024];
+    size_t length = pigeon_test_message(text, sizeof(text), "shm", 1, 10, "", "\"\":\"unnamed\"\n\"empty\":\"\"\n\"\":7\n");
+
+    pigeon_parse_context_t ctx;
+    uint64_t position = 99;
+    PIGEON_CHECK(pigeon_shm_cache_parse(&cache, &ctx, text, length, &position));
+    PIGEON_CHECK(position == 0);
+    PIGEON_CHECK(pigeon_shm_cache_head(&cache) == 1);
+
+    // Readers attach to the same segment read-only
+    pigeon_shm_cache_t reader;
+    PIGEON_CHECK(pigeon_shm_cache_attach(&reader, name));
+
+    uint64_t key;
+    PIGEON_CHECK(pigeon_message_key(text, length, &key));
+
+    size_t size = 0;
+    PIGEON_CHECK(pigeon_shm_cache_lookup(&reader, key, buffer, sizeof(buffer), &size) == PIGEON_SHM_CACHE_OK);
+    PIGEON_CHECK(pigeon_shm_cache_lookup(&reader, key + 1, buffer, sizeof(buffer), &size) == PIGEON_SHM_CACHE_NOT_FOUND);
+    PIGEON_CHECK(pigeon_shm_cache_lookup(&reader, key, buffer, 8, &size) == PIGEON_SHM_CACHE_TOO_SMALL);
+    PIGEON_CHECK(size > 8 && size <= SLOT_CAPACITY);
+
+    PIGEON_CHECK(pigeon_shm_cache_read(&reader, 0, buffer, sizeof(buffer), &size) == PIGEON_SHM_CACHE_OK);
+    pigeon_parsed_message_t message;
+    PIGEON_CHECK(pigeon_compact_message_expand((const pigeon_compact_message_t *)buffer, &message));
+
+    PIGEON_CHECK(message.kind == NULL);
+    PIGEON_CHECK(message.sequence_number == 1);
+    const pigeon_field_t * field = pigeon_list_head(&message.fields);
+    PIGEON_CHECK(field && field->field_name == NULL && field->field_type == PIGEON_FIELD_STRING);
+    PIGEON_CHECK_STR(field ? field->field_value.string : NULL, "unnamed");
+    field = field ? pigeon_list_next((void *)field) : NULL;
+    PIGEON_CHECK_STR(field ? field->field_name : NULL, "empty");
+    PIGEON_CHECK(field && field->field_type == PIGEON_FIELD_STRING && field->field_value.string == NULL);
+    field = field ? pigeon_list_next((void *)field) : NULL;
+    PIGEON_CHECK(field && field->field_name == NULL && field->field_type == PIGEON_FIELD_INT64 && field->field_value.int64_ == 7);
+    PIGEON_CHECK(pigeon_message_key_of(&message) == key);
+
+    // The read-only side cannot publish
+    PIGEON_CHECK(!pigeon_shm_cache_publish(&reader, &message, NULL));
+    pigeon_free_parsed_message(&message);
+
+    pigeon_shm_cache_close(&reader);
+    pigeon_shm_cache_close(&cache);
+}
+
+static void test_ring(const char * restrict name)
+{
+    pigeon_shm_cache_t cache;
+    PIGEON_CHECK(pigeon_shm_cache_create(&cache, name, 3, SLOT_CAPACITY));
+
+    // Three slots round up to four; publish six messages around the ring
+    uint64_t keys[6];
+    for (int i = 0; i < 6; ++i)
+    {
+        char text[1024];
+        size_t length = pigeon_test_message(text, sizeof(text), "ring", i + 1, 10 + i, "post", "\"\":\"\"\n");
+        pigeon_parse_context_t ctx;
+        uint64_t position;
+        PIGEON_CHECK(pigeon_shm_cache_parse(&cache, &ctx, text, length, &position));
+        PIGEON_CHECK(position == (uint64_t)i);
+        PIGEON_CHECK(pigeon_message_key(text, length, &keys[i]));
+    }
+
+    size_t size;
+    PIGEON_CHECK(pigeon_shm_cache_tail(&cache) == 2);
+    PIGEON_CHECK(pigeon_shm_cache_read(&cache, 1, buffer, sizeof(buffer), &size) == PIGEON_SHM_CACHE_OVERWRITTEN);
+    PIGEON_CHECK(pigeon_shm_cache_read(&cache, 6, buffer, sizeof(buffer), &size) == PIGEON_SHM_CACHE_PENDING);
+    PIGEON_CHECK(pigeon_shm_cache_lookup(&cache, keys[0], buffer, sizeof(buffer), &size) == PIGEON_SHM_CACHE_NOT_FOUND);
+
+    PIGEON_CHECK(pigeon_shm_cache_lookup(&cache, keys[5], buffer, sizeof(buffer), &size) == PIGEON_SHM_CACHE_OK);
+    const pigeon_compact_message_t * compact = (const pigeon_compact_message_t *)buffer;
+    PIGEON_CHECK(compact->sequence_number == 6 && compact->field_count == 1);
+    PIGEON_CHECK(compact->fields[0].name.length == 0 && compact->fields[0].value.string.length == 0);
+
+    // A message too large for a slot is refused, the ring left as it was
+    static char large[4 * SLOT_CAPACITY];
+    char fields[2 * SLOT_CAPACITY];
+    snprintf(fields, sizeof(fields), "\"\":\"%0*d\"\n", SLOT_CAPACITY, 0);
+    size_t length = pigeon_test_message(large, sizeof(large), "ring", 7, 20, "post", fields);
+    pigeon_parse_context_t ctx;
+    PIGEON_CHECK(!pigeon_shm_cache_parse(&cache, &ctx, large, length, NULL));
+    PIGEON_CHECK(strstr(cache.error_messages, "does not fit") != NULL);
+    PIGEON_CHECK(pigeon_shm_cache_head(&cache) == 6);
+
+    pigeon_shm_cache_close(&cache);
+}
+
+int main(void)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/pigeon_shm_test_%ld", (long)getpid());
+
+    test_empty_names(name);
+    test_ring(name);
+
+    pigeon_shm_cache_unlink(name);
+    return pigeon_test_result("shm_cache_test");
+}
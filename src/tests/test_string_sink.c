@@ -0,0 +1,133 @@
+#include "pigeon_test.h"
+#include "pigeon_memory.h"
+
+// Records what a string sink receives: the pieces joined with '|', and the
+// name and delivered count of the field at each call.
+typedef struct {
+    char pieces[512];
+    char names[256];
+    unsigned calls;
+    unsigned last_calls;
+    unsigned abort_after;
+    bool order_ok;
+} recorder_t;
+
+static bool record_piece(void * user_data, const pigeon_field_t * field, const char * chunk, size_t size, bool last)
+{
+    recorder_t * recorder = user_data;
+    size_t length = strlen(recorder->pieces);
+    snprintf(recorder->pieces + length, sizeof(recorder->pieces) - length, "%.*s%s", (int)size, chunk, last ? ";" : "|");
+
+    // A new value starts with nothing delivered yet
+    bool first = length == 0 || recorder->pieces[length - 1] == ';';
+    if (field->field_type != PIGEON_FIELD_STREAMED || (first && field->field_value.int64_ != 0))
+        recorder->order_ok = false;
+    if (first)
+    {
+        length = strlen(recorder->names);
+        snprintf(recorder->names + length, sizeof(recorder->names) - length, "[%s]", field->field_name ? field->field_name : "");
+    }
+
+    ++recorder->calls;
+    if (last)
+        ++recorder->last_calls;
+    return recorder->abort_after == 0 || recorder->calls < recorder->abort_after;
+}
+
+static bool parse_streamed(const char * restrict fields, size_t threshold, recorder_t * restrict recorder, pigeon_parsed_message_t * restrict message, pigeon_parse_context_t * restrict ctx)
+{
+    char text[2048];
+    pigeon_test_message(text, sizeof(text), "sink", 1, 10, "post", fields);
+
+    unsigned abort_after = recorder->abort_after;
+    memset(recorder, 0, sizeof(*recorder));
+    recorder->abort_after = abort_after;
+    recorder->order_ok = true;
+
+    pigeon_string_sink_t sink = { threshold, record_piece, recorder };
+    return pigeon_parse_message_streamed(ctx, text, strlen(text), message, &sink);
+}
+
+static const pigeon_field_t * field_at(const pigeon_parsed_message_t * restrict message, unsigned index)
+{
+    const pigeon_field_t * field = pigeon_list_head((pigeon_list_t *)&message->fields);
+    while (field && index-- > 0)
+        field = pigeon_list_next((void *)field);
+    return field;
+}
+
+static void test_pieces(void)
+{
+    recorder_t recorder = { .abort_after = 0 };
+    pigeon_parsed_message_t message;
+    pigeon_parse_context_t ctx;
+
+    bool parsed = parse_streamed(
+        "\"empty\":\"\"\n"
+        "\"fits\":\"abcd\"\n"
+        "\"long\":\"abcdefghij\"\n"
+        "\"\":\"0123456789\"\n"
+        "\"quote\":\"abc\\\"defgh\"\n"
+        "\"number\":42\n", 4, &recorder, &message, &ctx);
+    PIGEON_CHECK(parsed);
+    PIGEON_CHECK_STR(recorder.pieces, "abcd|efgh|ij;0123|4567|89;abc\"|defg|h;");
+    PIGEON_CHECK_STR(recorder.names, "[long][][quote]");
+    PIGEON_CHECK(recorder.last_calls == 3);
+    PIGEON_CHECK(recorder.order_ok);
+
+    // Short values stay ordinary strings, an empty one NULL
+    const pigeon_field_t * field = field_at(&message, 0);
+    PIGEON_CHECK(field && field->field_type == PIGEON_FIELD_STRING && field->field_value.string == NULL);
+    field = field_at(&message, 1);
+    PIGEON_CHECK(field && field->field_type == PIGEON_FIELD_STRING);
+    PIGEON_CHECK_STR(field ? field->field_value.string : NULL, "abcd");
+
+    // Streamed values keep only their length
+    field = field_at(&message, 2);
+    PIGEON_CHECK(field && field->field_type == PIGEON_FIELD_STREAMED && field->field_value.int64_ == 10);
+    field = field_at(&message, 3);
+    PIGEON_CHECK(field && field->field_type == PIGEON_FIELD_STREAMED && field->field_name == NULL && field->field_value.int64_ == 10);
+    field = field_at(&message, 4);
+    PIGEON_CHECK(field && field->field_type == PIGEON_FIELD_STREAMED && field->field_value.int64_ == 9);
+    field = field_at(&message, 5);
+    PIGEON_CHECK(field && field->field_type == PIGEON_FIELD_INT64 && field->field_value.int64_ == 42);
+    PIGEON_CHECK(field_at(&message, 6) == NULL);
+
+    pigeon_free_parsed_message(&message);
+}
+
+static void test_no_threshold(void)
+{
+    recorder_t recorder = { .abort_after = 0 };
+    pigeon_parsed_message_t message;
+    pigeon_parse_context_t ctx;
+
+    // A threshold of 0 collects every value as usual
+    PIGEON_CHECK(parse_streamed("\"long\":\"abcdefghij\"\n", 0, &recorder, &message, &ctx));
+    PIGEON_CHECK(recorder.calls == 0);
+    const pigeon_field_t * field = field_at(&message, 0);
+    PIGEON_CHECK_STR(field && field->field_type == PIGEON_FIELD_STRING ? field->field_value.string : NULL, "abcdefghij");
+    pigeon_free_parsed_message(&message);
+}
+
+static void test_abort(void)
+{
+    recorder_t recorder = { .abort_after = 2 };
+    pigeon_parsed_message_t message;
+    pigeon_parse_context_t ctx;
+
+    PIGEON_CHECK(!parse_streamed("\"\":\"abcdefghijkl\"\n", 4, &recorder, &message, &ctx));
+    PIGEON_CHECK(recorder.calls == 2);
+    PIGEON_CHECK(strstr(pigeon_get_error_messages(&ctx), "aborted by string sink") != NULL);
+
+    // The partly parsed message still holds the streamed field
+    pigeon_free_parsed_message(&message);
+}
+
+int main(void)
+{
+    test_pieces();
+    test_no_threshold();
+    test_abort();
+    return pigeon_test_result("string_sink_test");
+}
@@ -0,0 +1,91 @@
+#include "pigeon_test.h"
+
+// pigeon_validate_message runs the parser without building anything, so it
+// must accept and reject exactly what pigeon_parse_message does.
+static unsigned check_agrees(const char * restrict text, size_t size)
+{
+    pigeon_parse_context_t ctx;
+    bool valid = pigeon_validate_message(&ctx, text, (pigeon_message_size_t)size);
+
+    pigeon_parsed_message_t message;
+    bool parsed = pigeon_parse_message(&ctx, text, (pigeon_message_size_t)size, &message);
+    pigeon_free_parsed_message(&message);
+
+    if (valid != parsed)
+    {
+        fprintf(stderr, "validate %d, parse %d for %zu bytes of:\n%.*s\n", valid, parsed, size, (int)size, text);
+        ++pigeon_test_failures;
+    }
+
+    return parsed;
+}
+
+static void check_prefixes(const char * restrict text)
+{
+    size_t size = strlen(text);
+    PIGEON_CHECK(check_agrees(text, size));
+
+    // No prefix of a valid message may be accepted by one and not the other
+    for (size_t length = 0; length < size; ++length)
+        check_agrees(text, length);
+}
+
+static void test_valid(void)
+{
+    static const char * const fields[] = {
+        "",
+        "\"text\":\"hello\"\n",
+        "\"\":\"\"\n\"empty\":\"\"\n\"\":\"unnamed\"\n",
+        "\"count\":42\n\"zero\":0\n",
+        "\"who\":@ed25519:abc\n\"sig\":%ed25519:def\n\"blob\":&sha256:2cf24dba5fb0a30e26e83b2ac5b9e29e1b161e5c1fa7425e73043362938b9824\n",
+        "\"quote\":\"say \\\"hi\\\"\"\n\"only\":\"\\\"\"\n",
+    };
+
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i)
+    {
+        char text[1024];
+        pigeon_test_message(text, sizeof(text), "validate", (int)i + 1, 100 + (int64_t)i, i % 2 ? "post" : "", fields[i]);
+        check_prefixes(text);
+    }
+}
+
+static void test_invalid(void)
+{
+    static const char * const fields[] = {
+        "\"text\":\"unterminated\n",
+        "\"text\":\"bad \\n escape\"\n",
+        "\"count\":-1\n",
+        "\"text\" \"no colon\"\n",
+        "\"text\":\"trailing\" x\n",
+        "text:\"unquoted name\"\n",
+    };
+
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i)
+    {
+        char text[1024];
+        size_t size = pigeon_test_message(text, sizeof(text), "invalid", 1, 100, "post", fields[i]);
+        PIGEON_CHECK(!check_agrees(text, size));
+    }
+
+    // Every single-byte corruption of a valid message
+    char text[1024];
+    size_t size = pigeon_test_message(text, sizeof(text), "mutate", 2, 100, "post", "\"a\":\"b\"\n\"n\":7\n");
+    static const char replacements[] = { '\0', '\n', '"', ' ', 'x', '\\' };
+    for (size_t pos = 0; pos < size; ++pos)
+    {
+        char original = text[pos];
+        for (size_t r = 0; r < sizeof(replacements); ++r)
+        {
+            text[pos] = replacements[r];
+            check_agrees(text, size);
+        }
+        text[pos] = original;
+    }
+}
+
+int main(void)
+{
+    test_valid();
+    test_invalid();
+    return pigeon_test_result("validate_test");
+}
@@ -0,0 +1,101 @@
+#include "pigeon_chain.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// pigeon_validate: checks feed integrity across one or more logs and exits
+// non-zero if any message breaks its author's chain.
+
+typedef struct {
+    unsigned long long limit;
+    unsigned long long printed;
+} validate_report_t;
+
+static void validate_usage(FILE * out)
+{
+    fputs("Usage: pigeon_validate [OPTIONS] [FILE]...\n"
+        "Checks sequence numbers, previous hashes and timestamps of every feed.\n"
+        "Files are read in order as one log; with no files, stdin is read.\n"
+        "\n"
+        "  -j THREADS  number of worker threads (default 1)\n"
+        "  -p          allow feeds to start past sequence 1\n"
+        "  -m COUNT    print at most COUNT issues (default all)\n"
+        "  -q          do not print the summary to stderr\n", out);
+}
+
+static void validate_report(void * user_data, const char * path, uint64_t offset, pigeon_chain_issue_t issue, const char * details)
+{
+    validate_report_t * report = user_data;
+    if (report->limit && report->printed >= report->limit)
+        return;
+
+    ++report->printed;
+    printf("%s:%llu: %s: %s\n", path, (unsigned long long)offset, pigeon_chain_issue_name(issue), details);
+}
+
+static double validate_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char ** argv)
+{
+    validate_report_t report = { 0, 0 };
+    pigeon_chain_options_t options = { 1, false, validate_report, &report };
+    bool quiet = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:pm:qh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'j':
+                options.threads = (unsigned)atoi(optarg);
+                if (options.threads == 0 || options.threads > 1024)
+                {
+                    fprintf(stderr, "pigeon_validate: invalid thread count '%s'\n", optarg);
+                    return 2;
+                }
+                break;
+
+            case 'p': options.allow_partial = true; break;
+            case 'm': report.limit = strtoull(optarg, NULL, 10); break;
+            case 'q': quiet = true; break;
+
+            case 'h':
+                validate_usage(stdout);
+                return 0;
+
+            default:
+                validate_usage(stderr);
+                return 2;
+        }
+    }
+
+    const char * stdin_path = "-";
+    const char * const * paths = optind < argc ? (const char * const *)argv + optind : &stdin_path;
+    size_t path_count = optind < argc ? (size_t)(argc - optind) : 1;
+
+    double start = validate_now();
+    pigeon_chain_result_t result;
+    bool success = pigeon_chain_validate(paths, path_count, &options, &result);
+    double seconds = validate_now() - start;
+
+    fflush(stdout);
+    if (!success)
+        fprintf(stderr, "pigeon_validate: %s\n", result.error_messages);
+
+    if (!quiet)
+    {
+        fprintf(stderr, "pigeon_validate: %llu messages, %llu authors, %llu issues, %.1f MB in %.3f s (%.1f MB/s, %.0f msgs/s)\n",
+            (unsigned long long)result.messages, (unsigned long long)result.authors, (unsigned long long)result.issues,
+            result.bytes / 1e6, seconds, seconds > 0 ? result.bytes / 1e6 / seconds : 0.0, seconds > 0 ? result.messages / seconds : 0.0);
+    }
+
+    return !success || result.issues != 0 ? 1 : 0;
+}